@@ -0,0 +1,188 @@
+/*
+ * arena.c - region allocator for per-session state.
+ *
+ * Copyright (c) 2026 The ppp project. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The name(s) of the authors of this software must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission.
+ *
+ * THE AUTHORS OF THIS SOFTWARE DISCLAIM ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS, IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+ * AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pppd-private.h"
+#include "arena.h"
+
+/*
+ * Each arena is a list of chunks which are carved up from the front.
+ * When an arena is released, its first chunk is kept for reuse so
+ * that a long-running pppd settles into a steady state with no
+ * malloc/free traffic for these allocations at all.
+ */
+#define ARENA_CHUNK	4096		/* default chunk payload size */
+#define ARENA_ALIGN	16		/* alignment of returned memory */
+#define ARENA_ROUND(n)	(((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+struct arena_chunk {
+    struct arena_chunk	*next;
+    size_t		size;		/* bytes of payload */
+    size_t		used;		/* bytes of payload handed out */
+    /* payload follows, aligned to ARENA_ALIGN */
+};
+
+#define CHUNK_HDR	ARENA_ROUND(sizeof(struct arena_chunk))
+#define CHUNK_DATA(c)	((unsigned char *)(c) + CHUNK_HDR)
+
+struct arena {
+    struct arena_chunk	*chunks;	/* most recent chunk first */
+    size_t		inuse;		/* bytes handed out since release */
+    size_t		highwater;	/* largest value inuse has reached */
+};
+
+static struct arena arenas[PPP_ARENA_NUM];
+
+static const char *arena_names[PPP_ARENA_NUM] = {
+    "link", "auth", "network"
+};
+
+void *
+ppp_arena_alloc(ppp_arena_phase_t phase, size_t len)
+{
+    struct arena *ap;
+    struct arena_chunk *cp;
+    size_t size;
+    void *p;
+
+    if (phase >= PPP_ARENA_NUM)
+	return NULL;
+    ap = &arenas[phase];
+    len = ARENA_ROUND(len? len: 1);
+
+    cp = ap->chunks;
+    if (cp == NULL || cp->size - cp->used < len) {
+	size = len > ARENA_CHUNK? len: ARENA_CHUNK;
+	cp = malloc(CHUNK_HDR + size);
+	if (cp == NULL)
+	    return NULL;
+	cp->size = size;
+	cp->used = 0;
+	if (ap->chunks != NULL && len > ARENA_CHUNK) {
+	    /* keep carving from the current chunk after this one */
+	    cp->next = ap->chunks->next;
+	    ap->chunks->next = cp;
+	} else {
+	    cp->next = ap->chunks;
+	    ap->chunks = cp;
+	}
+    }
+
+    p = CHUNK_DATA(cp) + cp->used;
+    cp->used += len;
+    ap->inuse += len;
+    if (ap->inuse > ap->highwater)
+	ap->highwater = ap->inuse;
+    return p;
+}
+
+char *
+ppp_arena_strdup(ppp_arena_phase_t phase, const char *str)
+{
+    size_t len = strlen(str) + 1;
+    char *p;
+
+    p = ppp_arena_alloc(phase, len);
+    if (p != NULL)
+	memcpy(p, str, len);
+    return p;
+}
+
+bool
+ppp_arena_owns(const void *ptr)
+{
+    const unsigned char *p = ptr;
+    struct arena_chunk *cp;
+    int i;
+
+    for (i = 0; i < PPP_ARENA_NUM; ++i)
+	for (cp = arenas[i].chunks; cp != NULL; cp = cp->next)
+	    if (p >= CHUNK_DATA(cp) && p < CHUNK_DATA(cp) + cp->size)
+		return 1;
+    return 0;
+}
+
+void
+ppp_arena_release(ppp_arena_phase_t phase)
+{
+    struct arena *ap;
+    struct arena_chunk *cp, *keep, *next;
+
+    if (phase >= PPP_ARENA_NUM)
+	return;
+    ap = &arenas[phase];
+    if (ap->chunks == NULL)
+	return;
+
+    if (debug)
+	dbglog("Releasing %s arena: %lu bytes in use, high-water %lu",
+	       arena_names[phase], (unsigned long) ap->inuse,
+	       (unsigned long) ap->highwater);
+
+    /* keep one standard-sized chunk around for next time */
+    keep = NULL;
+    for (cp = ap->chunks; cp != NULL; cp = next) {
+	next = cp->next;
+	if (keep == NULL && cp->size == ARENA_CHUNK) {
+	    keep = cp;
+	    continue;
+	}
+	free(cp);
+    }
+    if (keep != NULL) {
+	keep->next = NULL;
+	keep->used = 0;
+    }
+    ap->chunks = keep;
+    ap->inuse = 0;
+}
+
+void
+ppp_arena_release_all(void)
+{
+    int i;
+
+    for (i = 0; i < PPP_ARENA_NUM; ++i)
+	ppp_arena_release(i);
+}
+
+size_t
+ppp_arena_highwater(ppp_arena_phase_t phase)
+{
+    if (phase >= PPP_ARENA_NUM)
+	return 0;
+    return arenas[phase].highwater;
+}
@@ -0,0 +1,90 @@
+/*
+ * arena.h - region allocator for per-session state.
+ *
+ * Copyright (c) 2026 The ppp project. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The name(s) of the authors of this software must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission.
+ *
+ * THE AUTHORS OF THIS SOFTWARE DISCLAIM ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS, IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+ * AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#ifndef PPP_ARENA_H
+#define PPP_ARENA_H
+
+#include "pppdconf.h"
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Memory allocated from an arena is never freed individually;
+ * everything in an arena is released together when the phase it
+ * belongs to is over.  All the arenas are released when the link
+ * terminates.
+ */
+typedef enum ppp_arena_phase {
+    PPP_ARENA_LINK,		/* lives until the link terminates */
+    PPP_ARENA_AUTH,		/* authentication state */
+    PPP_ARENA_NETWORK,		/* network-layer state */
+    PPP_ARENA_NUM
+} ppp_arena_phase_t;
+
+/*
+ * Allocate len bytes from the arena for the given phase.
+ * Returns NULL if memory is exhausted.
+ */
+void *ppp_arena_alloc(ppp_arena_phase_t phase, size_t len);
+
+/*
+ * Copy a string into the arena for the given phase.
+ */
+char *ppp_arena_strdup(ppp_arena_phase_t phase, const char *str);
+
+/*
+ * Check whether ptr was allocated from one of the arenas.
+ */
+bool ppp_arena_owns(const void *ptr);
+
+/*
+ * Release everything allocated from the arena for the given phase.
+ */
+void ppp_arena_release(ppp_arena_phase_t phase);
+
+/*
+ * Release all the arenas.
+ */
+void ppp_arena_release_all(void);
+
+/*
+ * Return the largest number of bytes that have been in use
+ * at once in the arena for the given phase.
+ */
+size_t ppp_arena_highwater(ppp_arena_phase_t phase);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PPP_ARENA_H */
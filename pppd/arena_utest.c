@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pppd-private.h"
+#include "arena.h"
+
+/* globals used by utils.c */
+int debug = 0;
+int error_count;
+int unsuccess;
+
+int
+test_alloc() {
+    char *a, *b;
+
+    a = ppp_arena_strdup(PPP_ARENA_AUTH, "client");
+    b = ppp_arena_alloc(PPP_ARENA_AUTH, 100);
+    if (a == NULL || b == NULL || strcmp(a, "client") != 0)
+	return -1;
+    if (((unsigned long) b & 15) != 0)
+	return -1;
+    if (!ppp_arena_owns(a) || !ppp_arena_owns(b))
+	return -1;
+    ppp_arena_release(PPP_ARENA_AUTH);
+    return 0;
+}
+
+int
+test_not_owned() {
+    char *p = malloc(16);
+    int ret = 0;
+
+    if (ppp_arena_owns(p))
+	ret = -1;
+    free(p);
+    return ret;
+}
+
+int
+test_large() {
+    char *p;
+
+    /* bigger than a chunk, must still be usable throughout */
+    p = ppp_arena_alloc(PPP_ARENA_NETWORK, 20000);
+    if (p == NULL)
+	return -1;
+    memset(p, 0xa5, 20000);
+    if (!ppp_arena_owns(p + 19999))
+	return -1;
+    ppp_arena_release(PPP_ARENA_NETWORK);
+    if (ppp_arena_owns(p))
+	return -1;
+    return 0;
+}
+
+int
+test_highwater() {
+    int i;
+
+    ppp_arena_release_all();
+    for (i = 0; i < 100; ++i)
+	if (ppp_arena_alloc(PPP_ARENA_LINK, 64) == NULL)
+	    return -1;
+    ppp_arena_release(PPP_ARENA_LINK);
+    for (i = 0; i < 10; ++i)
+	if (ppp_arena_alloc(PPP_ARENA_LINK, 64) == NULL)
+	    return -1;
+    if (ppp_arena_highwater(PPP_ARENA_LINK) != 100 * 64)
+	return -1;
+    ppp_arena_release_all();
+    return 0;
+}
+
+int
+main()
+{
+    int failure = 0;
+
+    if (test_alloc()) {
+	printf("Could not allocate from an arena\n");
+	failure++;
+    }
+
+    if (test_not_owned()) {
+	printf("Arena claimed to own heap memory\n");
+	failure++;
+    }
+
+    if (test_large()) {
+	printf("Could not allocate a large block from an arena\n");
+	failure++;
+    }
+
+    if (test_highwater()) {
+	printf("Arena high-water mark is wrong\n");
+	failure++;
+    }
+
+    return failure;
+}
@@ -77,6 +77,7 @@
 #include <stdio.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <ctype.h>
 #include <unistd.h>
 #include <errno.h>
 #include <pwd.h>
@@ -115,6 +116,7 @@
 #endif
 
 #include "pppd-private.h"
+#include "arena.h"
 #include "options.h"
 #include "fsm.h"
 #include "lcp.h"
@@ -135,12 +137,6 @@
 #include "session.h"
 
 
-/* Bits in scan_authfile return value */
-#define NONWILD_SERVER	1
-#define NONWILD_CLIENT	2
-
-#define ISWILD(word)	(word[0] == '*' && word[1] == 0)
-
 /* The name by which the peer authenticated itself to us. */
 char peer_authname[MAXNAMELEN];
 
@@ -172,9 +168,20 @@ static int num_np_open;
 /* Number of network protocols which have come up. */
 static int num_np_up;
 
+/* When the first of them came up; connect time is counted from here. */
+static struct timeval np_up_time;
+
 /* Set if we got the contents of passwd[] from the pap-secrets file. */
 static int passwd_from_file;
 
+/* A PAP login waiting for the session checks */
+static struct pap_login {
+    int unit;
+    char user[256];
+    struct wordlist *addrs, *opts;	/* for pap_hook_result */
+    int login;				/* the login database was asked */
+} pap_login;
+
 /* Set if we require authentication only because we have a default route. */
 static bool default_auth;
 
@@ -186,6 +193,7 @@ pap_check_hook_fn *pap_check_hook = NULL;
 
 /* Hook for a plugin to check the PAP user and password */
 pap_auth_hook_fn *pap_auth_hook = NULL;
+pap_auth_async_hook_fn *pap_auth_async_hook = NULL;
 
 /* Hook for a plugin to know about the PAP user logout */
 pap_logout_hook_fn *pap_logout_hook = NULL;
@@ -256,6 +264,7 @@ bool explicit_passwd = 0;	/* Set if "password" option supplied */
 char remote_name[MAXNAMELEN];	/* Peer's name for authentication */
 char path_upapfile[MAXPATHLEN];	/* Pathname of pap-secrets file */
 char path_chapfile[MAXPATHLEN];	/* Pathname of chap-secrets file */
+char path_nthashfile[MAXPATHLEN]; /* Pathname of chap-nthashes file */
 
 #if defined(PPP_WITH_EAPTLS) || defined(PPP_WITH_PEAP)
 char *cacert_file  = NULL;  /* CA certificate file (pem format) */
@@ -282,9 +291,16 @@ static void network_phase (int);
 static void check_idle (void *);
 static void connect_time_expired (void *);
 static int  null_login (int);
+static int  check_passwd_session (int, char *, char *, int,
+				  struct wordlist *, struct wordlist *,
+				  char **);
+static void check_passwd_done (void *, int, char *);
+static int  check_passwd_result (int, int, char **, char *);
 static int  get_pap_passwd (char *);
 static int  have_pap_secret (int *);
 static int  have_chap_secret (char *, char *, int, int *);
+static int  have_nt_hash (char *, char *, int *);
+static int  decode_nt_hash (char *, unsigned char *);
 static int  have_srp_secret(char *client, char *server, int need_ip,
     int *lacks_ipp);
 
@@ -292,18 +308,9 @@ static int  have_srp_secret(char *client, char *server, int need_ip,
 static int  have_eaptls_secret_server
 (char *client, char *server, int need_ip, int *lacks_ipp);
 static int  have_eaptls_secret_client (char *client, char *server);
-static int  scan_authfile_eaptls(FILE * f, char *client, char *server,
-			       char *cli_cert, char *serv_cert,
-			       char *ca_cert, char *pk,
-			       struct wordlist ** addrs,
-			       struct wordlist ** opts,
-			       char *filename, int flags);
 #endif
 
 static int  ip_addr_check (u_int32_t, struct permitted_ip *);
-static int  scan_authfile(FILE *, char *, char *, char *,
-			  struct wordlist **, struct wordlist **,
-			  char *, int);
 static void free_wordlist (struct wordlist *);
 static void auth_script (char *);
 static void auth_script_done (void *);
@@ -313,7 +320,6 @@ static int  setupapfile (char **);
 static int  privgroup (char **);
 static int  set_noauth_addr (char **);
 static int  set_permitted_number (char **);
-static void check_access (FILE *, char *);
 static int  wordlist_count (struct wordlist *);
 static void check_maxoctets (void *);
 
@@ -428,6 +434,10 @@ struct option auth_options[] = {
       "Set pathname of chap-secrets", OPT_PRIO | OPT_PRIV | OPT_STATIC,
       NULL, MAXPATHLEN },
 
+    { "chap-nthashes", o_string, path_nthashfile,
+      "Set pathname of chap-nthashes", OPT_PRIO | OPT_PRIV | OPT_STATIC,
+      NULL, MAXPATHLEN },
+
     { "login", o_bool, &uselogin,
       "Use system password database for PAP", OPT_A2COPY | 1 ,
       &session_mgmt },
@@ -763,6 +773,14 @@ link_terminated(int unit)
     if (the_channel->cleanup)
 	(*the_channel->cleanup)();
 
+    /*
+     * Forget any options from the secrets file that we didn't get
+     * as far as applying, and release the per-session memory.
+     */
+    free_wordlist(extra_options);
+    extra_options = NULL;
+    ppp_arena_release_all();
+
     if (mp_on() && mp_master()) {
 	if (!bundle_terminating) {
 	    new_phase(PHASE_MASTER);
@@ -1187,6 +1205,7 @@ np_up(int unit, int proto)
 	ppp_set_status(EXIT_OK);
 	unsuccess = 0;
 	new_phase(PHASE_RUNNING);
+	ppp_get_time(&np_up_time);
 
 	if (idle_time_hook != 0)
 	    tlim = (*idle_time_hook)(NULL);
@@ -1239,6 +1258,38 @@ np_down(int unit, int proto)
     }
 }
 
+/*
+ * session_limits_changed - the idle time, connect time or traffic
+ * limit was changed while the network is up, by a plugin acting on a
+ * request from its server, say: restart the timers enforcing them so
+ * the new limits apply now rather than at the next connection.
+ */
+void
+session_limits_changed(void)
+{
+    struct timeval now;
+    int left;
+
+    if (num_np_up == 0)
+	return;
+
+    /* check_idle works out how long is left itself */
+    UNTIMEOUT(check_idle, NULL);
+    if (idle_time_hook != 0 || ppp_get_max_idle_time() > 0)
+	TIMEOUT(check_idle, NULL, 0);
+
+    UNTIMEOUT(connect_time_expired, NULL);
+    if (ppp_get_max_connect_time() > 0) {
+	ppp_get_time(&now);
+	left = ppp_get_max_connect_time() - (now.tv_sec - np_up_time.tv_sec);
+	TIMEOUT(connect_time_expired, 0, MAX(left, 0));
+    }
+
+    UNTIMEOUT(check_maxoctets, NULL);
+    if (maxoctets > 0)
+	TIMEOUT(check_maxoctets, NULL, 0);
+}
+
 /*
  * np_finished - a network protocol has finished using the link.
  */
@@ -1516,7 +1567,6 @@ check_passwd(int unit,
     struct wordlist *addrs = NULL, *opts = NULL;
     char passwd[256], user[256];
     char secret[MAXWORDLEN];
-    static int attempts = 0;
 
     /*
      * Make copies of apasswd and auser, then null-terminate them.
@@ -1530,19 +1580,23 @@ check_passwd(int unit,
     /*
      * Check if a plugin wants to handle this.
      */
+    if (pap_auth_async_hook) {
+	ret = (*pap_auth_async_hook)(user, passwd, msg, &addrs, &opts,
+				     upap_auth_done, &upap[unit]);
+	if (ret == PAP_AUTH_PENDING) {
+	    BZERO(passwd, sizeof(passwd));
+	    return UPAP_AUTHPENDING;
+	}
+	if (ret >= 0) {
+	    BZERO(passwd, sizeof(passwd));
+	    return pap_hook_result(unit, ret, addrs, opts);
+	}
+    }
     if (pap_auth_hook) {
 	ret = (*pap_auth_hook)(user, passwd, msg, &addrs, &opts);
 	if (ret >= 0) {
-	    /* note: set_allowed_addrs() saves opts (but not addrs):
-	       don't free it! */
-	    if (ret)
-		set_allowed_addrs(unit, addrs, opts);
-	    else if (opts != 0)
-		free_wordlist(opts);
-	    if (addrs != 0)
-		free_wordlist(addrs);
 	    BZERO(passwd, sizeof(passwd));
-	    return ret? UPAP_AUTHACK: UPAP_AUTHNAK;
+	    return pap_hook_result(unit, ret, addrs, opts);
 	}
     }
 
@@ -1568,17 +1622,6 @@ check_passwd(int unit,
 	     */
 	    int login_secret = strcmp(secret, "@login") == 0;
 	    ret = UPAP_AUTHACK;
-	    if (uselogin || login_secret) {
-		/* login option or secret is @login */
-		if (session_full(user, passwd, devnam, msg) == 0) {
-		    ret = UPAP_AUTHNAK;
-		}
-	    } else if (session_mgmt) {
-		if (session_check(user, NULL, devnam, NULL) == 0) {
-		    warn("Peer %q failed PAP Session verification", user);
-		    ret = UPAP_AUTHNAK;
-		}
-	    }
 	    if (secret[0] != 0 && !login_secret) {
 		/* password given in pap-secrets - must match */
 		if (cryptpap || strcmp(passwd, secret) != 0) {
@@ -1589,9 +1632,84 @@ check_passwd(int unit,
 			ret = UPAP_AUTHNAK;
 		}
 	    }
+	    if (ret == UPAP_AUTHACK && (uselogin || login_secret || session_mgmt)) {
+		/* login option or secret is @login, or session checks */
+		ret = check_passwd_session(unit, user, passwd,
+					   uselogin || login_secret,
+					   addrs, opts, msg);
+	    }
 	}
 	fclose(f);
     }
+    BZERO(passwd, sizeof(passwd));
+    BZERO(secret, sizeof(secret));
+    if (ret == UPAP_AUTHPENDING)
+	return ret;
+
+    ret = check_passwd_result(unit, ret, msg, user);
+    pap_hook_result(unit, ret == UPAP_AUTHACK, addrs, opts);
+    return ret;
+}
+
+/*
+ * check_passwd_session - start the login or session checks for a peer
+ * whose PAP password was otherwise good.  The checks may take a while,
+ * so if the answer will come later, to check_passwd_done, the lists
+ * are kept and we return UPAP_AUTHPENDING.
+ */
+static int
+check_passwd_session(int unit, char *user, char *passwd, int login,
+		     struct wordlist *addrs, struct wordlist *opts,
+		     char **msg)
+{
+    int ok;
+
+    pap_login.unit = unit;
+    strlcpy(pap_login.user, user, sizeof(pap_login.user));
+    pap_login.addrs = addrs;
+    pap_login.opts = opts;
+    pap_login.login = login;
+    if (login)
+	ok = session_start_async(SESS_ALL, user, passwd, devnam, msg,
+				 check_passwd_done, NULL);
+    else
+	ok = session_start_async(SESS_ACCT, user, NULL, devnam, NULL,
+				 check_passwd_done, NULL);
+    if (ok == SESSION_PENDING)
+	return UPAP_AUTHPENDING;
+    if (!ok && !login)
+	warn("Peer %q failed PAP Session verification", user);
+    return ok? UPAP_AUTHACK: UPAP_AUTHNAK;
+}
+
+/*
+ * check_passwd_done - the login or session checks have finished:
+ * send the peer our answer.
+ */
+static void
+check_passwd_done(void *arg, int ok, char *msg)
+{
+    int ret;
+
+    if (!pap_login.login) {
+	if (!ok)
+	    warn("Peer %q failed PAP Session verification", pap_login.user);
+	msg = "";
+    }
+    ret = check_passwd_result(pap_login.unit, ok? UPAP_AUTHACK: UPAP_AUTHNAK,
+			      &msg, pap_login.user);
+    upap_auth_done(&upap[pap_login.unit], ret == UPAP_AUTHACK, msg,
+		   pap_login.addrs, pap_login.opts);
+}
+
+/*
+ * check_passwd_result - count failed logins, and fill in the message
+ * for the peer if nothing else has.
+ */
+static int
+check_passwd_result(int unit, int ret, char **msg, char *user)
+{
+    static int attempts = 0;
 
     if (ret == UPAP_AUTHNAK) {
         if (**msg == 0)
@@ -1608,22 +1726,32 @@ check_passwd(int unit,
 	}
 	if (attempts > 3)
 	    sleep((u_int) (attempts - 3) * 5);
-	if (opts != NULL)
-	    free_wordlist(opts);
 
     } else {
 	attempts = 0;			/* Reset count */
 	if (**msg == 0)
 	    *msg = "Login ok";
-	set_allowed_addrs(unit, addrs, opts);
     }
+    return ret;
+}
 
-    if (addrs != NULL)
+/*
+ * pap_hook_result - set the allowed addresses and options if a plugin
+ * accepted the peer, free the lists, and return the PAP response code.
+ */
+int
+pap_hook_result(int unit, int ok, struct wordlist *addrs,
+		struct wordlist *opts)
+{
+    /* note: set_allowed_addrs() saves opts (but not addrs):
+       don't free it! */
+    if (ok)
+	set_allowed_addrs(unit, addrs, opts);
+    else if (opts != 0)
+	free_wordlist(opts);
+    if (addrs != 0)
 	free_wordlist(addrs);
-    BZERO(passwd, sizeof(passwd));
-    BZERO(secret, sizeof(secret));
-
-    return ret;
+    return ok? UPAP_AUTHACK: UPAP_AUTHNAK;
 }
 
 /*
@@ -1777,19 +1905,61 @@ have_chap_secret(char *client, char *server,
 	}
     }
 
-    filename = path_chapfile;
-    f = fopen(filename, "r");
-    if (f == NULL)
-	return 0;
-
     if (client != NULL && client[0] == 0)
 	client = NULL;
     else if (server != NULL && server[0] == 0)
 	server = NULL;
 
+    ret = -1;
+    filename = path_chapfile;
+    f = fopen(filename, "r");
+    if (f != NULL) {
+	ret = scan_authfile(f, client, server, NULL, &addrs, NULL, filename, 0);
+	fclose(f);
+	if (ret >= 0 && need_ip && !some_ip_ok(addrs)) {
+	    if (lacks_ipp != 0)
+		*lacks_ipp = 1;
+	    ret = -1;
+	}
+	if (addrs != 0)
+	    free_wordlist(addrs);
+    }
+
+    /*
+     * NT hashes can only be used to check the peer, which is
+     * when need_ip is set, and only with MS-CHAP.
+     */
+    if (ret < 0 && need_ip && (lcp_wantoptions[0].chap_mdtype
+			       & (MDTYPE_MICROSOFT | MDTYPE_MICROSOFT_V2)))
+	return have_nt_hash(client, server, lacks_ipp);
+
+    return ret >= 0;
+}
+
+
+/*
+ * have_nt_hash - check whether the chap-nthashes file has an entry
+ * that we could use for authenticating `client' on `server' with
+ * MS-CHAP.  Either can be NULL.
+ */
+static int
+have_nt_hash(char *client, char *server, int *lacks_ipp)
+{
+    FILE *f;
+    int ret;
+    char *filename;
+    struct wordlist *addrs;
+
+    filename = path_nthashfile;
+    if (filename[0] == 0)
+	return 0;
+    f = fopen(filename, "r");
+    if (f == NULL)
+	return 0;
+
     ret = scan_authfile(f, client, server, NULL, &addrs, NULL, filename, 0);
     fclose(f);
-    if (ret >= 0 && need_ip && !some_ip_ok(addrs)) {
+    if (ret >= 0 && !some_ip_ok(addrs)) {
 	if (lacks_ipp != 0)
 	    *lacks_ipp = 1;
 	ret = -1;
@@ -1900,6 +2070,89 @@ get_secret(int unit, char *client, char *server,
 }
 
 
+/*
+ * decode_nt_hash - convert the secret field of a chap-nthashes entry,
+ * the NtPasswordHash and the PasswordHashHash as hex separated by a
+ * colon, into 32 bytes.  Returns 1 if the field was well-formed.
+ */
+static int
+decode_nt_hash(char *word, unsigned char *hash)
+{
+    int i, n, digit;
+
+    if (strlen(word) != 65 || word[32] != ':')
+	return 0;
+    for (i = 0; i < 32; ++i) {
+	hash[i] = 0;
+	for (n = 0; n < 2; ++n) {
+	    digit = *word++;
+	    if (digit == ':')
+		digit = *word++;
+	    if (!isxdigit(digit))
+		return 0;
+	    digit = toupper(digit) - '0';
+	    if (digit > 9)
+		digit += '0' + 10 - 'A';
+	    hash[i] = (hash[i] << 4) + digit;
+	}
+    }
+    return 1;
+}
+
+
+/*
+ * get_nt_hash - look up the precomputed MS-CHAP password hashes for
+ * authenticating the given client on the given server in the
+ * chap-nthashes file.  hash gets the NtPasswordHash followed by the
+ * PasswordHashHash, 16 bytes each.  We can only be the server.
+ * An entry in the chap-secrets file that names the client and server
+ * at least as closely is used instead, so returns 0 then.
+ */
+int
+get_nt_hash(int unit, char *client, char *server, unsigned char *hash)
+{
+    FILE *f;
+    int ret, chapret;
+    char *filename;
+    struct wordlist *addrs, *opts;
+    char secbuf[MAXWORDLEN];
+
+    filename = path_nthashfile;
+    if (filename[0] == 0)
+	return 0;
+    f = fopen(filename, "r");
+    if (f == NULL)
+	return 0;		/* the file is optional */
+    check_access(f, filename);
+
+    addrs = opts = NULL;
+    secbuf[0] = 0;
+    ret = scan_authfile(f, client, server, secbuf, &addrs, &opts, filename, 0);
+    fclose(f);
+    if (ret >= 0 && (f = fopen(path_chapfile, "r")) != NULL) {
+	chapret = scan_authfile(f, client, server, NULL, NULL, NULL,
+				path_chapfile, 0);
+	fclose(f);
+	if (chapret >= ret)
+	    ret = -1;
+    }
+    if (ret >= 0 && !decode_nt_hash(secbuf, hash)) {
+	error("Bad NT hash for %s on %s in %s", client, server, filename);
+	ret = -1;
+    }
+    BZERO(secbuf, sizeof(secbuf));
+
+    if (ret >= 0)
+	set_allowed_addrs(unit, addrs, opts);
+    else if (opts != 0)
+	free_wordlist(opts);
+    if (addrs != 0)
+	free_wordlist(addrs);
+
+    return ret >= 0;
+}
+
+
 /*
  * get_srp_secret - open the SRP secret file and return the secret
  * for authenticating the given client on the given server.
@@ -2196,7 +2449,7 @@ auth_number(void)
 /*
  * check_access - complain if a secret file has too-liberal permissions.
  */
-static void
+void
 check_access(FILE *f, char *filename)
 {
     struct stat sbuf;
@@ -2210,175 +2463,6 @@ check_access(FILE *f, char *filename)
 }
 
 
-/*
- * scan_authfile - Scan an authorization file for a secret suitable
- * for authenticating `client' on `server'.  The return value is -1
- * if no secret is found, otherwise >= 0.  The return value has
- * NONWILD_CLIENT set if the secret didn't have "*" for the client, and
- * NONWILD_SERVER set if the secret didn't have "*" for the server.
- * Any following words on the line up to a "--" (i.e. address authorization
- * info) are placed in a wordlist and returned in *addrs.  Any
- * following words (extra options) are placed in a wordlist and
- * returned in *opts.
- * We assume secret is NULL or points to MAXWORDLEN bytes of space.
- * Flags are non-zero if we need two colons in the secret in order to
- * match.
- */
-static int
-scan_authfile(FILE *f, char *client, char *server,
-	      char *secret, struct wordlist **addrs,
-	      struct wordlist **opts, char *filename,
-	      int flags)
-{
-    int newline, xxx;
-    int got_flag, best_flag;
-    FILE *sf;
-    struct wordlist *ap, *addr_list, *alist, **app;
-    char word[MAXWORDLEN];
-    char atfile[MAXWORDLEN];
-    char lsecret[MAXWORDLEN];
-    char *cp;
-
-    if (addrs != NULL)
-	*addrs = NULL;
-    if (opts != NULL)
-	*opts = NULL;
-    addr_list = NULL;
-    if (!getword(f, word, &newline, filename))
-	return -1;		/* file is empty??? */
-    newline = 1;
-    best_flag = -1;
-    for (;;) {
-	/*
-	 * Skip until we find a word at the start of a line.
-	 */
-	while (!newline && getword(f, word, &newline, filename))
-	    ;
-	if (!newline)
-	    break;		/* got to end of file */
-
-	/*
-	 * Got a client - check if it's a match or a wildcard.
-	 */
-	got_flag = 0;
-	if (client != NULL && strcmp(word, client) != 0 && !ISWILD(word)) {
-	    newline = 0;
-	    continue;
-	}
-	if (!ISWILD(word))
-	    got_flag = NONWILD_CLIENT;
-
-	/*
-	 * Now get a server and check if it matches.
-	 */
-	if (!getword(f, word, &newline, filename))
-	    break;
-	if (newline)
-	    continue;
-	if (!ISWILD(word)) {
-	    if (server != NULL && strcmp(word, server) != 0)
-		continue;
-	    got_flag |= NONWILD_SERVER;
-	}
-
-	/*
-	 * Got some sort of a match - see if it's better than what
-	 * we have already.
-	 */
-	if (got_flag <= best_flag)
-	    continue;
-
-	/*
-	 * Get the secret.
-	 */
-	if (!getword(f, word, &newline, filename))
-	    break;
-	if (newline)
-	    continue;
-
-	/*
-	 * SRP-SHA1 authenticator should never be reading secrets from
-	 * a file.  (Authenticatee may, though.)
-	 */
-	if (flags && ((cp = strchr(word, ':')) == NULL ||
-	    strchr(cp + 1, ':') == NULL))
-	    continue;
-
-	if (secret != NULL) {
-	    /*
-	     * Special syntax: @/pathname means read secret from file.
-	     */
-	    if (word[0] == '@' && word[1] == '/') {
-		strlcpy(atfile, word+1, sizeof(atfile));
-		if ((sf = fopen(atfile, "r")) == NULL) {
-		    warn("can't open indirect secret file %s", atfile);
-		    continue;
-		}
-		check_access(sf, atfile);
-		if (!getword(sf, word, &xxx, atfile)) {
-		    warn("no secret in indirect secret file %s", atfile);
-		    fclose(sf);
-		    continue;
-		}
-		fclose(sf);
-	    }
-	    strlcpy(lsecret, word, sizeof(lsecret));
-	}
-
-	/*
-	 * Now read address authorization info and make a wordlist.
-	 */
-	app = &alist;
-	for (;;) {
-	    if (!getword(f, word, &newline, filename) || newline)
-		break;
-	    ap = (struct wordlist *)
-		    malloc(sizeof(struct wordlist) + strlen(word) + 1);
-	    if (ap == NULL)
-		novm("authorized addresses");
-	    ap->word = (char *) (ap + 1);
-	    strcpy(ap->word, word);
-	    *app = ap;
-	    app = &ap->next;
-	}
-	*app = NULL;
-
-	/*
-	 * This is the best so far; remember it.
-	 */
-	best_flag = got_flag;
-	if (addr_list)
-	    free_wordlist(addr_list);
-	addr_list = alist;
-	if (secret != NULL)
-	    strlcpy(secret, lsecret, MAXWORDLEN);
-
-	if (!newline)
-	    break;
-    }
-
-    /* scan for a -- word indicating the start of options */
-    for (app = &addr_list; (ap = *app) != NULL; app = &ap->next)
-	if (strcmp(ap->word, "--") == 0)
-	    break;
-    /* ap = start of options */
-    if (ap != NULL) {
-	ap = ap->next;		/* first option */
-	free(*app);			/* free the "--" word */
-	*app = NULL;		/* terminate addr list */
-    }
-    if (opts != NULL)
-	*opts = ap;
-    else if (ap != NULL)
-	free_wordlist(ap);
-    if (addrs != NULL)
-	*addrs = addr_list;
-    else if (addr_list != NULL)
-	free_wordlist(addr_list);
-
-    return best_flag;
-}
-
 /*
  * wordlist_count - return the number of items in a wordlist
  */
@@ -2394,6 +2478,8 @@ wordlist_count(struct wordlist *wp)
 
 /*
  * free_wordlist - release memory allocated for a wordlist.
+ * Words read from the secrets files live in the auth arena
+ * and are released with it rather than individually.
  */
 static void
 free_wordlist(struct wordlist *wp)
@@ -2402,7 +2488,8 @@ free_wordlist(struct wordlist *wp)
 
     while (wp != NULL) {
 	next = wp->next;
-	free(wp);
+	if (!ppp_arena_owns(wp))
+	    free(wp);
 	wp = next;
     }
 }
@@ -2491,8 +2578,7 @@ have_eaptls_secret_server(char *client, char *server,
 
     ret =
 	scan_authfile_eaptls(f, client, server, clicertfile, servcertfile,
-			     cacertfile, pkfile, &addrs, NULL, filename,
-			     0);
+			     cacertfile, pkfile, &addrs, NULL, filename);
 
     fclose(f);
 
@@ -2543,8 +2629,7 @@ have_eaptls_secret_client(char *client, char *server)
 
     ret =
 	scan_authfile_eaptls(f, client, server, clicertfile, servcertfile,
-			     cacertfile, pkfile, &addrs, NULL, filename,
-			     0);
+			     cacertfile, pkfile, &addrs, NULL, filename);
     fclose(f);
 
 /*
@@ -2560,161 +2645,6 @@ have_eaptls_secret_client(char *client, char *server)
 }
 
 
-static int
-scan_authfile_eaptls(FILE *f, char *client, char *server,
-		     char *cli_cert, char *serv_cert, char *ca_cert,
-		     char *pk, struct wordlist **addrs,
-		     struct wordlist **opts,
-		     char *filename, int flags)
-{
-    int newline;
-    int got_flag, best_flag;
-    struct wordlist *ap, *addr_list, *alist, **app;
-    char word[MAXWORDLEN];
-
-    if (addrs != NULL)
-	*addrs = NULL;
-    if (opts != NULL)
-	*opts = NULL;
-    addr_list = NULL;
-    if (!getword(f, word, &newline, filename))
-	return -1;		/* file is empty??? */
-    newline = 1;
-    best_flag = -1;
-    for (;;) {
-	/*
-	 * Skip until we find a word at the start of a line.
-	 */
-	while (!newline && getword(f, word, &newline, filename));
-	if (!newline)
-	    break;		/* got to end of file */
-
-	/*
-	 * Got a client - check if it's a match or a wildcard.
-	 */
-	got_flag = 0;
-	if (client != NULL && strcmp(word, client) != 0 && !ISWILD(word)) {
-	    newline = 0;
-	    continue;
-	}
-	if (!ISWILD(word))
-	    got_flag = NONWILD_CLIENT;
-
-	/*
-	 * Now get a server and check if it matches.
-	 */
-	if (!getword(f, word, &newline, filename))
-	    break;
-	if (newline)
-	    continue;
-	if (!ISWILD(word)) {
-	    if (server != NULL && strcmp(word, server) != 0)
-		continue;
-	    got_flag |= NONWILD_SERVER;
-	}
-
-	/*
-	 * Got some sort of a match - see if it's better than what
-	 * we have already.
-	 */
-	if (got_flag <= best_flag)
-	    continue;
-
-	/*
-	 * Get the cli_cert
-	 */
-	if (!getword(f, word, &newline, filename))
-	    break;
-	if (newline)
-	    continue;
-	if (strcmp(word, "-") != 0) {
-	    strlcpy(cli_cert, word, MAXWORDLEN);
-	} else
-	    cli_cert[0] = 0;
-
-	/*
-	 * Get serv_cert
-	 */
-	if (!getword(f, word, &newline, filename))
-	    break;
-	if (newline)
-	    continue;
-	if (strcmp(word, "-") != 0) {
-	    strlcpy(serv_cert, word, MAXWORDLEN);
-	} else
-	    serv_cert[0] = 0;
-
-	/*
-	 * Get ca_cert
-	 */
-	if (!getword(f, word, &newline, filename))
-	    break;
-	if (newline)
-	    continue;
-	strlcpy(ca_cert, word, MAXWORDLEN);
-
-	/*
-	 * Get pk
-	 */
-	if (!getword(f, word, &newline, filename))
-	    break;
-	if (newline)
-	    continue;
-	strlcpy(pk, word, MAXWORDLEN);
-
-
-	/*
-	 * Now read address authorization info and make a wordlist.
-	 */
-	app = &alist;
-	for (;;) {
-	    if (!getword(f, word, &newline, filename) || newline)
-		break;
-	    ap = (struct wordlist *)
-		malloc(sizeof(struct wordlist) + strlen(word) + 1);
-	    if (ap == NULL)
-		novm("authorized addresses");
-	    ap->word = (char *) (ap + 1);
-	    strcpy(ap->word, word);
-	    *app = ap;
-	    app = &ap->next;
-	}
-	*app = NULL;
-	/*
-	 * This is the best so far; remember it.
-	 */
-	best_flag = got_flag;
-	if (addr_list)
-	    free_wordlist(addr_list);
-	addr_list = alist;
-
-	if (!newline)
-	    break;
-    }
-
-    /* scan for a -- word indicating the start of options */
-    for (app = &addr_list; (ap = *app) != NULL; app = &ap->next)
-	if (strcmp(ap->word, "--") == 0)
-	    break;
-    /* ap = start of options */
-    if (ap != NULL) {
-	ap = ap->next;		/* first option */
-	free(*app);		/* free the "--" word */
-	*app = NULL;		/* terminate addr list */
-    }
-    if (opts != NULL)
-	*opts = ap;
-    else if (ap != NULL)
-	free_wordlist(ap);
-    if (addrs != NULL)
-	*addrs = addr_list;
-    else if (addr_list != NULL)
-	free_wordlist(addr_list);
-
-    return best_flag;
-}
-
-
 int
 get_eaptls_secret(int unit, char *client, char *server,
 		  char *clicertfile, char *servcertfile, char *cacertfile,
@@ -2767,7 +2697,7 @@ get_eaptls_secret(int unit, char *client, char *server,
 		check_access(fp, filename);
 
 		ret = scan_authfile_eaptls(fp, client, server, clicertfile, servcertfile,
-				cacertfile, pkfile, &addrs, &opts, filename, 0);
+				cacertfile, pkfile, &addrs, &opts, filename);
 
 		fclose(fp);
 
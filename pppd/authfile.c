@@ -0,0 +1,1241 @@
+/*
+ * authfile.c - reading and indexing of secrets files.
+ *
+ * Copyright (c) 2026 The ppp project. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The name(s) of the authors of this software must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission.
+ *
+ * THE AUTHORS OF THIS SOFTWARE DISCLAIM ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS, IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+ * AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
+#include "pppd-private.h"
+#include "options.h"
+#include "arena.h"
+
+/*
+ * Secrets files (pap-secrets, chap-secrets, srp-secrets, eaptls-server
+ * and eaptls-client) can be large,
+ * and are consulted several times for each authentication.  Rather than
+ * tokenizing the whole file every time, the first lookup compiles it
+ * into an in-memory index: the entries in file order, plus a hash table
+ * from the (client, server) pair to the first entry with that pair.
+ * Entries with the same pair are chained in file order.
+ *
+ * The index is rebuilt when inotify reports that the file has changed,
+ * or, where inotify isn't available, when its size or modification time
+ * changes.  A different inode behind the same name also forces a rebuild.
+ */
+
+struct authent {
+    int		client;		/* offsets of the words in strings */
+    int		server;
+    int		secret;
+    int		words;		/* index of first address word in wordv */
+    int		nwords;		/* # address (and option) words */
+    int		next;		/* next entry with same client & server */
+};
+
+struct authfile_index {
+    struct authfile_index *next;
+    char	*filename;
+    dev_t	dev;		/* identity and state of the file */
+    ino_t	ino;
+    off_t	size;
+    struct timespec mtime;
+    int		wd;		/* inotify watch descriptor, or -1 */
+    bool	stale;		/* file has changed since we read it */
+
+    char	*strings;	/* all the words, null-terminated */
+    int		slen, salloc;
+    int		*wordv;		/* offsets of address words */
+    int		nwordv, awordv;
+    struct authent *ents;
+    int		nents, aents;
+    int		*hash;		/* first entry for each pair, or -1 */
+    int		hsize;		/* # buckets in hash, a power of 2 */
+};
+
+static struct authfile_index *indexes;	/* one per file we have read */
+
+#ifdef HAVE_SYS_INOTIFY_H
+static int inotify_fd = -1;
+#endif
+
+static int  scan_authfile_linear(FILE *, char *, char *, char *,
+				 struct wordlist **, struct wordlist **,
+				 char *, int);
+#ifdef PPP_WITH_EAPTLS
+static int  scan_authfile_eaptls_linear(FILE *, char *, char *, char *,
+					char *, char *, char *,
+					struct wordlist **, struct wordlist **,
+					char *);
+#endif
+static struct authfile_index *get_index(FILE *, char *);
+static int  lookup_index(struct authfile_index *, char *, char *, char *,
+			 struct wordlist **, struct wordlist **, int);
+static int  find_entry(struct authfile_index *, char *, char *, char *,
+		       int, int, int *);
+static struct wordlist *entry_words(struct authfile_index *,
+				    struct authent *, int);
+static int  check_secret(char *, char *, int);
+static struct wordlist *new_word(char *);
+static int  split_options(struct wordlist *, struct wordlist **,
+			  struct wordlist **, int);
+
+/*
+ * scan_authfile - Scan an authorization file for a secret suitable
+ * for authenticating `client' on `server'.  The return value is -1
+ * if no secret is found, otherwise >= 0.  The return value has
+ * NONWILD_CLIENT set if the secret didn't have "*" for the client, and
+ * NONWILD_SERVER set if the secret didn't have "*" for the server.
+ * Any following words on the line up to a "--" (i.e. address authorization
+ * info) are placed in a wordlist and returned in *addrs.  Any
+ * following words (extra options) are placed in a wordlist and
+ * returned in *opts.  The wordlists are allocated from the auth arena.
+ * We assume secret is NULL or points to MAXWORDLEN bytes of space.
+ * Flags are non-zero if we need two colons in the secret in order to
+ * match.
+ */
+int
+scan_authfile(FILE *f, char *client, char *server,
+	      char *secret, struct wordlist **addrs,
+	      struct wordlist **opts, char *filename,
+	      int flags)
+{
+    struct authfile_index *ix;
+
+    if (addrs != NULL)
+	*addrs = NULL;
+    if (opts != NULL)
+	*opts = NULL;
+
+    ix = get_index(f, filename);
+    if (ix == NULL) {
+	/* couldn't build an index, read the file the slow way */
+	rewind(f);
+	return scan_authfile_linear(f, client, server, secret,
+				    addrs, opts, filename, flags);
+    }
+    return lookup_index(ix, client, server, secret, addrs, opts, flags);
+}
+
+/*
+ * scan_authfile_linear - find the secret by reading through the
+ * file from start to finish.
+ */
+static int
+scan_authfile_linear(FILE *f, char *client, char *server,
+		     char *secret, struct wordlist **addrs,
+		     struct wordlist **opts, char *filename,
+		     int flags)
+{
+    int newline, got_flag, best_flag;
+    struct wordlist *addr_list, *alist, **app;
+    char word[MAXWORDLEN];
+    char lsecret[MAXWORDLEN];
+
+    addr_list = NULL;
+    if (!getword(f, word, &newline, filename))
+	return -1;		/* file is empty??? */
+    newline = 1;
+    best_flag = -1;
+    for (;;) {
+	/*
+	 * Skip until we find a word at the start of a line.
+	 */
+	while (!newline && getword(f, word, &newline, filename))
+	    ;
+	if (!newline)
+	    break;		/* got to end of file */
+
+	/*
+	 * Got a client - check if it's a match or a wildcard.
+	 */
+	got_flag = 0;
+	if (client != NULL && strcmp(word, client) != 0 && !ISWILD(word)) {
+	    newline = 0;
+	    continue;
+	}
+	if (!ISWILD(word))
+	    got_flag = NONWILD_CLIENT;
+
+	/*
+	 * Now get a server and check if it matches.
+	 */
+	if (!getword(f, word, &newline, filename))
+	    break;
+	if (newline)
+	    continue;
+	if (!ISWILD(word)) {
+	    if (server != NULL && strcmp(word, server) != 0)
+		continue;
+	    got_flag |= NONWILD_SERVER;
+	}
+
+	/*
+	 * Got some sort of a match - see if it's better than what
+	 * we have already.
+	 */
+	if (got_flag <= best_flag)
+	    continue;
+
+	/*
+	 * Get the secret.
+	 */
+	if (!getword(f, word, &newline, filename))
+	    break;
+	if (newline)
+	    continue;
+	if (!check_secret(word, secret != NULL? lsecret: NULL, flags))
+	    continue;
+
+	/*
+	 * Now read address authorization info and make a wordlist.
+	 */
+	app = &alist;
+	for (;;) {
+	    if (!getword(f, word, &newline, filename) || newline)
+		break;
+	    *app = new_word(word);
+	    app = &(*app)->next;
+	}
+	*app = NULL;
+
+	/*
+	 * This is the best so far; remember it.
+	 */
+	best_flag = got_flag;
+	addr_list = alist;
+	if (secret != NULL)
+	    strlcpy(secret, lsecret, MAXWORDLEN);
+
+	if (!newline)
+	    break;
+    }
+
+    return split_options(addr_list, addrs, opts, best_flag);
+}
+
+#ifdef PPP_WITH_EAPTLS
+/*
+ * scan_authfile_eaptls - Scan an EAP-TLS secrets file for the entry
+ * for `client' on `server'.  The return value is as for scan_authfile.
+ * The client certificate, server certificate, CA certificate and private
+ * key file names are copied to cli_cert, serv_cert, ca_cert and pk, which
+ * each point to MAXWORDLEN bytes of space; a "-" for either certificate
+ * gives an empty string.  The addresses and options are returned as for
+ * scan_authfile.
+ */
+int
+scan_authfile_eaptls(FILE *f, char *client, char *server,
+		     char *cli_cert, char *serv_cert, char *ca_cert,
+		     char *pk, struct wordlist **addrs,
+		     struct wordlist **opts, char *filename)
+{
+    struct authfile_index *ix;
+    struct authent *ep;
+    char *word;
+    int best, best_flag;
+
+    if (addrs != NULL)
+	*addrs = NULL;
+    if (opts != NULL)
+	*opts = NULL;
+
+    ix = get_index(f, filename);
+    if (ix == NULL) {
+	rewind(f);
+	return scan_authfile_eaptls_linear(f, client, server, cli_cert,
+					   serv_cert, ca_cert, pk,
+					   addrs, opts, filename);
+    }
+
+    best = find_entry(ix, client, server, NULL, 0, 1, &best_flag);
+    if (best < 0)
+	return -1;
+
+    /* the secret is the client certificate, then the other three files */
+    ep = &ix->ents[best];
+    word = ix->strings + ep->secret;
+    strlcpy(cli_cert, strcmp(word, "-") != 0? word: "", MAXWORDLEN);
+    word = ix->strings + ix->wordv[ep->words];
+    strlcpy(serv_cert, strcmp(word, "-") != 0? word: "", MAXWORDLEN);
+    strlcpy(ca_cert, ix->strings + ix->wordv[ep->words + 1], MAXWORDLEN);
+    strlcpy(pk, ix->strings + ix->wordv[ep->words + 2], MAXWORDLEN);
+
+    return split_options(entry_words(ix, ep, 3), addrs, opts, best_flag);
+}
+
+/*
+ * scan_authfile_eaptls_linear - find the EAP-TLS entry by reading
+ * through the file from start to finish.
+ */
+static int
+scan_authfile_eaptls_linear(FILE *f, char *client, char *server,
+			    char *cli_cert, char *serv_cert, char *ca_cert,
+			    char *pk, struct wordlist **addrs,
+			    struct wordlist **opts, char *filename)
+{
+    int newline, i, eof;
+    int got_flag, best_flag;
+    struct wordlist *addr_list, *alist, **app;
+    char word[MAXWORDLEN];
+    char files[4][MAXWORDLEN];
+
+    addr_list = NULL;
+    if (!getword(f, word, &newline, filename))
+	return -1;		/* file is empty??? */
+    newline = 1;
+    best_flag = -1;
+    eof = 0;
+    for (;;) {
+	/*
+	 * Skip until we find a word at the start of a line.
+	 */
+	while (!newline && getword(f, word, &newline, filename))
+	    ;
+	if (!newline)
+	    break;		/* got to end of file */
+
+	/*
+	 * Got a client - check if it's a match or a wildcard.
+	 */
+	got_flag = 0;
+	if (client != NULL && strcmp(word, client) != 0 && !ISWILD(word)) {
+	    newline = 0;
+	    continue;
+	}
+	if (!ISWILD(word))
+	    got_flag = NONWILD_CLIENT;
+
+	/*
+	 * Now get a server and check if it matches.
+	 */
+	if (!getword(f, word, &newline, filename))
+	    break;
+	if (newline)
+	    continue;
+	if (!ISWILD(word)) {
+	    if (server != NULL && strcmp(word, server) != 0)
+		continue;
+	    got_flag |= NONWILD_SERVER;
+	}
+
+	/*
+	 * Got some sort of a match - see if it's better than what
+	 * we have already.
+	 */
+	if (got_flag <= best_flag)
+	    continue;
+
+	/*
+	 * Get the client cert, server cert, CA cert and private key.
+	 */
+	for (i = 0; i < 4; ++i) {
+	    if (!getword(f, word, &newline, filename)) {
+		eof = 1;
+		break;
+	    }
+	    if (newline)
+		break;
+	    strlcpy(files[i], word, MAXWORDLEN);
+	}
+	if (eof)
+	    break;
+	if (i < 4)
+	    continue;
+
+	/*
+	 * Now read address authorization info and make a wordlist.
+	 */
+	app = &alist;
+	for (;;) {
+	    if (!getword(f, word, &newline, filename) || newline)
+		break;
+	    *app = new_word(word);
+	    app = &(*app)->next;
+	}
+	*app = NULL;
+
+	/*
+	 * This is the best so far; remember it.
+	 */
+	best_flag = got_flag;
+	addr_list = alist;
+	strlcpy(cli_cert, strcmp(files[0], "-") != 0? files[0]: "", MAXWORDLEN);
+	strlcpy(serv_cert, strcmp(files[1], "-") != 0? files[1]: "", MAXWORDLEN);
+	strlcpy(ca_cert, files[2], MAXWORDLEN);
+	strlcpy(pk, files[3], MAXWORDLEN);
+
+	if (!newline)
+	    break;
+    }
+
+    return split_options(addr_list, addrs, opts, best_flag);
+}
+#endif /* PPP_WITH_EAPTLS */
+
+/*
+ * check_secret - check that a secret from a secrets file is usable,
+ * and if lsecret is non-NULL, copy it there, following an indirection
+ * to another file if necessary.
+ */
+static int
+check_secret(char *word, char *lsecret, int flags)
+{
+    FILE *sf;
+    int xxx;
+    char atfile[MAXWORDLEN];
+    char iword[MAXWORDLEN];
+    char *cp;
+
+    /*
+     * SRP-SHA1 authenticator should never be reading secrets from
+     * a file.  (Authenticatee may, though.)
+     */
+    if (flags && ((cp = strchr(word, ':')) == NULL ||
+	strchr(cp + 1, ':') == NULL))
+	return 0;
+
+    if (lsecret == NULL)
+	return 1;
+
+    /*
+     * Special syntax: @/pathname means read secret from file.
+     */
+    if (word[0] == '@' && word[1] == '/') {
+	strlcpy(atfile, word+1, sizeof(atfile));
+	if ((sf = fopen(atfile, "r")) == NULL) {
+	    warn("can't open indirect secret file %s", atfile);
+	    return 0;
+	}
+	check_access(sf, atfile);
+	if (!getword(sf, iword, &xxx, atfile)) {
+	    warn("no secret in indirect secret file %s", atfile);
+	    fclose(sf);
+	    return 0;
+	}
+	fclose(sf);
+	word = iword;
+    }
+    strlcpy(lsecret, word, MAXWORDLEN);
+    return 1;
+}
+
+/*
+ * new_word - make a wordlist entry for word in the auth arena.
+ */
+static struct wordlist *
+new_word(char *word)
+{
+    struct wordlist *ap;
+
+    ap = (struct wordlist *) ppp_arena_alloc(PPP_ARENA_AUTH,
+	    sizeof(struct wordlist) + strlen(word) + 1);
+    if (ap == NULL)
+	novm("authorized addresses");
+    ap->word = (char *) (ap + 1);
+    strcpy(ap->word, word);
+    ap->next = NULL;
+    return ap;
+}
+
+/*
+ * split_options - split the words following the secret at a "--"
+ * into addresses and options, and return them.
+ */
+static int
+split_options(struct wordlist *addr_list, struct wordlist **addrs,
+	      struct wordlist **opts, int best_flag)
+{
+    struct wordlist *ap, **app;
+
+    /* scan for a -- word indicating the start of options */
+    for (app = &addr_list; (ap = *app) != NULL; app = &ap->next)
+	if (strcmp(ap->word, "--") == 0)
+	    break;
+    /* ap = start of options */
+    if (ap != NULL) {
+	ap = ap->next;		/* first option */
+	*app = NULL;		/* terminate addr list */
+    }
+    if (opts != NULL)
+	*opts = ap;
+    if (addrs != NULL)
+	*addrs = addr_list;
+
+    return best_flag;
+}
+
+/*
+ * Look up the first entry with the given client and server words.
+ */
+static unsigned int
+pair_hash(const char *client, const char *server)
+{
+    unsigned int h = 2166136261U;	/* FNV-1a */
+
+    while (*client)
+	h = (h ^ (unsigned char) *client++) * 16777619U;
+    h = (h ^ 0xff) * 16777619U;
+    while (*server)
+	h = (h ^ (unsigned char) *server++) * 16777619U;
+    return h;
+}
+
+static int *
+pair_bucket(struct authfile_index *ix, const char *client, const char *server)
+{
+    unsigned int mask = ix->hsize - 1;
+    unsigned int b = pair_hash(client, server) & mask;
+    struct authent *ep;
+    int i;
+
+    for (;; b = (b + 1) & mask) {
+	i = ix->hash[b];
+	if (i < 0)
+	    break;
+	ep = &ix->ents[i];
+	if (strcmp(ix->strings + ep->client, client) == 0
+	    && strcmp(ix->strings + ep->server, server) == 0)
+	    break;
+    }
+    return &ix->hash[b];
+}
+
+/*
+ * entry_usable - check whether an entry can be used.  Secrets must
+ * pass check_secret; EAP-TLS entries must have all four file names.
+ */
+static int
+entry_usable(struct authfile_index *ix, struct authent *ep,
+	     char *lsecret, int flags, int certs)
+{
+    if (certs)
+	return ep->nwords >= 3;
+    return check_secret(ix->strings + ep->secret, lsecret, flags);
+}
+
+/*
+ * find_entry - find the best entry using the index.  This gives
+ * the same answer as scanning the file: the first entry in the
+ * file with the most specific match wins.  Returns the entry
+ * number and sets *flagp, or returns -1.
+ */
+static int
+find_entry(struct authfile_index *ix, char *client, char *server,
+	   char *lsecret, int flags, int certs, int *flagp)
+{
+    int e, level, got_flag, best, best_flag;
+    char *c, *s;
+    struct authent *ep;
+
+    best = -1;
+    best_flag = -1;
+    if (client != NULL && server != NULL) {
+	/*
+	 * Try the most specific pair first, then fall back to wildcards.
+	 */
+	for (level = NONWILD_CLIENT | NONWILD_SERVER; level >= 0; --level) {
+	    if (level & NONWILD_CLIENT) {
+		if (ISWILD(client))
+		    continue;
+		c = client;
+	    } else
+		c = "*";
+	    if (level & NONWILD_SERVER) {
+		if (ISWILD(server))
+		    continue;
+		s = server;
+	    } else
+		s = "*";
+	    if (ix->hsize == 0)
+		break;
+	    for (e = *pair_bucket(ix, c, s); e >= 0; e = ix->ents[e].next) {
+		if (entry_usable(ix, &ix->ents[e], lsecret, flags, certs)) {
+		    best = e;
+		    best_flag = level;
+		    break;
+		}
+	    }
+	    if (best >= 0)
+		break;
+	}
+    } else {
+	/*
+	 * We don't know the client or server, so any entry could match.
+	 */
+	for (e = 0; e < ix->nents; ++e) {
+	    ep = &ix->ents[e];
+	    c = ix->strings + ep->client;
+	    s = ix->strings + ep->server;
+	    got_flag = 0;
+	    if (!ISWILD(c)) {
+		if (client != NULL && strcmp(c, client) != 0)
+		    continue;
+		got_flag = NONWILD_CLIENT;
+	    }
+	    if (!ISWILD(s)) {
+		if (server != NULL && strcmp(s, server) != 0)
+		    continue;
+		got_flag |= NONWILD_SERVER;
+	    }
+	    if (got_flag <= best_flag)
+		continue;
+	    if (!entry_usable(ix, ep, lsecret, flags, certs))
+		continue;
+	    best = e;
+	    best_flag = got_flag;
+	}
+    }
+
+    *flagp = best_flag;
+    return best;
+}
+
+/*
+ * entry_words - make a wordlist from the address words of an entry,
+ * starting at word `first'.
+ */
+static struct wordlist *
+entry_words(struct authfile_index *ix, struct authent *ep, int first)
+{
+    struct wordlist *list, **app;
+    int i;
+
+    app = &list;
+    for (i = first; i < ep->nwords; ++i) {
+	*app = new_word(ix->strings + ix->wordv[ep->words + i]);
+	app = &(*app)->next;
+    }
+    *app = NULL;
+    return list;
+}
+
+/*
+ * lookup_index - find the best secret using the index.
+ */
+static int
+lookup_index(struct authfile_index *ix, char *client, char *server,
+	     char *secret, struct wordlist **addrs,
+	     struct wordlist **opts, int flags)
+{
+    int best, best_flag;
+    char lsecret[MAXWORDLEN];
+
+    best = find_entry(ix, client, server, secret != NULL? lsecret: NULL,
+		      flags, 0, &best_flag);
+    if (best < 0)
+	return -1;
+
+    /* check_secret only touches lsecret when it succeeds */
+    if (secret != NULL)
+	strlcpy(secret, lsecret, MAXWORDLEN);
+
+    return split_options(entry_words(ix, &ix->ents[best], 0),
+			 addrs, opts, best_flag);
+}
+
+/*
+ * Routines for building an index.
+ */
+static int
+add_string(struct authfile_index *ix, char *word)
+{
+    int len = strlen(word) + 1;
+    int off = ix->slen;
+    char *p;
+
+    if (ix->slen + len > ix->salloc) {
+	int n = 2 * ix->salloc + len + 4096;
+	p = realloc(ix->strings, n);
+	if (p == NULL)
+	    return -1;
+	ix->strings = p;
+	ix->salloc = n;
+    }
+    memcpy(ix->strings + off, word, len);
+    ix->slen += len;
+    return off;
+}
+
+static int
+add_word(struct authfile_index *ix, char *word)
+{
+    int off, *p;
+
+    if (ix->nwordv >= ix->awordv) {
+	int n = 2 * ix->awordv + 256;
+	p = realloc(ix->wordv, n * sizeof(int));
+	if (p == NULL)
+	    return 0;
+	ix->wordv = p;
+	ix->awordv = n;
+    }
+    off = add_string(ix, word);
+    if (off < 0)
+	return 0;
+    ix->wordv[ix->nwordv++] = off;
+    return 1;
+}
+
+static struct authent *
+add_entry(struct authfile_index *ix)
+{
+    struct authent *p;
+
+    if (ix->nents >= ix->aents) {
+	int n = 2 * ix->aents + 256;
+	p = realloc(ix->ents, n * sizeof(struct authent));
+	if (p == NULL)
+	    return NULL;
+	ix->ents = p;
+	ix->aents = n;
+    }
+    p = &ix->ents[ix->nents];
+    p->words = ix->nwordv;
+    p->nwords = 0;
+    p->next = -1;
+    return p;
+}
+
+static void
+clear_index(struct authfile_index *ix)
+{
+    free(ix->strings);
+    free(ix->wordv);
+    free(ix->ents);
+    free(ix->hash);
+    ix->strings = NULL;
+    ix->wordv = NULL;
+    ix->ents = NULL;
+    ix->hash = NULL;
+    ix->slen = ix->salloc = 0;
+    ix->nwordv = ix->awordv = 0;
+    ix->nents = ix->aents = 0;
+    ix->hsize = 0;
+}
+
+/*
+ * build_index - read the file and fill in the index.
+ * The file is tokenized exactly as scan_authfile_linear would.
+ */
+static int
+build_index(struct authfile_index *ix, FILE *f, char *filename)
+{
+    int newline, i, *bp, *tail;
+    char word[MAXWORDLEN];
+    struct authent *ep;
+
+    clear_index(ix);
+    if (!getword(f, word, &newline, filename))
+	return 1;		/* file is empty */
+    newline = 1;
+    for (;;) {
+	while (!newline && getword(f, word, &newline, filename))
+	    ;
+	if (!newline)
+	    break;
+
+	if ((ep = add_entry(ix)) == NULL)
+	    return 0;
+	if ((ep->client = add_string(ix, word)) < 0)
+	    return 0;
+	if (!getword(f, word, &newline, filename))
+	    break;
+	if (newline)
+	    continue;
+	if ((ep->server = add_string(ix, word)) < 0)
+	    return 0;
+	if (!getword(f, word, &newline, filename))
+	    break;
+	if (newline)
+	    continue;
+	if ((ep->secret = add_string(ix, word)) < 0)
+	    return 0;
+	for (;;) {
+	    if (!getword(f, word, &newline, filename) || newline)
+		break;
+	    if (!add_word(ix, word))
+		return 0;
+	    ++ep->nwords;
+	}
+	++ix->nents;		/* the entry is complete */
+
+	if (!newline)
+	    break;
+    }
+
+    /* now hash the entries, keeping those with the same pair in order */
+    for (ix->hsize = 64; ix->hsize < 2 * ix->nents; ix->hsize <<= 1)
+	;
+    ix->hash = malloc(ix->hsize * sizeof(int));
+    if (ix->hash == NULL) {
+	ix->hsize = 0;
+	return 0;
+    }
+    for (i = 0; i < ix->hsize; ++i)
+	ix->hash[i] = -1;
+    tail = malloc(ix->nents * sizeof(int) + 1);
+    if (tail == NULL)
+	return 0;
+    for (i = 0; i < ix->nents; ++i) {
+	ep = &ix->ents[i];
+	bp = pair_bucket(ix, ix->strings + ep->client,
+			 ix->strings + ep->server);
+	if (*bp < 0)
+	    *bp = i;
+	else
+	    ix->ents[tail[*bp]].next = i;
+	tail[*bp] = i;
+    }
+    free(tail);
+    return 1;
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+/*
+ * read_inotify - collect any changes inotify has told us about.
+ */
+static void
+read_inotify(void)
+{
+    char buf[4096]
+	__attribute__ ((aligned(__alignof__(struct inotify_event))));
+    struct inotify_event *ev;
+    struct authfile_index *ix;
+    ssize_t n;
+    char *p;
+
+    if (inotify_fd < 0)
+	return;
+    while ((n = read(inotify_fd, buf, sizeof(buf))) > 0) {
+	for (p = buf; p < buf + n; p += sizeof(*ev) + ev->len) {
+	    ev = (struct inotify_event *) p;
+	    for (ix = indexes; ix != NULL; ix = ix->next) {
+		if (ix->wd != ev->wd)
+		    continue;
+		ix->stale = 1;
+		if (ev->mask & IN_IGNORED)
+		    ix->wd = -1;	/* the watch has gone away */
+	    }
+	}
+    }
+}
+
+/*
+ * watch_file - ask inotify to tell us when the file changes.
+ */
+static void
+watch_file(struct authfile_index *ix)
+{
+    if (inotify_fd < 0) {
+	inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotify_fd < 0)
+	    return;
+    }
+    ix->wd = inotify_add_watch(inotify_fd, ix->filename,
+			       IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE
+			       | IN_MOVE_SELF | IN_DELETE_SELF);
+}
+#endif /* HAVE_SYS_INOTIFY_H */
+
+/*
+ * get_index - return an up-to-date index for the open file f,
+ * or NULL if we can't make one.
+ */
+static struct authfile_index *
+get_index(FILE *f, char *filename)
+{
+    struct authfile_index *ix;
+    struct stat sbuf;
+
+    if (fstat(fileno(f), &sbuf) < 0)
+	return NULL;
+
+#ifdef HAVE_SYS_INOTIFY_H
+    read_inotify();
+#endif
+    for (ix = indexes; ix != NULL; ix = ix->next)
+	if (strcmp(ix->filename, filename) == 0)
+	    break;
+    if (ix != NULL && !ix->stale
+	&& ix->dev == sbuf.st_dev && ix->ino == sbuf.st_ino
+	&& (ix->wd >= 0 || (ix->size == sbuf.st_size
+			    && ix->mtime.tv_sec == sbuf.st_mtim.tv_sec
+			    && ix->mtime.tv_nsec == sbuf.st_mtim.tv_nsec)))
+	return ix;
+
+    if (ix == NULL) {
+	ix = calloc(1, sizeof(*ix));
+	if (ix == NULL)
+	    return NULL;
+	ix->filename = strdup(filename);
+	if (ix->filename == NULL) {
+	    free(ix);
+	    return NULL;
+	}
+	ix->wd = -1;
+	ix->next = indexes;
+	indexes = ix;
+    }
+
+    /* set up the watch before reading, so we can't miss a change */
+#ifdef HAVE_SYS_INOTIFY_H
+    watch_file(ix);
+#endif
+    ix->stale = 0;
+    ix->dev = sbuf.st_dev;
+    ix->ino = sbuf.st_ino;
+    ix->size = sbuf.st_size;
+    ix->mtime = sbuf.st_mtim;
+    if (!build_index(ix, f, filename)) {
+	clear_index(ix);
+	ix->stale = 1;
+	return NULL;
+    }
+    if (debug)
+	dbglog("Indexed %d entries from %s", ix->nents, filename);
+    return ix;
+}
+
+#ifdef UNIT_TEST
+/*
+ * Check that the index gives the same answers as reading the file,
+ * and with -b, time both ways of looking up a secret.
+ */
+#include <time.h>
+
+int debug = 0;
+int error_count;
+int unsuccess;
+
+void ppp_option_error(char *fmt, ...) { }
+void die(int status) { exit(status); }
+void check_access(FILE *f, char *filename) { }
+void novm(const char *msg) { fprintf(stderr, "no memory for %s\n", msg); exit(1); }
+
+static char *test_file = "/tmp/ppp_authfile_utest.secrets";
+
+static void
+write_secrets(int nlines, int gen)
+{
+    FILE *f;
+    int i;
+
+    f = fopen(test_file, "w");
+    if (f == NULL) {
+	perror(test_file);
+	exit(1);
+    }
+    fprintf(f, "# client\tserver\tsecret\taddresses\n");
+    for (i = 0; i < nlines; ++i) {
+	switch (i % 7) {
+	case 0:
+	    fprintf(f, "user%d\t*\tpw%d-%d\n", i % 50, i, gen);
+	    break;
+	case 1:
+	    fprintf(f, "*\tsrv%d\t\"pw %d\"\t10.0.0.%d\n", i % 5, i, i % 250);
+	    break;
+	case 2:
+	    fprintf(f, "user%d\tsrv%d\tpw%d\t* -- mtu %d\n",
+		    i % 50, i % 5, i, 1000 + i);
+	    break;
+	case 3:
+	    fprintf(f, "user%d\tsrv%d\ta:b:%d\t-\n", i % 50, i % 5, i);
+	    break;
+	case 4:
+	    fprintf(f, "user%d srv%d\n", i % 50, i % 5);	/* no secret */
+	    break;
+	case 5:
+	    fprintf(f, "user%d\tsrv%d\tpw%d\t10.1.%d.0/24 !10.1.%d.1 \\\n"
+		    "\t10.2.0.1\n", i, i % 5, i, i % 250, i % 250);
+	    break;
+	default:
+	    fprintf(f, "*\t*\tdefault%d\n", i);
+	}
+    }
+    fclose(f);
+}
+
+static int
+same_list(struct wordlist *a, struct wordlist *b)
+{
+    for (; a != NULL && b != NULL; a = a->next, b = b->next)
+	if (strcmp(a->word, b->word) != 0)
+	    return 0;
+    return a == b;
+}
+
+static int
+compare(char *client, char *server, int flags)
+{
+    FILE *f;
+    int r1, r2;
+    char s1[MAXWORDLEN], s2[MAXWORDLEN];
+    struct wordlist *a1, *a2, *o1, *o2;
+
+    f = fopen(test_file, "r");
+    s1[0] = s2[0] = 0;
+    a1 = o1 = NULL;
+    r1 = scan_authfile_linear(f, client, server, s1, &a1, &o1,
+			      test_file, flags);
+    rewind(f);
+    r2 = scan_authfile(f, client, server, s2, &a2, &o2, test_file, flags);
+    fclose(f);
+    if (r1 != r2 || strcmp(s1, s2) != 0 || !same_list(a1, a2)
+	|| !same_list(o1, o2)) {
+	printf("Mismatch for %s %s: %d/%d %s/%s\n", client? client: "(null)",
+	       server? server: "(null)", r1, r2, s1, s2);
+	return 0;
+    }
+    ppp_arena_release(PPP_ARENA_AUTH);
+    return 1;
+}
+
+static int
+test_lookups(void)
+{
+    char client[32], server[32];
+    int i, ok = 1;
+
+    write_secrets(1000, 0);
+    for (i = 0; i < 2000 && ok; ++i) {
+	slprintf(client, sizeof(client), "user%d", i % 60);
+	slprintf(server, sizeof(server), "srv%d", i % 7);
+	ok = compare(client, server, 0)
+	    && compare(client, server, i & 1)
+	    && compare(NULL, server, 0)
+	    && compare(client, NULL, 0)
+	    && compare("*", server, 0)
+	    && compare(client, "*", 0)
+	    && compare("", server, 0);
+    }
+    return ok;
+}
+
+#ifdef PPP_WITH_EAPTLS
+static void
+write_eaptls(int nlines)
+{
+    FILE *f;
+    int i;
+
+    f = fopen(test_file, "w");
+    if (f == NULL) {
+	perror(test_file);
+	exit(1);
+    }
+    for (i = 0; i < nlines; ++i) {
+	switch (i % 5) {
+	case 0:
+	    fprintf(f, "user%d\tsrv%d\t/c/%d.pem\t-\t/ca.pem\t/k/%d.key\n",
+		    i % 30, i % 4, i, i);
+	    break;
+	case 1:
+	    fprintf(f, "user%d *\t- /s/%d.pem /ca.pem /k/%d.key 10.0.0.%d\n",
+		    i % 30, i, i, i % 250);
+	    break;
+	case 2:
+	    fprintf(f, "user%d srv%d /c/%d.pem /s.pem /ca.pem\n",
+		    i % 30, i % 4, i);		/* no key */
+	    break;
+	case 3:
+	    fprintf(f, "* srv%d - - /ca%d.pem /k.key * -- mtu %d\n",
+		    i % 4, i, 1000 + i);
+	    break;
+	default:
+	    fprintf(f, "* * /c.pem /s.pem /ca.pem /k%d.key\n", i);
+	}
+    }
+    fclose(f);
+}
+
+static int
+compare_eaptls(char *client, char *server)
+{
+    FILE *f;
+    int r1, r2, i;
+    char v1[4][MAXWORDLEN], v2[4][MAXWORDLEN];
+    struct wordlist *a1, *a2, *o1, *o2;
+
+    memset(v1, 0, sizeof(v1));
+    memset(v2, 0, sizeof(v2));
+    f = fopen(test_file, "r");
+    a1 = o1 = NULL;
+    r1 = scan_authfile_eaptls_linear(f, client, server, v1[0], v1[1],
+				     v1[2], v1[3], &a1, &o1, test_file);
+    rewind(f);
+    r2 = scan_authfile_eaptls(f, client, server, v2[0], v2[1], v2[2],
+			      v2[3], &a2, &o2, test_file);
+    fclose(f);
+    for (i = 0; i < 4; ++i)
+	if (strcmp(v1[i], v2[i]) != 0)
+	    break;
+    if (r1 != r2 || i < 4 || !same_list(a1, a2) || !same_list(o1, o2)) {
+	printf("EAP-TLS mismatch for %s %s: %d/%d\n",
+	       client? client: "(null)", server? server: "(null)", r1, r2);
+	return 0;
+    }
+    ppp_arena_release(PPP_ARENA_AUTH);
+    return 1;
+}
+
+static int
+test_eaptls(void)
+{
+    char client[32], server[32];
+    int i, ok = 1;
+
+    write_eaptls(500);
+    for (i = 0; i < 500 && ok; ++i) {
+	slprintf(client, sizeof(client), "user%d", i % 40);
+	slprintf(server, sizeof(server), "srv%d", i % 6);
+	ok = compare_eaptls(client, server)
+	    && compare_eaptls(NULL, server)
+	    && compare_eaptls(client, NULL);
+    }
+    return ok;
+}
+#endif /* PPP_WITH_EAPTLS */
+
+static int
+test_reload(void)
+{
+    FILE *f;
+    char secret[MAXWORDLEN];
+    int ret;
+
+    write_secrets(100, 1);
+    f = fopen(test_file, "r");
+    ret = scan_authfile(f, "user0", "nowhere", secret, NULL, NULL,
+			test_file, 0);
+    fclose(f);
+    if (ret < 0 || strcmp(secret, "pw0-1") != 0)
+	return 0;
+
+    write_secrets(100, 2);
+    f = fopen(test_file, "r");
+    ret = scan_authfile(f, "user0", "nowhere", secret, NULL, NULL,
+			test_file, 0);
+    fclose(f);
+    return ret >= 0 && strcmp(secret, "pw0-2") == 0;
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+bench(int nlines, int nlookups)
+{
+    FILE *f;
+    char client[32], secret[MAXWORDLEN];
+    struct wordlist *addrs, *opts;
+    double t0, t_scan, t_index;
+    int i;
+
+    write_secrets(nlines, 0);
+    f = fopen(test_file, "r");
+
+    t0 = now();
+    for (i = 0; i < nlookups; ++i) {
+	slprintf(client, sizeof(client), "user%d", i % 60);
+	rewind(f);
+	scan_authfile_linear(f, client, "srv1", secret, &addrs, &opts,
+			     test_file, 0);
+	ppp_arena_release(PPP_ARENA_AUTH);
+    }
+    t_scan = (now() - t0) / nlookups;
+
+    rewind(f);
+    scan_authfile(f, "user0", "srv1", secret, &addrs, &opts, test_file, 0);
+    t0 = now();
+    for (i = 0; i < nlookups * 100; ++i) {
+	slprintf(client, sizeof(client), "user%d", i % 60);
+	scan_authfile(f, client, "srv1", secret, &addrs, &opts, test_file, 0);
+	ppp_arena_release(PPP_ARENA_AUTH);
+    }
+    t_index = (now() - t0) / (nlookups * 100);
+    fclose(f);
+
+    printf("%d lines: scan %.3f ms/lookup, index %.3f us/lookup (%.0fx)\n",
+	   nlines, t_scan * 1e3, t_index * 1e6, t_scan / t_index);
+}
+
+int
+main(int argc, char *argv[])
+{
+    int failure = 0;
+
+    if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+	bench(1000, 200);
+	bench(20000, 20);
+	bench(200000, 5);
+	unlink(test_file);
+	return 0;
+    }
+
+    if (!test_lookups()) {
+	printf("Index lookups differ from scanning the file\n");
+	failure++;
+    }
+
+#ifdef PPP_WITH_EAPTLS
+    if (!test_eaptls()) {
+	printf("EAP-TLS index lookups differ from scanning the file\n");
+	failure++;
+    }
+
+#endif
+    if (!test_reload()) {
+	printf("Index was not rebuilt when the file changed\n");
+	failure++;
+    }
+
+    unlink(test_file);
+    return failure;
+}
+#endif /* UNIT_TEST */
@@ -53,6 +53,7 @@ int chap_mdtype_all = MDTYPE_ALL;
 
 /* Hook for a plugin to validate CHAP challenge */
 chap_verify_hook_fn *chap_verify_hook = NULL;
+chap_verify_async_hook_fn *chap_verify_async_hook = NULL;
 
 /*
  * Option variables.
@@ -106,6 +107,7 @@ static struct chap_server_state {
 	int challenge_pktlen;
 	unsigned char challenge[CHAL_MAX_PKTLEN];
 	char message[256];
+	char peer[MAXNAMELEN+1];	/* name of peer being verified */
 } server;
 
 /* Values for flags in chap_client_state and chap_server_state */
@@ -115,6 +117,8 @@ static struct chap_server_state {
 #define AUTH_FAILED		8
 #define TIMEOUT_PENDING		0x10
 #define CHALLENGE_VALID		0x20
+#define VERIFY_PENDING		0x40
+#define CHECK_PENDING		0x80
 
 /*
  * Prototypes.
@@ -128,6 +132,13 @@ static void chap_generate_challenge(struct chap_server_state *ss);
 static void chap_handle_response(struct chap_server_state *ss, int code,
 		unsigned char *pkt, int len);
 static chap_verify_hook_fn chap_verify_response;
+static chap_verify_done_fn chap_verify_done;
+static void chap_verified(struct chap_server_state *ss, int id, int ok,
+		char *name);
+static void chap_send_result(struct chap_server_state *ss, int id,
+		char *name);
+static session_done_fn chap_session_done;
+static void chap_auth_finished(struct chap_server_state *ss, char *name);
 static void chap_respond(struct chap_client_state *cs, int id,
 		unsigned char *pkt, int len);
 static void chap_handle_status(struct chap_client_state *cs, int code, int id,
@@ -338,13 +349,13 @@ static void
 chap_handle_response(struct chap_server_state *ss, int id,
 		     unsigned char *pkt, int len)
 {
-	int response_len, ok, mlen;
-	unsigned char *response, *p;
+	int response_len, ok;
+	unsigned char *response;
 	char *name = NULL;
 	chap_verify_hook_fn *verifier;
 	char rname[MAXNAMELEN+1];
 
-	if ((ss->flags & LOWERUP) == 0)
+	if ((ss->flags & (LOWERUP | VERIFY_PENDING | CHECK_PENDING)) != LOWERUP)
 		return;
 	if (id != ss->challenge[PPP_HDRLEN+1] || len < 2)
 		return;
@@ -377,19 +388,69 @@ chap_handle_response(struct chap_server_state *ss, int id,
 			}
 		}
 
-		if (chap_verify_hook)
-			verifier = chap_verify_hook;
-		else
-			verifier = chap_verify_response;
-		ok = (*verifier)(name, ss->name, id, ss->digest,
+		if (chap_verify_async_hook) {
+			ok = (*chap_verify_async_hook)(name, ss->name, id,
+				ss->digest,
+				ss->challenge + PPP_HDRLEN + CHAP_HDRLEN,
+				response, ss->message, sizeof(ss->message),
+				chap_verify_done, ss);
+			if (ok == CHAP_VERIFY_PENDING) {
+				/* ignore retransmissions until it's done */
+				strlcpy(ss->peer, name, sizeof(ss->peer));
+				ss->flags |= VERIFY_PENDING;
+				return;
+			}
+		} else {
+			if (chap_verify_hook)
+				verifier = chap_verify_hook;
+			else
+				verifier = chap_verify_response;
+			ok = (*verifier)(name, ss->name, id, ss->digest,
 				 ss->challenge + PPP_HDRLEN + CHAP_HDRLEN,
 				 response, ss->message, sizeof(ss->message));
-		if (!ok || !auth_number()) {
-			ss->flags |= AUTH_FAILED;
-			warn("Peer %q failed CHAP authentication", name);
 		}
-	} else if ((ss->flags & AUTH_DONE) == 0)
-		return;
+		chap_verified(ss, id, ok, name);
+	} else if ((ss->flags & AUTH_DONE) != 0)
+		chap_send_result(ss, id, NULL);
+}
+
+/*
+ * chap_verify_done - a plugin has finished checking the response.
+ */
+static void
+chap_verify_done(void *arg, int ok)
+{
+	struct chap_server_state *ss = arg;
+
+	if ((ss->flags & VERIFY_PENDING) == 0)
+		return;		/* the link went down meanwhile */
+	ss->flags &= ~VERIFY_PENDING;
+	chap_verified(ss, ss->challenge[PPP_HDRLEN+1], ok,
+		      explicit_remote? remote_name: ss->peer);
+}
+
+/*
+ * chap_verified - we know whether the peer's response was good.
+ */
+static void
+chap_verified(struct chap_server_state *ss, int id, int ok, char *name)
+{
+	if (!ok || !auth_number()) {
+		ss->flags |= AUTH_FAILED;
+		warn("Peer %q failed CHAP authentication", name);
+	}
+	chap_send_result(ss, id, name);
+}
+
+/*
+ * chap_send_result - send a success or failure packet, and if this
+ * is the first answer to our challenge, tell the rest of pppd.
+ */
+static void
+chap_send_result(struct chap_server_state *ss, int id, char *name)
+{
+	int len, mlen, ok;
+	unsigned char *p;
 
 	/* send the response */
 	p = outpacket_buf;
@@ -416,27 +477,64 @@ chap_handle_response(struct chap_server_state *ss, int id,
 		     * account info (like when using Winbind integrated with
 		     * PAM).
 		     */
-		    if (session_mgmt &&
-			session_check(name, NULL, devnam, NULL) == 0) {
-			ss->flags |= AUTH_FAILED;
-			warn("Peer %q failed CHAP Session verification", name);
+		    if (session_mgmt) {
+			ok = session_start_async(SESS_ACCT, name, NULL, devnam,
+						 NULL, chap_session_done, ss);
+			if (ok == SESSION_PENDING) {
+				/* ignore retransmissions until it's done */
+				strlcpy(ss->peer, name, sizeof(ss->peer));
+				ss->flags |= CHECK_PENDING;
+				return;
+			}
+			if (!ok) {
+				ss->flags |= AUTH_FAILED;
+				warn("Peer %q failed CHAP Session verification",
+				     name);
+			}
 		    }
 		}
-		if (ss->flags & AUTH_FAILED) {
-			auth_peer_fail(0, PPP_CHAP);
-		} else {
-			if ((ss->flags & AUTH_DONE) == 0)
-				auth_peer_success(0, PPP_CHAP,
-						  ss->digest->code,
-						  name, strlen(name));
-			if (chap_rechallenge_time) {
-				ss->flags |= TIMEOUT_PENDING;
-				TIMEOUT(chap_server_timeout, ss,
-					chap_rechallenge_time);
-			}
+		chap_auth_finished(ss, name);
+	}
+}
+
+/*
+ * chap_session_done - the session checks on the peer have finished.
+ */
+static void
+chap_session_done(void *arg, int ok, char *msg)
+{
+	struct chap_server_state *ss = arg;
+
+	if ((ss->flags & CHECK_PENDING) == 0)
+		return;		/* the link went down meanwhile */
+	ss->flags &= ~CHECK_PENDING;
+	if (!ok) {
+		ss->flags |= AUTH_FAILED;
+		warn("Peer %q failed CHAP Session verification", ss->peer);
+	}
+	chap_auth_finished(ss, ss->peer);
+}
+
+/*
+ * chap_auth_finished - tell the rest of pppd how the first answer to
+ * our challenge went.
+ */
+static void
+chap_auth_finished(struct chap_server_state *ss, char *name)
+{
+	if (ss->flags & AUTH_FAILED) {
+		auth_peer_fail(0, PPP_CHAP);
+	} else {
+		if ((ss->flags & AUTH_DONE) == 0)
+			auth_peer_success(0, PPP_CHAP, ss->digest->code,
+					  name, strlen(name));
+		if (chap_rechallenge_time) {
+			ss->flags |= TIMEOUT_PENDING;
+			TIMEOUT(chap_server_timeout, ss,
+				chap_rechallenge_time);
 		}
-		ss->flags |= AUTH_DONE;
 	}
+	ss->flags |= AUTH_DONE;
 }
 
 /*
@@ -453,6 +551,15 @@ chap_verify_response(char *name, char *ourname, int id,
 	int ok;
 	unsigned char secret[MAXSECRETLEN];
 	int secret_len;
+	unsigned char hash[32];
+
+	/* MS-CHAP can check against precomputed password hashes */
+	if (digest->verify_nt_hash && get_nt_hash(0, name, ourname, hash)) {
+		ok = digest->verify_nt_hash(id, name, hash, challenge,
+					    response, message, message_space);
+		memset(hash, 0, sizeof(hash));
+		return ok;
+	}
 
 	/* Get the secret that the peer is supposed to know */
 	if (!get_secret(0, name, ourname, (char *)secret, &secret_len, 1)) {
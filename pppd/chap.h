@@ -119,6 +119,15 @@ struct chap_digest_type {
 	void (*handle_failure)(unsigned char *pkt, int len);
 
 	struct chap_digest_type *next;
+
+	/*
+	 * Optional: check the response against the precomputed
+	 * NtPasswordHash and PasswordHashHash (16 bytes each) from the
+	 * chap-nthashes file rather than against a secret.
+	 */
+	int (*verify_nt_hash)(int id, char *name, unsigned char *hash,
+		unsigned char *challenge, unsigned char *response,
+		char *message, int message_space);
 };
 
 /*
@@ -154,6 +163,23 @@ typedef int (chap_verify_hook_fn)(char *name, char *ourname, int id,
 			char *message, int message_space);
 extern chap_verify_hook_fn *chap_verify_hook;
 
+/*
+ * Like chap_verify_hook, but the plugin may instead return
+ *   CHAP_VERIFY_PENDING and later call done(arg, ok), so that pppd keeps
+ *   running while the response is checked.  The name, challenge and
+ *   response are only valid during the call; message remains valid until
+ *   done is called.  If set, this is used in place of chap_verify_hook
+ *   for CHAP (but not EAP) authentication.
+ */
+#define CHAP_VERIFY_PENDING	2
+typedef void (chap_verify_done_fn)(void *arg, int ok);
+typedef int (chap_verify_async_hook_fn)(char *name, char *ourname, int id,
+			struct chap_digest_type *digest,
+			unsigned char *challenge, unsigned char *response,
+			char *message, int message_space,
+			chap_verify_done_fn *done, void *arg);
+extern chap_verify_async_hook_fn *chap_verify_async_hook;
+
 /* Called by digest code to register a digest type */
 extern void chap_register_digest(struct chap_digest_type *);
 
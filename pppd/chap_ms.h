@@ -84,6 +84,25 @@ void ChapMS2 (u_char *, u_char *, char *, char *, int,
 
 void ChallengeHash (u_char[16], u_char *, char *, u_char[8]);
 
+/*
+ * One MS-CHAPv2 response to be checked by ChapMS2_VerifyBatch.
+ * rchallenge is our 16 byte challenge, response the peer's response
+ * (MS_CHAP2_RESPONSE_LEN bytes, past the length byte); ok is set to 1
+ * if its NT-Response matches secret, or the NtPasswordHash in nthash
+ * when that isn't NULL.
+ */
+struct chapms2_verify {
+    u_char	*rchallenge;
+    u_char	*response;
+    char	*user;
+    char	*secret;
+    int		secret_len;
+    u_char	*nthash;
+    int		ok;
+};
+
+void ChapMS2_VerifyBatch (struct chapms2_verify *, int);
+
 
 /**
  * PasswordHashHash - 16 bytes representing the NT Password Hash Hash
@@ -65,5 +65,28 @@ struct _PPP_CIPHER_CTX
     void *priv;
 };
 
+/*
+ * Each primitive can have an implementation in pppd itself and one
+ * using OpenSSL.  PPP_crypto_init picks the faster for each.
+ */
+enum {
+    PPP_CRYPTO_BUILTIN,
+    PPP_CRYPTO_OPENSSL,
+    PPP_CRYPTO_NBACKENDS
+};
+
+struct ppp_crypto_prim
+{
+    const char *name;
+    int used;                   /* backend PPP_md4() etc. return */
+    const PPP_MD *md[PPP_CRYPTO_NBACKENDS];         /* NULL if not */
+    const PPP_CIPHER *cipher[PPP_CRYPTO_NBACKENDS]; /* compiled in */
+};
+
+extern struct ppp_crypto_prim ppp_md4_prim;
+extern struct ppp_crypto_prim ppp_md5_prim;
+extern struct ppp_crypto_prim ppp_sha1_prim;
+extern struct ppp_crypto_prim ppp_des_prim;
+
 
 #endif
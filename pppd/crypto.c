@@ -35,6 +35,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
 
 #include "pppd.h"
 #include "crypto.h"
@@ -130,6 +131,11 @@ int PPP_CipherInit(PPP_CIPHER_CTX *ctx, const PPP_CIPHER *cipher, const unsigned
     int ret = 0;
     if (ctx && cipher) {
         ret = 1;
+        if (ctx->priv && ctx->cipher.clean_fn
+                && ctx->cipher.init_fn != cipher->init_fn) {
+            /* re-used with another implementation */
+            ctx->cipher.clean_fn(ctx);
+        }
         ctx->is_encr = encr;
         ctx->cipher = *cipher;
         if (ctx->cipher.init_fn) {
@@ -196,9 +202,213 @@ PPP_crypto_error(char *fmt, ...)
 }
 
 
+static struct ppp_crypto_prim *crypto_prims[] = {
+    &ppp_md4_prim,
+    &ppp_md5_prim,
+    &ppp_sha1_prim,
+    &ppp_des_prim,
+    NULL
+};
+
+static const char *crypto_backends[PPP_CRYPTO_NBACKENDS] = {
+    [PPP_CRYPTO_BUILTIN] = "builtin",
+    [PPP_CRYPTO_OPENSSL] = "openssl",
+};
+
+/* Operations timed for each backend by PPP_crypto_init, in 64 bytes */
+#define CRYPTO_PROBE_OPS	64
+#define CRYPTO_PROBE_LEN	64
+
+/*
+ * crypto_op - digest or encrypt len bytes of in with one backend of
+ * a primitive, the way pppd does it: with a context of its own.
+ * Calls the implementation directly, so that a backend that doesn't
+ * work can be passed over without logging errors.
+ */
+static int
+crypto_op(struct ppp_crypto_prim *prim, int backend,
+          const unsigned char *in, int len, unsigned char *out)
+{
+    static const unsigned char key[8] = "pppdkey";
+    int ret = 0, outl;
+    unsigned int mdlen = 64;
+
+    if (prim->md[backend]) {
+        PPP_MD_CTX *ctx = PPP_MD_CTX_new();
+        if (ctx) {
+            ctx->md = *prim->md[backend];
+            ret = ctx->md.init_fn(ctx)
+                && ctx->md.update_fn(ctx, in, len)
+                && ctx->md.final_fn(ctx, out, &mdlen);
+            PPP_MD_CTX_free(ctx);
+        }
+    } else if (prim->cipher[backend]) {
+        PPP_CIPHER_CTX *ctx = PPP_CIPHER_CTX_new();
+        if (ctx) {
+            ctx->cipher = *prim->cipher[backend];
+            ctx->is_encr = 1;
+            ret = ctx->cipher.init_fn(ctx, key, NULL)
+                && ctx->cipher.update_fn(ctx, out, &outl, in, len & ~7)
+                && ctx->cipher.final_fn(ctx, out + outl, &outl);
+            PPP_CIPHER_CTX_free(ctx);
+        }
+    }
+    return ret;
+}
+
+static double
+crypto_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * crypto_time - seconds per operation on len bytes with one backend
+ * of a primitive, the best of three runs of n, or -1 if the backend
+ * is missing or fails.
+ */
+static double
+crypto_time(struct ppp_crypto_prim *prim, int backend, int len, int n)
+{
+    unsigned char *in, out[1600];
+    double t0, t, best = -1;
+    int i, run;
+
+    if (!prim->md[backend] && !prim->cipher[backend])
+        return -1;
+    in = calloc(1, len);
+    if (in == NULL)
+        return -1;
+    for (run = 0; run < 3; ++run) {
+        t0 = crypto_now();
+        for (i = 0; i < n; ++i)
+            if (!crypto_op(prim, backend, in, len, out))
+                goto fail;
+        t = (crypto_now() - t0) / n;
+        if (best < 0 || t < best)
+            best = t;
+    }
+    free(in);
+    return best;
+
+ fail:
+    free(in);
+    return -1;
+}
+
+/*
+ * crypto_works - check that a backend gives the same answer as the
+ * builtin one.
+ */
+static int
+crypto_works(struct ppp_crypto_prim *prim, int backend)
+{
+    unsigned char in[CRYPTO_PROBE_LEN], out[64], expect[64];
+    int i;
+
+    for (i = 0; i < sizeof(in); ++i)
+        in[i] = i;
+    memset(out, 0, sizeof(out));
+    memset(expect, 0, sizeof(expect));
+    return crypto_op(prim, backend, in, sizeof(in), out)
+        && crypto_op(prim, PPP_CRYPTO_BUILTIN, in, sizeof(in), expect)
+        && memcmp(out, expect, sizeof(out)) == 0;
+}
+
+/*
+ * crypto_select - use the fastest working backend for a primitive.
+ */
+static void
+crypto_select(struct ppp_crypto_prim *prim)
+{
+    double t, best = -1;
+    int b;
+
+    for (b = 0; b < PPP_CRYPTO_NBACKENDS; ++b) {
+        if (b != PPP_CRYPTO_BUILTIN && !crypto_works(prim, b))
+            continue;
+        t = crypto_time(prim, b, CRYPTO_PROBE_LEN, CRYPTO_PROBE_OPS);
+        if (t >= 0 && (best < 0 || t < best)) {
+            best = t;
+            prim->used = b;
+        }
+    }
+}
+
+/*
+ * crypto_use - use the named backend, or the fastest for "auto",
+ * for one primitive.  Returns 0 if it isn't available.
+ */
+static int
+crypto_use(struct ppp_crypto_prim *prim, const char *backend)
+{
+    int b;
+
+    if (strcmp(backend, "auto") == 0) {
+        crypto_select(prim);
+        return 1;
+    }
+    for (b = 0; b < PPP_CRYPTO_NBACKENDS; ++b) {
+        if (strcmp(backend, crypto_backends[b]) == 0
+            && (prim->md[b] || prim->cipher[b])
+            && (b == PPP_CRYPTO_BUILTIN || crypto_works(prim, b))) {
+            prim->used = b;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int PPP_crypto_set_backend(const char *spec)
+{
+    char buf[128], *item, *next, *backend;
+    int i, ok, any;
+
+    if (strlen(spec) >= sizeof(buf))
+        return 0;
+    strcpy(buf, spec);
+
+    for (item = buf; item != NULL; item = next) {
+        next = strchr(item, ',');
+        if (next != NULL)
+            *next++ = 0;
+        backend = strchr(item, '=');
+        if (backend != NULL) {
+            *backend++ = 0;
+            for (i = 0; crypto_prims[i] != NULL; ++i)
+                if (strcmp(item, crypto_prims[i]->name) == 0)
+                    break;
+            if (crypto_prims[i] == NULL || !crypto_use(crypto_prims[i], backend))
+                return 0;
+        } else {
+            /* all the primitives that have it */
+            for (i = any = 0; crypto_prims[i] != NULL; ++i) {
+                ok = crypto_use(crypto_prims[i], item);
+                any |= ok;
+            }
+            if (!any)
+                return 0;
+        }
+    }
+    return 1;
+}
+
+const char *PPP_crypto_backend(const char *name)
+{
+    int i;
+
+    for (i = 0; crypto_prims[i] != NULL; ++i)
+        if (strcmp(name, crypto_prims[i]->name) == 0)
+            return crypto_backends[crypto_prims[i]->used];
+    return NULL;
+}
+
 int PPP_crypto_init()
 {
-    int retval = 0;
+    int i, retval = 0;
 
 #if OPENSSL_VERSION_NUMBER >= 0x30000000L
     g_crypto_ctx.legacy = OSSL_PROVIDER_load(NULL, "legacy");
@@ -216,6 +426,10 @@ int PPP_crypto_init()
     }
 #endif
 
+    /* Pick the fastest backend for each primitive */
+    for (i = 0; crypto_prims[i] != NULL; ++i)
+        crypto_select(crypto_prims[i]);
+
     retval = 1;
 
 done:
@@ -522,38 +736,180 @@ int test_des_decrypt()
     return success;
 }
 
+/*
+ * Digesting in pieces must give the same as all at once, whichever
+ * backend is in use.
+ */
+int test_md_pieces()
+{
+    static const PPP_MD *(*mds[])(void) = { PPP_md4, PPP_md5, PPP_sha1 };
+    static const int step[3] = { 1, 5, 64 };
+    unsigned char data[200], whole[64], pieces[64];
+    unsigned int len;
+    PPP_MD_CTX *ctx;
+    int i, j, k, n, cut, success = 1;
+
+    for (i = 0; i < sizeof(data); ++i)
+        data[i] = i * 7;
+
+    for (i = 0; i < 3; ++i) {
+        for (cut = 0; cut <= 130; cut += 13) {
+            ctx = PPP_MD_CTX_new();
+            len = sizeof(whole);
+            if (!ctx || !PPP_DigestInit(ctx, mds[i]())
+                || !PPP_DigestUpdate(ctx, data, sizeof(data))
+                || !PPP_DigestFinal(ctx, whole, &len))
+                success = 0;
+            PPP_MD_CTX_free(ctx);
+
+            /* cut, then the rest in 1, 5 and 64 byte pieces */
+            ctx = PPP_MD_CTX_new();
+            if (!ctx || !PPP_DigestInit(ctx, mds[i]())
+                || !PPP_DigestUpdate(ctx, data, cut))
+                success = 0;
+            for (j = cut, k = 0; j < sizeof(data); j += n, ++k) {
+                n = step[k % 3];
+                if (n > sizeof(data) - j)
+                    n = sizeof(data) - j;
+                PPP_DigestUpdate(ctx, data + j, n);
+            }
+            len = sizeof(pieces);
+            if (!PPP_DigestFinal(ctx, pieces, &len)
+                || memcmp(whole, pieces, len) != 0)
+                success = 0;
+            PPP_MD_CTX_free(ctx);
+        }
+    }
+    return success;
+}
+
+int test_set_backend()
+{
+    return PPP_crypto_set_backend("builtin")
+        && strcmp(PPP_crypto_backend("md4"), "builtin") == 0
+        && PPP_crypto_set_backend("md4=auto,des=builtin")
+        && strcmp(PPP_crypto_backend("des"), "builtin") == 0
+        && !PPP_crypto_set_backend("md4=nosuch")
+        && !PPP_crypto_set_backend("rot13=builtin")
+        && !PPP_crypto_set_backend("nosuch")
+        && PPP_crypto_backend("rot13") == NULL
+        && PPP_crypto_set_backend("auto");
+}
+
+static unsigned long long
+cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/*
+ * bench - operations per second and cycles per byte (of the time
+ * stamp counter, where there is one) for each primitive and backend,
+ * at the sizes pppd hashes: password hashes, CHAP and EAP values,
+ * and whole packets.
+ */
+static void
+bench(void)
+{
+    static const int sizes[] = { 16, 64, 256, 1496 };
+    struct ppp_crypto_prim *prim;
+    unsigned long long c0;
+    double t, cpb;
+    int i, b, k, n;
+
+    printf("%-5s %-8s %6s %12s %10s\n",
+           "", "backend", "bytes", "ops/s", "cycles/B");
+    for (i = 0; (prim = crypto_prims[i]) != NULL; ++i) {
+        for (b = 0; b < PPP_CRYPTO_NBACKENDS; ++b) {
+            if (!prim->md[b] && !prim->cipher[b])
+                continue;
+            for (k = 0; k < sizeof(sizes) / sizeof(sizes[0]); ++k) {
+                n = 20000 / (1 + sizes[k] / 64);
+                c0 = cycles();
+                t = crypto_time(prim, b, sizes[k], n);
+                cpb = (double) (cycles() - c0) / (3 * n) / sizes[k];
+                if (t < 0) {
+                    printf("%-5s %-8s %6d %12s\n", prim->name,
+                           crypto_backends[b], sizes[k], "failed");
+                    continue;
+                }
+                printf("%-5s %-8s %6d %12.0f", prim->name,
+                       crypto_backends[b], sizes[k], 1 / t);
+                if (cpb > 0)
+                    printf(" %10.1f\n", cpb);
+                else
+                    printf(" %10s\n", "-");
+            }
+        }
+    }
+
+    printf("auto:");
+    for (i = 0; (prim = crypto_prims[i]) != NULL; ++i) {
+        crypto_select(prim);
+        printf(" %s=%s", prim->name, crypto_backends[prim->used]);
+    }
+    printf("\n");
+}
+
 int main(int argc, char *argv[])
 {
     int failure = 0;
+    int b;
 
     if (!PPP_crypto_init()) {
         printf("Couldn't initialize crypto test\n");
         return -1;
     }
 
-    if (!test_md4()) {
-        printf("MD4 test failed\n");
-        failure++;
+    if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+        bench();
+        PPP_crypto_deinit();
+        return 0;
     }
 
-    if (!test_md5()) {
-        printf("MD5 test failed\n");
+    if (!test_set_backend()) {
+        printf("Choosing crypto backends failed\n");
         failure++;
     }
 
-    if (!test_sha()) {
-        printf("SHA test failed\n");
-        failure++;
-    }
+    /* Run the known answer tests with each backend */
+    for (b = 0; b < PPP_CRYPTO_NBACKENDS; ++b) {
+        if (!PPP_crypto_set_backend(crypto_backends[b]))
+            continue;
 
-    if (!test_des_encrypt()) {
-        printf("DES encryption test failed\n");
-        failure++;
-    }
+        if (!test_md4()) {
+            printf("MD4 test failed (%s)\n", crypto_backends[b]);
+            failure++;
+        }
 
-    if (!test_des_decrypt()) {
-        printf("DES decryption test failed\n");
-        failure++;
+        if (!test_md5()) {
+            printf("MD5 test failed (%s)\n", crypto_backends[b]);
+            failure++;
+        }
+
+        if (!test_sha()) {
+            printf("SHA test failed (%s)\n", crypto_backends[b]);
+            failure++;
+        }
+
+        if (!test_md_pieces()) {
+            printf("Digest in pieces test failed (%s)\n", crypto_backends[b]);
+            failure++;
+        }
+
+        if (!test_des_encrypt()) {
+            printf("DES encryption test failed (%s)\n", crypto_backends[b]);
+            failure++;
+        }
+
+        if (!test_des_decrypt()) {
+            printf("DES decryption test failed (%s)\n", crypto_backends[b]);
+            failure++;
+        }
     }
 
     if (!PPP_crypto_deinit()) {
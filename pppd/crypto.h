@@ -152,10 +152,35 @@ int PPP_CipherFinal(PPP_CIPHER_CTX *ctx,
 void PPP_crypto_error(char *fmt, ...);
 
 /*
- * Global initialization, must be called once per process
+ * Hash n separate messages at once, the i'th digest going to out[i].
+ * Faster than one context per message when the messages are short.
+ */
+void PPP_md4_mb(int n, const unsigned char *const *data, const size_t *len,
+        unsigned char (*out)[MD4_DIGEST_LENGTH]);
+void PPP_sha1_mb(int n, const unsigned char *const *data, const size_t *len,
+        unsigned char (*out)[SHA_DIGEST_LENGTH]);
+
+/*
+ * Global initialization, must be called once per process.  Times the
+ * builtin and OpenSSL implementations of each primitive and uses the
+ * faster.
  */
 int PPP_crypto_init();
 
+/*
+ * Choose the implementations used: "builtin", "openssl" or "auto"
+ * (the fastest) for all the primitives, or for some with e.g.
+ * "md4=builtin,sha1=openssl".  Returns 0 if spec isn't valid or
+ * names a backend that isn't available.
+ */
+int PPP_crypto_set_backend(const char *spec);
+
+/*
+ * The name of the backend in use for primitive "md4", "md5", "sha1"
+ * or "des", or NULL.
+ */
+const char *PPP_crypto_backend(const char *name);
+
 /*
  * Global deinitialization
  */
@@ -37,6 +37,7 @@
 #endif
 
 #include <stddef.h>
+#include <string.h>
 
 #include "crypto.h"
 #include "crypto_ms.h"
@@ -180,6 +181,30 @@ DesDecrypt(const unsigned char *cipher, const unsigned char *key, unsigned char
 	return (retval);
 }
 
+int
+DesEncryptBatch(int n, const unsigned char *clear, const unsigned char *key,
+        unsigned char *cipher)
+{
+    int i, retval = 1;
+    int clen = 0;
+    unsigned char des_key[8];
+
+    /* One context for the lot, re-keyed for each block */
+    PPP_CIPHER_CTX *ctx = PPP_CIPHER_CTX_new();
+    if (!ctx)
+        return 0;
+
+    for (i = 0; i < n && retval; ++i) {
+        MakeKey(key + 7 * i, des_key);
+        retval = PPP_CipherInit(ctx, PPP_des_ecb(), des_key, NULL, 1)
+            && PPP_CipherUpdate(ctx, cipher + 8 * i, &clen, clear + 8 * i, 8);
+    }
+
+    memset(des_key, 0, sizeof(des_key));
+    PPP_CIPHER_CTX_free(ctx);
+    return retval;
+}
+
 #ifdef UNIT_TEST_MSCRYPTO
 
 #include <string.h>
@@ -76,6 +76,25 @@ int DesEncrypt(const unsigned char *clear, const unsigned char *key,
 int DesDecrypt(const unsigned char *cipher, const unsigned char *key,
         unsigned char *clear);
 
+/**
+ * DES encrypt n blocks, each under a key of its own, sharing one cipher
+ * context between them.
+ *
+ * Parameters:
+ * const unsigned char *clear:
+ *      n 8 byte blocks to be encrypted
+ *
+ * const unsigned char *key:
+ *      n raw 7-byte keys, laid end to end, and one byte of padding
+ *
+ * unsigned char *cipher:
+ *      Space for the n 8 byte output blocks
+ *
+ * DesEncryptBatch returns 1 on success
+ */
+int DesEncryptBatch(int n, const unsigned char *clear,
+        const unsigned char *key, unsigned char *cipher);
+
 #ifdef __cplusplus
 }
 #endif
@@ -73,7 +73,19 @@ struct packet {
 struct packet *pend_q;
 struct packet *pend_qtail;
 
+/*
+ * Packet buffers are framemax bytes long so that they can be
+ * kept on a free list and reused rather than being allocated
+ * and freed for every packet we queue.
+ */
+#define MAX_FREE_PACKETS	32
+
+static struct packet *free_q;	/* buffers available for reuse */
+static int n_free;		/* # buffers on free_q */
+
 static int active_packet(unsigned char *, int);
+static struct packet *alloc_packet(int);
+static void free_packet(struct packet *);
 
 /*
  * demand_conf - configure the interface for doing dial-on-demand.
@@ -150,7 +162,7 @@ demand_discard(void)
     /* discard all saved packets */
     for (pkt = pend_q; pkt != NULL; pkt = nextpkt) {
 	nextpkt = pkt->next;
-	free(pkt);
+	free_packet(pkt);
     }
     pend_q = NULL;
     framelen = 0;
@@ -280,7 +292,7 @@ loop_frame(unsigned char *frame, int len)
     if (!active_packet(frame, len))
 	return 0;
 
-    pkt = (struct packet *) malloc(sizeof(struct packet) + len);
+    pkt = alloc_packet(len);
     if (pkt != NULL) {
 	pkt->length = len;
 	pkt->next = NULL;
@@ -310,7 +322,7 @@ demand_rexmit(int proto)
 	nextpkt = pkt->next;
 	if (PPP_PROTOCOL(pkt->data) == proto) {
 	    output(0, pkt->data, pkt->length);
-	    free(pkt);
+	    free_packet(pkt);
 	} else {
 	    if (prev == NULL)
 		pend_q = pkt;
@@ -324,6 +336,38 @@ demand_rexmit(int proto)
 	prev->next = NULL;
 }
 
+/*
+ * alloc_packet - get a buffer for a queued packet of len bytes.
+ */
+static struct packet *
+alloc_packet(int len)
+{
+    struct packet *pkt;
+
+    if (len <= framemax && (pkt = free_q) != NULL) {
+	free_q = pkt->next;
+	--n_free;
+	return pkt;
+    }
+    return (struct packet *) malloc(sizeof(struct packet)
+				    + (len > framemax? len: framemax));
+}
+
+/*
+ * free_packet - put a packet buffer back on the free list.
+ */
+static void
+free_packet(struct packet *pkt)
+{
+    if (pkt->length > framemax || n_free >= MAX_FREE_PACKETS) {
+	free(pkt);
+	return;
+    }
+    pkt->next = free_q;
+    free_q = pkt;
+    ++n_free;
+}
+
 /*
  * Scan a packet to decide whether it is an "active" packet,
  * that is, whether it is worth bringing up the link for.
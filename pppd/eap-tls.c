@@ -387,7 +387,8 @@ SSL_CTX *eaptls_init_ssl(int init_server, char *cacertfile, char *capath,
 
     SSL_CTX_set_default_passwd_cb (ctx, password_callback);
 
-    if (tls_set_ca(ctx, capath, cacertfile) != 0) {
+    /* The CA certificates and CRLs, shared with other contexts */
+    if (tls_set_store(ctx, capath, cacertfile, crl_dir, crl_file) != 0) {
         goto fail;
     }
 
@@ -595,11 +596,6 @@ SSL_CTX *eaptls_init_ssl(int init_server, char *cacertfile, char *capath,
         goto fail;
     }
 
-    /* Configure CRL check (if any) */
-    if (tls_set_crl(ctx, crl_dir, crl_file)) {
-        goto fail;
-    }
-
     return ctx;
 
 fail:
@@ -618,6 +614,38 @@ fail:
     return NULL;
 }
 
+static SSL_CTX *eaptls_build_ssl_ctx(const struct tls_ctx_conf *conf)
+{
+    return eaptls_init_ssl(conf->server, (char *) conf->ca_file,
+            (char *) conf->ca_dir, (char *) conf->cert_file,
+            (char *) conf->pkey_file, (char *) conf->pkcs12_file);
+}
+
+/*
+ * Return an SSL context for these files, shared with other sessions
+ * using the same ones.  The caller gets its own reference, which it
+ * drops with SSL_CTX_free as usual.
+ */
+static SSL_CTX *eaptls_get_ssl_ctx(int init_server, char *cacertfile,
+            char *capath, char *certfile, char *privkeyfile, char *pkcs12)
+{
+    struct tls_ctx_conf conf;
+
+    memset(&conf, 0, sizeof(conf));
+    conf.name = "EAP-TLS";
+    conf.server = init_server;
+    conf.ca_file = cacertfile;
+    conf.ca_dir = capath;
+    conf.cert_file = certfile;
+    conf.pkey_file = privkeyfile;
+    conf.pkcs12_file = pkcs12;
+    conf.crl_dir = crl_dir;
+    conf.crl_file = crl_file;
+    conf.max_version = max_tls_version;
+    conf.passwd = passwd;
+    return tls_get_ctx(&conf, eaptls_build_ssl_ctx);
+}
+
 /*
  * Determine the maximum packet size by looking at the LCP handshake
  */
@@ -677,7 +705,7 @@ int eaptls_init_ssl_server(eap_state * esp)
 
     ets->mtu = eaptls_get_mtu(esp->es_unit);
 
-    ets->ctx = eaptls_init_ssl(1, cacertfile, capath, servcertfile, pkfile, pkcs12);
+    ets->ctx = eaptls_get_ssl_ctx(1, cacertfile, capath, servcertfile, pkfile, pkcs12);
     if (!ets->ctx)
         goto fail;
 
@@ -715,6 +743,7 @@ int eaptls_init_ssl_server(eap_state * esp)
 
 fail:
     SSL_CTX_free(ets->ctx);
+    ets->ctx = NULL;
     return 0;
 }
 
@@ -749,8 +778,8 @@ int eaptls_init_ssl_client(eap_state * esp)
         return 0;
     }
 
-    dbglog( "calling eaptls_init_ssl" );
-    ets->ctx = eaptls_init_ssl(0, cacertfile, capath, clicertfile, pkfile, pkcs12);
+    dbglog( "calling eaptls_get_ssl_ctx" );
+    ets->ctx = eaptls_get_ssl_ctx(0, cacertfile, capath, clicertfile, pkfile, pkcs12);
     if (!ets->ctx)
         goto fail;
 
@@ -785,6 +814,7 @@ int eaptls_init_ssl_client(eap_state * esp)
 fail:
     dbglog( "eaptls_init_ssl_client: fail" );
     SSL_CTX_free(ets->ctx);
+    ets->ctx = NULL;
     return 0;
 
 }
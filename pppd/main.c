@@ -89,6 +89,7 @@
 #include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
+#include <poll.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <limits.h>
@@ -186,6 +187,17 @@ static int sigpipe[2];
 
 char **script_env;		/* Env. variable values for scripts */
 int s_env_nalloc;		/* # words avail at script_env */
+static int s_env_nvars;		/* # variables in script_env */
+static int *s_env_hash;		/* hash index from name to script_env slot */
+static int s_env_hsize;		/* # buckets in s_env_hash, a power of 2 */
+static int s_env_hused;		/* # buckets used, including deleted ones */
+#ifdef PPP_WITH_TDB
+static char *s_env_dbuf;	/* script_env serialized for the database */
+static int s_env_dlen;		/* length of the serialized script_env */
+static int s_env_dalloc;	/* # bytes avail at s_env_dbuf */
+static bool s_env_dvalid;	/* s_env_dbuf is up to date */
+static int *s_env_doff;		/* where each variable is in s_env_dbuf */
+#endif
 
 u_char outpacket_buf[PPP_MRU+PPP_HDRLEN]; /* buffer for outgoing packet */
 u_char inpacket_buf[PPP_MRU+PPP_HDRLEN]; /* buffer for incoming packet */
@@ -237,6 +249,7 @@ static void cleanup(void);
 static void get_input(void);
 static void calltimeout(void);
 static struct timeval *timeleft(struct timeval *);
+static void call_fd_handlers(void);
 static void kill_my_pg(int);
 static void hup(int);
 static void term(int);
@@ -365,6 +378,7 @@ main(int argc, char *argv[])
 
     strlcpy(path_upapfile, PPP_PATH_UPAPFILE, MAXPATHLEN);
     strlcpy(path_chapfile, PPP_PATH_CHAPFILE, MAXPATHLEN);
+    strlcpy(path_nthashfile, PPP_PATH_NTHASHFILE, MAXPATHLEN);
 
     strlcpy(path_net_init, PPP_PATH_NET_INIT, MAXPATHLEN);
     strlcpy(path_net_preup, PPP_PATH_NET_PREUP, MAXPATHLEN);
@@ -694,6 +708,7 @@ handle_events(void)
     waiting = 0;
     remove_fd(sigpipe[0]);
 
+    call_fd_handlers();
     calltimeout();
     if (got_sighup) {
 	info("Hangup (SIGHUP)");
@@ -1399,6 +1414,7 @@ struct	callout {
 };
 
 static struct callout *callout = NULL;	/* Callout list */
+static struct callout *callout_free;	/* Unused callouts for reuse */
 static struct timeval timenow;		/* Current time */
 
 /*
@@ -1410,9 +1426,11 @@ ppp_timeout(void (*func)(void *), void *arg, int secs, int usecs)
     struct callout *newp, *p, **pp;
 
     /*
-     * Allocate timeout.
+     * Allocate timeout, reusing an old one if we can.
      */
-    if ((newp = (struct callout *) malloc(sizeof(struct callout))) == NULL)
+    if ((newp = callout_free) != NULL)
+	callout_free = newp->c_next;
+    else if ((newp = (struct callout *) malloc(sizeof(struct callout))) == NULL)
 	fatal("Out of memory in timeout()!");
     newp->c_arg = arg;
     newp->c_func = func;
@@ -1451,7 +1469,8 @@ ppp_untimeout(void (*func)(void *), void *arg)
     for (copp = &callout; (freep = *copp); copp = &freep->c_next)
 	if (freep->c_func == func && freep->c_arg == arg) {
 	    *copp = freep->c_next;
-	    free((char *) freep);
+	    freep->c_next = callout_free;
+	    callout_free = freep;
 	    break;
 	}
 }
@@ -1478,7 +1497,8 @@ calltimeout(void)
 	callout = p->c_next;
 	(*p->c_func)(p->c_arg);
 
-	free((char *) p);
+	p->c_next = callout_free;
+	callout_free = p;
     }
 }
 
@@ -1506,6 +1526,108 @@ timeleft(struct timeval *tvp)
 }
 
 
+/*
+ * Functions that plugins want called when an fd becomes readable.
+ */
+struct fd_handler {
+    int			fd;
+    ppp_fd_handler_fn	*func;
+    void		*arg;
+};
+
+static struct fd_handler *fd_handlers;
+static struct pollfd *fd_polls;		/* grown alongside fd_handlers */
+static int n_fd_handlers, max_fd_handlers;
+
+/*
+ * ppp_add_fd_handler - have func(fd, arg) called from the main loop
+ * whenever fd is readable.  A later call for the same fd replaces the
+ * handler.  Returns 0, or -1 if we ran out of memory or the main loop
+ * can't wait for any more fds (or for this one).
+ */
+int
+ppp_add_fd_handler(int fd, ppp_fd_handler_fn *func, void *arg)
+{
+    struct fd_handler *h;
+    struct pollfd *p;
+    int i;
+
+    for (i = 0; i < n_fd_handlers; ++i)
+	if (fd_handlers[i].fd == fd)
+	    break;
+    if (i == n_fd_handlers) {
+	if (n_fd_handlers >= max_fd_handlers) {
+	    h = realloc(fd_handlers, (max_fd_handlers + 8) * sizeof(*h));
+	    if (h == NULL)
+		return -1;
+	    fd_handlers = h;
+	    p = realloc(fd_polls, (max_fd_handlers + 8) * sizeof(*p));
+	    if (p == NULL)
+		return -1;
+	    fd_polls = p;
+	    max_fd_handlers += 8;
+	}
+	if (try_add_fd(fd) < 0) {
+	    error("Can't wait for input on fd %d", fd);
+	    return -1;
+	}
+	++n_fd_handlers;
+    }
+    fd_handlers[i].fd = fd;
+    fd_handlers[i].func = func;
+    fd_handlers[i].arg = arg;
+    return 0;
+}
+
+/*
+ * ppp_remove_fd_handler - stop watching fd.
+ */
+void
+ppp_remove_fd_handler(int fd)
+{
+    int i;
+
+    for (i = 0; i < n_fd_handlers; ++i) {
+	if (fd_handlers[i].fd == fd) {
+	    fd_handlers[i] = fd_handlers[--n_fd_handlers];
+	    remove_fd(fd);
+	    break;
+	}
+    }
+}
+
+/*
+ * call_fd_handlers - call the handlers for any fds that are readable.
+ * A handler may add or remove handlers, so we look each one up again
+ * before calling it, and don't hold on to fd_polls, which may move.
+ */
+static void
+call_fd_handlers(void)
+{
+    int i, j, n;
+
+    n = n_fd_handlers;
+    if (n <= 0)
+	return;
+    for (i = 0; i < n; ++i) {
+	fd_polls[i].fd = fd_handlers[i].fd;
+	fd_polls[i].events = POLLIN;
+	fd_polls[i].revents = 0;
+    }
+    if (poll(fd_polls, n, 0) <= 0)
+	return;
+    for (i = 0; i < n; ++i) {
+	if (fd_polls[i].revents == 0)
+	    continue;
+	for (j = 0; j < n_fd_handlers; ++j) {
+	    if (fd_handlers[j].fd == fd_polls[i].fd) {
+		(*fd_handlers[j].func)(fd_polls[i].fd, fd_handlers[j].arg);
+		break;
+	    }
+	}
+    }
+}
+
 /*
  * kill_my_pg - send a signal to our process group, and ignore it ourselves.
  * We assume that sig is currently blocked.
@@ -1756,30 +1878,223 @@ ppp_safe_fork(int infd, int outfd, int errfd)
 	return 0;
 }
 
+/*
+ * The script environment is kept as a NULL-terminated array which can
+ * be handed straight to execve, together with an open-addressed hash
+ * table mapping each variable name to its slot in the array.  Setting
+ * a variable that already exists replaces it in its slot; removing a
+ * variable moves the last one into the hole, so the array never has
+ * to be shifted or searched.
+ */
+#define ENV_EMPTY	(-1)	/* hash bucket never used */
+#define ENV_DELETED	(-2)	/* hash bucket whose variable was removed */
+
+static unsigned int
+env_hash(const char *name, int len)
+{
+    unsigned int h = 2166136261U;	/* FNV-1a */
+
+    while (len-- > 0)
+	h = (h ^ (unsigned char) *name++) * 16777619U;
+    return h;
+}
+
+/*
+ * env_find - look up variable `var' (of length varl) in script_env.
+ * Returns its index, or -1 if it isn't set.  *bucketp is set to the
+ * hash bucket that refers to it, or where it should be inserted.
+ */
+static int
+env_find(const char *var, int varl, int *bucketp)
+{
+    unsigned int mask = s_env_hsize - 1;
+    unsigned int b = env_hash(var, varl) & mask;
+    int i, avail = -1;
+    char *p;
+
+    for (;; b = (b + 1) & mask) {
+	i = s_env_hash[b];
+	if (i == ENV_EMPTY)
+	    break;
+	if (i == ENV_DELETED) {
+	    if (avail < 0)
+		avail = b;
+	    continue;
+	}
+	p = script_env[i];
+	if (strncmp(p, var, varl) == 0 && p[varl] == '=') {
+	    *bucketp = b;
+	    return i;
+	}
+    }
+    *bucketp = avail >= 0? avail: b;
+    return -1;
+}
+
+/*
+ * env_reserve - make sure there is room for one more variable
+ * in script_env and its hash index.
+ */
 static bool
-add_script_env(int pos, char *newstring)
+env_reserve(void)
 {
-    if (pos + 1 >= s_env_nalloc) {
-	int new_n = pos + 17;
-	char **newenv = realloc(script_env, new_n * sizeof(char *));
-	if (newenv == NULL) {
-	    free(newstring - 1);
+    int i, n, size;
+    unsigned int b, mask;
+    char *p;
+
+    if (s_env_nvars + 2 > s_env_nalloc) {
+	int new_n = s_env_nvars + 18;
+	char **newenv;
+#ifdef PPP_WITH_TDB
+	int *newoff = realloc(s_env_doff, new_n * sizeof(int));
+	if (newoff == NULL)
 	    return 0;
-	}
+	s_env_doff = newoff;
+#endif
+	newenv = realloc(script_env, new_n * sizeof(char *));
+	if (newenv == NULL)
+	    return 0;
+	if (script_env == NULL)
+	    newenv[0] = NULL;
 	script_env = newenv;
 	s_env_nalloc = new_n;
     }
+    if (2 * (s_env_hused + 1) <= s_env_hsize)
+	return 1;
+
+    /* grow the table (or just clear out deleted buckets) */
+    for (size = 32; size < 4 * (s_env_nvars + 1); size <<= 1)
+	;
+    free(s_env_hash);
+    s_env_hash = malloc(size * sizeof(int));
+    if (s_env_hash == NULL) {
+	s_env_hsize = s_env_hused = 0;
+	return 0;
+    }
+    for (b = 0; b < size; ++b)
+	s_env_hash[b] = ENV_EMPTY;
+    mask = size - 1;
+    for (i = 0; (p = script_env[i]) != NULL; ++i) {
+	n = strchr(p, '=') - p;
+	for (b = env_hash(p, n) & mask; s_env_hash[b] != ENV_EMPTY;
+	     b = (b + 1) & mask)
+	    ;
+	s_env_hash[b] = i;
+    }
+    s_env_hsize = size;
+    s_env_hused = s_env_nvars;
+    return 1;
+}
+
+/*
+ * env_add - append newstring to script_env, using the hash
+ * bucket found by env_find.
+ */
+static void
+env_add(int bucket, char *newstring)
+{
+    int pos = s_env_nvars++;
+
     script_env[pos] = newstring;
     script_env[pos + 1] = NULL;
-    return 1;
+    if (s_env_hash[bucket] == ENV_EMPTY)
+	++s_env_hused;
+    s_env_hash[bucket] = pos;
+#ifdef PPP_WITH_TDB
+    if (s_env_dvalid) {
+	/* extend the serialized form rather than rebuilding it */
+	int len = strlen(newstring);
+
+	if (s_env_dlen + len + 2 > s_env_dalloc) {
+	    s_env_dvalid = 0;
+	} else {
+	    s_env_doff[pos] = s_env_dlen;
+	    memcpy(s_env_dbuf + s_env_dlen, newstring, len);
+	    s_env_dbuf[s_env_dlen + len] = ';';
+	}
+    }
+    s_env_dlen += strlen(newstring) + 1;
+#endif
 }
 
+#ifdef PPP_WITH_TDB
+/*
+ * env_patch_db - replace olen bytes of the serialized form, where the
+ * variable in slot pos starts, with the nlen bytes at str, moving the
+ * rest up or down.  We leave the caller to update s_env_dlen.
+ */
+static void
+env_patch_db(int pos, int olen, const char *str, int nlen)
+{
+    int off = s_env_doff[pos];
+    int delta = nlen - olen;
+    int i;
+
+    if (s_env_dlen + delta + 1 > s_env_dalloc) {
+	s_env_dvalid = 0;
+	return;
+    }
+    if (delta != 0) {
+	memmove(s_env_dbuf + off + nlen, s_env_dbuf + off + olen,
+		s_env_dlen - off - olen);
+	for (i = 0; i < s_env_nvars; ++i)
+	    if (s_env_doff[i] > off)
+		s_env_doff[i] += delta;
+    }
+    if (nlen > 0)
+	memcpy(s_env_dbuf + off, str, nlen);
+}
+#endif
+
+/*
+ * env_replace - replace the variable in slot pos with newstring.
+ */
+static void
+env_replace(int pos, char *newstring)
+{
+#ifdef PPP_WITH_TDB
+    int olen = strlen(script_env[pos]);
+    int nlen = strlen(newstring);
+
+    if (s_env_dvalid)
+	env_patch_db(pos, olen, newstring, nlen);
+    s_env_dlen += nlen - olen;
+#endif
+    free(script_env[pos] - 1);
+    script_env[pos] = newstring;
+}
+
+/*
+ * env_remove - remove the variable in slot pos, referred to by
+ * hash bucket `bucket', filling the hole with the last variable.
+ */
 static void
-remove_script_env(int pos)
+env_remove(int pos, int bucket)
 {
+    int last = s_env_nvars - 1;
+    int b;
+    char *p;
+
+#ifdef PPP_WITH_TDB
+    int len = strlen(script_env[pos]) + 1;	/* with its ';' */
+
+    if (s_env_dvalid)
+	env_patch_db(pos, len, NULL, 0);
+    s_env_dlen -= len;
+#endif
+    s_env_nvars = last;
     free(script_env[pos] - 1);
-    while ((script_env[pos] = script_env[pos + 1]) != NULL)
-	pos++;
+    s_env_hash[bucket] = ENV_DELETED;
+    if (pos != last) {
+	p = script_env[last];
+	script_env[pos] = p;
+#ifdef PPP_WITH_TDB
+	s_env_doff[pos] = s_env_doff[last];
+#endif
+	if (env_find(p, strchr(p, '=') - p, &b) == last)
+	    s_env_hash[b] = pos;
+    }
+    script_env[last] = NULL;
 }
 
 /*
@@ -1876,14 +2191,13 @@ update_script_environment(void)
     struct userenv *uep;
 
     for (uep = userenv_list; uep != NULL; uep = uep->ue_next) {
-	int i;
-	char *p, *newstring;
+	int i, b;
+	char *newstring;
 	int nlen = strlen(uep->ue_name);
 
-	for (i = 0; (p = script_env[i]) != NULL; i++) {
-	    if (strncmp(p, uep->ue_name, nlen) == 0 && p[nlen] == '=')
-		break;
-	}
+	if (!env_reserve())
+	    continue;
+	i = env_find(uep->ue_name, nlen, &b);
 	if (uep->ue_isset) {
 	    nlen += strlen(uep->ue_value) + 2;
 	    newstring = malloc(nlen + 1);
@@ -1891,12 +2205,12 @@ update_script_environment(void)
 		continue;
 	    *newstring++ = 0;
 	    slprintf(newstring, nlen, "%s=%s", uep->ue_name, uep->ue_value);
-	    if (p != NULL)
-		script_env[i] = newstring;
+	    if (i >= 0)
+		env_replace(i, newstring);
 	    else
-		add_script_env(i, newstring);
-	} else if (p != NULL) {
-	    remove_script_env(i);
+		env_add(b, newstring);
+	} else if (i >= 0) {
+	    env_remove(i, b);
 	}
     }
 }
@@ -2177,8 +2491,8 @@ ppp_script_setenv(char *var, char *value, int iskey)
 {
     size_t varl = strlen(var);
     size_t vl = varl + strlen(value) + 2;
-    int i;
-    char *p, *newstring;
+    int i, b;
+    char *newstring;
 
     newstring = (char *) malloc(vl+1);
     if (newstring == 0)
@@ -2186,40 +2500,23 @@ ppp_script_setenv(char *var, char *value, int iskey)
     *newstring++ = iskey;
     slprintf(newstring, vl, "%s=%s", var, value);
 
+    if (!env_reserve()) {
+	free(newstring - 1);
+	return;
+    }
+
     /* check if this variable is already set */
-    if (script_env != 0) {
-	for (i = 0; (p = script_env[i]) != 0; ++i) {
-	    if (strncmp(p, var, varl) == 0 && p[varl] == '=') {
+    i = env_find(var, varl, &b);
+    if (i >= 0) {
 #ifdef PPP_WITH_TDB
-		if (p[-1] && pppdb != NULL)
-		    delete_db_key(p);
+	if (script_env[i][-1] && pppdb != NULL)
+	    delete_db_key(script_env[i]);
 #endif
-		free(p-1);
-		script_env[i] = newstring;
-#ifdef PPP_WITH_TDB
-		if (pppdb != NULL) {
-		    if (iskey)
-			add_db_key(newstring);
-		    update_db_entry();
-		}
-#endif
-		return;
-	    }
-	}
+	env_replace(i, newstring);
     } else {
-	/* no space allocated for script env. ptrs. yet */
-	i = 0;
-	script_env = malloc(16 * sizeof(char *));
-	if (script_env == 0) {
-	    free(newstring - 1);
-	    return;
-	}
-	s_env_nalloc = 16;
+	env_add(b, newstring);
     }
 
-    if (!add_script_env(i, newstring))
-	return;
-
 #ifdef PPP_WITH_TDB
     if (pppdb != NULL) {
 	if (iskey)
@@ -2236,21 +2533,19 @@ ppp_script_setenv(char *var, char *value, int iskey)
 void
 ppp_script_unsetenv(char *var)
 {
-    int vl = strlen(var);
-    int i;
-    char *p;
+    int i, b;
 
-    if (script_env == 0)
+    if (script_env == 0 || s_env_hsize == 0)
 	return;
-    for (i = 0; (p = script_env[i]) != 0; ++i) {
-	if (strncmp(p, var, vl) == 0 && p[vl] == '=') {
+    i = env_find(var, strlen(var), &b);
+    if (i >= 0) {
 #ifdef PPP_WITH_TDB
-	    if (p[-1] && pppdb != NULL)
-		delete_db_key(p);
+	char *p = script_env[i];
+
+	if (p[-1] && pppdb != NULL)
+	    delete_db_key(p);
 #endif
-	    remove_script_env(i);
-	    break;
-	}
+	env_remove(i, b);
     }
 #ifdef PPP_WITH_TDB
     if (pppdb != NULL)
@@ -2301,31 +2596,34 @@ static void
 update_db_entry(void)
 {
     TDB_DATA key, dbuf;
-    int vlen, i;
-    char *p, *q, *vbuf;
+    int i;
+    char *p, *q;
 
     if (script_env == NULL)
 	return;
-    vlen = 0;
-    for (i = 0; (p = script_env[i]) != 0; ++i)
-	vlen += strlen(p) + 1;
-    vbuf = malloc(vlen + 1);
-    if (vbuf == 0)
-	novm("database entry");
-    q = vbuf;
-    for (i = 0; (p = script_env[i]) != 0; ++i)
-	q += slprintf(q, vbuf + vlen - q, "%s;", p);
+    if (!s_env_dvalid) {
+	/* rebuild the serialized form, leaving room to append to it */
+	if (s_env_dlen + 1 > s_env_dalloc) {
+	    q = realloc(s_env_dbuf, 2 * s_env_dlen + 64);
+	    if (q == 0)
+		novm("database entry");
+	    s_env_dbuf = q;
+	    s_env_dalloc = 2 * s_env_dlen + 64;
+	}
+	q = s_env_dbuf;
+	for (i = 0; (p = script_env[i]) != 0; ++i) {
+	    s_env_doff[i] = q - s_env_dbuf;
+	    q += slprintf(q, s_env_dbuf + s_env_dalloc - q, "%s;", p);
+	}
+	s_env_dvalid = 1;
+    }
 
     key.dptr = db_key;
     key.dsize = strlen(db_key);
-    dbuf.dptr = vbuf;
-    dbuf.dsize = vlen;
+    dbuf.dptr = s_env_dbuf;
+    dbuf.dsize = s_env_dlen;
     if (tdb_store(pppdb, key, dbuf, TDB_REPLACE))
 	error("tdb_store failed: %s", tdb_errorstr(pppdb));
-
-    if (vbuf)
-        free(vbuf);
-
 }
 
 /*
@@ -44,6 +44,7 @@
 #include "pppd-private.h"
 #include "fsm.h"
 #include "lcp.h"
+#include "magic.h"
 #include "tdb.h"
 #include "multilink.h"
 
@@ -54,15 +55,55 @@ bool doing_multilink;		/* multilink was enabled and agreed to */
 bool multilink_master;		/* we own the multilink bundle */
 
 extern TDB_CONTEXT *pppdb;
-extern char db_key[];
+
+/*
+ * Bundles are recorded in the database as binary records rather
+ * than as text.  The record stored under blinks_id describes the
+ * bundle (its unit, the pid of the master pppd and the head of the
+ * list of member links), and each member link has its own record,
+ * keyed by its pid, which is threaded onto a doubly-linked list.
+ * This makes adding or removing a link a constant number of
+ * database operations however many links the bundle has.
+ * A secondary index maps the ppp unit number back to blinks_id.
+ * The epoch is a random value chosen when the bundle is created,
+ * so that link records left behind by an earlier incarnation of
+ * the same bundle are never spliced into the current list.
+ */
+#define MP_BUNDLE_MAGIC	0x4d504231	/* "MPB1" */
+#define MP_LINK_MAGIC	0x4d504c31	/* "MPL1" */
+
+struct mp_bundle_rec {
+	u_int32_t magic;
+	u_int32_t epoch;	/* identifies this instance of the bundle */
+	int	unit;		/* ppp unit number of the bundle */
+	int	master_pid;	/* pid of the pppd which owns the unit */
+	int	head;		/* pid of the first link, or 0 */
+	int	nlinks;		/* number of links on the list */
+};
+
+struct mp_link_rec {
+	u_int32_t magic;
+	u_int32_t epoch;	/* epoch of the bundle we belong to */
+	int	pid;		/* pid of the pppd for this link */
+	int	prev;		/* pid of the previous link, or 0 */
+	int	next;		/* pid of the next link, or 0 */
+};
 
 static void make_bundle_links(int append);
 static void remove_bundle_link(void);
-static void iterate_bundle_links(void (*func)(char *));
+static void iterate_bundle_links(void (*func)(int));
+
+static int get_bundle_rec(struct mp_bundle_rec *);
+static void put_bundle_rec(struct mp_bundle_rec *);
+static int get_link_rec(int pid, struct mp_link_rec *);
+static void put_link_rec(struct mp_link_rec *);
+static void delete_link_rec(int pid);
+static void set_unit_index(int unit);
+static void delete_unit_index(int unit);
 
 static int get_default_epdisc(struct epdisc *);
-static int parse_num(char *str, const char *key, int *valp);
-static int owns_unit(TDB_DATA pid, int unit);
+static int owns_unit(int unit, int pid);
+static int index_owns_unit(int unit);
 
 #define set_ip_epdisc(ep, addr) do {	\
 	ep->length = 4;			\
@@ -125,10 +166,10 @@ mp_join_bundle(void)
 	lcp_options *go = &lcp_gotoptions[0];
 	lcp_options *ho = &lcp_hisoptions[0];
 	lcp_options *ao = &lcp_allowoptions[0];
-	int unit, pppd_pid;
+	int unit;
 	int l, mtu;
 	char *p;
-	TDB_DATA key, pid, rec;
+	struct mp_bundle_rec brec;
 
 	if (doing_multilink) {
 		/* have previously joined a bundle */
@@ -174,6 +215,8 @@ mp_join_bundle(void)
 		l += 3 * ho->endpoint.length + 8;
 	if (bundle_name)
 		l += 3 * strlen(bundle_name) + 2;
+	free(bundle_id);	/* left over from a previous bundle */
+	free(blinks_id);
 	bundle_id = malloc(l);
 	if (bundle_id == 0)
 		novm("bundle identifier");
@@ -212,25 +255,12 @@ mp_join_bundle(void)
 	 */
 	unit = -1;
 	lock_db();
-	key.dptr = bundle_id;
-	key.dsize = p - bundle_id;
-	pid = tdb_fetch(pppdb, key);
-	if (pid.dptr != NULL) {
-		/* bundle ID exists, see if the pppd record exists */
-		rec = tdb_fetch(pppdb, pid);
-		if (rec.dptr != NULL && rec.dsize > 0) {
-			/* make sure the string is null-terminated */
-			rec.dptr[rec.dsize-1] = 0;
-			/* parse the interface number */
-			parse_num(rec.dptr, "UNIT=", &unit);
-			/* check the pid value */
-			if (!parse_num(rec.dptr, "PPPD_PID=", &pppd_pid)
-			    || !process_exists(pppd_pid)
-			    || !owns_unit(pid, unit))
-				unit = -1;
-			free(rec.dptr);
-		}
-		free(pid.dptr);
+	if (get_bundle_rec(&brec)) {
+		/* bundle exists, check that its master is still around */
+		unit = brec.unit;
+		if (unit < 0 || !process_exists(brec.master_pid)
+		    || !owns_unit(unit, brec.master_pid))
+			unit = -1;
 	}
 
 	if (unit >= 0) {
@@ -265,11 +295,9 @@ void mp_exit_bundle(void)
 	unlock_db();
 }
 
-static void sendhup(char *str)
+static void sendhup(int pid)
 {
-	int pid;
-
-	if (parse_num(str, "PPPD_PID=", &pid) && pid != getpid()) {
+	if (pid != getpid()) {
 		if (debug)
 			dbglog("sending SIGHUP to process %d", pid);
 		kill(pid, SIGHUP);
@@ -279,6 +307,7 @@ static void sendhup(char *str)
 void mp_bundle_terminated(void)
 {
 	TDB_DATA key;
+	struct mp_bundle_rec brec;
 
 	bundle_terminating = 1;
 	upper_layers_down(0);
@@ -292,6 +321,8 @@ void mp_bundle_terminated(void)
 	lock_db();
 	destroy_bundle();
 	iterate_bundle_links(sendhup);
+	if (get_bundle_rec(&brec) && brec.master_pid == getpid())
+		delete_unit_index(brec.unit);
 	key.dptr = blinks_id;
 	key.dsize = strlen(blinks_id);
 	tdb_delete(pppdb, key);
@@ -305,143 +336,302 @@ void mp_bundle_terminated(void)
 
 static void make_bundle_links(int append)
 {
-	TDB_DATA key, rec;
-	char *p;
-	char entry[32];
-	int l;
+	struct mp_bundle_rec brec;
+	struct mp_link_rec lrec, hrec;
+	int pid = getpid();
 
-	key.dptr = blinks_id;
-	key.dsize = strlen(blinks_id);
-	slprintf(entry, sizeof(entry), "%s;", db_key);
-	p = entry;
 	if (append) {
-		rec = tdb_fetch(pppdb, key);
-		if (rec.dptr != NULL && rec.dsize > 0) {
-			rec.dptr[rec.dsize-1] = 0;
-			if (strstr(rec.dptr, db_key) != NULL) {
-				/* already in there? strange */
-				warn("link entry already exists in tdb");
-				return;
-			}
-			l = rec.dsize + strlen(entry);
-			p = malloc(l);
-			if (p == NULL)
-				novm("bundle link list");
-			slprintf(p, l, "%s%s", rec.dptr, entry);
-		} else {
+		if (!get_bundle_rec(&brec)) {
 			warn("bundle link list not found");
+			return;
+		}
+		if (get_link_rec(pid, &lrec) && lrec.epoch == brec.epoch) {
+			/* already in there? strange */
+			warn("link entry already exists in tdb");
+			return;
 		}
-		if (rec.dptr != NULL)
-			free(rec.dptr);
+	} else {
+		brec.magic = MP_BUNDLE_MAGIC;
+		brec.epoch = magic();
+		brec.unit = ifunit;
+		brec.master_pid = pid;
+		brec.head = 0;
+		brec.nlinks = 0;
+		set_unit_index(ifunit);
 	}
-	rec.dptr = p;
-	rec.dsize = strlen(p) + 1;
-	if (tdb_store(pppdb, key, rec, TDB_REPLACE))
-		error("couldn't %s bundle link list",
-		      append? "update": "create");
-	if (p != entry)
-		free(p);
+
+	/* push our link onto the front of the list */
+	lrec.magic = MP_LINK_MAGIC;
+	lrec.epoch = brec.epoch;
+	lrec.pid = pid;
+	lrec.prev = 0;
+	lrec.next = 0;
+	if (brec.head != 0 && get_link_rec(brec.head, &hrec)
+	    && hrec.epoch == brec.epoch) {
+		hrec.prev = pid;
+		put_link_rec(&hrec);
+		lrec.next = brec.head;
+	}
+	put_link_rec(&lrec);
+	brec.head = pid;
+	++brec.nlinks;
+	put_bundle_rec(&brec);
 }
 
 static void remove_bundle_link(void)
 {
-	TDB_DATA key, rec;
-	char entry[32];
-	char *p, *q;
-	int l;
-
-	key.dptr = blinks_id;
-	key.dsize = strlen(blinks_id);
-	slprintf(entry, sizeof(entry), "%s;", db_key);
+	struct mp_bundle_rec brec;
+	struct mp_link_rec lrec, nrec;
+	int pid = getpid();
 
-	rec = tdb_fetch(pppdb, key);
-	if (rec.dptr == NULL || rec.dsize <= 0) {
-		if (rec.dptr != NULL)
-			free(rec.dptr);
+	if (!get_link_rec(pid, &lrec))
 		return;
+	delete_link_rec(pid);
+	if (!get_bundle_rec(&brec) || brec.epoch != lrec.epoch)
+		return;
+
+	/* unlink us from our neighbours */
+	if (lrec.prev != 0) {
+		if (get_link_rec(lrec.prev, &nrec) && nrec.epoch == brec.epoch) {
+			nrec.next = lrec.next;
+			put_link_rec(&nrec);
+		}
+	} else if (brec.head == pid) {
+		brec.head = lrec.next;
 	}
-	rec.dptr[rec.dsize-1] = 0;
-	p = strstr(rec.dptr, entry);
-	if (p != NULL) {
-		q = p + strlen(entry);
-		l = strlen(q) + 1;
-		memmove(p, q, l);
-		rec.dsize = p - rec.dptr + l;
-		if (tdb_store(pppdb, key, rec, TDB_REPLACE))
-			error("couldn't update bundle link list (removal)");
+	if (lrec.next != 0 && get_link_rec(lrec.next, &nrec)
+	    && nrec.epoch == brec.epoch) {
+		nrec.prev = lrec.prev;
+		put_link_rec(&nrec);
 	}
-	free(rec.dptr);
+	if (brec.nlinks > 0)
+		--brec.nlinks;
+	put_bundle_rec(&brec);
 }
 
-static void iterate_bundle_links(void (*func)(char *))
+static void iterate_bundle_links(void (*func)(int))
 {
-	TDB_DATA key, rec, pp;
-	char *p, *q;
+	struct mp_bundle_rec brec;
+	struct mp_link_rec lrec;
+	int pid, n;
 
-	key.dptr = blinks_id;
-	key.dsize = strlen(blinks_id);
-	rec = tdb_fetch(pppdb, key);
-	if (rec.dptr == NULL || rec.dsize <= 0) {
+	if (!get_bundle_rec(&brec)) {
 		error("bundle link list not found (iterating list)");
-		if (rec.dptr != NULL)
-			free(rec.dptr);
 		return;
 	}
-	p = rec.dptr;
-	p[rec.dsize-1] = 0;
-	while ((q = strchr(p, ';')) != NULL) {
-		*q = 0;
-		key.dptr = p;
-		key.dsize = q - p;
-		pp = tdb_fetch(pppdb, key);
-		if (pp.dptr != NULL && pp.dsize > 0) {
-			pp.dptr[pp.dsize-1] = 0;
-			func(pp.dptr);
+	/* the count guards against a corrupted (cyclic) list */
+	for (pid = brec.head, n = 0; pid != 0 && n < brec.nlinks; ++n) {
+		if (!get_link_rec(pid, &lrec) || lrec.epoch != brec.epoch)
+			break;
+		func(pid);
+		pid = lrec.next;
+	}
+}
+
+/*
+ * Fetch a fixed-size binary record from the database.
+ */
+static int
+fetch_rec(TDB_DATA key, void *buf, size_t len, u_int32_t magic)
+{
+	TDB_DATA rec;
+	int ret = 0;
+
+	rec = tdb_fetch(pppdb, key);
+	if (rec.dptr != NULL) {
+		if (rec.dsize == len && memcmp(rec.dptr, &magic, 4) == 0) {
+			memcpy(buf, rec.dptr, len);
+			ret = 1;
 		}
-		if (pp.dptr != NULL)
-			free(pp.dptr);
-		p = q + 1;
+		free(rec.dptr);
 	}
-	free(rec.dptr);
+	return ret;
+}
+
+static void
+store_rec(TDB_DATA key, void *buf, size_t len)
+{
+	TDB_DATA rec;
+
+	rec.dptr = buf;
+	rec.dsize = len;
+	if (tdb_store(pppdb, key, rec, TDB_REPLACE))
+		error("couldn't update bundle database: %s",
+		      tdb_errorstr(pppdb));
 }
 
 static int
-parse_num(char *str, const char *key, int *valp)
+get_bundle_rec(struct mp_bundle_rec *brec)
 {
-	char *p, *endp;
-	int i;
-
-	p = strstr(str, key);
-	if (p != 0) {
-		p += strlen(key);
-		i = strtol(p, &endp, 10);
-		if (endp != p && (*endp == 0 || *endp == ';')) {
-			*valp = i;
+	TDB_DATA key;
+
+	key.dptr = blinks_id;
+	key.dsize = strlen(blinks_id);
+	return fetch_rec(key, brec, sizeof(*brec), MP_BUNDLE_MAGIC);
+}
+
+static void
+put_bundle_rec(struct mp_bundle_rec *brec)
+{
+	TDB_DATA key;
+
+	key.dptr = blinks_id;
+	key.dsize = strlen(blinks_id);
+	store_rec(key, brec, sizeof(*brec));
+}
+
+static TDB_DATA
+link_key(char *buf, size_t len, int pid)
+{
+	TDB_DATA key;
+
+	slprintf(buf, len, "BUNDLE_LINK=%d", pid);
+	key.dptr = buf;
+	key.dsize = strlen(buf);
+	return key;
+}
+
+static int
+get_link_rec(int pid, struct mp_link_rec *lrec)
+{
+	char lkey[32];
+
+	return fetch_rec(link_key(lkey, sizeof(lkey), pid),
+			 lrec, sizeof(*lrec), MP_LINK_MAGIC);
+}
+
+static void
+put_link_rec(struct mp_link_rec *lrec)
+{
+	char lkey[32];
+
+	store_rec(link_key(lkey, sizeof(lkey), lrec->pid),
+		  lrec, sizeof(*lrec));
+}
+
+static void
+delete_link_rec(int pid)
+{
+	char lkey[32];
+
+	tdb_delete(pppdb, link_key(lkey, sizeof(lkey), pid));
+}
+
+/*
+ * The unit index maps a ppp unit number to the key of the
+ * bundle which is using it.
+ */
+static TDB_DATA
+unit_key(char *buf, size_t len, int unit)
+{
+	TDB_DATA key;
+
+	slprintf(buf, len, "BUNDLE_UNIT=%d", unit);
+	key.dptr = buf;
+	key.dsize = strlen(buf);
+	return key;
+}
+
+static void
+set_unit_index(int unit)
+{
+	char ukey[32];
+	TDB_DATA rec;
+
+	rec.dptr = blinks_id;
+	rec.dsize = strlen(blinks_id);
+	if (tdb_store(pppdb, unit_key(ukey, sizeof(ukey), unit), rec,
+		      TDB_REPLACE))
+		error("couldn't create bundle unit index: %s",
+		      tdb_errorstr(pppdb));
+}
+
+static void
+delete_unit_index(int unit)
+{
+	char ukey[32];
+
+	if (index_owns_unit(unit))
+		tdb_delete(pppdb, unit_key(ukey, sizeof(ukey), unit));
+}
+
+/*
+ * Check whether the unit index still gives ppp unit `unit' to our bundle.
+ */
+static int
+index_owns_unit(int unit)
+{
+	char ukey[32];
+	TDB_DATA vd;
+	int ret = 0;
+
+	vd = tdb_fetch(pppdb, unit_key(ukey, sizeof(ukey), unit));
+	if (vd.dptr != NULL) {
+		ret = vd.dsize == strlen(blinks_id)
+			&& memcmp(vd.dptr, blinks_id, vd.dsize) == 0;
+		free(vd.dptr);
+	}
+	return ret;
+}
+
+/*
+ * Check whether a pppd's database entry has the setting `str',
+ * which is "NAME=value", in it.
+ */
+static int
+entry_has(TDB_DATA rec, const char *str)
+{
+	size_t n = strlen(str);
+	char *p = rec.dptr, *end = rec.dptr + rec.dsize;
+
+	while (p + n < end) {
+		if (memcmp(p, str, n) == 0 && p[n] == ';')
 			return 1;
-		}
+		p = memchr(p, ';', end - p);
+		if (p == NULL)
+			break;
+		++p;
 	}
 	return 0;
 }
 
 /*
- * Check whether the pppd identified by `key' still owns ppp unit `unit'.
+ * Check whether our bundle still owns ppp unit `unit', by asking the
+ * live entry of its master, pppd `pid': the UNIT= key main.c keeps for
+ * the master must lead to that entry, and the entry must still be for
+ * this unit and bundle.  A stale index entry left by a master that
+ * died, whose pid has since been reused, fails one of these.
  */
 static int
-owns_unit(TDB_DATA key, int unit)
+owns_unit(int unit, int pid)
 {
-	char ifkey[32];
+	char ifkey[32], pidkey[32];
 	TDB_DATA kd, vd;
 	int ret = 0;
 
+	if (!index_owns_unit(unit))
+		return 0;
+
 	slprintf(ifkey, sizeof(ifkey), "UNIT=%d", unit);
+	slprintf(pidkey, sizeof(pidkey), "pppd%d", pid);
 	kd.dptr = ifkey;
 	kd.dsize = strlen(ifkey);
 	vd = tdb_fetch(pppdb, kd);
-	if (vd.dptr != NULL) {
-		ret = vd.dsize == key.dsize
-			&& memcmp(vd.dptr, key.dptr, vd.dsize) == 0;
-		free(vd.dptr);
-	}
+	if (vd.dptr == NULL)
+		return 0;
+	ret = vd.dsize == strlen(pidkey)
+		&& memcmp(vd.dptr, pidkey, vd.dsize) == 0;
+	free(vd.dptr);
+	if (!ret)
+		return 0;
+
+	kd.dptr = pidkey;
+	kd.dsize = strlen(pidkey);
+	vd = tdb_fetch(pppdb, kd);
+	if (vd.dptr == NULL)
+		return 0;
+	ret = entry_has(vd, ifkey) && entry_has(vd, bundle_id);
+	free(vd.dptr);
 	return ret;
 }
 
@@ -81,6 +81,9 @@
 #include "options.h"
 #include "upap.h"
 #include "pathnames.h"
+#include "crypto.h"
+
+#ifndef UNIT_TEST  /* the unit tests only need getword */
 
 #if defined(ultrix) || defined(NeXT)
 char *strdup(char *);
@@ -188,6 +191,7 @@ static int setactivefilter(char **);
 #endif
 
 static int setmodir(char **);
+static int setcryptobackend(char **);
 
 static int user_setenv(char **);
 static void user_setprint(struct option *, printer_func, void *);
@@ -402,6 +406,9 @@ struct option general_options[] = {
     { "mo-timeout", o_int, &maxoctets_timeout,
       "Check for traffic limit every N seconds", OPT_PRIO | OPT_LLIMIT | 1 },
 
+    { "crypto-backend", o_special, setcryptobackend,
+      "Choose the MD4/MD5/SHA1/DES implementations" },
+
     /* Dummy option, does nothing */
     { "noipx", o_bool, &noipx_opt, NULL, OPT_NOPRINT | 1 },
 
@@ -422,6 +429,7 @@ void
 ppp_set_max_idle_time(unsigned int max)
 {
     idle_time_limit = max;
+    session_limits_changed();
 }
 
 int
@@ -434,12 +442,14 @@ void
 ppp_set_max_connect_time(unsigned int max)
 {
     maxconnect = max;
+    session_limits_changed();
 }
 
 void
 ppp_set_session_limit(unsigned int octets)
 {
     maxoctets = octets;
+    session_limits_changed();
 }
 
 void
@@ -1330,6 +1340,8 @@ readable(int fd)
 }
 #endif
 
+#endif /* UNIT_TEST */
+
 /*
  * Read a word from a file.
  * Words are delimited by white-space or by quotes (" or ').
@@ -1575,6 +1587,8 @@ getword(FILE *f, char *word, int *newlinep, char *filename)
 
 }
 
+#ifndef UNIT_TEST
+
 /*
  * number_option - parse an unsigned numeric parameter for an option.
  */
@@ -1773,6 +1787,16 @@ setmodir(char **argv)
     return 1;
 }
 
+static int
+setcryptobackend(char **argv)
+{
+    if (!PPP_crypto_set_backend(*argv)) {
+	ppp_option_error("invalid or unavailable crypto backend: %s", *argv);
+	return 0;
+    }
+    return 1;
+}
+
 #ifdef PPP_WITH_PLUGINS
 static int
 loadplugin(char **argv)
@@ -1980,3 +2004,5 @@ user_unsetprint(struct option *opt, printer_func printer, void *arg)
 	    opt->source = uep->ue_source;
     }
 }
+
+#endif /* UNIT_TEST */
@@ -89,6 +89,7 @@
 
 #define PPP_PATH_UPAPFILE       PPP_PATH_CONFDIR "/pap-secrets"
 #define PPP_PATH_CHAPFILE       PPP_PATH_CONFDIR "/chap-secrets"
+#define PPP_PATH_NTHASHFILE     PPP_PATH_CONFDIR "/chap-nthashes"
 #define PPP_PATH_SRPFILE        PPP_PATH_CONFDIR "/srp-secrets"
 
 #ifdef PPP_WITH_EAPTLS
@@ -466,9 +466,38 @@ done:
 	*out_len = used;
 }
 
-int peap_init(struct peap_state **ctx, const char *rhostname)
+static SSL_CTX *peap_new_ctx(const struct tls_ctx_conf *conf)
 {
 	const SSL_METHOD *method;
+	SSL_CTX *ctx;
+
+	method = tls_method();
+	if (!method)
+		novm("TLS_method() failed");
+	ctx = SSL_CTX_new(method);
+	if (!ctx)
+		novm("SSL_CTX_new() failed");
+
+	/* Configure the default options */
+	tls_set_opts(ctx);
+
+	/* Configure the max TLS version */
+	tls_set_version(ctx, conf->max_version);
+
+	/* Configure the peer certificate callback */
+	tls_set_verify(ctx, 5);
+
+	/* Configure CA locations and CRL check (if any) */
+	if (tls_set_store(ctx, conf->ca_dir, conf->ca_file,
+			conf->crl_dir, conf->crl_file)) {
+		fatal("Could not set CA or CRL verify locations");
+	}
+	return ctx;
+}
+
+int peap_init(struct peap_state **ctx, const char *rhostname)
+{
+	struct tls_ctx_conf conf;
 
 	if (!ctx)
 		return -1;
@@ -484,31 +513,16 @@ int peap_init(struct peap_state **ctx, const char *rhostname)
 	psm->out_buf = malloc(TLS_RECORD_MAX_SIZE);
 	if (!psm->out_buf)
 		novm("peap tls buffer");
-	method = tls_method();
-	if (!method)
-		novm("TLS_method() failed");
-	psm->ctx = SSL_CTX_new(method);
-	if (!psm->ctx)
-		novm("SSL_CTX_new() failed");
-
-	/* Configure the default options */
-	tls_set_opts(psm->ctx);
-
-	/* Configure the max TLS version */
-	tls_set_version(psm->ctx, max_tls_version);
-
-	/* Configure the peer certificate callback */
-	tls_set_verify(psm->ctx, 5);
-
-	/* Configure CA locations */
-	if (tls_set_ca(psm->ctx, ca_path, cacert_file)) {
-		fatal("Could not set CA verify locations");
-	}
 
-	/* Configure CRL check (if any) */
-	if (tls_set_crl(psm->ctx, crl_dir, crl_file)) {
-		fatal("Could not set CRL verify locations");
-	}
+	/* Share the SSL context with other sessions */
+	memset(&conf, 0, sizeof(conf));
+	conf.name = "PEAP";
+	conf.ca_file = cacert_file;
+	conf.ca_dir = ca_path;
+	conf.crl_dir = crl_dir;
+	conf.crl_file = crl_file;
+	conf.max_version = max_tls_version;
+	psm->ctx = tls_get_ctx(&conf, peap_new_ctx);
 
 	psm->out_bio = BIO_new(BIO_s_mem());
 	psm->in_bio = BIO_new(BIO_s_mem());
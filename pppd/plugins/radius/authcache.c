@@ -0,0 +1,229 @@
+/*
+ * authcache.c - recent successful authentications, shared by every
+ * pppd on the host.
+ *
+ *
+ * Copyright (c) 2026 The ppp project. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The name(s) of the authors of this software must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission.
+ *
+ * THE AUTHORS OF THIS SOFTWARE DISCLAIM ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS, IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+ * AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <includes.h>
+#include <radiusclient.h>
+#include <sys/file.h>
+
+/*
+ * When a peer's link flaps it comes straight back with the same name
+ * and password, and asking the server about them again tells us
+ * nothing new.  So if auth_cache_ttl is set, each accepted request is
+ * remembered, with the attributes the server sent back, for that many
+ * seconds and at most auth_cache_uses times.
+ *
+ * An entry is found by an MD5 of the user name and what the peer
+ * proved itself with, salted with random bytes kept in the table, so
+ * the table holds no passwords.  The table is in auth_cache_file if
+ * that is set, so every pppd can use it, and is locked with flock
+ * while it is looked at; otherwise each pppd keeps its own.
+ */
+
+#define RC_AUTHCACHE_MAGIC	0x52414331	/* "RAC1" */
+#define RC_AUTHCACHE_ENTRIES	128
+#define RC_AUTHCACHE_PAIRS	1024	/* longest list of pairs kept */
+
+struct rc_authcache_entry {
+	unsigned char	key[AUTH_VECTOR_LEN];	/* all 0 if free */
+	long long	expires;		/* time() it is no good after */
+	int		uses;			/* times it may still be used */
+	int		len;			/* of pairs */
+	unsigned char	pairs[RC_AUTHCACHE_PAIRS];
+};
+
+struct rc_authcache_table {
+	UINT4		magic;
+	UINT4		nentries;
+	unsigned char	salt[AUTH_VECTOR_LEN];
+	struct rc_authcache_entry entry[RC_AUTHCACHE_ENTRIES];
+};
+
+static struct rc_authcache_table *rc_authcache_table;
+static int rc_authcache_fd = -1;
+
+/* a new table: empty, with a salt of its own */
+static void rc_authcache_init (void *table)
+{
+	struct rc_authcache_table *t = table;
+
+	random_bytes (t->salt, sizeof (t->salt));
+	t->nentries = RC_AUTHCACHE_ENTRIES;
+}
+
+/*
+ * Function: rc_authcache_map
+ *
+ * Purpose: find the table, making it if need be.
+ *
+ */
+
+static struct rc_authcache_table *rc_authcache_map (void)
+{
+	if (rc_authcache_table == NULL)
+		rc_authcache_table = rc_map_table (rc_conf_str("auth_cache_file"),
+						   sizeof (struct rc_authcache_table),
+						   RC_AUTHCACHE_MAGIC,
+						   rc_authcache_init,
+						   &rc_authcache_fd);
+	return rc_authcache_table;
+}
+
+static void rc_authcache_lock (void)
+{
+	if (rc_authcache_fd >= 0)
+		flock (rc_authcache_fd, LOCK_EX);
+}
+
+static void rc_authcache_unlock (void)
+{
+	if (rc_authcache_fd >= 0)
+		flock (rc_authcache_fd, LOCK_UN);
+}
+
+/*
+ * Function: rc_authcache_key
+ *
+ * Purpose: make the key for a user and what they proved themselves
+ *	    with, e.g. their PAP password.
+ *
+ * Returns: 0 if the key was made, -1 if there is no cache
+ *
+ */
+
+int rc_authcache_key (const char *user, const void *data, int len,
+		      unsigned char *key)
+{
+	struct rc_authcache_table *t;
+	unsigned char	buf[AUTH_VECTOR_LEN + 2 * (AUTH_STRING_LEN + 1)];
+	int		ulen = strlen (user);
+
+	if (rc_conf_int("auth_cache_ttl") <= 0
+	    || ulen > AUTH_STRING_LEN || len > AUTH_STRING_LEN
+	    || (t = rc_authcache_map ()) == NULL)
+		return -1;
+
+	memcpy (buf, t->salt, AUTH_VECTOR_LEN);
+	memcpy (buf + AUTH_VECTOR_LEN, user, ulen + 1);
+	memcpy (buf + AUTH_VECTOR_LEN + ulen + 1, data, len);
+	rc_md5_calc (key, buf, AUTH_VECTOR_LEN + ulen + 1 + len);
+	memset (buf, 0, sizeof (buf));
+	return 0;
+}
+
+/*
+ * Function: rc_authcache_get
+ *
+ * Purpose: look for a recent acceptance with the given key, and use it
+ *	    up once.
+ *
+ * Returns: OK_RC, with the attributes the server sent in *received,
+ *	    or ERROR_RC if there is none
+ *
+ */
+
+int rc_authcache_get (const unsigned char *key, VALUE_PAIR **received)
+{
+	struct rc_authcache_table *t = rc_authcache_map ();
+	struct rc_authcache_entry *e;
+	unsigned char	pairs[RC_AUTHCACHE_PAIRS];
+	time_t		now = time (NULL);
+	int		i, len = -1;
+
+	if (t == NULL)
+		return ERROR_RC;
+
+	rc_authcache_lock ();
+	for (i = 0; i < RC_AUTHCACHE_ENTRIES; ++i)
+	{
+		e = &t->entry[i];
+		if (memcmp (e->key, key, AUTH_VECTOR_LEN) != 0)
+			continue;
+		if (e->expires >= now && e->uses > 0)
+		{
+			len = e->len;
+			memcpy (pairs, e->pairs, len);
+			--e->uses;
+		}
+		if (e->expires < now || e->uses <= 0)
+			memset (e, 0, sizeof (*e));
+		break;
+	}
+	rc_authcache_unlock ();
+
+	if (len < 0)
+		return ERROR_RC;
+	*received = rc_avpair_unflatten (pairs, len);
+	return OK_RC;
+}
+
+/*
+ * Function: rc_authcache_put
+ *
+ * Purpose: remember that the server accepted a request with the given
+ *	    key, and what it sent back.
+ *
+ */
+
+void rc_authcache_put (const unsigned char *key, VALUE_PAIR *received)
+{
+	struct rc_authcache_table *t = rc_authcache_map ();
+	struct rc_authcache_entry *e, *victim = NULL;
+	unsigned char	pairs[RC_AUTHCACHE_PAIRS];
+	time_t		now = time (NULL);
+	int		i, len;
+
+	if (t == NULL || rc_conf_int("auth_cache_uses") <= 0)
+		return;
+	len = rc_avpair_flatten (received, pairs, sizeof (pairs));
+	if (len < 0)
+		return;
+
+	/* the same key, else a free or stale entry, else the oldest */
+	rc_authcache_lock ();
+	for (i = 0; i < RC_AUTHCACHE_ENTRIES; ++i)
+	{
+		e = &t->entry[i];
+		if (memcmp (e->key, key, AUTH_VECTOR_LEN) == 0)
+		{
+			victim = e;
+			break;
+		}
+		if (victim == NULL || e->expires < victim->expires)
+			victim = e;
+	}
+	memcpy (victim->key, key, AUTH_VECTOR_LEN);
+	victim->expires = now + rc_conf_int("auth_cache_ttl");
+	victim->uses = rc_conf_int("auth_cache_uses");
+	victim->len = len;
+	memcpy (victim->pairs, pairs, len);
+	rc_authcache_unlock ();
+}
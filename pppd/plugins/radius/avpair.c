@@ -17,9 +17,124 @@
 #include <includes.h>
 #include <radiusclient.h>
 
-static void rc_extract_vendor_specific_attributes(int attrlen,
-						  unsigned char *ptr,
-						  VALUE_PAIR **vp);
+#include <stddef.h>
+
+/*
+ * Pairs come from arenas where they can: between rc_arena_begin and
+ * rc_arena_end the pairs made are carved out of blocks of
+ * RC_ARENA_PAIRS, rather than malloc'd one at a time.  A block is freed
+ * once the arena is over and every pair in it has been freed, so the
+ * pairs can be used, and freed, just as if they were malloc'd.
+ */
+
+#define RC_ARENA_PAIRS	32
+
+typedef struct rc_pair_slot {
+	struct rc_arena	*arena;		/* NULL if malloc'd by itself */
+	VALUE_PAIR	vp;
+} RC_PAIR_SLOT;
+
+typedef struct rc_arena {
+	int		used;		/* slots handed out */
+	int		live;		/* slots handed out and not freed */
+	RC_PAIR_SLOT	slot[RC_ARENA_PAIRS];
+} RC_ARENA;
+
+static RC_ARENA *rc_arena;		/* the block we carve from */
+static int rc_arena_depth;		/* how many rc_arena_begins */
+
+/*
+ * Function: rc_arena_begin
+ *
+ * Purpose: make the pairs for a request come from an arena until
+ *	    rc_arena_end.  Calls nest.
+ *
+ */
+
+void rc_arena_begin (void)
+{
+	++rc_arena_depth;
+}
+
+/*
+ * Function: rc_arena_close
+ *
+ * Purpose: stop carving pairs from the current block, freeing it if
+ *	    none of them are left.
+ *
+ */
+
+static void rc_arena_close (void)
+{
+	if (rc_arena != NULL && rc_arena->live == 0)
+		free (rc_arena);
+	rc_arena = NULL;
+}
+
+/*
+ * Function: rc_arena_end
+ *
+ * Purpose: go back to malloc'ing each pair.
+ *
+ */
+
+void rc_arena_end (void)
+{
+	if (rc_arena_depth > 0 && --rc_arena_depth == 0)
+		rc_arena_close ();
+}
+
+/*
+ * Function: rc_pair_alloc
+ *
+ * Purpose: get the memory for a new pair.
+ *
+ */
+
+static VALUE_PAIR *rc_pair_alloc (void)
+{
+	RC_PAIR_SLOT	*s;
+
+	if (rc_arena_depth > 0)
+	{
+		if (rc_arena != NULL && rc_arena->used == RC_ARENA_PAIRS)
+			rc_arena_close ();
+		if (rc_arena == NULL
+		    && (rc_arena = malloc (sizeof (RC_ARENA))) != NULL)
+			rc_arena->used = rc_arena->live = 0;
+	}
+	if (rc_arena_depth > 0 && rc_arena != NULL)
+	{
+		s = &rc_arena->slot[rc_arena->used++];
+		s->arena = rc_arena;
+		++rc_arena->live;
+	}
+	else if ((s = malloc (sizeof (RC_PAIR_SLOT))) != NULL)
+		s->arena = NULL;
+	else
+		return NULL;
+	return &s->vp;
+}
+
+/*
+ * Function: rc_pair_release
+ *
+ * Purpose: give back the memory of a pair.
+ *
+ */
+
+static void rc_pair_release (VALUE_PAIR *vp)
+{
+	RC_PAIR_SLOT	*s;
+	RC_ARENA	*a;
+
+	s = (RC_PAIR_SLOT *) ((char *) vp - offsetof (RC_PAIR_SLOT, vp));
+	if ((a = s->arena) == NULL)
+		free (s);
+	else if (--a->live == 0 && a != rc_arena)
+		free (a);
+}
+
 /*
  * Function: rc_avpair_add
  *
@@ -118,8 +233,7 @@ VALUE_PAIR *rc_avpair_new (int attrid, const void *pval, int len, int vendorcode
 	}
 	else
 	{
-		if ((vp = (VALUE_PAIR *) malloc (sizeof (VALUE_PAIR)))
-							!= (VALUE_PAIR *) NULL)
+		if ((vp = rc_pair_alloc ()) != (VALUE_PAIR *) NULL)
 		{
 			strlcpy (vp->name, pda->name, NAME_LENGTH);
 			vp->attribute = attrid;
@@ -130,7 +244,7 @@ VALUE_PAIR *rc_avpair_new (int attrid, const void *pval, int len, int vendorcode
 			{
 				return vp;
 			}
-			free (vp);
+			rc_pair_release (vp);
 			vp = (VALUE_PAIR *) NULL;
 		}
 		else
@@ -140,206 +254,336 @@ VALUE_PAIR *rc_avpair_new (int attrid, const void *pval, int len, int vendorcode
 }
 
 /*
+ * Function: rc_attr_put
  *
- * Function: rc_avpair_gen
+ * Purpose: write an attribute straight into a packet, inside a
+ *	    Vendor-Specific attribute if it has a vendor.
  *
- * Purpose: takes attribute/value pairs from buffer and builds a
- *	    value_pair list using allocated memory.
+ * Returns: the number of octets written, or -1 if it doesn't fit.
  *
- * Returns: value_pair list or NULL on failure
  */
 
-VALUE_PAIR *rc_avpair_gen (AUTH_HDR *auth)
+int rc_attr_put (unsigned char *buf, int space, int attribute,
+		 int vendorcode, const void *value, int len)
 {
-	int             length;
-	int             x_len;
-	int             attribute;
-	int             attrlen;
-	UINT4           lvalue;
-	unsigned char         *x_ptr;
-	unsigned char         *ptr;
-	DICT_ATTR      *attr;
-	VALUE_PAIR     *vp;
-	VALUE_PAIR     *pair;
-	char            hex[3];		/* For hex string conversion. */
-	char            buffer[512];
+	int		hdrlen = vendorcode == VENDOR_NONE? 2: 8;
 
-	/*
-	 * Extract attribute-value pairs
-	 */
-	ptr = auth->data;
-	length = ntohs ((unsigned short) auth->length) - AUTH_HDR_LEN;
-	vp = (VALUE_PAIR *) NULL;
+	if (len < 0 || hdrlen + len > MIN (space, 255))
+		return -1;
 
-	while (length > 0)
+	if (vendorcode == VENDOR_NONE)
 	{
-		attribute = *ptr++;
-		attrlen = *ptr++;
-		if (attrlen < 2 || attrlen > length)
-		{
-			error("rc_avpair_gen: received attribute with invalid length");
-			break;
-		}
-		attrlen -= 2;
+		buf[0] = attribute;
+		buf[1] = len + 2;
+	}
+	else
+	{
+		buf[0] = PW_VENDOR_SPECIFIC;
+		buf[1] = len + 8;
+		buf[2] = 0;
+		buf[3] = ((unsigned int) vendorcode >> 16) & 255;
+		buf[4] = ((unsigned int) vendorcode >> 8) & 255;
+		buf[5] = (unsigned int) vendorcode & 255;
+		buf[6] = attribute;
+		buf[7] = len + 2;
+	}
+	memcpy (buf + hdrlen, value, len);
+	return hdrlen + len;
+}
 
-		/* Handle vendor-specific specially */
-		if (attribute == PW_VENDOR_SPECIFIC) {
-		    rc_extract_vendor_specific_attributes(attrlen, ptr, &vp);
-		    ptr += attrlen;
-		    length -= (attrlen + 2);
-		    continue;
-		}
-		if ((attr = rc_dict_getattr (attribute, VENDOR_NONE)) == (DICT_ATTR *) NULL)
+/*
+ * Function: rc_attr_put_int
+ *
+ * Purpose: write an integer or address attribute into a packet.
+ *
+ * Returns: as rc_attr_put.
+ *
+ */
+
+int rc_attr_put_int (unsigned char *buf, int space, int attribute,
+		     int vendorcode, UINT4 value)
+{
+	UINT4		nvalue = htonl (value);
+
+	return rc_attr_put (buf, space, attribute, vendorcode, &nvalue,
+			    sizeof (nvalue));
+}
+
+/*
+ * Function: rc_attr_first
+ *
+ * Purpose: get ready to read the attributes of a packet with
+ *	    rc_attr_next.
+ *
+ */
+
+void rc_attr_first (RC_ATTR_CURSOR *cur, AUTH_HDR *auth)
+{
+	int		length = ntohs ((unsigned short) auth->length);
+
+	cur->ptr = auth->data;
+	cur->end = (unsigned char *) auth + MAX (length, AUTH_HDR_LEN);
+	cur->vsa = cur->vsa_end = NULL;
+	cur->vendorcode = VENDOR_NONE;
+}
+
+/*
+ * Function: rc_attr_next
+ *
+ * Purpose: find the next attribute in a packet, looking inside
+ *	    Vendor-Specific attributes, assuming they are in the
+ *	    "SHOULD" format recommended by RFC 2138.  The value is
+ *	    left where it is in the packet, not copied.
+ *
+ * Returns: 1 if one was found, 0 at the end of the packet.
+ *
+ */
+
+int rc_attr_next (RC_ATTR_CURSOR *cur, RC_ATTR *attr)
+{
+	const unsigned char *ptr;
+	int		attrlen, vlen;
+
+	for (;;)
+	{
+		/* the rest of a Vendor-Specific attribute */
+		if (cur->vsa != NULL)
 		{
-			*buffer= '\0';	/* Initial length. */
-			for (x_ptr = ptr, x_len = attrlen ;
-				x_len > 0 ;
-				x_len--, x_ptr++)
+			ptr = cur->vsa;
+			if (cur->vsa_end - ptr >= 2 && ptr[1] >= 2
+			    && ptr[1] <= cur->vsa_end - ptr)
 			{
-				sprintf (hex, "%2.2X", *x_ptr);
-				strcat (buffer, hex);
+				vlen = ptr[1];
+				cur->vsa += vlen;
+				attr->attribute = ptr[0];
+				attr->vendorcode = cur->vendorcode;
+				attr->value = ptr + 2;
+				attr->len = vlen - 2;
+				return 1;
 			}
-			warn("rc_avpair_gen: received unknown attribute %d of length %d: 0x%s",
-				attribute, attrlen, buffer);
+			/* Do not log an error.  We are supposed to be able
+			   to cope with arbitrary vendor-specific gunk */
+			cur->vsa = NULL;
 		}
-		else
+
+		ptr = cur->ptr;
+		if (cur->end - ptr < 2)
+			return 0;
+		attrlen = ptr[1];
+		if (attrlen < 2 || attrlen > cur->end - ptr)
 		{
-			if ((pair =
-				(VALUE_PAIR *) malloc (sizeof (VALUE_PAIR))) ==
-					(VALUE_PAIR *) NULL)
-			{
-				novm("rc_avpair_gen");
-				rc_avpair_free(vp);
-				return NULL;
-			}
-			strcpy (pair->name, attr->name);
-			pair->attribute = attr->value;
-			pair->vendorcode = VENDOR_NONE;
-			pair->type = attr->type;
-			pair->next = (VALUE_PAIR *) NULL;
+			error("rc_avpair_gen: received attribute with invalid length");
+			cur->ptr = cur->end;
+			return 0;
+		}
+		cur->ptr += attrlen;
 
-			switch (attr->type)
-			{
+		if (ptr[0] != PW_VENDOR_SPECIFIC)
+		{
+			attr->attribute = ptr[0];
+			attr->vendorcode = VENDOR_NONE;
+			attr->value = ptr + 2;
+			attr->len = attrlen - 2;
+			return 1;
+		}
 
-			    case PW_TYPE_STRING:
-			    case PW_TYPE_IFID:
-			    case PW_TYPE_IPV6ADDR:
-			    case PW_TYPE_IPV6PREFIX:
-				memcpy (pair->strvalue, (char *) ptr, (size_t) attrlen);
-				pair->strvalue[attrlen] = '\0';
-				pair->lvalue = attrlen;
-				rc_avpair_insert (&vp, (VALUE_PAIR *) NULL, pair);
-				break;
+		/* High-order octet of Vendor-Id must be zero (RFC2138) */
+		if (attrlen < 10 || ptr[2] != 0)
+			continue;
+		cur->vendorcode = (ptr[3] << 16) | (ptr[4] << 8) | ptr[5];
+		cur->vsa = ptr + 6;
+		cur->vsa_end = ptr + attrlen;
+	}
+}
 
-			    case PW_TYPE_INTEGER:
-			    case PW_TYPE_IPADDR:
-				memcpy ((char *) &lvalue, (char *) ptr,
-					sizeof (UINT4));
-				pair->lvalue = ntohl (lvalue);
-				rc_avpair_insert (&vp, (VALUE_PAIR *) NULL, pair);
-				break;
+/*
+ * Function: rc_pack_list
+ *
+ * Purpose: Packs an attribute value pair list into a packet, leaving
+ *	    out any that won't fit in space octets.
+ *
+ * Returns: Number of octets packed.
+ *
+ */
 
-			    default:
-				warn("rc_avpair_gen: %s has unknown type", attr->name);
-				free (pair);
-				break;
+int rc_pack_list (VALUE_PAIR *vp, char *secret, AUTH_HDR *auth, int space)
+{
+    int             length, i, pc, secretlen, padded_length;
+    int             total_length = 0;
+    unsigned char   passbuf[AUTH_PASS_LEN];
+    unsigned char   md5buf[256];
+    unsigned char   *buf, *vector;
+
+    buf = auth->data;
+
+    for (; vp != (VALUE_PAIR *) NULL; vp = vp->next)
+	{
+	    length = -1;
+
+	    if (vp->vendorcode == VENDOR_NONE
+		&& vp->attribute == PW_USER_PASSWORD)
+	    {
+		/* Encrypt the password */
+
+		/* Chop off password at AUTH_PASS_LEN */
+		length = vp->lvalue;
+		if (length > AUTH_PASS_LEN) length = AUTH_PASS_LEN;
+
+		/* Calculate the padded length */
+		padded_length = (length+(AUTH_VECTOR_LEN-1)) & ~(AUTH_VECTOR_LEN-1);
+
+		if (padded_length + 2 <= space - total_length)
+		{
+		    *buf++ = vp->attribute;
+
+		    /* Record the attribute length */
+		    *buf++ = padded_length + 2;
+
+		    /* Pad the password with zeros */
+		    memset ((char *) passbuf, '\0', AUTH_PASS_LEN);
+		    memcpy ((char *) passbuf, vp->strvalue, (size_t) length);
+
+		    secretlen = strlen (secret);
+		    vector = auth->vector;
+		    for(i = 0; i < padded_length; i += AUTH_VECTOR_LEN) {
+			/* Calculate the MD5 digest*/
+			strcpy ((char *) md5buf, secret);
+			memcpy ((char *) md5buf + secretlen, vector,
+				AUTH_VECTOR_LEN);
+			rc_md5_calc (buf, md5buf, secretlen + AUTH_VECTOR_LEN);
+
+			/* Remeber the start of the digest */
+			vector = buf;
+
+			/* Xor the password into the MD5 digest */
+			for (pc = i; pc < (i + AUTH_VECTOR_LEN); pc++) {
+			    *buf++ ^= passbuf[pc];
 			}
+		    }
+
+		    total_length += padded_length + 2;
+		    continue;
+		}
+		length = -1;
+	    }
+	    else
+	    {
+		/* Everything else goes in as it is */
+		switch (vp->type) {
+		case PW_TYPE_STRING:
+		    length = rc_attr_put (buf, space - total_length,
+					  vp->attribute, vp->vendorcode,
+					  vp->strvalue, vp->lvalue);
+		    break;
+
+		case PW_TYPE_INTEGER:
+		case PW_TYPE_IPADDR:
+		    length = rc_attr_put_int (buf, space - total_length,
+					      vp->attribute, vp->vendorcode,
+					      vp->lvalue);
+		    break;
 
+		default:
+		    continue;
 		}
-		ptr += attrlen;
-		length -= attrlen + 2;
+	    }
+
+	    if (length < 0)
+	    {
+		error("rc_pack_list: no room for %s", vp->name);
+		continue;
+	    }
+	    buf += length;
+	    total_length += length;
 	}
-	return (vp);
+    return total_length;
 }
 
 /*
- * Function: rc_extract_vendor_specific_attributes
  *
- * Purpose: Extracts vendor-specific attributes, assuming they are in
- *          the "SHOULD" format recommended by RCF 2138.
+ * Function: rc_avpair_gen
  *
- * Returns: found value_pair
+ * Purpose: takes attribute/value pairs from buffer and builds a
+ *	    value_pair list, the pairs all coming from one arena.
  *
+ * Returns: value_pair list or NULL on failure
  */
-static void rc_extract_vendor_specific_attributes(int attrlen,
-						  unsigned char *ptr,
-						  VALUE_PAIR **vp)
+
+VALUE_PAIR *rc_avpair_gen (AUTH_HDR *auth)
 {
-    int vendor_id;
-    int vtype;
-    int vlen;
-    UINT4 lvalue;
-    DICT_ATTR *attr;
-    VALUE_PAIR *pair;
-
-    /* ptr is sitting at vendor-ID */
-    if (attrlen < 8) {
-	/* Nothing to see here... */
-	return;
-    }
+	RC_ATTR_CURSOR	cur;
+	RC_ATTR		a;
+	UINT4           lvalue;
+	DICT_ATTR      *attr;
+	VALUE_PAIR     *vp = NULL, **tail = &vp;
+	VALUE_PAIR     *pair;
+	char            buffer[2 * 253 + 1];	/* For hex string conversion. */
+	int		i;
 
-    /* High-order octet of Vendor-Id must be zero (RFC2138) */
-    if (*ptr) {
-	return;
-    }
-
-    /* Extract vendor_id */
-    vendor_id = (int) (
-	((unsigned int) ptr[1]) * 256 * 256 +
-	((unsigned int) ptr[2]) * 256 +
-	((unsigned int) ptr[3]));
-    /* Bump ptr up to contents */
-    ptr += 4;
-
-    /* Set attrlen to length of data */
-    attrlen -= 4;
-    for (; attrlen; attrlen -= vlen+2, ptr += vlen) {
-	vtype = *ptr++;
-	vlen = *ptr++;
-	vlen -= 2;
-	if (vlen < 0 || vlen > attrlen - 2) {
-	    /* Do not log an error.  We are supposed to be able to cope with
-	       arbitrary vendor-specific gunk */
-	    return;
-	}
-	/* Looks plausible... */
-	if ((attr = rc_dict_getattr(vtype, vendor_id)) == NULL) {
-	    continue;
-	}
+	rc_arena_begin ();
+	rc_attr_first (&cur, auth);
+	while (rc_attr_next (&cur, &a))
+	{
+		if ((attr = rc_dict_getattr (a.attribute, a.vendorcode)) == (DICT_ATTR *) NULL)
+		{
+			if (a.vendorcode != VENDOR_NONE)
+				continue;
+			for (i = 0; i < a.len; ++i)
+				sprintf (buffer + 2 * i, "%2.2X", a.value[i]);
+			buffer[2 * i] = '\0';
+			warn("rc_avpair_gen: received unknown attribute %d of length %d: 0x%s",
+				a.attribute, a.len, buffer);
+			continue;
+		}
 
-	/* TODO: Check that length matches data size!!!!! */
-	pair = (VALUE_PAIR *) malloc(sizeof(VALUE_PAIR));
-	if (!pair) {
-	    novm("rc_avpair_gen");
-	    return;
-	}
-	strcpy(pair->name, attr->name);
-	pair->attribute = attr->value;
-	pair->vendorcode = vendor_id;
-	pair->type = attr->type;
-	pair->next = NULL;
-	switch (attr->type) {
-	case PW_TYPE_STRING:
-	    memcpy (pair->strvalue, (char *) ptr, (size_t) vlen);
-	    pair->strvalue[vlen] = '\0';
-	    pair->lvalue = vlen;
-	    rc_avpair_insert (vp, (VALUE_PAIR *) NULL, pair);
-	    break;
-
-	case PW_TYPE_INTEGER:
-	case PW_TYPE_IPADDR:
-	    memcpy ((char *) &lvalue, (char *) ptr,
-		    sizeof (UINT4));
-	    pair->lvalue = ntohl (lvalue);
-	    rc_avpair_insert (vp, (VALUE_PAIR *) NULL, pair);
-	    break;
-
-	default:
-	    warn("rc_avpair_gen: %s has unknown type", attr->name);
-	    free (pair);
-	    break;
+		switch (attr->type)
+		{
+		    case PW_TYPE_STRING:
+		    case PW_TYPE_IFID:
+		    case PW_TYPE_IPV6ADDR:
+		    case PW_TYPE_IPV6PREFIX:
+			break;
+
+		    case PW_TYPE_INTEGER:
+		    case PW_TYPE_IPADDR:
+			if (a.len == sizeof (UINT4))
+				break;
+			warn("rc_avpair_gen: %s has length %d", attr->name, a.len);
+			continue;
+
+		    default:
+			warn("rc_avpair_gen: %s has unknown type", attr->name);
+			continue;
+		}
+
+		if ((pair = rc_pair_alloc ()) == (VALUE_PAIR *) NULL)
+		{
+			novm("rc_avpair_gen");
+			rc_avpair_free(vp);
+			vp = NULL;
+			break;
+		}
+		strcpy (pair->name, attr->name);
+		pair->attribute = attr->value;
+		pair->vendorcode = a.vendorcode;
+		pair->type = attr->type;
+		pair->next = (VALUE_PAIR *) NULL;
+		if (attr->type == PW_TYPE_INTEGER || attr->type == PW_TYPE_IPADDR)
+		{
+			memcpy ((char *) &lvalue, a.value, sizeof (UINT4));
+			pair->lvalue = ntohl (lvalue);
+		}
+		else
+		{
+			memcpy (pair->strvalue, a.value, (size_t) a.len);
+			pair->strvalue[a.len] = '\0';
+			pair->lvalue = a.len;
+		}
+		*tail = pair;
+		tail = &pair->next;
 	}
-    }
+	rc_arena_end ();
+	return (vp);
 }
 
 /*
@@ -372,7 +616,7 @@ VALUE_PAIR *rc_avpair_copy(VALUE_PAIR *p)
 	VALUE_PAIR *vp, *fp = NULL, *lp = NULL;
 
 	while (p) {
-		vp = malloc(sizeof(VALUE_PAIR));
+		vp = rc_pair_alloc();
 		if (!vp) {
 		    novm("rc_avpair_copy");
 		    return NULL; /* leaks a little but so what */
@@ -462,7 +706,7 @@ void rc_avpair_free (VALUE_PAIR *pair)
 	while (pair != (VALUE_PAIR *) NULL)
 	{
 		next = pair->next;
-		free (pair);
+		rc_pair_release (pair);
 		pair = next;
 	}
 }
@@ -580,9 +824,7 @@ int rc_avpair_parse (char *buffer, VALUE_PAIR **first_pair)
 		    case PARSE_MODE_VALUE:		/* Value */
 			rc_fieldcpy (valstr, &buffer);
 
-			if ((pair =
-				(VALUE_PAIR *) malloc (sizeof (VALUE_PAIR)))
-							== (VALUE_PAIR *) NULL)
+			if ((pair = rc_pair_alloc ()) == (VALUE_PAIR *) NULL)
 			{
 				novm("rc_avpair_parse");
 				if (*first_pair) {
@@ -619,7 +861,7 @@ int rc_avpair_parse (char *buffer, VALUE_PAIR **first_pair)
 							rc_avpair_free(*first_pair);
 							*first_pair = (VALUE_PAIR *) NULL;
 						}
-						free (pair);
+						rc_pair_release (pair);
 						return (-1);
 					}
 					else
@@ -653,7 +895,7 @@ int rc_avpair_parse (char *buffer, VALUE_PAIR **first_pair)
 					rc_avpair_free(*first_pair);
 					*first_pair = (VALUE_PAIR *) NULL;
 				}
-				free (pair);
+				rc_pair_release (pair);
 				return (-1);
 			}
 			pair->next = (VALUE_PAIR *) NULL;
@@ -819,3 +1061,83 @@ VALUE_PAIR *rc_avpair_readin(FILE *input)
 
 	return vp;
 }
+
+/*
+ * Each pair flattened by rc_avpair_flatten is one of these, then
+ * lvalue bytes if it is a string.
+ */
+
+struct rc_flat_pair {
+	int		attribute;
+	int		vendorcode;
+	int		type;
+	UINT4		lvalue;
+};
+
+/*
+ * Function: rc_avpair_flatten
+ *
+ * Purpose: copy a list of pairs into buf, to be kept somewhere and
+ *	    turned back into pairs by rc_avpair_unflatten.
+ *
+ * Returns: the length, or -1 if it doesn't fit.
+ *
+ */
+
+int rc_avpair_flatten (VALUE_PAIR *vp, unsigned char *buf, int max)
+{
+	struct rc_flat_pair fp;
+	int		len = 0, slen;
+
+	for (; vp != NULL; vp = vp->next)
+	{
+		slen = vp->type == PW_TYPE_STRING? vp->lvalue: 0;
+		if (len + sizeof (fp) + slen > max)
+			return -1;
+		fp.attribute = vp->attribute;
+		fp.vendorcode = vp->vendorcode;
+		fp.type = vp->type;
+		fp.lvalue = vp->lvalue;
+		memcpy (buf + len, &fp, sizeof (fp));
+		len += sizeof (fp);
+		memcpy (buf + len, vp->strvalue, slen);
+		len += slen;
+	}
+	return len;
+}
+
+/*
+ * Function: rc_avpair_unflatten
+ *
+ * Purpose: rebuild the pairs flattened by rc_avpair_flatten.
+ *
+ */
+
+VALUE_PAIR *rc_avpair_unflatten (const unsigned char *buf, int len)
+{
+	VALUE_PAIR	*vp = NULL;
+	struct rc_flat_pair fp;
+	char		str[AUTH_STRING_LEN + 1];
+	int		off = 0, slen;
+
+	while (off + sizeof (fp) <= len)
+	{
+		memcpy (&fp, buf + off, sizeof (fp));
+		off += sizeof (fp);
+		slen = fp.type == PW_TYPE_STRING? fp.lvalue: 0;
+		if (slen > AUTH_STRING_LEN || off + slen > len)
+			break;
+		if (fp.type == PW_TYPE_STRING)
+		{
+			memcpy (str, buf + off, slen);
+			str[slen] = 0;
+			rc_avpair_add (&vp, fp.attribute, str, slen,
+				       fp.vendorcode);
+		}
+		else
+			rc_avpair_add (&vp, fp.attribute, &fp.lvalue, 0,
+				       fp.vendorcode);
+		off += slen;
+	}
+	return vp;
+}
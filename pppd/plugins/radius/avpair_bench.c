@@ -0,0 +1,332 @@
+/*
+ * avpair_bench.c - how long it takes to encode and decode an accounting
+ * request, with and without VALUE_PAIRs.
+ *
+ *
+ * Copyright (c) 2026 The ppp project. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The name(s) of the authors of this software must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission.
+ *
+ * THE AUTHORS OF THIS SOFTWARE DISCLAIM ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS, IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+ * AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <includes.h>
+#include <radiusclient.h>
+
+/*
+ * Run by "make bench".  This stands in for pppd, so the few things the
+ * library wants from it are here.
+ */
+
+static char dict_file[] = "/tmp/bench_avpair.XXXXXX";
+
+static const char dict_text[] =
+    "ATTRIBUTE User-Name 1 string\n"
+    "ATTRIBUTE NAS-IP-Address 4 ipaddr\n"
+    "ATTRIBUTE NAS-Port 5 integer\n"
+    "ATTRIBUTE Service-Type 6 integer\n"
+    "ATTRIBUTE Framed-Protocol 7 integer\n"
+    "ATTRIBUTE Framed-IP-Address 8 ipaddr\n"
+    "ATTRIBUTE Reply-Message 18 string\n"
+    "ATTRIBUTE Class 25 string\n"
+    "ATTRIBUTE Session-Timeout 27 integer\n"
+    "ATTRIBUTE Called-Station-Id 30 string\n"
+    "ATTRIBUTE Calling-Station-Id 31 string\n"
+    "ATTRIBUTE NAS-Identifier 32 string\n"
+    "ATTRIBUTE Acct-Status-Type 40 integer\n"
+    "ATTRIBUTE Acct-Delay-Time 41 integer\n"
+    "ATTRIBUTE Acct-Input-Octets 42 integer\n"
+    "ATTRIBUTE Acct-Output-Octets 43 integer\n"
+    "ATTRIBUTE Acct-Session-Id 44 string\n"
+    "ATTRIBUTE Acct-Authentic 45 integer\n"
+    "ATTRIBUTE Acct-Session-Time 46 integer\n"
+    "ATTRIBUTE Acct-Input-Packets 47 integer\n"
+    "ATTRIBUTE Acct-Output-Packets 48 integer\n"
+    "ATTRIBUTE Acct-Input-Gigawords 52 integer\n"
+    "ATTRIBUTE Acct-Output-Gigawords 53 integer\n"
+    "ATTRIBUTE NAS-Port-Type 61 integer\n"
+    "ATTRIBUTE Acct-Interim-Interval 85 integer\n"
+    "VENDOR Microsoft 311\n"
+    "ATTRIBUTE MS-Primary-DNS-Server 28 ipaddr Microsoft\n"
+    "ATTRIBUTE MS-Secondary-DNS-Server 29 ipaddr Microsoft\n";
+
+void
+error(const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+void
+warn(const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+void
+fatal(const char *fmt, ...)
+{
+    exit(1);
+}
+
+void
+novm(const char *msg)
+{
+    fprintf(stderr, "out of memory for %s\n", msg);
+    exit(1);
+}
+
+int
+slprintf(char *buf, int buflen, const char *fmt, ...)
+{
+    va_list args;
+    int n;
+
+    va_start(args, fmt);
+    n = vsnprintf(buf, buflen, fmt, args);
+    va_end(args);
+    return n;
+}
+
+size_t
+strlcpy(char *dest, const char *src, size_t len)
+{
+    size_t ret = strlen(src);
+
+    if (len != 0) {
+	if (ret < len)
+	    strcpy(dest, src);
+	else {
+	    strncpy(dest, src, len - 1);
+	    dest[len-1] = 0;
+	}
+    }
+    return ret;
+}
+
+char *
+rc_conf_str(char *name)
+{
+    return NULL;		/* no dictionary_cache */
+}
+
+UINT4
+rc_get_ipaddr(const char *host)
+{
+    return 0;
+}
+
+void
+rc_str2tm(char *valstr, struct tm *tm)
+{
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* What pppd sends in an interim update */
+static const char *session_id = "5F3A9C0B00001A2B";
+static const char *user = "customer1234@isp.example.net";
+static const char *calling = "00:11:22:33:44:55";
+static UINT4 dns = 0x08080808;
+static UINT4 counters[] = {
+    3,				/* Acct-Status-Type = Interim-Update */
+    1,				/* Acct-Authentic = RADIUS */
+    2,				/* Framed-Protocol = PPP */
+    5,				/* NAS-Port-Type = Virtual */
+    2,				/* Service-Type = Framed */
+    12345,			/* NAS-Port */
+    0x0a000001,			/* Framed-IP-Address */
+    3600,			/* Acct-Session-Time */
+    1234567890,			/* Acct-Input-Octets */
+    987654321,			/* Acct-Output-Octets */
+    1234567,			/* Acct-Input-Packets */
+    7654321,			/* Acct-Output-Packets */
+    1,				/* Acct-Input-Gigawords */
+    0,				/* Acct-Output-Gigawords */
+    0xc0a80001,			/* NAS-IP-Address */
+};
+static int counter_attrs[] = {
+    PW_ACCT_STATUS_TYPE, PW_ACCT_AUTHENTIC, PW_FRAMED_PROTOCOL,
+    PW_NAS_PORT_TYPE, PW_SERVICE_TYPE, PW_NAS_PORT, PW_FRAMED_IP_ADDRESS,
+    PW_ACCT_SESSION_TIME, PW_ACCT_INPUT_OCTETS, PW_ACCT_OUTPUT_OCTETS,
+    PW_ACCT_INPUT_PACKETS, PW_ACCT_OUTPUT_PACKETS,
+    PW_ACCT_INPUT_GIGAWORDS, PW_ACCT_OUTPUT_GIGAWORDS, PW_NAS_IP_ADDRESS,
+};
+#define NCOUNTERS	(sizeof(counters) / sizeof(counters[0]))
+
+/* The request as pppd builds it, then packed into a packet */
+static int
+encode_pairs(AUTH_HDR *auth)
+{
+    VALUE_PAIR *send = NULL;
+    int i, len;
+
+    rc_avpair_add(&send, PW_ACCT_SESSION_ID, session_id, 0, VENDOR_NONE);
+    rc_avpair_add(&send, PW_USER_NAME, user, 0, VENDOR_NONE);
+    for (i = 0; i < NCOUNTERS; ++i)
+	rc_avpair_add(&send, counter_attrs[i], &counters[i], 0, VENDOR_NONE);
+    rc_avpair_add(&send, PW_CALLING_STATION_ID, calling, 0, VENDOR_NONE);
+    rc_avpair_add(&send, PW_MS_PRIMARY_DNS_SERVER, &dns, 0, VENDOR_MICROSOFT);
+    len = rc_pack_list(send, "secret", auth, RC_PACKET_MAX - AUTH_HDR_LEN);
+    rc_avpair_free(send);
+    return len;
+}
+
+/* The same, written straight into the packet */
+static int
+encode_direct(AUTH_HDR *auth)
+{
+    unsigned char *buf = auth->data;
+    int space = RC_PACKET_MAX - AUTH_HDR_LEN;
+    int i, len = 0;
+
+    len += rc_attr_put(buf + len, space - len, PW_ACCT_SESSION_ID,
+		       VENDOR_NONE, session_id, strlen(session_id));
+    len += rc_attr_put(buf + len, space - len, PW_USER_NAME,
+		       VENDOR_NONE, user, strlen(user));
+    for (i = 0; i < NCOUNTERS; ++i)
+	len += rc_attr_put_int(buf + len, space - len, counter_attrs[i],
+			       VENDOR_NONE, counters[i]);
+    len += rc_attr_put(buf + len, space - len, PW_CALLING_STATION_ID,
+		       VENDOR_NONE, calling, strlen(calling));
+    len += rc_attr_put_int(buf + len, space - len, PW_MS_PRIMARY_DNS_SERVER,
+			   VENDOR_MICROSOFT, dns);
+    return len;
+}
+
+/* Decode a packet into pairs, as rc_send_server does with replies */
+static int
+decode_pairs(AUTH_HDR *auth)
+{
+    VALUE_PAIR *vp, *received = rc_avpair_gen(auth);
+    int n = 0;
+
+    for (vp = received; vp != NULL; vp = vp->next)
+	++n;
+    rc_avpair_free(received);
+    return n;
+}
+
+/* Look at each attribute of a packet where it lies */
+static int
+decode_views(AUTH_HDR *auth)
+{
+    RC_ATTR_CURSOR cur;
+    RC_ATTR attr;
+    int n = 0;
+
+    rc_attr_first(&cur, auth);
+    while (rc_attr_next(&cur, &attr))
+	if (rc_dict_getattr(attr.attribute, attr.vendorcode) != NULL)
+	    ++n;
+    return n;
+}
+
+int
+main(int argc, char *argv[])
+{
+    unsigned char pbuf[BUFFER_LEN], dbuf[BUFFER_LEN];
+    AUTH_HDR *pairs = (AUTH_HDR *) pbuf, *direct = (AUTH_HDR *) dbuf;
+    int i, len, n, iters = argc > 1 ? atoi(argv[1]) : 200000;
+    double t0, t_malloc, t_arena, t_direct, t_gen, t_views;
+    int fd;
+
+    if ((fd = mkstemp(dict_file)) < 0
+	|| write(fd, dict_text, sizeof(dict_text) - 1) < 0) {
+	perror(dict_file);
+	return 1;
+    }
+    close(fd);
+    i = rc_read_dictionary(dict_file);
+    unlink(dict_file);
+    if (i != 0)
+	return 1;
+
+    memset(pbuf, 0, sizeof(pbuf));
+    memset(dbuf, 0, sizeof(dbuf));
+    len = encode_pairs(pairs);
+    if (encode_direct(direct) != len
+	|| memcmp(pairs->data, direct->data, len) != 0) {
+	printf("direct encoding differs from packing pairs\n");
+	return 1;
+    }
+    pairs->code = PW_ACCOUNTING_REQUEST;
+    pairs->length = htons(len + AUTH_HDR_LEN);
+    n = NCOUNTERS + 4;
+    if (decode_pairs(pairs) != n || decode_views(pairs) != n) {
+	printf("decoding found the wrong number of attributes\n");
+	return 1;
+    }
+
+    t0 = now();
+    for (i = 0; i < iters; ++i)
+	encode_pairs(pairs);
+    t_malloc = (now() - t0) / iters;
+
+    t0 = now();
+    for (i = 0; i < iters; ++i) {
+	rc_arena_begin();
+	encode_pairs(pairs);
+	rc_arena_end();
+    }
+    t_arena = (now() - t0) / iters;
+
+    t0 = now();
+    for (i = 0; i < iters; ++i)
+	encode_direct(direct);
+    t_direct = (now() - t0) / iters;
+
+    t0 = now();
+    for (i = 0; i < iters; ++i)
+	decode_pairs(pairs);
+    t_gen = (now() - t0) / iters;
+
+    t0 = now();
+    for (i = 0; i < iters; ++i)
+	decode_views(pairs);
+    t_views = (now() - t0) / iters;
+
+    printf("accounting request, %d attributes, %d octets\n", n,
+	   len + AUTH_HDR_LEN);
+    printf("encode: pairs %.0f ns, pairs in arena %.0f ns, direct %.0f ns\n",
+	   t_malloc * 1e9, t_arena * 1e9, t_direct * 1e9);
+    printf("decode: pairs %.0f ns, views %.0f ns\n",
+	   t_gen * 1e9, t_views * 1e9);
+    return 0;
+}
@@ -84,13 +84,14 @@ static unsigned char rc_guess_seqnbr(void)
 }
 
 /*
- * Function: rc_get_seqnbr
+ * Function: rc_seqfile_seqnbr
  *
- * Purpose: generate a sequence number
+ * Purpose: take the next sequence number from the seqfile shared
+ *	    with other processes; only used if use_seqfile is set.
  *
  */
 
-unsigned char rc_get_seqnbr(void)
+static unsigned char rc_seqfile_seqnbr(void)
 {
 	FILE *sf;
 	int tries = 1;
@@ -151,6 +152,31 @@ unsigned char rc_get_seqnbr(void)
 	return (unsigned char)seq_nbr;
 }
 
+/*
+ * Function: rc_get_seqnbr
+ *
+ * Purpose: generate a sequence number
+ *
+ * Each of our sockets hands out the identifiers in use on it, so this
+ * is only where it starts looking for a free one; a counter will do,
+ * with no file to lock on the way to the server.
+ *
+ */
+
+unsigned char rc_get_seqnbr(void)
+{
+	static int seq_nbr = -1;
+
+	if (rc_conf_int("use_seqfile"))
+		return rc_seqfile_seqnbr();
+
+	if (seq_nbr < 0)
+		seq_nbr = rc_guess_seqnbr();
+	else
+		seq_nbr = (seq_nbr + 1) & UCHAR_MAX;
+	return (unsigned char)seq_nbr;
+}
+
 /*
  * Function: rc_auth
  *
@@ -195,6 +221,7 @@ int rc_auth_using_server(SERVER *authserver,
 	SEND_DATA       data;
 	int		result;
 	int		i;
+	int		order[SERVER_MAX], n;
 	int		timeout = rc_conf_int("radius_timeout");
 	int		retries = rc_conf_int("radius_retries");
 
@@ -216,15 +243,16 @@ int rc_auth_using_server(SERVER *authserver,
 		return (ERROR_RC);
 
 	result = ERROR_RC;
-	for(i=0; (i<authserver->max) && (result != OK_RC) && (result != BADRESP_RC)
+	n = rc_health_order(authserver, order);
+	for(i=0; (i<n) && (result != OK_RC) && (result != BADRESP_RC)
 		; i++)
 	{
 		if (data.receive_pairs != NULL) {
 			rc_avpair_free(data.receive_pairs);
 			data.receive_pairs = NULL;
 		}
-		rc_buildreq(&data, PW_ACCESS_REQUEST, authserver->name[i],
-			    authserver->port[i], timeout, retries);
+		rc_buildreq(&data, PW_ACCESS_REQUEST, authserver->name[order[i]],
+			    authserver->port[order[i]], timeout, retries);
 
 		result = rc_send_server (&data, msg, info);
 	}
@@ -234,6 +262,39 @@ int rc_auth_using_server(SERVER *authserver,
 	return result;
 }
 
+/*
+ * Function: rc_auth_async
+ *
+ * Purpose: Like rc_auth_using_server, but returns at once; callback
+ *	    is called with the outcome from pppd's main loop.  The
+ *	    send pairs belong to the request from then on, unless an
+ *	    error is returned, in which case callback is never called.
+ *
+ */
+
+int rc_auth_async(SERVER *authserver,
+		  UINT4 client_port,
+		  VALUE_PAIR *send,
+		  rc_callback_fn *callback, void *arg)
+{
+	/*
+	 * Fill in NAS-IP-Address or NAS-Identifier
+	 */
+
+	if (rc_get_nas_id(&send) == ERROR_RC)
+	    return (ERROR_RC);
+
+	/*
+	 * Fill in NAS-Port
+	 */
+
+	if (rc_avpair_add(&send, PW_NAS_PORT, &client_port, 0, VENDOR_NONE) == NULL)
+		return (ERROR_RC);
+
+	return rc_send_server_async(PW_ACCESS_REQUEST, authserver, send,
+				    callback, arg);
+}
+
 /*
  * Function: rc_auth_proxy
  *
@@ -252,6 +313,7 @@ int rc_auth_proxy(VALUE_PAIR *send, VALUE_PAIR **received, char *msg)
 	SEND_DATA       data;
 	int		result;
 	int		i;
+	int		order[SERVER_MAX], n;
 	SERVER		*authserver = rc_conf_srv("authserver");
 	int		timeout = rc_conf_int("radius_timeout");
 	int		retries = rc_conf_int("radius_retries");
@@ -260,15 +322,16 @@ int rc_auth_proxy(VALUE_PAIR *send, VALUE_PAIR **received, char *msg)
 	data.receive_pairs = NULL;
 
 	result = ERROR_RC;
-	for(i=0; (i<authserver->max) && (result != OK_RC) && (result != BADRESP_RC)
+	n = rc_health_order(authserver, order);
+	for(i=0; (i<n) && (result != OK_RC) && (result != BADRESP_RC)
 		; i++)
 	{
 		if (data.receive_pairs != NULL) {
 			rc_avpair_free(data.receive_pairs);
 			data.receive_pairs = NULL;
 		}
-		rc_buildreq(&data, PW_ACCESS_REQUEST, authserver->name[i],
-			    authserver->port[i], timeout, retries);
+		rc_buildreq(&data, PW_ACCESS_REQUEST, authserver->name[order[i]],
+			    authserver->port[order[i]], timeout, retries);
 
 		result = rc_send_server (&data, msg, NULL);
 	}
@@ -299,6 +362,7 @@ int rc_acct_using_server(SERVER *acctserver,
 	struct timeval	start_time, dtime;
 	char		msg[4096];
 	int		i;
+	int		order[SERVER_MAX], n;
 	int		timeout = rc_conf_int("radius_timeout");
 	int		retries = rc_conf_int("radius_retries");
 
@@ -329,15 +393,16 @@ int rc_acct_using_server(SERVER *acctserver,
 
 	ppp_get_time(&start_time);
 	result = ERROR_RC;
-	for(i=0; (i<acctserver->max) && (result != OK_RC) && (result != BADRESP_RC)
+	n = rc_health_order(acctserver, order);
+	for(i=0; (i<n) && (result != OK_RC) && (result != BADRESP_RC)
 		; i++)
 	{
 		if (data.receive_pairs != NULL) {
 			rc_avpair_free(data.receive_pairs);
 			data.receive_pairs = NULL;
 		}
-		rc_buildreq(&data, PW_ACCOUNTING_REQUEST, acctserver->name[i],
-			    acctserver->port[i], timeout, retries);
+		rc_buildreq(&data, PW_ACCOUNTING_REQUEST, acctserver->name[order[i]],
+			    acctserver->port[order[i]], timeout, retries);
 
 		ppp_get_time(&dtime);
 		dtime.tv_sec -= start_time.tv_sec;
@@ -382,6 +447,7 @@ int rc_acct_proxy(VALUE_PAIR *send)
 	int		result;
 	char		msg[4096];
 	int		i;
+	int		order[SERVER_MAX], n;
 	SERVER		*acctserver = rc_conf_srv("authserver");
 	int		timeout = rc_conf_int("radius_timeout");
 	int		retries = rc_conf_int("radius_retries");
@@ -390,15 +456,16 @@ int rc_acct_proxy(VALUE_PAIR *send)
 	data.receive_pairs = NULL;
 
 	result = ERROR_RC;
-	for(i=0; (i<acctserver->max) && (result != OK_RC) && (result != BADRESP_RC)
+	n = rc_health_order(acctserver, order);
+	for(i=0; (i<n) && (result != OK_RC) && (result != BADRESP_RC)
 		; i++)
 	{
 		if (data.receive_pairs != NULL) {
 			rc_avpair_free(data.receive_pairs);
 			data.receive_pairs = NULL;
 		}
-		rc_buildreq(&data, PW_ACCOUNTING_REQUEST, acctserver->name[i],
-			    acctserver->port[i], timeout, retries);
+		rc_buildreq(&data, PW_ACCOUNTING_REQUEST, acctserver->name[order[i]],
+			    acctserver->port[order[i]], timeout, retries);
 
 		result = rc_send_server (&data, msg, NULL);
 	}
@@ -386,9 +386,9 @@ static int test_config(char *filename)
 		error("%s: login_tries <= 0 is illegal", filename);
 		return (-1);
 	}
-	if (rc_conf_str("seqfile") == NULL)
+	if (rc_conf_int("use_seqfile") && rc_conf_str("seqfile") == NULL)
 	{
-		error("%s: seqfile not specified", filename);
+		error("%s: use_seqfile set but seqfile not specified", filename);
 		return (-1);
 	}
 	if (rc_conf_int("login_timeout") <= 0)
@@ -411,79 +411,146 @@ static int test_config(char *filename)
 }
 
 /*
- * Function: rc_find_match
- *
- * Purpose: see if ip_addr is one of the ip addresses of hostname
+ * The servers file, read into memory with the names in it resolved, so
+ * that finding a server's secret is a lookup by address rather than a
+ * read of the file with a DNS query for each line.  It is read again,
+ * and the names looked up again, every servers_ttl seconds from a
+ * timer, or sooner if the file has changed.  The lookups block the
+ * main loop while they run; if one fails, the addresses we had are
+ * kept.
+ */
+
+struct rc_secret {
+	UINT4		addr;		/* host order; 0 if free */
+	char		secret[MAX_SECRET_LENGTH + 1];
+};
+
+static struct {
+	struct rc_secret *slot;
+	unsigned int	size;		/* a power of 2 */
+	unsigned int	count;
+	int		loaded;
+	int		timers;		/* refresh timers are running */
+	int		unresolved;	/* names we had no address for */
+	time_t		retry;		/* when to read it again for them */
+	struct stat	st;		/* of the file when we read it */
+} rc_servers;
+
+static void rc_servers_timer (void *);
+
+static unsigned int rc_secret_hash (UINT4 addr)
+{
+	addr *= 2654435761U;
+	return addr ^ (addr >> 16);
+}
+
+/*
+ * Function: rc_secret_add
  *
- * Returns: 0 on success, -1 when failure
+ * Purpose: remember the secret for an address, unless an earlier
+ *	    line gave one.
  *
  */
 
-static int find_match (UINT4 *ip_addr, char *hostname)
+static void rc_secret_add (struct rc_secret **slotp, unsigned int *sizep,
+			   unsigned int *countp, UINT4 addr, char *secret)
 {
-	UINT4           addr;
-	char          **paddr;
-	struct hostent *hp;
+	struct rc_secret *slot = *slotp, *ns;
+	unsigned int	i, j, size = *sizep;
 
-	if (rc_good_ipaddr (hostname) == 0)
+	if (addr == 0)
+		return;
+	if (2 * (*countp + 1) > size)
 	{
-		if (*ip_addr == ntohl(inet_addr (hostname)))
+		ns = calloc (size ? 2 * size : 32, sizeof (*ns));
+		if (ns == NULL)
 		{
-			return (0);
+			novm("rc_find_server");
+			return;
 		}
-	}
-	else
-	{
-		if ((hp = gethostbyname (hostname)) == (struct hostent *) NULL)
+		for (i = 0; i < size; ++i)
 		{
-			return (-1);
+			if (slot[i].addr == 0)
+				continue;
+			for (j = rc_secret_hash (slot[i].addr) & (2 * size - 1);
+			     ns[j].addr != 0; j = (j + 1) & (2 * size - 1))
+				;
+			ns[j] = slot[i];
 		}
-		for (paddr = hp->h_addr_list; *paddr; paddr++)
+		if (slot != NULL)
 		{
-			addr = ** (UINT4 **) paddr;
-			if (ntohl(addr) == *ip_addr)
-			{
-				return (0);
-			}
+			memset (slot, 0, size * sizeof (*slot));
+			free (slot);
 		}
+		size = size ? 2 * size : 32;
+		*slotp = slot = ns;
+		*sizep = size;
 	}
-	return (-1);
+	for (i = rc_secret_hash (addr) & (size - 1); slot[i].addr != 0;
+	     i = (i + 1) & (size - 1))
+		if (slot[i].addr == addr)
+			return;
+	slot[i].addr = addr;
+	strlcpy (slot[i].secret, secret, sizeof (slot[i].secret));
+	++*countp;
 }
 
 /*
- * Function: rc_find_server
+ * Function: rc_servers_add_host
  *
- * Purpose: search a server in the servers file
+ * Purpose: remember secret for all the addresses of hostname.
+ *
+ */
+
+static void rc_servers_add_host (struct rc_secret **slotp, unsigned int *sizep,
+				 unsigned int *countp, char *hostname,
+				 char *secret)
+{
+	UINT4	addrs[8];
+	int	i, n;
+
+	n = rc_resolve (hostname, addrs, 8);
+	if (n == 0)
+		++rc_servers.unresolved;
+	for (i = 0; i < n; ++i)
+		rc_secret_add (slotp, sizep, countp, addrs[i], secret);
+}
+
+/*
+ * Function: rc_servers_load
+ *
+ * Purpose: read the servers file into memory.  If it can't be read,
+ *	    what we had is kept.
  *
  * Returns: 0 on success, -1 on failure
  *
  */
 
-int rc_find_server (char *server_name, UINT4 *ip_addr, char *secret)
+static int rc_servers_load (void)
 {
 	UINT4	myipaddr = 0;
-	int             len;
-	int             result;
 	FILE           *clientfd;
 	char           *h;
 	char           *s;
 	char           *host2;
 	char            buffer[128];
 	char            hostnm[AUTH_ID_LEN + 1];
-
-	/* Get the IP address of the authentication server */
-	if ((*ip_addr = rc_get_ipaddr (server_name)) == (UINT4) 0)
-		return (-1);
+	char            secret[MAX_SECRET_LENGTH + 1];
+	struct rc_secret *slot = NULL;
+	unsigned int	size = 0, count = 0;
+	UINT4		addr;
+	struct stat	st;
 
 	if ((clientfd = fopen (rc_conf_str("servers"), "r")) == (FILE *) NULL)
 	{
 		error("rc_find_server: couldn't open file: %m: %s", rc_conf_str("servers"));
 		return (-1);
 	}
+	fstat (fileno (clientfd), &st);
+	rc_servers.unresolved = 0;
 
 	myipaddr = rc_own_ipaddress();
 
-	result = 0;
 	while (fgets (buffer, sizeof (buffer), clientfd) != (char *) NULL)
 	{
 		if (*buffer == '#')
@@ -503,41 +570,137 @@ int rc_find_server (char *server_name, UINT4 *ip_addr, char *secret)
 
 		if (!strchr (hostnm, '/')) /* If single name form */
 		{
-			if (find_match (ip_addr, hostnm) == 0)
-			{
-				result++;
-				break;
-			}
+			rc_servers_add_host (&slot, &size, &count, hostnm, secret);
 		}
 		else /* <name1>/<name2> "paired" form */
 		{
 			strtok (hostnm, "/");
-			if (find_match (&myipaddr, hostnm) == 0)
+			host2 = strtok (NULL, " ");
+			if (rc_resolve (hostnm, &addr, 1) && addr == myipaddr)
 			{	     /* If we're the 1st name, target is 2nd */
-				host2 = strtok (NULL, " ");
-				if (find_match (ip_addr, host2) == 0)
-				{
-					result++;
-					break;
-				}
+				if (host2 != NULL)
+					rc_servers_add_host (&slot, &size, &count,
+							     host2, secret);
 			}
 			else	/* If we were 2nd name, target is 1st name */
 			{
-				if (find_match (ip_addr, hostnm) == 0)
-				{
-					result++;
-					break;
-				}
+				rc_servers_add_host (&slot, &size, &count,
+						     hostnm, secret);
 			}
 		}
 	}
 	fclose (clientfd);
-	if (result == 0)
+	memset (buffer, '\0', sizeof (buffer));
+	memset (secret, '\0', sizeof (secret));
+
+	if (rc_servers.slot != NULL)
 	{
-		memset (buffer, '\0', sizeof (buffer));
-		error("rc_find_server: couldn't find RADIUS server %s in %s",
-		      server_name, rc_conf_str("servers"));
-		return (-1);
+		memset (rc_servers.slot, 0, rc_servers.size * sizeof (*slot));
+		free (rc_servers.slot);
 	}
+	rc_servers.slot = slot;
+	rc_servers.size = size;
+	rc_servers.count = count;
+	rc_servers.st = st;
+	rc_servers.loaded = 1;
+	rc_servers.retry = time (NULL) + 30;
 	return 0;
 }
+
+/*
+ * Function: rc_servers_timer
+ *
+ * Purpose: look up the server names again and reread the servers
+ *	    file, away from the path of any request.
+ *
+ */
+
+static void rc_servers_timer (void *arg)
+{
+	int ttl = rc_conf_int("servers_ttl");
+
+	rc_resolve_refresh ();
+	rc_servers_load ();
+	if (ttl > 0)
+		ppp_timeout(rc_servers_timer, NULL, ttl, 0);
+}
+
+/*
+ * Function: rc_servers_check
+ *
+ * Purpose: reread the servers file from a timer if it has changed.
+ *
+ */
+
+static void rc_servers_check (void *arg)
+{
+	struct stat st;
+
+	if (stat (rc_conf_str("servers"), &st) == 0
+	    && (st.st_mtime != rc_servers.st.st_mtime
+		|| st.st_size != rc_servers.st.st_size
+		|| st.st_ino != rc_servers.st.st_ino))
+		rc_servers_load ();
+	ppp_timeout(rc_servers_check, NULL, 5, 0);
+}
+
+/*
+ * Function: rc_find_server
+ *
+ * Purpose: search a server in the servers file
+ *
+ * Returns: 0 on success, -1 on failure
+ *
+ */
+
+int rc_find_server (char *server_name, UINT4 *ip_addr, char *secret)
+{
+	unsigned int	i, mask;
+	int		ttl, tries;
+
+	/* start these whether or not anything below works, so that names
+	   which fail to resolve now are looked up again later */
+	if (!rc_servers.timers)
+	{
+		rc_servers.timers = 1;
+		ttl = rc_conf_int("servers_ttl");
+		if (ttl > 0)
+			ppp_timeout(rc_servers_timer, NULL, ttl, 0);
+		ppp_timeout(rc_servers_check, NULL, 5, 0);
+	}
+
+	/* Get the IP address of the authentication server */
+	if ((*ip_addr = rc_get_ipaddr (server_name)) == (UINT4) 0)
+		return (-1);
+
+	if (!rc_servers.loaded && rc_servers_load () < 0)
+		return (-1);
+
+	for (tries = 0; tries < 2; ++tries)
+	{
+		if (rc_servers.size != 0)
+		{
+			mask = rc_servers.size - 1;
+			for (i = rc_secret_hash (*ip_addr) & mask;
+			     rc_servers.slot[i].addr != 0; i = (i + 1) & mask)
+			{
+				if (rc_servers.slot[i].addr == *ip_addr)
+				{
+					memset (secret, '\0', MAX_SECRET_LENGTH + 1);
+					strlcpy (secret, rc_servers.slot[i].secret,
+						 MAX_SECRET_LENGTH + 1);
+					return 0;
+				}
+			}
+		}
+
+		/* it may be one of the names that didn't resolve last time */
+		if (rc_servers.unresolved == 0 || time (NULL) < rc_servers.retry
+		    || rc_servers_load () < 0)
+			break;
+	}
+
+	error("rc_find_server: couldn't find RADIUS server %s in %s",
+	      server_name, rc_conf_str("servers"));
+	return (-1);
+}
@@ -18,22 +18,537 @@
 
 #include <includes.h>
 #include <radiusclient.h>
+#include <sys/mman.h>
 
 static DICT_ATTR *dictionary_attributes = NULL;
 static DICT_VALUE *dictionary_values = NULL;
 static VENDOR_DICT *vendor_dictionaries = NULL;
 
 /*
- * Function: rc_read_dictionary
+ * Hash indexes over the lists above, so that looking up an attribute
+ * for each one in a packet doesn't mean walking the whole dictionary.
+ * Each is an open-addressed table that doubles when half full.  An
+ * entry added later replaces an earlier one with the same key, since
+ * that's the one the lists (which are built by prepending) find first.
+ */
+
+struct dict_slot {
+	unsigned int	hash;
+	void		*item;
+};
+
+struct dict_index {
+	struct dict_slot *slot;
+	unsigned int	size;		/* 0 or a power of 2 */
+	unsigned int	count;
+};
+
+typedef int (dict_match_fn)(const void *item, const void *key);
+
+static struct dict_index attr_by_id;	/* (value, vendorcode) */
+static struct dict_index attr_by_name;	/* case-insensitive name */
+static struct dict_index value_by_name;	/* case-insensitive name */
+static struct dict_index value_by_attr;	/* (attrname, value) */
+static struct dict_index vendor_by_id;
+static struct dict_index vendor_by_name;
+
+/*
+ * Function: dict_hash
  *
- * Purpose: Initialize the dictionary.  Read all ATTRIBUTES into
- *	    the dictionary_attributes list.  Read all VALUES into
- *	    the dictionary_values list.  Construct VENDOR dictionaries
- *          as required.
+ * Purpose: FNV-1a hash of a string, folding case if asked,
+ *	    mixed with an integer.
  *
  */
 
-int rc_read_dictionary (char *filename)
+static unsigned int dict_hash (const char *s, int fold, int n)
+{
+	unsigned int h = 2166136261U;
+	unsigned char c;
+
+	if (s != NULL) {
+		while ((c = *s++) != 0) {
+			if (fold)
+				c = tolower (c);
+			h = (h ^ c) * 16777619U;
+		}
+	}
+	h = (h ^ (unsigned int) n) * 16777619U;
+	return h ^ (h >> 15);
+}
+
+/*
+ * Function: dict_index_find
+ *
+ * Purpose: look up key in an index.
+ *
+ * Returns: the item, or NULL if there is none.
+ *
+ */
+
+static void *dict_index_find (struct dict_index *ix, unsigned int hash,
+			      dict_match_fn *match, const void *key)
+{
+	unsigned int	i, mask;
+	struct dict_slot *sp;
+
+	if (ix->size == 0)
+		return NULL;
+	mask = ix->size - 1;
+	for (i = hash & mask; (sp = &ix->slot[i])->item != NULL; i = (i + 1) & mask)
+		if (sp->hash == hash && (*match)(sp->item, key))
+			return sp->item;
+	return NULL;
+}
+
+/*
+ * Function: dict_index_put
+ *
+ * Purpose: add an item to an index, replacing any with the same key
+ *	    if replace says so.
+ *
+ */
+
+static void dict_index_put (struct dict_index *ix, unsigned int hash,
+			    dict_match_fn *match, const void *key, void *item,
+			    int (*replace)(const void *old, const void *new))
+{
+	unsigned int	i, mask, size;
+	struct dict_slot *sp, *old;
+
+	if (2 * (ix->count + 1) > ix->size) {
+		size = ix->size ? 2 * ix->size : 64;
+		sp = calloc (size, sizeof (*sp));
+		if (sp == NULL)
+			novm("rc_read_dictionary");
+		old = ix->slot;
+		for (i = 0; i < ix->size; ++i) {
+			unsigned int j;
+
+			if (old[i].item == NULL)
+				continue;
+			for (j = old[i].hash & (size - 1); sp[j].item != NULL;
+			     j = (j + 1) & (size - 1))
+				;
+			sp[j] = old[i];
+		}
+		free (old);
+		ix->slot = sp;
+		ix->size = size;
+	}
+
+	mask = ix->size - 1;
+	for (i = hash & mask; (sp = &ix->slot[i])->item != NULL; i = (i + 1) & mask) {
+		if (sp->hash == hash && (*match)(sp->item, key)) {
+			if (replace == NULL || (*replace)(sp->item, item))
+				sp->item = item;
+			return;
+		}
+	}
+	sp->hash = hash;
+	sp->item = item;
+	++ix->count;
+}
+
+static int attr_id_match (const void *item, const void *key)
+{
+	const DICT_ATTR *a = item, *k = key;
+
+	return a->value == k->value && a->vendorcode == k->vendorcode;
+}
+
+static int attr_name_match (const void *item, const void *key)
+{
+	return strcasecmp (((const DICT_ATTR *) item)->name, key) == 0;
+}
+
+static int value_name_match (const void *item, const void *key)
+{
+	return strcasecmp (((const DICT_VALUE *) item)->name, key) == 0;
+}
+
+static int value_attr_match (const void *item, const void *key)
+{
+	const DICT_VALUE *v = item, *k = key;
+
+	return v->value == k->value && strcmp (v->attrname, k->attrname) == 0;
+}
+
+static int vendor_id_match (const void *item, const void *key)
+{
+	return ((const VENDOR_DICT *) item)->vendorcode == *(const int *) key;
+}
+
+static int vendor_name_match (const void *item, const void *key)
+{
+	return strcmp (((const VENDOR_DICT *) item)->vendorname, key) == 0;
+}
+
+/*
+ * Function: attr_name_replace
+ *
+ * Purpose: decide which of two attributes with the same name
+ *	    rc_dict_findattr should return.  Standard attributes come
+ *	    before vendor ones, and vendors defined later before those
+ *	    defined earlier.
+ *
+ */
+
+static int attr_name_replace (const void *old, const void *new)
+{
+	const DICT_ATTR *o = old, *n = new;
+	VENDOR_DICT *dict;
+
+	if (n->vendorcode == VENDOR_NONE || n->vendorcode == o->vendorcode)
+		return 1;
+	if (o->vendorcode == VENDOR_NONE)
+		return 0;
+	for (dict = vendor_dictionaries; dict != NULL; dict = dict->next) {
+		if (dict->vendorcode == n->vendorcode)
+			return 1;
+		if (dict->vendorcode == o->vendorcode)
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * A dictionary compiled from the text files, written to the file named
+ * by the dictionary_cache option.  It holds the name, size and
+ * modification time of every file that was read, and the VENDOR,
+ * ATTRIBUTE and VALUE lines in the order they were read, as fixed-size
+ * records.  If none of the files has changed, the next pppd maps it and
+ * replays the records rather than parsing the text again.
+ */
+
+#define DICT_CACHE_MAGIC	0x52414431	/* "RAD1" */
+
+struct dict_cache_hdr {
+	UINT4		magic;
+	UINT4		recsize;	/* sizeof(struct dict_cache_rec) */
+	UINT4		nfiles;
+	UINT4		nrecs;
+};
+
+struct dict_cache_file {
+	char		name[PATH_MAX];
+	long long	size;
+	long long	mtime;
+	long long	ino;
+};
+
+#define DICT_REC_VENDOR		1
+#define DICT_REC_ATTR		2
+#define DICT_REC_VALUE		3
+
+struct dict_cache_rec {
+	int		kind;
+	int		value;
+	int		type;
+	char		name[NAME_LENGTH + 1];
+	char		other[NAME_LENGTH + 1];	/* vendor or attribute name */
+};
+
+/* What we have read, while we are making a new cache */
+static struct {
+	int		active;
+	struct dict_cache_file *files;
+	int		nfiles, maxfiles;
+	struct dict_cache_rec *recs;
+	int		nrecs, maxrecs;
+} dict_log;
+
+/*
+ * Function: dict_cache_note_file
+ *
+ * Purpose: remember a file we are about to read.
+ *
+ */
+
+static void dict_cache_note_file (char *filename, struct stat *st)
+{
+	struct dict_cache_file *f;
+
+	if (!dict_log.active)
+		return;
+	if (strlen (filename) >= sizeof (f->name)) {
+		dict_log.active = 0;	/* can't check it later */
+		return;
+	}
+	if (dict_log.nfiles >= dict_log.maxfiles) {
+		dict_log.maxfiles += 8;
+		f = realloc (dict_log.files, dict_log.maxfiles * sizeof (*f));
+		if (f == NULL)
+			novm("rc_read_dictionary");
+		dict_log.files = f;
+	}
+	f = &dict_log.files[dict_log.nfiles++];
+	memset (f, 0, sizeof (*f));
+	strcpy (f->name, filename);
+	f->size = st->st_size;
+	f->mtime = st->st_mtime;
+	f->ino = st->st_ino;
+}
+
+/*
+ * Function: dict_cache_note
+ *
+ * Purpose: remember a line we have read.
+ *
+ */
+
+static void dict_cache_note (int kind, const char *name, const char *other,
+			     int value, int type)
+{
+	struct dict_cache_rec *r;
+
+	if (!dict_log.active)
+		return;
+	if (dict_log.nrecs >= dict_log.maxrecs) {
+		dict_log.maxrecs = dict_log.maxrecs ? 2 * dict_log.maxrecs : 256;
+		r = realloc (dict_log.recs, dict_log.maxrecs * sizeof (*r));
+		if (r == NULL)
+			novm("rc_read_dictionary");
+		dict_log.recs = r;
+	}
+	r = &dict_log.recs[dict_log.nrecs++];
+	memset (r, 0, sizeof (*r));
+	r->kind = kind;
+	r->value = value;
+	r->type = type;
+	strlcpy (r->name, name, sizeof (r->name));
+	if (other != NULL)
+		strlcpy (r->other, other, sizeof (r->other));
+}
+
+/*
+ * Function: dict_add_vendor
+ *
+ * Purpose: add a VENDOR to the dictionary.
+ *
+ */
+
+static void dict_add_vendor (char *name, int code)
+{
+	VENDOR_DICT    *vdict;
+
+	vdict = (VENDOR_DICT *) malloc (sizeof (VENDOR_DICT));
+	if (!vdict)
+		novm("rc_read_dictionary");
+	strcpy(vdict->vendorname, name);
+	vdict->vendorcode = code;
+	vdict->attributes = NULL;
+	vdict->next = vendor_dictionaries;
+	vendor_dictionaries = vdict;
+
+	dict_index_put (&vendor_by_id, dict_hash (NULL, 0, code),
+			vendor_id_match, &code, vdict, NULL);
+	dict_index_put (&vendor_by_name, dict_hash (name, 0, 0),
+			vendor_name_match, name, vdict, NULL);
+	dict_cache_note (DICT_REC_VENDOR, name, NULL, code, 0);
+}
+
+/*
+ * Function: dict_add_attr
+ *
+ * Purpose: add an ATTRIBUTE to the dictionary.  The vendor, if
+ *	    vendorname isn't empty, must be known.
+ *
+ */
+
+static void dict_add_attr (char *name, int value, int type, char *vendorname)
+{
+	DICT_ATTR      *attr;
+	VENDOR_DICT    *vdict;
+
+	vdict = *vendorname? rc_dict_findvendor (vendorname): NULL;
+
+	/* Create a new attribute for the list */
+	if ((attr = (DICT_ATTR *) malloc (sizeof (DICT_ATTR))) == NULL)
+		novm("rc_read_dictionary");
+	strcpy (attr->name, name);
+	if (vdict) {
+	    attr->vendorcode = vdict->vendorcode;
+	} else {
+	    attr->vendorcode = VENDOR_NONE;
+	}
+	attr->value = value;
+	attr->type = type;
+
+	/* Insert it into the list */
+	if (vdict) {
+	    attr->next = vdict->attributes;
+	    vdict->attributes = attr;
+	} else {
+	    attr->next = dictionary_attributes;
+	    dictionary_attributes = attr;
+	}
+
+	dict_index_put (&attr_by_id, dict_hash (NULL, 0, value ^ (attr->vendorcode << 8)),
+			attr_id_match, attr, attr, NULL);
+	dict_index_put (&attr_by_name, dict_hash (name, 1, 0),
+			attr_name_match, name, attr, attr_name_replace);
+	dict_cache_note (DICT_REC_ATTR, name, vendorname, value, type);
+}
+
+/*
+ * Function: dict_add_value
+ *
+ * Purpose: add a VALUE to the dictionary.
+ *
+ */
+
+static void dict_add_value (char *attrname, char *name, int value)
+{
+	DICT_VALUE     *dval;
+
+	/* Create a new VALUE entry for the list */
+	if ((dval = (DICT_VALUE *) malloc (sizeof (DICT_VALUE))) == NULL)
+		novm("rc_read_dictionary");
+	strcpy (dval->attrname, attrname);
+	strcpy (dval->name, name);
+	dval->value = value;
+
+	/* Insert it into the list */
+	dval->next = dictionary_values;
+	dictionary_values = dval;
+
+	dict_index_put (&value_by_name, dict_hash (name, 1, 0),
+			value_name_match, name, dval, NULL);
+	dict_index_put (&value_by_attr, dict_hash (attrname, 0, value),
+			value_attr_match, dval, dval, NULL);
+	dict_cache_note (DICT_REC_VALUE, name, attrname, value, 0);
+}
+
+/*
+ * Function: dict_cache_load
+ *
+ * Purpose: load the dictionary from the cache, if it was made from
+ *	    filename and nothing it was made from has changed since.
+ *
+ * Returns: 0 on success, -1 if the cache can't be used
+ *
+ */
+
+static int dict_cache_load (char *cachefile, char *filename)
+{
+	int		fd, i, ok;
+	struct stat	st;
+	size_t		maplen;
+	void		*map;
+	struct dict_cache_hdr *hdr;
+	struct dict_cache_file *files;
+	struct dict_cache_rec *r;
+
+	if ((fd = open (cachefile, O_RDONLY)) < 0)
+		return -1;
+	if (fstat (fd, &st) < 0 || st.st_size < sizeof (*hdr)) {
+		close (fd);
+		return -1;
+	}
+	maplen = st.st_size;
+	map = mmap (NULL, maplen, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close (fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	hdr = map;
+	files = (struct dict_cache_file *) (hdr + 1);
+	ok = hdr->magic == DICT_CACHE_MAGIC
+		&& hdr->recsize == sizeof (struct dict_cache_rec)
+		&& hdr->nfiles > 0 && hdr->nfiles < 1024
+		&& maplen == sizeof (*hdr)
+			+ (off_t) hdr->nfiles * sizeof (*files)
+			+ (off_t) hdr->nrecs * sizeof (*r)
+		&& strcmp (files[0].name, filename) == 0;
+
+	/* are the text files the same as when it was made? */
+	for (i = 0; ok && i < hdr->nfiles; ++i) {
+		files[i].name[sizeof (files[i].name) - 1] = 0;
+		ok = stat (files[i].name, &st) == 0
+			&& st.st_size == files[i].size
+			&& st.st_mtime == files[i].mtime
+			&& st.st_ino == files[i].ino;
+	}
+
+	if (ok) {
+		r = (struct dict_cache_rec *) (files + hdr->nfiles);
+		for (i = 0; i < hdr->nrecs; ++i, ++r) {
+			r->name[NAME_LENGTH] = 0;
+			r->other[NAME_LENGTH] = 0;
+			switch (r->kind) {
+			case DICT_REC_VENDOR:
+				dict_add_vendor (r->name, r->value);
+				break;
+			case DICT_REC_ATTR:
+				dict_add_attr (r->name, r->value, r->type,
+					       r->other);
+				break;
+			case DICT_REC_VALUE:
+				dict_add_value (r->other, r->name, r->value);
+				break;
+			}
+		}
+	}
+	munmap (map, maplen);
+	return ok? 0: -1;
+}
+
+/*
+ * Function: dict_cache_save
+ *
+ * Purpose: write out what we have read for the next pppd.  It goes
+ *	    to a temporary file which is then renamed, so other pppds
+ *	    see either the old cache or the new one.
+ *
+ */
+
+static void dict_cache_save (char *cachefile)
+{
+	struct dict_cache_hdr hdr;
+	char		tmpname[PATH_MAX];
+	FILE		*f;
+	int		fd, ok;
+
+	if (slprintf (tmpname, sizeof (tmpname), "%s.XXXXXX", cachefile)
+	    >= sizeof (tmpname) - 1)
+		return;
+	if ((fd = mkstemp (tmpname)) < 0) {
+		warn("rc_read_dictionary: couldn't create %s: %m", tmpname);
+		return;
+	}
+	fchmod (fd, 0644);
+	if ((f = fdopen (fd, "w")) == NULL) {
+		close (fd);
+		unlink (tmpname);
+		return;
+	}
+
+	memset (&hdr, 0, sizeof (hdr));
+	hdr.magic = DICT_CACHE_MAGIC;
+	hdr.recsize = sizeof (struct dict_cache_rec);
+	hdr.nfiles = dict_log.nfiles;
+	hdr.nrecs = dict_log.nrecs;
+	ok = fwrite (&hdr, sizeof (hdr), 1, f) == 1
+		&& fwrite (dict_log.files, sizeof (*dict_log.files),
+			   dict_log.nfiles, f) == dict_log.nfiles
+		&& fwrite (dict_log.recs, sizeof (*dict_log.recs),
+			   dict_log.nrecs, f) == dict_log.nrecs;
+	if (fclose (f) != 0)
+		ok = 0;
+	if (!ok || rename (tmpname, cachefile) < 0) {
+		warn("rc_read_dictionary: couldn't write %s: %m", cachefile);
+		unlink (tmpname);
+	}
+}
+
+/*
+ * Function: rc_parse_dictionary
+ *
+ * Purpose: Read a text dictionary and any it includes.
+ *
+ */
+
+static int rc_parse_dictionary (char *filename)
 {
 	FILE           *dictfd;
 	char            dummystr[AUTH_ID_LEN];
@@ -43,9 +558,8 @@ int rc_read_dictionary (char *filename)
 	char            typestr[AUTH_ID_LEN];
 	char            vendorstr[AUTH_ID_LEN];
 	int             line_no;
-	DICT_ATTR      *attr;
-	DICT_VALUE     *dval;
 	VENDOR_DICT    *vdict;
+	struct stat     st;
 	char            buffer[256];
 	int             value;
 	int             type;
@@ -57,6 +571,8 @@ int rc_read_dictionary (char *filename)
 				filename, strerror(errno));
 		return (-1);
 	}
+	if (fstat (fileno (dictfd), &st) == 0)
+		dict_cache_note_file (filename, &st);
 
 	line_no = 0;
 	retcode = 0;
@@ -86,17 +602,7 @@ int rc_read_dictionary (char *filename)
 			break;
 		    }
 		    /* Create new vendor entry */
-		    vdict = (VENDOR_DICT *) malloc (sizeof (VENDOR_DICT));
-		    if (!vdict) {
-			novm("rc_read_dictionary");
-			retcode = -1;
-			break;
-		    }
-		    strcpy(vdict->vendorname, namestr);
-		    vdict->vendorcode = value;
-		    vdict->attributes = NULL;
-		    vdict->next = vendor_dictionaries;
-		    vendor_dictionaries = vdict;
+		    dict_add_vendor (namestr, value);
 		}
 		else if (strncmp (buffer, "ATTRIBUTE", 9) == 0)
 		{
@@ -187,35 +693,8 @@ int rc_read_dictionary (char *filename)
 				    retcode = -1;
 				    break;
 			    }
-			} else {
-			    vdict = NULL;
-			}
-			/* Create a new attribute for the list */
-			if ((attr =
-				(DICT_ATTR *) malloc (sizeof (DICT_ATTR)))
-							== (DICT_ATTR *) NULL)
-			{
-				novm("rc_read_dictionary");
-				retcode = -1;
-				break;
-			}
-			strcpy (attr->name, namestr);
-			if (vdict) {
-			    attr->vendorcode = vdict->vendorcode;
-			} else {
-			    attr->vendorcode = VENDOR_NONE;
-			}
-			attr->value = value;
-			attr->type = type;
-
-			/* Insert it into the list */
-			if (vdict) {
-			    attr->next = vdict->attributes;
-			    vdict->attributes = attr;
-			} else {
-			    attr->next = dictionary_attributes;
-			    dictionary_attributes = attr;
 			}
+			dict_add_attr (namestr, value, type, vendorstr);
 		}
 		else if (strncmp (buffer, "VALUE", 5) == 0)
 		{
@@ -257,22 +736,7 @@ int rc_read_dictionary (char *filename)
 			}
 			value = atoi (valstr);
 
-			/* Create a new VALUE entry for the list */
-			if ((dval =
-				(DICT_VALUE *) malloc (sizeof (DICT_VALUE)))
-							== (DICT_VALUE *) NULL)
-			{
-				novm("rc_read_dictionary");
-				retcode = -1;
-				break;
-			}
-			strcpy (dval->attrname, attrstr);
-			strcpy (dval->name, namestr);
-			dval->value = value;
-
-			/* Insert it into the list */
-			dval->next = dictionary_values;
-			dictionary_values = dval;
+			dict_add_value (attrstr, namestr, value);
 		}
 		else if (strncmp (buffer, "INCLUDE", 7) == 0)
 		{
@@ -284,7 +748,7 @@ int rc_read_dictionary (char *filename)
 				retcode = -1;
 				break;
 			}
-			if (rc_read_dictionary(namestr) == -1)
+			if (rc_parse_dictionary(namestr) == -1)
 			{
 				retcode = -1;
 				break;
@@ -295,6 +759,41 @@ int rc_read_dictionary (char *filename)
 	return retcode;
 }
 
+/*
+ * Function: rc_read_dictionary
+ *
+ * Purpose: Initialize the dictionary.  Read all ATTRIBUTES into
+ *	    the dictionary_attributes list.  Read all VALUES into
+ *	    the dictionary_values list.  Construct VENDOR dictionaries
+ *          as required.  Use the compiled cache if there is an
+ *	    up-to-date one, and make one if not.
+ *
+ */
+
+int rc_read_dictionary (char *filename)
+{
+	char	*cachefile = rc_conf_str("dictionary_cache");
+	int	retcode;
+
+	if (cachefile != NULL && *cachefile != 0
+	    && dictionary_attributes == NULL && vendor_dictionaries == NULL
+	    && dictionary_values == NULL) {
+		if (dict_cache_load (cachefile, filename) == 0)
+			return 0;
+		dict_log.active = 1;
+	}
+
+	retcode = rc_parse_dictionary (filename);
+
+	if (dict_log.active && retcode == 0)
+		dict_cache_save (cachefile);
+	dict_log.active = 0;
+	free (dict_log.files);
+	free (dict_log.recs);
+	memset (&dict_log, 0, sizeof (dict_log));
+	return retcode;
+}
+
 /*
  * Function: rc_dict_getattr
  *
@@ -306,31 +805,13 @@ int rc_read_dictionary (char *filename)
 
 DICT_ATTR *rc_dict_getattr (int attribute, int vendor)
 {
-	DICT_ATTR      *attr;
-	VENDOR_DICT    *dict;
+	DICT_ATTR	key;
 
-	if (vendor == VENDOR_NONE) {
-	    attr = dictionary_attributes;
-	    while (attr != (DICT_ATTR *) NULL) {
-		if (attr->value == attribute) {
-		    return (attr);
-		}
-		attr = attr->next;
-	    }
-	} else {
-	    dict = rc_dict_getvendor(vendor);
-	    if (!dict) {
-		return NULL;
-	    }
-	    attr = dict->attributes;
-	    while (attr) {
-		if (attr->value == attribute) {
-		    return attr;
-		}
-		attr = attr->next;
-	    }
-	}
-	return NULL;
+	key.value = attribute;
+	key.vendorcode = vendor;
+	return dict_index_find (&attr_by_id,
+				dict_hash (NULL, 0, attribute ^ (vendor << 8)),
+				attr_id_match, &key);
 }
 
 /*
@@ -343,32 +824,8 @@ DICT_ATTR *rc_dict_getattr (int attribute, int vendor)
 
 DICT_ATTR *rc_dict_findattr (char *attrname)
 {
-	DICT_ATTR      *attr;
-	VENDOR_DICT    *dict;
-
-	attr = dictionary_attributes;
-	while (attr != (DICT_ATTR *) NULL)
-	{
-		if (strcasecmp (attr->name, attrname) == 0)
-		{
-			return (attr);
-		}
-		attr = attr->next;
-	}
-
-	/* Search vendor-specific dictionaries */
-	dict = vendor_dictionaries;
-	while (dict) {
-	    attr = dict->attributes;
-	    while (attr) {
-		if (strcasecmp (attr->name, attrname) == 0) {
-		    return (attr);
-		}
-		attr = attr->next;
-	    }
-	    dict = dict->next;
-	}
-	return ((DICT_ATTR *) NULL);
+	return dict_index_find (&attr_by_name, dict_hash (attrname, 1, 0),
+				attr_name_match, attrname);
 }
 
 
@@ -382,18 +839,8 @@ DICT_ATTR *rc_dict_findattr (char *attrname)
 
 DICT_VALUE *rc_dict_findval (char *valname)
 {
-	DICT_VALUE     *val;
-
-	val = dictionary_values;
-	while (val != (DICT_VALUE *) NULL)
-	{
-		if (strcasecmp (val->name, valname) == 0)
-		{
-			return (val);
-		}
-		val = val->next;
-	}
-	return ((DICT_VALUE *) NULL);
+	return dict_index_find (&value_by_name, dict_hash (valname, 1, 0),
+				value_name_match, valname);
 }
 
 /*
@@ -406,19 +853,15 @@ DICT_VALUE *rc_dict_findval (char *valname)
 
 DICT_VALUE * rc_dict_getval (UINT4 value, char *attrname)
 {
-	DICT_VALUE     *val;
+	DICT_VALUE	key;
 
-	val = dictionary_values;
-	while (val != (DICT_VALUE *) NULL)
-	{
-		if (strcmp (val->attrname, attrname) == 0 &&
-				val->value == value)
-		{
-			return (val);
-		}
-		val = val->next;
-	}
-	return ((DICT_VALUE *) NULL);
+	if (strlen (attrname) > NAME_LENGTH)
+		return NULL;
+	strcpy (key.attrname, attrname);
+	key.value = value;
+	return dict_index_find (&value_by_attr,
+				dict_hash (attrname, 0, value),
+				value_attr_match, &key);
 }
 
 /*
@@ -429,16 +872,8 @@ DICT_VALUE * rc_dict_getval (UINT4 value, char *attrname)
  */
 VENDOR_DICT * rc_dict_findvendor (char *vendorname)
 {
-    VENDOR_DICT *dict;
-
-    dict = vendor_dictionaries;
-    while (dict) {
-	if (!strcmp(vendorname, dict->vendorname)) {
-	    return dict;
-	}
-	dict = dict->next;
-    }
-    return NULL;
+    return dict_index_find (&vendor_by_name, dict_hash (vendorname, 0, 0),
+			    vendor_name_match, vendorname);
 }
 
 /*
@@ -449,14 +884,6 @@ VENDOR_DICT * rc_dict_findvendor (char *vendorname)
  */
 VENDOR_DICT * rc_dict_getvendor (int id)
 {
-    VENDOR_DICT *dict;
-
-    dict = vendor_dictionaries;
-    while (dict) {
-	if (id == dict->vendorcode) {
-	    return dict;
-	}
-	dict = dict->next;
-    }
-    return NULL;
+    return dict_index_find (&vendor_by_id, dict_hash (NULL, 0, id),
+			    vendor_id_match, &id);
 }
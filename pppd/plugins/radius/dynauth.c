@@ -0,0 +1,644 @@
+/*
+ * dynauth.c - act on Disconnect-Request and CoA-Request packets from
+ * the RADIUS server, RFC 5176.
+ *
+ *
+ * Copyright (c) 2026 The ppp project. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The name(s) of the authors of this software must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission.
+ *
+ * THE AUTHORS OF THIS SOFTWARE DISCLAIM ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS, IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+ * AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <includes.h>
+#include <radiusclient.h>
+#include <sys/un.h>
+
+/*
+ * The server sends its requests to dynauth_port, naming the session by
+ * its Acct-Session-Id, Framed-IP-Address or User-Name.  There is a pppd
+ * for each session on the host but only one of them can have the port:
+ * whichever binds it first checks each request and passes it on to the
+ * pppd whose session it names, over a unix datagram socket that pppd
+ * has bound in dynauth_dir, named for its session id, with links to it
+ * named for its address and user.  That pppd acts on the request and
+ * sends it back with the outcome, to the "port" socket in dynauth_dir,
+ * and the pppd with the port answers the server.  The others keep
+ * trying for the port, so it is picked up again if its owner exits.
+ * Without dynauth_dir, only the session of the pppd with the port can
+ * be reached.
+ */
+
+#define RC_DYNAUTH_RETRY	10	/* seconds between tries for the port */
+#define RC_DYNAUTH_PORT		"port"	/* where outcomes are sent */
+
+/* What is passed between pppds, followed by the request */
+struct rc_dynauth_msg {
+	struct sockaddr_in from;	/* who sent the request */
+	int		cause;		/* Error-Cause, 0 for done, -1 in a request */
+};
+
+static struct rc_dynauth {
+	int		udp;		/* the port, if we have it */
+	int		port;		/* for outcomes, if we have the port */
+	int		local;		/* for requests for our session */
+	char		*dir;
+	char		session_id[AUTH_STRING_LEN + 1];
+	UINT4		ipaddr;
+	char		user[AUTH_STRING_LEN + 1];
+	rc_dynauth_fn	*handler;
+	void		*arg;
+} rc_dynauth = { -1, -1, -1 };
+
+static void rc_dynauth_input (int, void *);
+static void rc_dynauth_msg_input (int, void *);
+
+/*
+ * Function: rc_dynauth_path
+ *
+ * Purpose: make the name in dynauth_dir for a session id, an address
+ *	    ("ip-" and the address) or a user ("user-" and the name).
+ *
+ * Returns: 0, or -1 if there is no name for it.
+ *
+ */
+
+static int rc_dynauth_path (struct sockaddr_un *un, const char *prefix,
+			    const char *name, int len)
+{
+	int		n;
+
+	/* names can be anything, but must stay in the directory */
+	if (len <= 0 || memchr (name, '/', len) != NULL
+	    || memchr (name, 0, len) != NULL || (*prefix == 0 && *name == '.'))
+		return -1;
+	memset (un, 0, sizeof (*un));
+	un->sun_family = AF_UNIX;
+	n = snprintf (un->sun_path, sizeof (un->sun_path), "%s/%s%.*s",
+		      rc_dynauth.dir, prefix, len, name);
+	return n < sizeof (un->sun_path)? 0: -1;
+}
+
+/*
+ * Function: rc_dynauth_socket
+ *
+ * Purpose: bind a unix datagram socket to a name in dynauth_dir,
+ *	    replacing whatever was left there.
+ *
+ * Returns: the socket, or -1 on error.
+ *
+ */
+
+static int rc_dynauth_socket (struct sockaddr_un *un)
+{
+	int		fd;
+
+	fd = socket (AF_UNIX, SOCK_DGRAM, 0);
+	if (fd < 0)
+	{
+		error("rc_dynauth: socket: %m");
+		return -1;
+	}
+	unlink (un->sun_path);
+	if (bind (fd, (struct sockaddr *) un, sizeof (*un)) < 0)
+	{
+		error("rc_dynauth: couldn't bind %s: %m", un->sun_path);
+		close (fd);
+		return -1;
+	}
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	if (ppp_add_fd_handler(fd, rc_dynauth_msg_input, NULL) < 0)
+	{
+		unlink (un->sun_path);
+		close (fd);
+		error("rc_dynauth: can't wait for messages on %s", un->sun_path);
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * Function: rc_dynauth_bind
+ *
+ * Purpose: try to get the port, and try again later if another pppd
+ *	    has it.
+ *
+ */
+
+static void rc_dynauth_bind (void *arg)
+{
+	struct sockaddr_in sin;
+	struct sockaddr_un un;
+	int		fd;
+
+	fd = socket (AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+	{
+		error("rc_dynauth: socket: %m");
+		return;
+	}
+	memset (&sin, 0, sizeof (sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(rc_own_bind_ipaddress());
+	sin.sin_port = htons ((unsigned short) rc_conf_int("dynauth_port"));
+	if (bind (fd, (struct sockaddr *) &sin, sizeof (sin)) < 0)
+	{
+		if (errno != EADDRINUSE)
+			error("rc_dynauth: couldn't bind port %d: %m",
+			      rc_conf_int("dynauth_port"));
+		close (fd);
+		ppp_timeout(rc_dynauth_bind, NULL, RC_DYNAUTH_RETRY, 0);
+		return;
+	}
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	if (ppp_add_fd_handler(fd, rc_dynauth_input, NULL) < 0)
+	{
+		close (fd);
+		error("rc_dynauth: can't wait for requests on port %d",
+		      rc_conf_int("dynauth_port"));
+		ppp_timeout(rc_dynauth_bind, NULL, RC_DYNAUTH_RETRY, 0);
+		return;
+	}
+	rc_dynauth.udp = fd;
+
+	if (rc_dynauth.dir != NULL
+	    && rc_dynauth_path (&un, "", RC_DYNAUTH_PORT,
+				strlen (RC_DYNAUTH_PORT)) == 0)
+		rc_dynauth.port = rc_dynauth_socket (&un);
+	dbglog("rc_dynauth: listening on port %d", rc_conf_int("dynauth_port"));
+}
+
+/*
+ * Function: rc_dynauth_find
+ *
+ * Purpose: see which session a request names, and whether it is ours.
+ *
+ * Returns: 1 if every one of Acct-Session-Id, Framed-IP-Address and
+ *	    User-Name in the request matches our session, otherwise 0;
+ *	    the first of them in the request is put in *which.
+ *
+ */
+
+static int rc_dynauth_find (AUTH_HDR *req, RC_ATTR *which)
+{
+	RC_ATTR_CURSOR	cur;
+	RC_ATTR		attr;
+	int		match = rc_dynauth.handler != NULL;
+	UINT4		ipaddr;
+
+	which->attribute = 0;
+	rc_attr_first (&cur, req);
+	while (rc_attr_next (&cur, &attr))
+	{
+		if (attr.vendorcode != VENDOR_NONE)
+			continue;
+		switch (attr.attribute)
+		{
+		case PW_ACCT_SESSION_ID:
+			match &= attr.len == strlen (rc_dynauth.session_id)
+				 && memcmp (attr.value, rc_dynauth.session_id,
+					    attr.len) == 0;
+			break;
+		case PW_FRAMED_IP_ADDRESS:
+			ipaddr = htonl(rc_dynauth.ipaddr);
+			match &= attr.len == 4
+				 && memcmp (attr.value, &ipaddr, 4) == 0;
+			break;
+		case PW_USER_NAME:
+			match &= attr.len == strlen (rc_dynauth.user)
+				 && memcmp (attr.value, rc_dynauth.user,
+					    attr.len) == 0;
+			break;
+		default:
+			continue;
+		}
+		if (which->attribute == 0)
+			*which = attr;
+	}
+	return match && which->attribute != 0;
+}
+
+/*
+ * Function: rc_dynauth_reply
+ *
+ * Purpose: answer a request, ACK if cause is 0, otherwise NAK with
+ *	    cause as its Error-Cause.
+ *
+ */
+
+static void rc_dynauth_reply (struct sockaddr_in *to, AUTH_HDR *req, int cause)
+{
+	unsigned char	buf[RC_PACKET_MAX + MAX_SECRET_LENGTH];
+	AUTH_HDR	*auth = (AUTH_HDR *) buf;
+	char		secret[MAX_SECRET_LENGTH + 1];
+	RC_ATTR_CURSOR	cur;
+	RC_ATTR		attr;
+	UINT4		ipaddr;
+	int		len, n;
+
+	if (rc_find_server (inet_ntoa (to->sin_addr), &ipaddr, secret) != 0)
+		return;
+
+	auth->code = req->code + (cause == 0? 1: 2);
+	auth->id = req->id;
+	len = AUTH_HDR_LEN;
+
+	/* Proxy-State goes back as it came, RFC 5176 section 3.1 */
+	rc_attr_first (&cur, req);
+	while (rc_attr_next (&cur, &attr))
+		if (attr.attribute == PW_PROXY_STATE
+		    && attr.vendorcode == VENDOR_NONE
+		    && (n = rc_attr_put (buf + len, RC_PACKET_MAX - len,
+					 PW_PROXY_STATE, VENDOR_NONE,
+					 attr.value, attr.len)) > 0)
+			len += n;
+	if (cause != 0 && (n = rc_attr_put_int (buf + len, RC_PACKET_MAX - len,
+						PW_ERROR_CAUSE, VENDOR_NONE,
+						cause)) > 0)
+		len += n;
+	auth->length = htons ((unsigned short) len);
+
+	/* Response Authenticator, as for Access-Request replies */
+	memcpy (auth->vector, req->vector, AUTH_VECTOR_LEN);
+	n = strlen (secret);
+	memcpy (buf + len, secret, n);
+	rc_md5_calc (auth->vector, buf, len + n);
+	memset (secret, 0, sizeof (secret));
+
+	if (sendto (rc_dynauth.udp, buf, len, 0, (struct sockaddr *) to,
+		    sizeof (*to)) < 0)
+		error("rc_dynauth: couldn't answer %I: %m",
+		      to->sin_addr.s_addr);
+}
+
+/*
+ * Function: rc_dynauth_check
+ *
+ * Purpose: check a request read from the port came from a server we
+ *	    share a secret with, RFC 5176 section 3.5.
+ *
+ * Returns: 0 if it did, -1 if not.
+ *
+ */
+
+static int rc_dynauth_check (struct sockaddr_in *from, AUTH_HDR *req, int len)
+{
+	unsigned char	buf[RC_PACKET_MAX + MAX_SECRET_LENGTH];
+	unsigned char	vector[AUTH_VECTOR_LEN];
+	char		secret[MAX_SECRET_LENGTH + 1];
+	UINT4		ipaddr;
+	int		n, ok;
+
+	if (rc_find_server (inet_ntoa (from->sin_addr), &ipaddr, secret) != 0)
+		return -1;
+
+	memcpy (buf, req, len);
+	memset (((AUTH_HDR *) buf)->vector, 0, AUTH_VECTOR_LEN);
+	n = strlen (secret);
+	memcpy (buf + len, secret, n);
+	rc_md5_calc (vector, buf, len + n);
+	memset (secret, 0, sizeof (secret));
+	memset (buf + len, 0, n);
+
+	ok = memcmp (vector, req->vector, AUTH_VECTOR_LEN) == 0;
+	if (!ok)
+		error("rc_dynauth: request from %I has a bad authenticator",
+		      from->sin_addr.s_addr);
+	return ok? 0: -1;
+}
+
+/*
+ * Function: rc_dynauth_fresh
+ *
+ * Purpose: check a request's Event-Timestamp is within
+ *	    dynauth_time_window seconds of now, RFC 5176 section 3.5,
+ *	    so that an old one can't be replayed.
+ *
+ * Returns: 0 if it is, or if it has none and dynauth_require_timestamp
+ *	    is off, otherwise the Error-Cause to refuse it with.
+ *
+ */
+
+static int rc_dynauth_fresh (struct sockaddr_in *from, AUTH_HDR *req)
+{
+	RC_ATTR_CURSOR	cur;
+	RC_ATTR		attr;
+	UINT4		stamp;
+	long long	skew;
+
+	rc_attr_first (&cur, req);
+	while (rc_attr_next (&cur, &attr))
+	{
+		if (attr.attribute != PW_EVENT_TIMESTAMP
+		    || attr.vendorcode != VENDOR_NONE)
+			continue;
+		if (attr.len != 4)
+		{
+			error("rc_dynauth: request from %I has a bad "
+			      "Event-Timestamp", from->sin_addr.s_addr);
+			return PW_ERROR_INVALID_REQUEST;
+		}
+		memcpy (&stamp, attr.value, 4);
+		skew = (long long) time (NULL) - ntohl (stamp);
+		if (skew < 0)
+			skew = -skew;
+		if (skew <= rc_conf_int("dynauth_time_window"))
+			return 0;
+		error("rc_dynauth: request from %I is %lld s out of date",
+		      from->sin_addr.s_addr, skew);
+		return PW_ERROR_INVALID_REQUEST;
+	}
+	if (!rc_conf_int("dynauth_require_timestamp"))
+		return 0;
+	error("rc_dynauth: request from %I has no Event-Timestamp",
+	      from->sin_addr.s_addr);
+	return PW_ERROR_INVALID_REQUEST;
+}
+
+/*
+ * Function: rc_dynauth_input
+ *
+ * Purpose: read a request from the port, act on it if it names our
+ *	    session, pass it on to the pppd whose session it names if
+ *	    not.
+ *
+ */
+
+static void rc_dynauth_input (int fd, void *arg)
+{
+	unsigned char	buf[sizeof (struct rc_dynauth_msg) + RC_PACKET_MAX];
+	struct rc_dynauth_msg *msg = (struct rc_dynauth_msg *) buf;
+	AUTH_HDR	*req = (AUTH_HDR *) (msg + 1);
+	socklen_t	salen;
+	struct sockaddr_un un;
+	struct in_addr	in;
+	RC_ATTR		which;
+	char		*prefix;
+	int		n, len, cause;
+
+	for (;;)
+	{
+		salen = sizeof (msg->from);
+		n = recvfrom (fd, req, RC_PACKET_MAX, 0,
+			      (struct sockaddr *) &msg->from, &salen);
+		if (n < 0)
+			return;
+
+		len = ntohs ((unsigned short) req->length);
+		if (n < AUTH_HDR_LEN || len < AUTH_HDR_LEN || len > n
+		    || (req->code != PW_DISCONNECT_REQUEST
+			&& req->code != PW_COA_REQUEST))
+		{
+			dbglog("rc_dynauth: ignoring bad packet from %I",
+			       msg->from.sin_addr.s_addr);
+			continue;
+		}
+		if (rc_dynauth_check (&msg->from, req, len) < 0)
+			continue;
+		if ((cause = rc_dynauth_fresh (&msg->from, req)) != 0)
+		{
+			rc_dynauth_reply (&msg->from, req, cause);
+			continue;
+		}
+
+		if (rc_dynauth_find (req, &which))
+		{
+			cause = (*rc_dynauth.handler)(rc_dynauth.arg, req);
+			rc_dynauth_reply (&msg->from, req, cause);
+			continue;
+		}
+
+		/* it's someone else's, if anyone's */
+		cause = PW_ERROR_SESSION_NOT_FOUND;
+		n = -1;
+		if (which.attribute == 0)
+			cause = PW_ERROR_MISSING_ATTRIBUTE;
+		else if (rc_dynauth.port < 0)
+			;
+		else if (which.attribute == PW_FRAMED_IP_ADDRESS)
+		{
+			if (which.len == 4)
+			{
+				memcpy (&in, which.value, 4);
+				prefix = inet_ntoa (in);
+				n = rc_dynauth_path (&un, "ip-", prefix,
+						     strlen (prefix));
+			}
+		}
+		else
+			n = rc_dynauth_path (&un, which.attribute == PW_USER_NAME?
+					     "user-": "", (char *) which.value,
+					     which.len);
+		if (n == 0)
+		{
+			msg->cause = -1;
+			if (sendto (rc_dynauth.port, buf, sizeof (*msg) + len, 0,
+				    (struct sockaddr *) &un, sizeof (un)) >= 0)
+				continue;
+			/* left behind by a pppd that died */
+			if (errno == ECONNREFUSED)
+				unlink (un.sun_path);
+		}
+		rc_dynauth_reply (&msg->from, req, cause);
+	}
+}
+
+/*
+ * Function: rc_dynauth_msg_input
+ *
+ * Purpose: read what one pppd passes another: a request for our
+ *	    session to act on, or the outcome of one we passed on.
+ *
+ */
+
+static void rc_dynauth_msg_input (int fd, void *arg)
+{
+	unsigned char	buf[sizeof (struct rc_dynauth_msg) + RC_PACKET_MAX];
+	struct rc_dynauth_msg *msg = (struct rc_dynauth_msg *) buf;
+	AUTH_HDR	*req = (AUTH_HDR *) (msg + 1);
+	struct sockaddr_un un;
+	socklen_t	salen;
+	RC_ATTR		which;
+	int		n;
+
+	for (;;)
+	{
+		salen = sizeof (un);
+		n = recvfrom (fd, buf, sizeof (buf), 0,
+			      (struct sockaddr *) &un, &salen);
+		if (n < 0)
+			return;
+		if (n < sizeof (*msg) + AUTH_HDR_LEN
+		    || ntohs ((unsigned short) req->length) != n - sizeof (*msg))
+			continue;
+
+		if (msg->cause >= 0)
+		{
+			/* the outcome of one we passed on */
+			if (rc_dynauth.udp >= 0)
+				rc_dynauth_reply (&msg->from, req, msg->cause);
+			continue;
+		}
+
+		/* a link may have been left pointing at us by mistake */
+		if (rc_dynauth_find (req, &which))
+			msg->cause = (*rc_dynauth.handler)(rc_dynauth.arg, req);
+		else
+			msg->cause = PW_ERROR_SESSION_NOT_FOUND;
+		if (salen > sizeof (sa_family_t))
+			sendto (fd, buf, n, 0, (struct sockaddr *) &un, salen);
+	}
+}
+
+/*
+ * Function: rc_dynauth_link
+ *
+ * Purpose: point a name in dynauth_dir at our session's socket, or
+ *	    remove it if it still points there.
+ *
+ */
+
+static void rc_dynauth_link (const char *prefix, const char *name, int add)
+{
+	struct sockaddr_un un, target, tmp;
+	char		buf[sizeof (un.sun_path)];
+	int		n;
+
+	if (rc_dynauth_path (&un, prefix, name, strlen (name)) < 0
+	    || rc_dynauth_path (&target, "", rc_dynauth.session_id,
+				strlen (rc_dynauth.session_id)) < 0)
+		return;
+
+	if (add)
+	{
+		/* the newest session of a user is the one it finds */
+		slprintf(tmp.sun_path, sizeof (tmp.sun_path), "%s/.%d",
+			 rc_dynauth.dir, getpid ());
+		unlink (tmp.sun_path);
+		if (symlink (target.sun_path, tmp.sun_path) < 0
+		    || rename (tmp.sun_path, un.sun_path) < 0)
+		{
+			error("rc_dynauth: couldn't link %s: %m", un.sun_path);
+			unlink (tmp.sun_path);
+		}
+		return;
+	}
+	n = readlink (un.sun_path, buf, sizeof (buf) - 1);
+	if (n > 0)
+	{
+		buf[n] = 0;
+		if (strcmp (buf, target.sun_path) == 0)
+			unlink (un.sun_path);
+	}
+}
+
+/*
+ * Function: rc_dynauth_start
+ *
+ * Purpose: let the server reach our session, by Acct-Session-Id,
+ *	    address (if not 0) or user, with its requests passed to
+ *	    handler, which returns the Error-Cause to answer with, or 0
+ *	    for an ACK.  Does nothing unless dynauth_port is set.
+ *
+ */
+
+void rc_dynauth_start (const char *session_id, UINT4 ipaddr, const char *user,
+		       rc_dynauth_fn *handler, void *arg)
+{
+	struct sockaddr_un un;
+	char		*dir;
+	struct in_addr	in;
+
+	if (rc_conf_int("dynauth_port") <= 0)
+		return;
+	rc_dynauth_stop ();
+
+	dir = rc_conf_str("dynauth_dir");
+	if (rc_dynauth.dir == NULL && dir != NULL && *dir != 0)
+	{
+		if (mkdir (dir, 0700) < 0 && errno != EEXIST)
+			error("rc_dynauth: couldn't make %s: %m", dir);
+		else
+			rc_dynauth.dir = dir;
+	}
+
+	strlcpy (rc_dynauth.session_id, session_id,
+		 sizeof (rc_dynauth.session_id));
+	rc_dynauth.ipaddr = ipaddr;
+	strlcpy (rc_dynauth.user, user, sizeof (rc_dynauth.user));
+	rc_dynauth.handler = handler;
+	rc_dynauth.arg = arg;
+
+	if (rc_dynauth.dir != NULL
+	    && rc_dynauth_path (&un, "", session_id, strlen (session_id)) == 0
+	    && (rc_dynauth.local = rc_dynauth_socket (&un)) >= 0)
+	{
+		if (ipaddr != 0)
+		{
+			in.s_addr = htonl(ipaddr);
+			rc_dynauth_link ("ip-", inet_ntoa (in), 1);
+		}
+		if (*user != 0)
+			rc_dynauth_link ("user-", user, 1);
+	}
+
+	if (rc_dynauth.udp < 0)
+		rc_dynauth_bind (NULL);
+}
+
+/*
+ * Function: rc_dynauth_stop
+ *
+ * Purpose: stop the server reaching our session.  Any port we have is
+ *	    kept, for the sessions of other pppds.
+ *
+ */
+
+void rc_dynauth_stop (void)
+{
+	struct sockaddr_un un;
+	struct in_addr	in;
+
+	if (rc_dynauth.handler == NULL)
+		return;
+	rc_dynauth.handler = NULL;
+	ppp_untimeout(rc_dynauth_bind, NULL);
+
+	if (rc_dynauth.local < 0)
+		return;
+	if (rc_dynauth.ipaddr != 0)
+	{
+		in.s_addr = htonl(rc_dynauth.ipaddr);
+		rc_dynauth_link ("ip-", inet_ntoa (in), 0);
+	}
+	if (rc_dynauth.user[0] != 0)
+		rc_dynauth_link ("user-", rc_dynauth.user, 0);
+	if (rc_dynauth_path (&un, "", rc_dynauth.session_id,
+			     strlen (rc_dynauth.session_id)) == 0)
+		unlink (un.sun_path);
+	ppp_remove_fd_handler(rc_dynauth.local);
+	close (rc_dynauth.local);
+	rc_dynauth.local = -1;
+}
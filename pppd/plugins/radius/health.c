@@ -0,0 +1,333 @@
+/*
+ * health.c - how each RADIUS server has been doing, shared by every
+ * pppd on the host.
+ *
+ *
+ * Copyright (c) 2026 The ppp project. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The name(s) of the authors of this software must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission.
+ *
+ * THE AUTHORS OF THIS SOFTWARE DISCLAIM ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS, IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+ * AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <includes.h>
+#include <radiusclient.h>
+
+/*
+ * The state of each server is kept in a small table in a file mapped
+ * by every pppd, so that once one of them finds a server dead the rest
+ * stop sending to it, and so that requests can go to whichever live
+ * server is least busy.  Entries are only ever updated with atomic
+ * operations; nothing is locked.  If the file can't be mapped we keep
+ * the table to ourselves.
+ *
+ * A server that fails to answer a request, after all retries, is held
+ * down for radius_deadtime seconds, doubling for each further failure
+ * up to 8 times that.  Once the hold-down is over it gets requests
+ * again, and the first reply marks it up.
+ */
+
+#define RC_HEALTH_MAGIC		0x52484c31	/* "RHL1" */
+#define RC_HEALTH_ENTRIES	64
+
+/* If nothing has been heard from a server for this long, we forget
+   about requests to it that were never answered, in case the pppd
+   that sent them died before it could count them. */
+#define RC_HEALTH_STALE		120
+
+struct rc_health {
+	unsigned long long key;		/* 0 if free; see rc_health_key */
+	int		outstanding;	/* requests waiting for replies */
+	int		failures;	/* consecutive unanswered requests */
+	int		srtt;		/* smoothed round trip, in ms */
+	int		down;		/* 1 if being held down */
+	long long	down_until;	/* time() the hold-down ends */
+	long long	last_event;	/* time() of the last send/reply/timeout */
+};
+
+struct rc_health_table {
+	UINT4		magic;
+	UINT4		nentries;
+	struct rc_health entry[RC_HEALTH_ENTRIES];
+};
+
+static struct rc_health_table *rc_health_table;
+
+/* a new table: empty, so all it needs is its size */
+static void rc_health_init (void *table)
+{
+	struct rc_health_table *t = table;
+
+	t->nentries = RC_HEALTH_ENTRIES;
+}
+
+/*
+ * Function: rc_health_map
+ *
+ * Purpose: find the shared table, making it if need be.
+ *
+ */
+
+static struct rc_health_table *rc_health_map (void)
+{
+	if (rc_health_table == NULL)
+		rc_health_table = rc_map_table (rc_conf_str("server_health_file"),
+						sizeof (struct rc_health_table),
+						RC_HEALTH_MAGIC, rc_health_init,
+						NULL);
+	return rc_health_table;
+}
+
+/*
+ * Function: rc_health_key
+ *
+ * Purpose: make the key for a server from its address and port.
+ *
+ */
+
+static unsigned long long rc_health_key (UINT4 addr, int port)
+{
+	return (1ULL << 63) | ((unsigned long long) addr << 16)
+		| (unsigned short) port;
+}
+
+/*
+ * Function: rc_health_get
+ *
+ * Purpose: find the entry for a server, adding it if it's new.
+ *
+ * Returns: the entry, or NULL if the table is full.
+ *
+ */
+
+static struct rc_health *rc_health_get (UINT4 addr, int port)
+{
+	struct rc_health_table *t = rc_health_map ();
+	unsigned long long key = rc_health_key (addr, port), old;
+	int		i, n;
+
+	if (t == NULL)
+		return NULL;
+	i = (addr ^ port) % RC_HEALTH_ENTRIES;
+	for (n = 0; n < RC_HEALTH_ENTRIES; ++n, i = (i + 1) % RC_HEALTH_ENTRIES)
+	{
+		old = __atomic_load_n (&t->entry[i].key, __ATOMIC_ACQUIRE);
+		if (old == key)
+			return &t->entry[i];
+		if (old != 0)
+			continue;
+		if (__atomic_compare_exchange_n (&t->entry[i].key, &old, key, 0,
+						 __ATOMIC_ACQ_REL,
+						 __ATOMIC_ACQUIRE)
+		    || old == key)
+			return &t->entry[i];
+	}
+	return NULL;
+}
+
+/*
+ * Function: rc_health_server
+ *
+ * Purpose: find the entry for one of a list of servers.
+ *
+ */
+
+static struct rc_health *rc_health_server (SERVER *servers, int i)
+{
+	UINT4		addr;
+
+	if (rc_resolve (servers->name[i], &addr, 1) == 0)
+		return NULL;
+	return rc_health_get (addr, servers->port[i]);
+}
+
+/*
+ * Function: rc_health_outstanding
+ *
+ * Purpose: how many requests are waiting for this server, forgetting
+ *	    ones that have been waiting far too long.
+ *
+ */
+
+static int rc_health_outstanding (struct rc_health *h, time_t now)
+{
+	int		n = __atomic_load_n (&h->outstanding, __ATOMIC_RELAXED);
+
+	if (n > 0 && now - __atomic_load_n (&h->last_event, __ATOMIC_RELAXED)
+	    > RC_HEALTH_STALE)
+	{
+		__atomic_compare_exchange_n (&h->outstanding, &n, 0, 0,
+					     __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+		n = 0;
+	}
+	return n < 0? 0: n;
+}
+
+/*
+ * Function: rc_health_order
+ *
+ * Purpose: decide the order in which to try a list of servers.
+ *	    Servers that are up come first, the one with the fewest
+ *	    requests outstanding, weighted by how quickly it answers,
+ *	    first; ties keep the configured order.  Servers being held
+ *	    down come last, the one whose hold-down ends soonest first,
+ *	    so that we still try something if they are all down.
+ *
+ * Returns: the number of servers in order.
+ *
+ */
+
+int rc_health_order (SERVER *servers, int *order)
+{
+	struct rc_health *h;
+	long long	score[SERVER_MAX], s;
+	time_t		now = time (NULL);
+	int		i, j, n;
+
+	n = MIN (servers->max, SERVER_MAX);
+	for (i = 0; i < n; ++i)
+	{
+		h = rc_health_server (servers, i);
+		if (h == NULL)
+			s = 0;
+		else if (__atomic_load_n (&h->down_until, __ATOMIC_RELAXED) > now)
+			s = (1LL << 40) + __atomic_load_n (&h->down_until,
+							   __ATOMIC_RELAXED);
+		else
+			s = (long long) (rc_health_outstanding (h, now) + 1)
+				* (__atomic_load_n (&h->srtt, __ATOMIC_RELAXED) + 10);
+
+		/* insertion sort, stable */
+		for (j = i; j > 0 && score[j-1] > s; --j)
+		{
+			score[j] = score[j-1];
+			order[j] = order[j-1];
+		}
+		score[j] = s;
+		order[j] = i;
+	}
+	return n;
+}
+
+/*
+ * Function: rc_health_sent
+ *
+ * Purpose: note that we have sent a request to a server.
+ *
+ */
+
+void rc_health_sent (UINT4 addr, int port)
+{
+	struct rc_health *h = rc_health_get (addr, port);
+
+	if (h == NULL)
+		return;
+	__atomic_add_fetch (&h->outstanding, 1, __ATOMIC_RELAXED);
+	__atomic_store_n (&h->last_event, (long long) time (NULL),
+			  __ATOMIC_RELAXED);
+}
+
+/*
+ * Function: rc_health_cancel
+ *
+ * Purpose: note that we've stopped waiting for a reply from a
+ *	    server, for reasons that say nothing about the server.
+ *
+ */
+
+void rc_health_cancel (UINT4 addr, int port)
+{
+	struct rc_health *h = rc_health_get (addr, port);
+
+	if (h == NULL)
+		return;
+	if (__atomic_sub_fetch (&h->outstanding, 1, __ATOMIC_RELAXED) < 0)
+		__atomic_store_n (&h->outstanding, 0, __ATOMIC_RELAXED);
+}
+
+/*
+ * Function: rc_health_reply
+ *
+ * Purpose: note that a server answered, in rtt milliseconds if
+ *	    rtt >= 0.
+ *
+ */
+
+void rc_health_reply (UINT4 addr, int port, int rtt)
+{
+	struct rc_health *h = rc_health_get (addr, port);
+	int		srtt, failures;
+
+	if (h == NULL)
+		return;
+	if (__atomic_sub_fetch (&h->outstanding, 1, __ATOMIC_RELAXED) < 0)
+		__atomic_store_n (&h->outstanding, 0, __ATOMIC_RELAXED);
+	__atomic_store_n (&h->last_event, (long long) time (NULL),
+			  __ATOMIC_RELAXED);
+	if (rtt >= 0)
+	{
+		srtt = __atomic_load_n (&h->srtt, __ATOMIC_RELAXED);
+		srtt = srtt? srtt + (rtt - srtt) / 8: rtt;
+		__atomic_store_n (&h->srtt, srtt, __ATOMIC_RELAXED);
+	}
+	failures = __atomic_exchange_n (&h->failures, 0, __ATOMIC_RELAXED);
+	__atomic_store_n (&h->down_until, 0LL, __ATOMIC_RELAXED);
+	if (__atomic_exchange_n (&h->down, 0, __ATOMIC_RELAXED))
+		notice("RADIUS server %I:%d is up again after %d failures",
+		       htonl (addr), port, failures);
+}
+
+/*
+ * Function: rc_health_timeout
+ *
+ * Purpose: note that a server didn't answer a request.
+ *
+ */
+
+void rc_health_timeout (UINT4 addr, int port)
+{
+	struct rc_health *h = rc_health_get (addr, port);
+	int		deadtime = rc_conf_int("radius_deadtime");
+	int		failures, hold;
+	time_t		now = time (NULL);
+
+	if (h == NULL)
+		return;
+	if (__atomic_sub_fetch (&h->outstanding, 1, __ATOMIC_RELAXED) < 0)
+		__atomic_store_n (&h->outstanding, 0, __ATOMIC_RELAXED);
+	__atomic_store_n (&h->last_event, (long long) now, __ATOMIC_RELAXED);
+	failures = __atomic_add_fetch (&h->failures, 1, __ATOMIC_RELAXED);
+	if (deadtime <= 0)
+		return;
+
+	hold = deadtime << MIN (failures - 1, 3);
+	__atomic_store_n (&h->down_until, (long long) now + hold,
+			  __ATOMIC_RELAXED);
+	if (!__atomic_exchange_n (&h->down, 1, __ATOMIC_RELAXED))
+		warn("RADIUS server %I:%d is down, not using it for %d seconds",
+		     htonl (addr), port, hold);
+	else
+		dbglog("RADIUS server %I:%d still down after %d failures, "
+		       "not using it for %d seconds", htonl (addr), port,
+		       failures, hold);
+}
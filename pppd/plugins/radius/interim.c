@@ -0,0 +1,212 @@
+/*
+ * interim.c - when each session sends its interim accounting updates,
+ * spread out across every pppd on the host.
+ *
+ *
+ * Copyright (c) 2026 The ppp project. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The name(s) of the authors of this software must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission.
+ *
+ * THE AUTHORS OF THIS SOFTWARE DISCLAIM ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS, IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+ * AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <includes.h>
+#include <radiusclient.h>
+
+/*
+ * Rather than every interval seconds from its Accounting-Start, which
+ * keeps sessions that came up together (after an outage, say) sending
+ * together for as long as they last, a session sends its updates at a
+ * fixed phase within the interval, counted from the epoch.  The phase
+ * comes from a hash of the session id, so it doesn't change, but to
+ * keep the rate even it is put in whichever of two slots of the
+ * interval has fewer sessions in it.  The count of sessions in each
+ * slot is kept in a table in interim_file, mapped by every pppd, and
+ * only updated with atomic operations; without the file each pppd
+ * counts only its own sessions.
+ *
+ * Each update may also be sent up to interim_jitter seconds early.
+ * The gap between updates is never longer than the interval asked for.
+ */
+
+#define RC_INTERIM_MAGIC	0x52494e31	/* "RIN1" */
+#define RC_INTERIM_INTERVALS	16		/* different intervals kept */
+#define RC_INTERIM_SLOTS	64		/* per interval */
+
+struct rc_interim_load {
+	int		interval;	/* 0 if free */
+	int		count[RC_INTERIM_SLOTS];
+};
+
+struct rc_interim_table {
+	UINT4		magic;
+	UINT4		nentries;
+	struct rc_interim_load entry[RC_INTERIM_INTERVALS];
+};
+
+static struct rc_interim_table *rc_interim_table;
+
+/* a new table: empty, so all it needs is its size */
+static void rc_interim_init (void *table)
+{
+	struct rc_interim_table *t = table;
+
+	t->nentries = RC_INTERIM_INTERVALS;
+}
+
+/*
+ * Function: rc_interim_map
+ *
+ * Purpose: find the shared table, making it if need be.
+ *
+ */
+
+static struct rc_interim_table *rc_interim_map (void)
+{
+	if (rc_interim_table == NULL)
+		rc_interim_table = rc_map_table (rc_conf_str("interim_file"),
+						 sizeof (struct rc_interim_table),
+						 RC_INTERIM_MAGIC, rc_interim_init,
+						 NULL);
+	return rc_interim_table;
+}
+
+/*
+ * Function: rc_interim_get
+ *
+ * Purpose: find the slot counts for an interval, adding it if it's new.
+ *
+ * Returns: the entry, or NULL if the table is full.
+ *
+ */
+
+static struct rc_interim_load *rc_interim_get (int interval)
+{
+	struct rc_interim_table *t = rc_interim_map ();
+	int		i, n, old;
+
+	if (t == NULL)
+		return NULL;
+	i = interval % RC_INTERIM_INTERVALS;
+	for (n = 0; n < RC_INTERIM_INTERVALS; ++n, i = (i + 1) % RC_INTERIM_INTERVALS)
+	{
+		old = __atomic_load_n (&t->entry[i].interval, __ATOMIC_ACQUIRE);
+		if (old == interval)
+			return &t->entry[i];
+		if (old != 0)
+			continue;
+		if (__atomic_compare_exchange_n (&t->entry[i].interval, &old,
+						 interval, 0, __ATOMIC_ACQ_REL,
+						 __ATOMIC_ACQUIRE)
+		    || old == interval)
+			return &t->entry[i];
+	}
+	return NULL;
+}
+
+/*
+ * Function: rc_interim_phase
+ *
+ * Purpose: choose when, within each interval, a session sends its
+ *	    updates, and count it in the slot that falls in.
+ *
+ * Returns: the phase, in seconds from the start of an interval; the
+ *	    slot to give to rc_interim_release is put in *slot.
+ *
+ */
+
+int rc_interim_phase (const char *session_id, int interval, int *slot)
+{
+	struct rc_interim_load *l = rc_interim_get (interval);
+	UINT4		h = 2166136261U;
+	int		s1, s2, width;
+
+	for (; *session_id; ++session_id)
+		h = (h ^ (unsigned char) *session_id) * 16777619U;
+
+	s1 = h % RC_INTERIM_SLOTS;
+	s2 = (h / RC_INTERIM_SLOTS) % RC_INTERIM_SLOTS;
+	if (l != NULL
+	    && __atomic_load_n (&l->count[s2], __ATOMIC_RELAXED)
+	       < __atomic_load_n (&l->count[s1], __ATOMIC_RELAXED))
+		s1 = s2;
+	if (l != NULL)
+		__atomic_add_fetch (&l->count[s1], 1, __ATOMIC_RELAXED);
+	*slot = s1;
+
+	width = interval / RC_INTERIM_SLOTS;
+	return (long long) s1 * interval / RC_INTERIM_SLOTS
+		+ (width > 1? (h >> 16) % width: 0);
+}
+
+/*
+ * Function: rc_interim_release
+ *
+ * Purpose: note that a session has stopped sending updates.
+ *
+ */
+
+void rc_interim_release (int interval, int slot)
+{
+	struct rc_interim_load *l = rc_interim_get (interval);
+
+	if (l == NULL || slot < 0 || slot >= RC_INTERIM_SLOTS)
+		return;
+	if (__atomic_sub_fetch (&l->count[slot], 1, __ATOMIC_RELAXED) < 0)
+		__atomic_store_n (&l->count[slot], 0, __ATOMIC_RELAXED);
+}
+
+/*
+ * Function: rc_interim_next
+ *
+ * Purpose: work out when a session should send its next update, given
+ *	    when it sent the last one (or its Accounting-Start).
+ *
+ * Returns: the number of seconds from now.
+ *
+ */
+
+int rc_interim_next (int interval, int phase, time_t last)
+{
+	time_t		now = time (NULL), next;
+	int		jitter = rc_conf_int("interim_jitter");
+
+	if (jitter > interval / 4)
+		jitter = interval / 4;
+	if (jitter < 0)
+		jitter = 0;
+
+	/* the first time that is phase into an interval, after now and
+	   after the time the last update was early for */
+	next = now + jitter;
+	next = next - (next - phase) % interval + interval;
+
+	if (jitter > 0)
+		next -= magic () % (jitter + 1);
+
+	if (next > last + interval)
+		next = last + interval;
+	if (next <= now)
+		next = now + 1;
+	return next - now;
+}
@@ -17,6 +17,114 @@
 #include <includes.h>
 #include <radiusclient.h>
 
+/*
+ * Names we have looked up, with their addresses, so that sending a
+ * request doesn't mean waiting for DNS.  rc_resolve_refresh() looks them
+ * all up again; it is called from a timer, away from the path of any
+ * request, though gethostbyname() still blocks the main loop while it
+ * runs.  A name that has never resolved is tried again by rc_resolve()
+ * itself, at most every RC_HOST_RETRY seconds, so that a DNS failure at
+ * startup doesn't last until the next refresh.
+ */
+
+#define RC_HOST_ADDRS	8
+#define RC_HOST_RETRY	30
+
+struct rc_host {
+	struct rc_host	*next;
+	int		naddrs;			/* 0 if it didn't resolve */
+	time_t		retry;			/* when to try again if not */
+	UINT4		addr[RC_HOST_ADDRS];	/* host order */
+	char		name[1];		/* really longer */
+};
+
+static struct rc_host *rc_hosts;
+
+/*
+ * Function: rc_host_resolve
+ *
+ * Purpose: look up the addresses of a name.  If that fails, the
+ *	    ones we had are kept.
+ *
+ */
+
+static void rc_host_resolve (struct rc_host *h)
+{
+	struct hostent *hp;
+	char          **paddr;
+	int		n;
+
+	if ((hp = gethostbyname (h->name)) == (struct hostent *) NULL)
+	{
+		h->retry = time (NULL) + RC_HOST_RETRY;
+		return;
+	}
+	n = 0;
+	for (paddr = hp->h_addr_list; *paddr && n < RC_HOST_ADDRS; paddr++)
+		h->addr[n++] = ntohl (** (UINT4 **) paddr);
+	h->naddrs = n;
+}
+
+/*
+ * Function: rc_resolve
+ *
+ * Purpose: find the addresses of a host name or address in dot
+ *	    notation, asking DNS only the first time we see the name.
+ *
+ * Returns: the number of addresses put in addrs, 0 if there are none
+ */
+
+int rc_resolve (const char *host, UINT4 *addrs, int max)
+{
+	struct rc_host *h;
+	int		n;
+
+	if (rc_good_ipaddr (host) == 0)
+	{
+		addrs[0] = ntohl(inet_addr (host));
+		return 1;
+	}
+
+	for (h = rc_hosts; h != NULL; h = h->next)
+		if (strcmp (h->name, host) == 0)
+			break;
+	if (h == NULL)
+	{
+		h = malloc (sizeof (*h) + strlen (host));
+		if (h == NULL)
+		{
+			novm("rc_resolve");
+			return 0;
+		}
+		strcpy (h->name, host);
+		h->naddrs = 0;
+		rc_host_resolve (h);
+		h->next = rc_hosts;
+		rc_hosts = h;
+	}
+	else if (h->naddrs == 0 && time (NULL) >= h->retry)
+		rc_host_resolve (h);
+
+	n = MIN (h->naddrs, max);
+	memcpy (addrs, h->addr, n * sizeof (UINT4));
+	return n;
+}
+
+/*
+ * Function: rc_resolve_refresh
+ *
+ * Purpose: look up again all the names we know.
+ *
+ */
+
+void rc_resolve_refresh (void)
+{
+	struct rc_host *h;
+
+	for (h = rc_hosts; h != NULL; h = h->next)
+		rc_host_resolve (h);
+}
+
 /*
  * Function: rc_get_ipaddr
  *
@@ -28,18 +136,14 @@
 
 UINT4 rc_get_ipaddr (const char *host)
 {
-	struct hostent *hp;
+	UINT4		addr;
 
-	if (rc_good_ipaddr (host) == 0)
-	{
-		return ntohl(inet_addr (host));
-	}
-	else if ((hp = gethostbyname (host)) == (struct hostent *) NULL)
+	if (rc_resolve (host, &addr, 1) == 0)
 	{
 		error("rc_get_ipaddr: couldn't resolve hostname: %s", host);
 		return ((UINT4) 0);
 	}
-	return ntohl((*(UINT4 *) hp->h_addr));
+	return addr;
 }
 
 /*
@@ -33,6 +33,15 @@ static SERVER authserver = {0};
 
 int default_tries = 4;
 int default_timeout = 60;
+int default_use_seqfile = 0;
+int default_servers_ttl = 300;
+int default_deadtime = 30;
+int default_auth_cache_ttl = 0;
+int default_auth_cache_uses = 3;
+int default_interim_jitter = 0;
+int default_dynauth_port = 0;
+int default_dynauth_time_window = 300;
+int default_dynauth_require_timestamp = 0;
 
 static OPTION config_options[] = {
 /* internally used options */
@@ -47,13 +56,33 @@ static OPTION config_options[] = {
 {"authserver",		OT_SRV, ST_UNDEF, &authserver},
 {"acctserver",		OT_SRV, ST_UNDEF, &acctserver},
 {"servers",		OT_STR, ST_UNDEF, NULL},
+{"servers_ttl",		OT_INT, ST_UNDEF, &default_servers_ttl},
 {"dictionary",		OT_STR, ST_UNDEF, NULL},
+{"dictionary_cache",	OT_STR, ST_UNDEF, NULL},
 {"login_radius",	OT_STR, ST_UNDEF, "/usr/sbin/login.radius"},
 {"seqfile",		OT_STR, ST_UNDEF, NULL},
+{"use_seqfile",		OT_INT, ST_UNDEF, &default_use_seqfile},
 {"mapfile",		OT_STR, ST_UNDEF, NULL},
 {"default_realm",	OT_STR, ST_UNDEF, NULL},
 {"radius_timeout",	OT_INT, ST_UNDEF, NULL},
 {"radius_retries",	OT_INT,	ST_UNDEF, NULL},
+{"radius_deadtime",	OT_INT,	ST_UNDEF, &default_deadtime},
+{"server_health_file",	OT_STR, ST_UNDEF, NULL},
+{"acct_spool_dir",	OT_STR, ST_UNDEF, NULL},
+{"auth_cache_ttl",	OT_INT, ST_UNDEF, &default_auth_cache_ttl},
+{"auth_cache_uses",	OT_INT, ST_UNDEF, &default_auth_cache_uses},
+{"auth_cache_file",	OT_STR, ST_UNDEF, NULL},
+{"interim_jitter",	OT_INT, ST_UNDEF, &default_interim_jitter},
+{"interim_file",		OT_STR, ST_UNDEF, NULL},
+{"radsec_servers",	OT_STR, ST_UNDEF, NULL},
+{"radsec_ca_file",	OT_STR, ST_UNDEF, NULL},
+{"radsec_ca_path",	OT_STR, ST_UNDEF, NULL},
+{"radsec_cert",		OT_STR, ST_UNDEF, NULL},
+{"radsec_key",		OT_STR, ST_UNDEF, NULL},
+{"dynauth_port",		OT_INT, ST_UNDEF, &default_dynauth_port},
+{"dynauth_dir",		OT_STR, ST_UNDEF, NULL},
+{"dynauth_time_window",	OT_INT, ST_UNDEF, &default_dynauth_time_window},
+{"dynauth_require_timestamp", OT_INT, ST_UNDEF, &default_dynauth_require_timestamp},
 {"nas_identifier",      OT_STR, ST_UNDEF, ""},
 {"bindaddr",            OT_STR, ST_UNDEF, NULL},
 /* local options */
@@ -49,6 +49,7 @@ static char const RCSID[] =
 #include <pppd/crypto.h>
 #include <pppd/fsm.h>
 #include <pppd/ipcp.h>
+#include <pppd/lcp.h>
 
 #include "radiusclient.h"
 
@@ -77,6 +78,10 @@ static option_t Options[] = {
 static pap_check_hook_fn radius_secret_check;
 static pap_auth_hook_fn radius_pap_auth;
 static chap_verify_hook_fn radius_chap_verify;
+static pap_auth_async_hook_fn radius_pap_auth_async;
+static chap_verify_async_hook_fn radius_chap_verify_async;
+static void radius_link_down(void *opaque, int arg);
+static void radius_exit(void *opaque, int arg);
 
 static void radius_ip_up(void *opaque, int arg);
 static void radius_ip_down(void *opaque, int arg);
@@ -90,6 +95,7 @@ static int radius_init(char *msg);
 static int get_client_port(const char *ifname);
 static int radius_allowed_address(u_int32_t addr);
 static void radius_acct_interim(void *);
+static int radius_dynauth(void *arg, AUTH_HDR *req);
 #ifdef PPP_WITH_MPPE
 static int radius_setmppekeys(VALUE_PAIR *vp, REQUEST_INFO *req_info,
 			      unsigned char *);
@@ -116,6 +122,9 @@ struct radius_state {
     char session_id[MAXSESSIONID + 1];
     time_t start_time;
     int acct_interim_interval;
+    int acct_interim_phase;	/* when in each interval to send */
+    int acct_interim_slot;	/* for rc_interim_release */
+    time_t acct_interim_last;	/* when we last sent accounting */
     SERVER *authserver;		/* Authentication server to use */
     SERVER *acctserver;		/* Accounting server to use */
     int class_len;
@@ -153,11 +162,17 @@ plugin_init(void)
     chap_check_hook = radius_secret_check;
     chap_verify_hook = radius_chap_verify;
 
+    /* don't hold up the rest of pppd while the server thinks */
+    pap_auth_async_hook = radius_pap_auth_async;
+    chap_verify_async_hook = radius_chap_verify_async;
+
     ip_choose_hook = radius_choose_ip;
     allowed_address_hook = radius_allowed_address;
 
     ppp_add_notify(NF_IP_UP, radius_ip_up, NULL);
     ppp_add_notify(NF_IP_DOWN, radius_ip_down, NULL);
+    ppp_add_notify(NF_LINK_DOWN, radius_link_down, NULL);
+    ppp_add_notify(NF_EXIT, radius_exit, NULL);
 
     memset(&rstate, 0, sizeof(rstate));
 
@@ -225,37 +240,28 @@ radius_choose_ip(u_int32_t *addrp)
 }
 
 /**********************************************************************
-* %FUNCTION: radius_pap_auth
+* %FUNCTION: radius_pap_request
 * %ARGUMENTS:
 *  user -- user-name of peer
 *  passwd -- password supplied by peer
-*  msgp -- Message which will be sent in PAP response
-*  paddrs -- set to a list of possible peer IP addresses
-*  popts -- set to a list of additional pppd options
+*  sendp -- set to the attributes to send
+*  radius_msg -- buffer of size BUF_LEN for error message
 * %RETURNS:
-*  1 if we can authenticate, -1 if we cannot.
+*  0 if the request was built, -1 if we cannot authenticate.
 * %DESCRIPTION:
-* Performs PAP authentication using RADIUS
+* Builds an Access-Request for PAP authentication
 ***********************************************************************/
 static int
-radius_pap_auth(char *user,
-		char *passwd,
-		char **msgp,
-		struct wordlist **paddrs,
-		struct wordlist **popts)
+radius_pap_request(char *user, char *passwd, VALUE_PAIR **sendp,
+		   char *radius_msg)
 {
-    VALUE_PAIR *send, *received;
+    VALUE_PAIR *send;
     UINT4 av_type;
-    int result;
-    static char radius_msg[BUF_LEN];
     const char *remote_number;
     const char *ipparam;
 
-    radius_msg[0] = 0;
-    *msgp = radius_msg;
-
     if (radius_init(radius_msg) < 0) {
-	return 0;
+	return -1;
     }
 
     /* Put user with potentially realm added in rstate.user */
@@ -268,7 +274,7 @@ radius_pap_auth(char *user,
     }
 
     send = NULL;
-    received = NULL;
+    rc_arena_begin();
 
     /* Hack... the "port" is the ppp interface number.  Should really be
        the tty */
@@ -294,7 +300,76 @@ radius_pap_auth(char *user,
     if (rstate.avp)
 	rc_avpair_insert(&send, NULL, rc_avpair_copy(rstate.avp));
 
-    if (rstate.authserver) {
+    rc_arena_end();
+    *sendp = send;
+    return 0;
+}
+
+/**********************************************************************
+* %FUNCTION: radius_pap_result
+* %ARGUMENTS:
+*  result -- outcome of the request
+*  received -- attributes received from the server
+*  radius_msg -- message from the server
+* %RETURNS:
+*  1 if the peer is authenticated, 0 if not.
+* %DESCRIPTION:
+* Acts on the reply to a PAP Access-Request
+***********************************************************************/
+static int
+radius_pap_result(int result, VALUE_PAIR *received, char *radius_msg)
+{
+    if (result == OK_RC) {
+	if (radius_setparams(received, radius_msg, NULL, NULL, NULL, NULL, 0) < 0) {
+	    result = ERROR_RC;
+	}
+    }
+
+    return (result == OK_RC) ? 1 : 0;
+}
+
+/**********************************************************************
+* %FUNCTION: radius_pap_auth
+* %ARGUMENTS:
+*  user -- user-name of peer
+*  passwd -- password supplied by peer
+*  msgp -- Message which will be sent in PAP response
+*  paddrs -- set to a list of possible peer IP addresses
+*  popts -- set to a list of additional pppd options
+* %RETURNS:
+*  1 if we can authenticate, -1 if we cannot.
+* %DESCRIPTION:
+* Performs PAP authentication using RADIUS, unless the server accepted
+* the same user and password a moment ago (see rc_authcache_get).
+***********************************************************************/
+static int
+radius_pap_auth(char *user,
+		char *passwd,
+		char **msgp,
+		struct wordlist **paddrs,
+		struct wordlist **popts)
+{
+    VALUE_PAIR *send, *received;
+    int result, cached;
+    unsigned char cache_key[AUTH_VECTOR_LEN];
+    static char radius_msg[BUF_LEN];
+
+    radius_msg[0] = 0;
+    *msgp = radius_msg;
+
+    if (radius_pap_request(user, passwd, &send, radius_msg) < 0) {
+	return 0;
+    }
+
+    received = NULL;
+    cached = rc_authcache_key(rstate.user, passwd, strlen(passwd),
+			      cache_key) == 0;
+
+    if (cached && rc_authcache_get(cache_key, &received) == OK_RC) {
+	dbglog("RADIUS: %s accepted recently, not asking again", rstate.user);
+	result = OK_RC;
+	cached = 0;
+    } else if (rstate.authserver) {
 	result = rc_auth_using_server(rstate.authserver,
 				      rstate.client_port, send,
 				      &received, radius_msg, NULL);
@@ -302,64 +377,170 @@ radius_pap_auth(char *user,
 	result = rc_auth(rstate.client_port, send, &received, radius_msg, NULL);
     }
 
-    if (result == OK_RC) {
-	if (radius_setparams(received, radius_msg, NULL, NULL, NULL, NULL, 0) < 0) {
-	    result = ERROR_RC;
-	}
-    }
+    result = radius_pap_result(result, received, radius_msg);
+    if (result && cached)
+	rc_authcache_put(cache_key, received);
 
     /* free value pairs */
     rc_avpair_free(received);
     rc_avpair_free(send);
 
-    return (result == OK_RC) ? 1 : 0;
+    return result;
 }
 
+/*
+ * State of the request started by radius_pap_auth_async or
+ * radius_chap_verify_async, while we wait for the server.
+ */
+static struct radius_pending {
+    pap_auth_done_fn *pap_done;
+    chap_verify_done_fn *chap_done;
+    void *arg;
+    struct chap_digest_type *digest;
+    unsigned char challenge[256];
+    char *message;
+    int message_space;
+    char msg[BUF_LEN];
+    int cached;				/* remember it if accepted */
+    unsigned char cache_key[AUTH_VECTOR_LEN];
+} pending;
+
 /**********************************************************************
-* %FUNCTION: radius_chap_verify
+* %FUNCTION: radius_auth_start
+* %ARGUMENTS:
+*  send -- the attributes to send
+*  callback -- called with the reply
+* %RETURNS:
+*  OK_RC if the request is under way
+* %DESCRIPTION:
+* Sends an Access-Request without waiting for the reply.
+***********************************************************************/
+static int
+radius_auth_start(VALUE_PAIR *send, rc_callback_fn *callback)
+{
+    SERVER *authserver = rstate.authserver;
+    int result;
+
+    if (!authserver)
+	authserver = rc_conf_srv("authserver");
+    result = rc_auth_async(authserver, rstate.client_port, send,
+			   callback, &pending);
+    if (result != OK_RC)
+	rc_avpair_free(send);
+    return result;
+}
+
+/**********************************************************************
+* %FUNCTION: radius_pap_reply
+* %ARGUMENTS:
+*  result, received, msg, info -- the outcome of the request
+*  arg -- ignored
+* %RETURNS:
+*  Nothing
+* %DESCRIPTION:
+* Finishes PAP authentication started by radius_pap_auth_async.
+***********************************************************************/
+static void
+radius_pap_reply(int result, VALUE_PAIR *received, char *msg,
+		 REQUEST_INFO *info, void *arg)
+{
+    pap_auth_done_fn *done = pending.pap_done;
+
+    pending.pap_done = NULL;
+    strlcpy(pending.msg, msg, sizeof(pending.msg));
+    result = radius_pap_result(result, received, pending.msg);
+    if (result && pending.cached)
+	rc_authcache_put(pending.cache_key, received);
+    rc_avpair_free(received);
+
+    (*done)(pending.arg, result, pending.msg, NULL, NULL);
+}
+
+/**********************************************************************
+* %FUNCTION: radius_pap_auth_async
+* %ARGUMENTS:
+*  user, passwd, msgp, paddrs, popts -- as for radius_pap_auth
+*  done -- called with the result once the server replies
+*  arg -- passed to done
+* %RETURNS:
+*  PAP_AUTH_PENDING if the request was sent, 0 if we cannot authenticate.
+* %DESCRIPTION:
+* Performs PAP authentication using RADIUS without blocking pppd.
+***********************************************************************/
+static int
+radius_pap_auth_async(char *user,
+		      char *passwd,
+		      char **msgp,
+		      struct wordlist **paddrs,
+		      struct wordlist **popts,
+		      pap_auth_done_fn *done, void *arg)
+{
+    VALUE_PAIR *send, *received;
+    int result;
+
+    rc_cancel_async(&pending);
+    pending.msg[0] = 0;
+    *msgp = pending.msg;
+
+    if (radius_pap_request(user, passwd, &send, pending.msg) < 0) {
+	return 0;
+    }
+
+    pending.cached = rc_authcache_key(rstate.user, passwd, strlen(passwd),
+				      pending.cache_key) == 0;
+    if (pending.cached && rc_authcache_get(pending.cache_key,
+					   &received) == OK_RC) {
+	dbglog("RADIUS: %s accepted recently, not asking again", rstate.user);
+	rc_avpair_free(send);
+	result = radius_pap_result(OK_RC, received, pending.msg);
+	rc_avpair_free(received);
+	return result;
+    }
+
+    if (radius_auth_start(send, radius_pap_reply) != OK_RC)
+	return 0;
+
+    pending.pap_done = done;
+    pending.chap_done = NULL;
+    pending.arg = arg;
+    return PAP_AUTH_PENDING;
+}
+
+/**********************************************************************
+* %FUNCTION: radius_chap_request
 * %ARGUMENTS:
 *  user -- name of the peer
-*  ourname -- name for this machine
 *  id -- the ID byte in the challenge
 *  digest -- points to the structure representing the digest type
 *  challenge -- the challenge string we sent (length in first byte)
 *  response -- the response (hash) the peer sent back (length in 1st byte)
-*  message -- space for a message to be returned to the peer
-*  message_space -- number of bytes available at *message.
+*  sendp -- set to the attributes to send
+*  radius_msg -- buffer of size BUF_LEN for error message
 * %RETURNS:
-*  1 if the response is good, 0 if it is bad
+*  0 if the request was built, -1 if the response is bad or we cannot
+*  authenticate.
 * %DESCRIPTION:
-* Performs CHAP, MS-CHAP and MS-CHAPv2 authentication using RADIUS.
+* Builds an Access-Request for CHAP, MS-CHAP and MS-CHAPv2 authentication
 ***********************************************************************/
 static int
-radius_chap_verify(char *user, char *ourname, int id,
-		   struct chap_digest_type *digest,
-		   unsigned char *challenge, unsigned char *response,
-		   char *message, int message_space)
+radius_chap_request(char *user, int id,
+		    struct chap_digest_type *digest,
+		    unsigned char *challenge, unsigned char *response,
+		    VALUE_PAIR **sendp, char *radius_msg)
 {
-    VALUE_PAIR *send, *received;
+    VALUE_PAIR *send;
     UINT4 av_type;
-    static char radius_msg[BUF_LEN];
-    int result;
     int challenge_len, response_len;
     u_char cpassword[MAX_RESPONSE_LEN + 1];
-#ifdef PPP_WITH_MPPE
-    /* Need the RADIUS secret and Request Authenticator to decode MPPE */
-    REQUEST_INFO request_info, *req_info = &request_info;
-#else
-    REQUEST_INFO *req_info = NULL;
-#endif
     const char *remote_number;
     const char *ipparam;
 
     challenge_len = *challenge++;
     response_len = *response++;
 
-    radius_msg[0] = 0;
-
     if (radius_init(radius_msg) < 0) {
 	error("%s", radius_msg);
-	return 0;
+	return -1;
     }
 
     /* return error for types we can't handle */
@@ -370,7 +551,7 @@ radius_chap_verify(char *user, char *ourname, int id,
 #endif
 	) {
 	error("RADIUS: Challenge type %u unsupported", digest->code);
-	return 0;
+	return -1;
     }
 
     /* Put user with potentially realm added in rstate.user */
@@ -384,7 +565,8 @@ radius_chap_verify(char *user, char *ourname, int id,
 	}
     }
 
-    send = received = NULL;
+    send = NULL;
+    rc_arena_begin();
 
     av_type = PW_FRAMED;
     rc_avpair_add (&send, PW_SERVICE_TYPE, &av_type, 0, VENDOR_NONE);
@@ -401,7 +583,7 @@ radius_chap_verify(char *user, char *ourname, int id,
     case CHAP_MD5:
 	/* CHAP-Challenge and CHAP-Password */
 	if (response_len != MD5_DIGEST_LENGTH)
-	    return 0;
+	    goto bad;
 	cpassword[0] = id;
 	memcpy(&cpassword[1], response, MD5_DIGEST_LENGTH);
 
@@ -418,7 +600,7 @@ radius_chap_verify(char *user, char *ourname, int id,
 	u_char *p = cpassword;
 
 	if (response_len != MS_CHAP_RESPONSE_LEN)
-	    return 0;
+	    goto bad;
 	*p++ = id;
 	/* The idiots use a different field order in RADIUS than PPP */
 	*p++ = response[MS_CHAP_USENT];
@@ -437,7 +619,7 @@ radius_chap_verify(char *user, char *ourname, int id,
 	u_char *p = cpassword;
 
 	if (response_len != MS_CHAP2_RESPONSE_LEN)
-	    return 0;
+	    goto bad;
 	*p++ = id;
 	/* The idiots use a different field order in RADIUS than PPP */
 	*p++ = response[MS_CHAP2_FLAGS];
@@ -465,25 +647,42 @@ radius_chap_verify(char *user, char *ourname, int id,
     if (rstate.avp)
 	rc_avpair_insert(&send, NULL, rc_avpair_copy(rstate.avp));
 
-    /*
-     * make authentication with RADIUS server
-     */
+    rc_arena_end();
+    *sendp = send;
+    return 0;
 
-    if (rstate.authserver) {
-	result = rc_auth_using_server(rstate.authserver,
-				      rstate.client_port, send,
-				      &received, radius_msg, req_info);
-    } else {
-	result = rc_auth(rstate.client_port, send, &received, radius_msg,
-			 req_info);
-    }
+ bad:
+    rc_arena_end();
+    rc_avpair_free(send);
+    return -1;
+}
 
+/**********************************************************************
+* %FUNCTION: radius_chap_result
+* %ARGUMENTS:
+*  result -- outcome of the request
+*  received -- attributes received from the server
+*  radius_msg -- message from the server
+*  req_info -- secret and authenticator of the request, or NULL
+*  digest, challenge -- as for radius_chap_verify
+*  message -- space for a message to be returned to the peer
+*  message_space -- number of bytes available at *message.
+* %RETURNS:
+*  1 if the response is good, 0 if it is bad
+* %DESCRIPTION:
+* Acts on the reply to a CHAP Access-Request
+***********************************************************************/
+static int
+radius_chap_result(int result, VALUE_PAIR *received, char *radius_msg,
+		   REQUEST_INFO *req_info, struct chap_digest_type *digest,
+		   unsigned char *challenge, char *message, int message_space)
+{
     strlcpy(message, radius_msg, message_space);
 
     if (result == OK_RC) {
 	if (!rstate.done_chap_once) {
 	    if (radius_setparams(received, radius_msg, req_info, digest,
-				 challenge, message, message_space) < 0) {
+				 challenge + 1, message, message_space) < 0) {
 		error("%s", radius_msg);
 		result = ERROR_RC;
 	    } else {
@@ -492,9 +691,272 @@ radius_chap_verify(char *user, char *ourname, int id,
 	}
     }
 
+    return (result == OK_RC);
+}
+
+/**********************************************************************
+* %FUNCTION: radius_chap_verify
+* %ARGUMENTS:
+*  user -- name of the peer
+*  ourname -- name for this machine
+*  id -- the ID byte in the challenge
+*  digest -- points to the structure representing the digest type
+*  challenge -- the challenge string we sent (length in first byte)
+*  response -- the response (hash) the peer sent back (length in 1st byte)
+*  message -- space for a message to be returned to the peer
+*  message_space -- number of bytes available at *message.
+* %RETURNS:
+*  1 if the response is good, 0 if it is bad
+* %DESCRIPTION:
+* Performs CHAP, MS-CHAP and MS-CHAPv2 authentication using RADIUS.
+***********************************************************************/
+static int
+radius_chap_verify(char *user, char *ourname, int id,
+		   struct chap_digest_type *digest,
+		   unsigned char *challenge, unsigned char *response,
+		   char *message, int message_space)
+{
+    VALUE_PAIR *send, *received;
+    static char radius_msg[BUF_LEN];
+    int result;
+#ifdef PPP_WITH_MPPE
+    /* Need the RADIUS secret and Request Authenticator to decode MPPE */
+    REQUEST_INFO request_info, *req_info = &request_info;
+#else
+    REQUEST_INFO *req_info = NULL;
+#endif
+
+    radius_msg[0] = 0;
+
+    if (radius_chap_request(user, id, digest, challenge, response,
+			    &send, radius_msg) < 0) {
+	return 0;
+    }
+
+    received = NULL;
+
+    /*
+     * make authentication with RADIUS server
+     */
+
+    if (rstate.authserver) {
+	result = rc_auth_using_server(rstate.authserver,
+				      rstate.client_port, send,
+				      &received, radius_msg, req_info);
+    } else {
+	result = rc_auth(rstate.client_port, send, &received, radius_msg,
+			 req_info);
+    }
+
+    result = radius_chap_result(result, received, radius_msg, req_info,
+				digest, challenge, message, message_space);
+
     rc_avpair_free(received);
     rc_avpair_free (send);
-    return (result == OK_RC);
+    return result;
+}
+
+/**********************************************************************
+* %FUNCTION: radius_chap_reply
+* %ARGUMENTS:
+*  result, received, msg, info -- the outcome of the request
+*  arg -- ignored
+* %RETURNS:
+*  Nothing
+* %DESCRIPTION:
+* Finishes CHAP authentication started by radius_chap_verify_async.
+***********************************************************************/
+static void
+radius_chap_reply(int result, VALUE_PAIR *received, char *msg,
+		  REQUEST_INFO *info, void *arg)
+{
+    chap_verify_done_fn *done = pending.chap_done;
+
+    pending.chap_done = NULL;
+    strlcpy(pending.msg, msg, sizeof(pending.msg));
+#ifndef PPP_WITH_MPPE
+    info = NULL;
+#endif
+    result = radius_chap_result(result, received, pending.msg, info,
+				pending.digest, pending.challenge,
+				pending.message, pending.message_space);
+    rc_avpair_free(received);
+
+    (*done)(pending.arg, result);
+}
+
+/**********************************************************************
+* %FUNCTION: radius_chap_verify_async
+* %ARGUMENTS:
+*  user ... message_space -- as for radius_chap_verify
+*  done -- called with the result once the server replies
+*  arg -- passed to done
+* %RETURNS:
+*  CHAP_VERIFY_PENDING if the request was sent, 0 if the response is bad
+*  or we cannot authenticate.
+* %DESCRIPTION:
+* Performs CHAP authentication using RADIUS without blocking pppd.
+***********************************************************************/
+static int
+radius_chap_verify_async(char *user, char *ourname, int id,
+			 struct chap_digest_type *digest,
+			 unsigned char *challenge, unsigned char *response,
+			 char *message, int message_space,
+			 chap_verify_done_fn *done, void *arg)
+{
+    VALUE_PAIR *send;
+
+    rc_cancel_async(&pending);
+    pending.msg[0] = 0;
+
+    if (radius_chap_request(user, id, digest, challenge, response,
+			    &send, pending.msg) < 0) {
+	return 0;
+    }
+
+    if (radius_auth_start(send, radius_chap_reply) != OK_RC)
+	return 0;
+
+    pending.pap_done = NULL;
+    pending.chap_done = done;
+    pending.arg = arg;
+    pending.digest = digest;
+    memcpy(pending.challenge, challenge, challenge[0] + 1);
+    pending.message = message;
+    pending.message_space = message_space;
+    return CHAP_VERIFY_PENDING;
+}
+
+/**********************************************************************
+* %FUNCTION: radius_link_down
+* %ARGUMENTS:
+*  opaque -- ignored
+*  arg -- ignored
+* %RETURNS:
+*  Nothing
+* %DESCRIPTION:
+*  Called when the link goes down.  Abandons any request still waiting
+*  for the server, since pppd no longer wants the answer.
+***********************************************************************/
+static void
+radius_link_down(void *opaque, int arg)
+{
+    rc_cancel_async(&pending);
+    pending.pap_done = NULL;
+    pending.chap_done = NULL;
+}
+
+/**********************************************************************
+* %FUNCTION: radius_exit
+* %ARGUMENTS:
+*  opaque -- ignored
+*  arg -- ignored
+* %RETURNS:
+*  Nothing
+* %DESCRIPTION:
+*  Called when pppd is about to exit.  Makes a last try at sending any
+*  spooled accounting records; those left stay in the spool.
+***********************************************************************/
+static void
+radius_exit(void *opaque, int arg)
+{
+    rc_spool_flush();
+}
+
+/**********************************************************************
+* %FUNCTION: radius_dynauth
+* %ARGUMENTS:
+*  arg -- ignored
+*  req -- Disconnect-Request or CoA-Request naming our session
+* %RETURNS:
+*  0 if done; otherwise the Error-Cause to tell the server
+* %DESCRIPTION:
+*  Acts on a request from the server, RFC 5176.  A Disconnect-Request
+*  closes the link; a CoA-Request changes the session's time and
+*  traffic limits, which apply at once, as if they had come in the
+*  Access-Accept: Session-Timeout still counts from when the link came
+*  up, and 0 takes a limit away.  A CoA-Request with anything else to
+*  change is refused and changes nothing.
+***********************************************************************/
+static int
+radius_dynauth(void *arg, AUTH_HDR *req)
+{
+    RC_ATTR_CURSOR cur;
+    RC_ATTR attr;
+    UINT4 value;
+    int pass;
+
+    if (req->code == PW_DISCONNECT_REQUEST) {
+	notice("RADIUS: disconnect requested by server");
+	ppp_set_status(EXIT_USER_REQUEST);
+	lcp_close(0, "Disconnected by RADIUS server");
+	return 0;
+    }
+
+    /* check it all first, then apply it */
+    for (pass = 0; pass < 2; ++pass) {
+	rc_attr_first(&cur, req);
+	while (rc_attr_next(&cur, &attr)) {
+	    if (attr.vendorcode != VENDOR_NONE)
+		return PW_ERROR_UNSUPPORTED_ATTRIBUTE;
+	    value = 0;
+	    if (attr.len == 4) {
+		memcpy(&value, attr.value, 4);
+		value = ntohl(value);
+	    }
+	    switch (attr.attribute) {
+	    case PW_SESSION_TIMEOUT:
+	    case PW_IDLE_TIMEOUT:
+	    case PW_SESSION_OCTETS_LIMIT:
+	    case PW_OCTETS_DIRECTION:
+		if (attr.len != 4)
+		    return PW_ERROR_INVALID_REQUEST;
+		break;
+
+	    /* naming the session or the NAS, or the server's business */
+	    case PW_USER_NAME:
+	    case PW_ACCT_SESSION_ID:
+	    case PW_FRAMED_IP_ADDRESS:
+	    case PW_NAS_IP_ADDRESS:
+	    case PW_NAS_IDENTIFIER:
+	    case PW_NAS_PORT:
+	    case PW_CALLING_STATION_ID:
+	    case PW_CALLED_STATION_ID:
+	    case PW_EVENT_TIMESTAMP:
+	    case PW_MESSAGE_AUTHENTICATOR:
+	    case PW_PROXY_STATE:
+	    case PW_STATE:
+	    case PW_CLASS:
+		continue;
+
+	    default:
+		return PW_ERROR_UNSUPPORTED_ATTRIBUTE;
+	    }
+	    if (pass == 0)
+		continue;
+
+	    switch (attr.attribute) {
+	    case PW_SESSION_TIMEOUT:
+		ppp_set_max_connect_time(value);
+		break;
+	    case PW_IDLE_TIMEOUT:
+		ppp_set_max_idle_time(value);
+		break;
+	    case PW_SESSION_OCTETS_LIMIT:
+		ppp_set_session_limit(value);
+		break;
+	    case PW_OCTETS_DIRECTION:
+		ppp_set_session_limit_dir(value);
+		break;
+	    }
+	    info("RADIUS: server changed %s to %u",
+		 attr.attribute == PW_SESSION_TIMEOUT? "Session-Timeout":
+		 attr.attribute == PW_IDLE_TIMEOUT? "Idle-Timeout":
+		 attr.attribute == PW_SESSION_OCTETS_LIMIT?
+		 "Session-Octets-Limit": "Octets-Direction", value);
+	}
+    }
+    return 0;
 }
 
 /**********************************************************************
@@ -997,6 +1459,7 @@ radius_acct_start(void)
 
     strlcpy(rstate.session_id, rc_mksid(), MAXSESSIONID);
 
+    rc_arena_begin();
     rc_avpair_add(&send, PW_ACCT_SESSION_ID,
 		   rstate.session_id, 0, VENDOR_NONE);
     rc_avpair_add(&send, PW_USER_NAME,
@@ -1038,12 +1501,9 @@ radius_acct_start(void)
     if (rstate.avp)
 	rc_avpair_insert(&send, NULL, rc_avpair_copy(rstate.avp));
 
-    if (rstate.acctserver) {
-	result = rc_acct_using_server(rstate.acctserver,
-				      rstate.client_port, send);
-    } else {
-	result = rc_acct(rstate.client_port, send);
-    }
+    result = rc_acct_spool(rstate.acctserver ? rstate.acctserver :
+			   rc_conf_srv("acctserver"), rstate.client_port, send);
+    rc_arena_end();
 
     rc_avpair_free(send);
 
@@ -1053,9 +1513,20 @@ radius_acct_start(void)
 		"Accounting START failed for %s", rstate.user);
     }
 
+    /* Let the server change or end the session */
+    rc_dynauth_start(rstate.session_id, ntohl(hisaddr), rstate.user,
+		     radius_dynauth, NULL);
+
     /* Kick off periodic accounting reports */
     if (rstate.acct_interim_interval) {
-	ppp_timeout(radius_acct_interim, NULL, rstate.acct_interim_interval, 0);
+	rstate.acct_interim_phase =
+	    rc_interim_phase(rstate.session_id, rstate.acct_interim_interval,
+			     &rstate.acct_interim_slot);
+	rstate.acct_interim_last = time(NULL);
+	ppp_timeout(radius_acct_interim, NULL,
+		    rc_interim_next(rstate.acct_interim_interval,
+				    rstate.acct_interim_phase,
+				    rstate.acct_interim_last), 0);
     }
 }
 
@@ -1084,9 +1555,15 @@ radius_acct_stop(void)
 	return;
     }
 
-    if (rstate.acct_interim_interval)
+    rc_dynauth_stop();
+
+    if (rstate.acct_interim_interval) {
 	ppp_untimeout(radius_acct_interim, NULL);
+	rc_interim_release(rstate.acct_interim_interval,
+			   rstate.acct_interim_slot);
+    }
 
+    rc_arena_begin();
     rc_avpair_add(&send, PW_ACCT_SESSION_ID, rstate.session_id,
 		   0, VENDOR_NONE);
 
@@ -1207,12 +1684,9 @@ radius_acct_stop(void)
     if (rstate.avp)
 	rc_avpair_insert(&send, NULL, rc_avpair_copy(rstate.avp));
 
-    if (rstate.acctserver) {
-	result = rc_acct_using_server(rstate.acctserver,
-				      rstate.client_port, send);
-    } else {
-	result = rc_acct(rstate.client_port, send);
-    }
+    result = rc_acct_spool(rstate.acctserver ? rstate.acctserver :
+			   rc_conf_srv("acctserver"), rstate.client_port, send);
+    rc_arena_end();
 
     if (result != OK_RC) {
 	/* RADIUS server could be down so make this a warning */
@@ -1229,7 +1703,9 @@ radius_acct_stop(void)
 * %RETURNS:
 *  Nothing
 * %DESCRIPTION:
-*  Sends an interim accounting message to the RADIUS server
+*  Sends an interim accounting message to the RADIUS server, and
+*  schedules the next one at this session's point in the interval
+*  (see rc_interim_next).
 ***********************************************************************/
 static void
 radius_acct_interim(void *ignored)
@@ -1247,6 +1723,7 @@ radius_acct_interim(void *ignored)
 	return;
     }
 
+    rc_arena_begin();
     rc_avpair_add(&send, PW_ACCT_SESSION_ID, rstate.session_id,
 		   0, VENDOR_NONE);
 
@@ -1315,12 +1792,9 @@ radius_acct_interim(void *ignored)
     if (rstate.avp)
 	rc_avpair_insert(&send, NULL, rc_avpair_copy(rstate.avp));
 
-    if (rstate.acctserver) {
-	result = rc_acct_using_server(rstate.acctserver,
-				      rstate.client_port, send);
-    } else {
-	result = rc_acct(rstate.client_port, send);
-    }
+    result = rc_acct_spool(rstate.acctserver ? rstate.acctserver :
+			   rc_conf_srv("acctserver"), rstate.client_port, send);
+    rc_arena_end();
 
     if (result != OK_RC) {
 	/* RADIUS server could be down so make this a warning */
@@ -1330,7 +1804,11 @@ radius_acct_interim(void *ignored)
     rc_avpair_free(send);
 
     /* Schedule another one */
-    ppp_timeout(radius_acct_interim, NULL, rstate.acct_interim_interval, 0);
+    rstate.acct_interim_last = time(NULL);
+    ppp_timeout(radius_acct_interim, NULL,
+		rc_interim_next(rstate.acct_interim_interval,
+				rstate.acct_interim_phase,
+				rstate.acct_interim_last), 0);
 }
 
 /**********************************************************************
@@ -1414,6 +1892,9 @@ radius_init(char *msg)
 	free(avpopt);
 	avpopt = n;
     }
+
+    /* Pick up accounting left unsent by an earlier pppd */
+    rc_spool_init(rc_conf_srv("acctserver"));
     return 0;
 }
 
@@ -0,0 +1,736 @@
+/*
+ * radius_bench.c - how many requests a second the client gets through,
+ * and how long each takes, against a RADIUS server.
+ *
+ *
+ * Copyright (c) 2026 The ppp project. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The name(s) of the authors of this software must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission.
+ *
+ * THE AUTHORS OF THIS SOFTWARE DISCLAIM ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS, IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+ * AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <includes.h>
+#include <radiusclient.h>
+#include <sys/time.h>
+#include <sys/select.h>
+
+/*
+ * Run by "make bench" against radius_standin, or against any server
+ * that has a client entry for us.  Each kind of request is built with
+ * the attributes radius.c gives it and sent the way radius.c sends it:
+ * by default through rc_auth_async and rc_send_server_async, as many
+ * at a time as -c says, with a little main loop standing in for
+ * pppd's; with -b one at a time through rc_auth_using_server and
+ * rc_acct_using_server, which is what pppd does without async
+ * authentication.  This stands in for pppd, so the things the library
+ * wants from it are here.
+ */
+
+enum { RQ_PAP, RQ_CHAP, RQ_MSCHAPV2, RQ_ACCT, RQ_KINDS };
+static const char *kind_names[RQ_KINDS] = { "pap", "chap", "mschapv2", "acct" };
+
+static const char dict_text[] =
+    "ATTRIBUTE User-Name 1 string\n"
+    "ATTRIBUTE User-Password 2 string\n"
+    "ATTRIBUTE CHAP-Password 3 string\n"
+    "ATTRIBUTE NAS-IP-Address 4 ipaddr\n"
+    "ATTRIBUTE NAS-Port 5 integer\n"
+    "ATTRIBUTE Service-Type 6 integer\n"
+    "ATTRIBUTE Framed-Protocol 7 integer\n"
+    "ATTRIBUTE Framed-IP-Address 8 ipaddr\n"
+    "ATTRIBUTE Reply-Message 18 string\n"
+    "ATTRIBUTE Class 25 string\n"
+    "ATTRIBUTE Session-Timeout 27 integer\n"
+    "ATTRIBUTE Calling-Station-Id 31 string\n"
+    "ATTRIBUTE NAS-Identifier 32 string\n"
+    "ATTRIBUTE Acct-Status-Type 40 integer\n"
+    "ATTRIBUTE Acct-Delay-Time 41 integer\n"
+    "ATTRIBUTE Acct-Input-Octets 42 integer\n"
+    "ATTRIBUTE Acct-Output-Octets 43 integer\n"
+    "ATTRIBUTE Acct-Session-Id 44 string\n"
+    "ATTRIBUTE Acct-Authentic 45 integer\n"
+    "ATTRIBUTE Acct-Session-Time 46 integer\n"
+    "ATTRIBUTE Acct-Input-Packets 47 integer\n"
+    "ATTRIBUTE Acct-Output-Packets 48 integer\n"
+    "ATTRIBUTE CHAP-Challenge 60 string\n"
+    "ATTRIBUTE NAS-Port-Type 61 integer\n"
+    "ATTRIBUTE Acct-Interim-Interval 85 integer\n"
+    "VENDOR Microsoft 311\n"
+    "ATTRIBUTE MS-CHAP-Challenge 11 string Microsoft\n"
+    "ATTRIBUTE MS-CHAP2-Response 25 string Microsoft\n"
+    "ATTRIBUTE MS-CHAP2-Success 26 string Microsoft\n";
+
+static int verbose;
+
+static void
+logit(const char *fmt, va_list args)
+{
+    vfprintf(stderr, fmt, args);
+    fputc('\n', stderr);
+}
+
+void
+error(const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    logit(fmt, args);
+    va_end(args);
+}
+
+void
+warn(const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    logit(fmt, args);
+    va_end(args);
+}
+
+void
+notice(const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    if (verbose)
+	logit(fmt, args);
+    va_end(args);
+}
+
+void
+info(const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    if (verbose)
+	logit(fmt, args);
+    va_end(args);
+}
+
+void
+dbglog(const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    if (verbose)
+	logit(fmt, args);
+    va_end(args);
+}
+
+void
+fatal(const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    logit(fmt, args);
+    va_end(args);
+    exit(1);
+}
+
+void
+novm(const char *msg)
+{
+    fprintf(stderr, "out of memory for %s\n", msg);
+    exit(1);
+}
+
+int
+slprintf(char *buf, int buflen, const char *fmt, ...)
+{
+    va_list args;
+    int n;
+
+    va_start(args, fmt);
+    n = vsnprintf(buf, buflen, fmt, args);
+    va_end(args);
+    return n;
+}
+
+size_t
+strlcpy(char *dest, const char *src, size_t len)
+{
+    size_t ret = strlen(src);
+
+    if (len != 0) {
+	if (ret < len)
+	    strcpy(dest, src);
+	else {
+	    strncpy(dest, src, len - 1);
+	    dest[len-1] = 0;
+	}
+    }
+    return ret;
+}
+
+const char *
+ppp_hostname(void)
+{
+    return "localhost";
+}
+
+int
+ppp_get_time(struct timeval *tv)
+{
+    return gettimeofday(tv, NULL);
+}
+
+bool
+ppp_signaled(int sig)
+{
+    return 0;
+}
+
+u_int32_t
+magic(void)
+{
+    return random();
+}
+
+void
+random_bytes(unsigned char *buf, int len)
+{
+    while (len-- > 0)
+	*buf++ = random();
+}
+
+/* RadSec isn't benchmarked here */
+int
+rc_radsec_server(const char *name)
+{
+    return 0;
+}
+
+RC_RADSEC *
+rc_radsec_new(const char *name, UINT4 ipaddr, unsigned short port,
+	      rc_radsec_input_fn *input, rc_radsec_lost_fn *lost, void *arg)
+{
+    return NULL;
+}
+
+int
+rc_radsec_connect(RC_RADSEC *conn, int timeout)
+{
+    return ERROR_RC;
+}
+
+int
+rc_radsec_send(RC_RADSEC *conn, const char *buf, int len)
+{
+    return ERROR_RC;
+}
+
+int
+rc_radsec_wait(RC_RADSEC *conn, struct timeval *timeout)
+{
+    return -1;
+}
+
+/*
+ * pppd's timeouts and fd handlers, and a main loop to run them.
+ */
+struct callout {
+    struct timeval due;
+    void (*func)(void *);
+    void *arg;
+    struct callout *next;
+};
+
+static struct callout *callouts;
+
+struct fd_handler {
+    int fd;
+    ppp_fd_handler_fn *func;
+    void *arg;
+};
+
+static struct fd_handler fd_handlers[16];
+static int n_fd_handlers;
+
+void
+ppp_timeout(void (*func)(void *), void *arg, int secs, int usecs)
+{
+    struct callout *c, **pp;
+
+    if ((c = malloc(sizeof(*c))) == NULL)
+	novm("callout");
+    c->func = func;
+    c->arg = arg;
+    gettimeofday(&c->due, NULL);
+    c->due.tv_sec += secs + usecs / 1000000;
+    c->due.tv_usec += usecs % 1000000;
+    if (c->due.tv_usec >= 1000000) {
+	c->due.tv_sec += 1;
+	c->due.tv_usec -= 1000000;
+    }
+    for (pp = &callouts; *pp != NULL; pp = &(*pp)->next)
+	if (timercmp(&c->due, &(*pp)->due, <))
+	    break;
+    c->next = *pp;
+    *pp = c;
+}
+
+void
+ppp_untimeout(void (*func)(void *), void *arg)
+{
+    struct callout *c, **pp;
+
+    for (pp = &callouts; (c = *pp) != NULL; pp = &c->next) {
+	if (c->func == func && c->arg == arg) {
+	    *pp = c->next;
+	    free(c);
+	    return;
+	}
+    }
+}
+
+int
+ppp_add_fd_handler(int fd, ppp_fd_handler_fn *func, void *arg)
+{
+    int i;
+
+    for (i = 0; i < n_fd_handlers; ++i)
+	if (fd_handlers[i].fd == fd)
+	    break;
+    if (i == n_fd_handlers) {
+	if (n_fd_handlers == sizeof(fd_handlers) / sizeof(fd_handlers[0]))
+	    return -1;
+	++n_fd_handlers;
+    }
+    fd_handlers[i].fd = fd;
+    fd_handlers[i].func = func;
+    fd_handlers[i].arg = arg;
+    return 0;
+}
+
+void
+ppp_remove_fd_handler(int fd)
+{
+    int i;
+
+    for (i = 0; i < n_fd_handlers; ++i) {
+	if (fd_handlers[i].fd == fd) {
+	    fd_handlers[i] = fd_handlers[--n_fd_handlers];
+	    return;
+	}
+    }
+}
+
+static void
+run_once(void)
+{
+    struct timeval now, wait, *waitp = NULL;
+    struct callout *c;
+    fd_set readfds;
+    int i, maxfd = -1;
+
+    gettimeofday(&now, NULL);
+    while ((c = callouts) != NULL && !timercmp(&now, &c->due, <)) {
+	callouts = c->next;
+	(*c->func)(c->arg);
+	free(c);
+    }
+    if (callouts != NULL) {
+	timersub(&callouts->due, &now, &wait);
+	waitp = &wait;
+    }
+
+    FD_ZERO(&readfds);
+    for (i = 0; i < n_fd_handlers; ++i) {
+	FD_SET(fd_handlers[i].fd, &readfds);
+	if (fd_handlers[i].fd > maxfd)
+	    maxfd = fd_handlers[i].fd;
+    }
+    if (select(maxfd + 1, &readfds, NULL, NULL, waitp) <= 0)
+	return;
+    for (i = 0; i < n_fd_handlers; ++i)
+	if (FD_ISSET(fd_handlers[i].fd, &readfds))
+	    (*fd_handlers[i].func)(fd_handlers[i].fd, fd_handlers[i].arg);
+}
+
+/*
+ * The benchmark.
+ */
+struct run {
+    int kind;
+    int total;			/* requests to send */
+    int sent, done;
+    int accepted, rejected, noreply, failed;
+    double *latency;		/* of each, in seconds */
+};
+
+struct request {
+    struct run *run;
+    double start;
+};
+
+static SERVER *authserver, *acctserver;
+static int concurrency = 64;
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+fill(unsigned char *buf, int len)
+{
+    random_bytes(buf, len);
+}
+
+/* A request of the given kind, as radius.c makes it */
+static VALUE_PAIR *
+build(int kind, int n)
+{
+    VALUE_PAIR *send = NULL;
+    char user[64], passwd[32], session[32];
+    unsigned char challenge[16], response[64];
+    UINT4 av_type;
+
+    slprintf(user, sizeof(user), "user%d@isp.example.net", n);
+    rc_arena_begin();
+
+    if (kind == RQ_ACCT) {
+	slprintf(session, sizeof(session), "%08X%08X", 0x5f3a9c0b, n);
+	rc_avpair_add(&send, PW_ACCT_SESSION_ID, session, 0, VENDOR_NONE);
+	rc_avpair_add(&send, PW_USER_NAME, user, 0, VENDOR_NONE);
+	rc_avpair_add(&send, PW_CLASS, "standin", 7, VENDOR_NONE);
+	av_type = PW_STATUS_ALIVE;
+	rc_avpair_add(&send, PW_ACCT_STATUS_TYPE, &av_type, 0, VENDOR_NONE);
+	av_type = PW_FRAMED;
+	rc_avpair_add(&send, PW_SERVICE_TYPE, &av_type, 0, VENDOR_NONE);
+	av_type = PW_PPP;
+	rc_avpair_add(&send, PW_FRAMED_PROTOCOL, &av_type, 0, VENDOR_NONE);
+	av_type = PW_RADIUS;
+	rc_avpair_add(&send, PW_ACCT_AUTHENTIC, &av_type, 0, VENDOR_NONE);
+	av_type = 3600;
+	rc_avpair_add(&send, PW_ACCT_SESSION_TIME, &av_type, 0, VENDOR_NONE);
+	av_type = 987654321;
+	rc_avpair_add(&send, PW_ACCT_OUTPUT_OCTETS, &av_type, 0, VENDOR_NONE);
+	av_type = 123456789;
+	rc_avpair_add(&send, PW_ACCT_INPUT_OCTETS, &av_type, 0, VENDOR_NONE);
+	av_type = 765432;
+	rc_avpair_add(&send, PW_ACCT_OUTPUT_PACKETS, &av_type, 0, VENDOR_NONE);
+	av_type = 123456;
+	rc_avpair_add(&send, PW_ACCT_INPUT_PACKETS, &av_type, 0, VENDOR_NONE);
+	rc_avpair_add(&send, PW_CALLING_STATION_ID, "00:11:22:33:44:55", 0,
+		      VENDOR_NONE);
+	av_type = PW_VIRTUAL;
+	rc_avpair_add(&send, PW_NAS_PORT_TYPE, &av_type, 0, VENDOR_NONE);
+	av_type = htonl(0x0a000000 + n);
+	rc_avpair_add(&send, PW_FRAMED_IP_ADDRESS, &av_type, 0, VENDOR_NONE);
+	rc_arena_end();
+	return send;
+    }
+
+    av_type = PW_FRAMED;
+    rc_avpair_add(&send, PW_SERVICE_TYPE, &av_type, 0, VENDOR_NONE);
+    av_type = PW_PPP;
+    rc_avpair_add(&send, PW_FRAMED_PROTOCOL, &av_type, 0, VENDOR_NONE);
+    rc_avpair_add(&send, PW_USER_NAME, user, 0, VENDOR_NONE);
+
+    switch (kind) {
+    case RQ_PAP:
+	slprintf(passwd, sizeof(passwd), "password%d", n);
+	rc_avpair_add(&send, PW_USER_PASSWORD, passwd, 0, VENDOR_NONE);
+	break;
+    case RQ_CHAP:
+	/* id, then the MD5 response */
+	fill(challenge, 16);
+	fill(response, 17);
+	rc_avpair_add(&send, PW_CHAP_CHALLENGE, challenge, 16, VENDOR_NONE);
+	rc_avpair_add(&send, PW_CHAP_PASSWORD, response, 17, VENDOR_NONE);
+	break;
+    case RQ_MSCHAPV2:
+	/* id, flags, peer challenge, reserved, NT response */
+	fill(challenge, 16);
+	fill(response, 50);
+	rc_avpair_add(&send, PW_MS_CHAP_CHALLENGE, challenge, 16,
+		      VENDOR_MICROSOFT);
+	rc_avpair_add(&send, PW_MS_CHAP2_RESPONSE, response, 50,
+		      VENDOR_MICROSOFT);
+	break;
+    }
+    rc_avpair_add(&send, PW_CALLING_STATION_ID, "00:11:22:33:44:55", 0,
+		  VENDOR_NONE);
+    rc_arena_end();
+    return send;
+}
+
+static void
+count(struct run *run, int result, double start)
+{
+    run->latency[run->done++] = now() - start;
+    switch (result) {
+    case OK_RC:
+	++run->accepted;
+	break;
+    case BADRESP_RC:
+	++run->rejected;
+	break;
+    case TIMEOUT_RC:
+	++run->noreply;
+	break;
+    default:
+	++run->failed;
+	break;
+    }
+}
+
+static int start_one(struct run *);
+
+static void
+done_one(int result, VALUE_PAIR *received, char *msg, REQUEST_INFO *info,
+	 void *arg)
+{
+    struct request *req = arg;
+    struct run *run = req->run;
+
+    rc_avpair_free(received);
+    count(run, result, req->start);
+    free(req);
+    while (run->sent < run->total && start_one(run) != OK_RC)
+	;
+}
+
+/* Send the next request of a run without waiting for the reply */
+static int
+start_one(struct run *run)
+{
+    struct request *req;
+    VALUE_PAIR *send;
+    UINT4 port = run->sent, delay = 0;
+    int result;
+
+    if ((req = malloc(sizeof(*req))) == NULL)
+	novm("request");
+    req->run = run;
+    req->start = now();
+    send = build(run->kind, run->sent++);
+
+    if (run->kind != RQ_ACCT)
+	result = rc_auth_async(authserver, port, send, done_one, req);
+    else {
+	/* what rc_acct_using_server adds, as spool.c does */
+	if (rc_get_nas_id(&send) == ERROR_RC
+	    || rc_avpair_add(&send, PW_NAS_PORT, &port, 0, VENDOR_NONE) == NULL
+	    || rc_avpair_add(&send, PW_ACCT_DELAY_TIME, &delay, 0,
+			     VENDOR_NONE) == NULL)
+	    result = ERROR_RC;
+	else
+	    result = rc_send_server_async(PW_ACCOUNTING_REQUEST, acctserver,
+					  send, done_one, req);
+    }
+    if (result != OK_RC) {
+	rc_avpair_free(send);
+	count(run, result, req->start);
+	free(req);
+    }
+    return result;
+}
+
+/* Send one request and wait for the reply */
+static void
+send_blocking(struct run *run)
+{
+    VALUE_PAIR *send, *received = NULL;
+    char msg[BUFFER_LEN];
+    double start = now();
+    int result;
+
+    send = build(run->kind, run->sent);
+    if (run->kind != RQ_ACCT)
+	result = rc_auth_using_server(authserver, run->sent, send, &received,
+				      msg, NULL);
+    else
+	result = rc_acct_using_server(acctserver, run->sent, send);
+    ++run->sent;
+    rc_avpair_free(send);
+    rc_avpair_free(received);
+    count(run, result, start);
+}
+
+static int
+cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+static double
+percentile(struct run *run, int pct)
+{
+    int i = (run->done * pct + 99) / 100 - 1;
+
+    return run->latency[i < 0 ? 0 : i] * 1e3;
+}
+
+static void
+bench(int kind, int total, int blocking)
+{
+    struct run run;
+    double t0, elapsed;
+    int i;
+
+    memset(&run, 0, sizeof(run));
+    run.kind = kind;
+    run.total = total;
+    if ((run.latency = malloc(total * sizeof(double))) == NULL)
+	novm("latencies");
+
+    t0 = now();
+    if (blocking) {
+	while (run.sent < total)
+	    send_blocking(&run);
+    } else {
+	for (i = 0; i < concurrency && run.sent < total; )
+	    if (start_one(&run) == OK_RC)
+		++i;
+	while (run.done < total)
+	    run_once();
+    }
+    elapsed = now() - t0;
+
+    qsort(run.latency, run.done, sizeof(double), cmp_double);
+    printf("%-9s %7d sent %7d ok %6d rejected %6d no reply %6d failed"
+	   " %8.0f req/s   ms: p50 %.2f p90 %.2f p99 %.2f max %.2f\n",
+	   kind_names[kind], total, run.accepted, run.rejected, run.noreply,
+	   run.failed, total / elapsed, percentile(&run, 50),
+	   percentile(&run, 90), percentile(&run, 99),
+	   percentile(&run, 100));
+    free(run.latency);
+}
+
+static void
+usage(void)
+{
+    fprintf(stderr, "usage: bench_radius [-bv] [-a address] [-p port]"
+	    " [-s secret] [-n requests]\n\t[-c concurrency] [-t timeout]"
+	    " [-r retries] [-k pap,chap,mschapv2,acct]\n");
+    exit(1);
+}
+
+/* The library reads the servers file when it needs it */
+static char dir[] = "/tmp/bench_radius.XXXXXX";
+static char servers[64];
+
+static void
+cleanup(void)
+{
+    unlink(servers);
+    rmdir(dir);
+}
+
+/* Write a file for the library to read */
+static int
+write_file(char *path, const char *text)
+{
+    FILE *f = fopen(path, "w");
+
+    if (f == NULL || fputs(text, f) == EOF || fclose(f) == EOF) {
+	perror(path);
+	return -1;
+    }
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    char conf[64], dict[64], text[1024];
+    char *address = "127.0.0.1", *secret = "testing123";
+    char *kinds = "pap,chap,mschapv2,acct";
+    int port = PW_AUTH_UDP_PORT, total = 20000, timeout = 2, retries = 3;
+    int blocking = 0, ok, c, i;
+
+    while ((c = getopt(argc, argv, "a:bc:k:n:p:r:s:t:v")) != -1) {
+	switch (c) {
+	case 'a': address = optarg; break;
+	case 'b': blocking = 1; break;
+	case 'c': concurrency = atoi(optarg); break;
+	case 'k': kinds = optarg; break;
+	case 'n': total = atoi(optarg); break;
+	case 'p': port = atoi(optarg); break;
+	case 'r': retries = atoi(optarg); break;
+	case 's': secret = optarg; break;
+	case 't': timeout = atoi(optarg); break;
+	case 'v': verbose = 1; break;
+	default: usage();
+	}
+    }
+    /* identifiers run out past 256 at a time */
+    if (optind != argc || total <= 0 || concurrency <= 0
+	|| concurrency > 256 || timeout <= 0 || retries <= 0)
+	usage();
+
+    if (mkdtemp(dir) == NULL) {
+	perror(dir);
+	return 1;
+    }
+    atexit(cleanup);
+    slprintf(conf, sizeof(conf), "%s/radiusclient.conf", dir);
+    slprintf(dict, sizeof(dict), "%s/dictionary", dir);
+    slprintf(servers, sizeof(servers), "%s/servers", dir);
+    slprintf(text, sizeof(text),
+	     "authserver %s:%d\nacctserver %s:%d\nservers %s\n"
+	     "dictionary %s\nradius_timeout %d\nradius_retries %d\n"
+	     "radius_deadtime 0\nmapfile /dev/null\nnas_identifier bench\n",
+	     address, port, address, port, servers, dict, timeout, retries);
+    ok = write_file(conf, text) == 0 && write_file(dict, dict_text) == 0;
+    if (ok) {
+	slprintf(text, sizeof(text), "%s %s\n", address, secret);
+	ok = write_file(servers, text) == 0;
+    }
+    ok = ok && rc_read_config(conf) == 0 && rc_read_dictionary(dict) == 0;
+    unlink(conf);
+    unlink(dict);
+    if (!ok)
+	return 1;
+    authserver = rc_conf_srv("authserver");
+    acctserver = rc_conf_srv("acctserver");
+
+    printf("%s:%d, %s, %d requests of each kind\n", address, port,
+	   blocking ? "one at a time" : "async", total);
+    if (!blocking)
+	printf("at most %d at a time\n", concurrency);
+    for (i = 0; i < RQ_KINDS; ++i) {
+	const char *p = strstr(kinds, kind_names[i]);
+	int len = strlen(kind_names[i]);
+
+	if (p != NULL && (p == kinds || p[-1] == ',')
+	    && (p[len] == '\0' || p[len] == ','))
+	    bench(i, total, blocking);
+    }
+    return 0;
+}
@@ -0,0 +1,413 @@
+/*
+ * radius_standin.c - a RADIUS server for load-testing the client: it
+ * answers every request, after a delay, unless told to lose some.
+ *
+ *
+ * Copyright (c) 2026 The ppp project. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The name(s) of the authors of this software must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission.
+ *
+ * THE AUTHORS OF THIS SOFTWARE DISCLAIM ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS, IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+ * AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <includes.h>
+#include <radiusclient.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/select.h>
+
+/*
+ * Started by "make bench" for bench_radius to send its requests to,
+ * but it can be pointed at by any client.  It doesn't check passwords:
+ * it accepts an Access-Request, or rejects it at random at the rate
+ * given with -r, and answers any Accounting-Request that carries the
+ * right authenticator.  Each answer is held back by the delay given
+ * with -d, give or take the jitter given with -j, and the share of
+ * requests given with -l is dropped without an answer.
+ *
+ * The client should be configured with the same secret (-s).  It
+ * prints what it did when it is stopped with SIGINT or SIGTERM.
+ */
+
+/* An answer waiting to be sent */
+struct answer {
+    struct timeval due;
+    struct sockaddr_in to;
+    int len;
+    unsigned char pkt[RC_PACKET_MAX];
+};
+
+/* The answers waiting, kept as a heap by when they are due */
+static struct answer **heap;
+static int nheap, maxheap;
+
+static char *secret = "testing123";
+static int delay_us, jitter_us;
+static int loss_pct, reject_pct;
+static volatile int stopped;
+
+static unsigned long n_requests, n_accepts, n_rejects, n_acct,
+    n_lost, n_bad;
+
+void
+error(const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+static void
+usage(void)
+{
+    fprintf(stderr, "usage: radius_standin [-b] [-a address] [-p port]"
+	    " [-s secret]\n\t[-d delay-ms] [-j jitter-ms] [-l loss-%%]"
+	    " [-r reject-%%]\n");
+    exit(1);
+}
+
+static void
+stop(int sig)
+{
+    stopped = 1;
+}
+
+/* A random number below n */
+static unsigned int
+below(unsigned int n)
+{
+    static unsigned int x = 0;
+
+    if (x == 0)
+	x = getpid() ^ time(NULL) ^ 0x9e3779b9;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return n ? x % n : 0;
+}
+
+static void
+heap_push(struct answer *a)
+{
+    struct answer **h;
+    int i, up;
+
+    if (nheap == maxheap) {
+	maxheap = maxheap ? maxheap * 2 : 256;
+	if ((h = realloc(heap, maxheap * sizeof(*h))) == NULL) {
+	    error("out of memory");
+	    exit(1);
+	}
+	heap = h;
+    }
+    for (i = nheap++; i > 0; i = up) {
+	up = (i - 1) / 2;
+	if (!timercmp(&a->due, &heap[up]->due, <))
+	    break;
+	heap[i] = heap[up];
+    }
+    heap[i] = a;
+}
+
+static struct answer *
+heap_pop(void)
+{
+    struct answer *top = heap[0], *last = heap[--nheap];
+    int i, child;
+
+    for (i = 0; (child = 2 * i + 1) < nheap; i = child) {
+	if (child + 1 < nheap
+	    && timercmp(&heap[child + 1]->due, &heap[child]->due, <))
+	    ++child;
+	if (!timercmp(&heap[child]->due, &last->due, <))
+	    break;
+	heap[i] = heap[child];
+    }
+    if (nheap > 0)
+	heap[i] = last;
+    return top;
+}
+
+/* Append an attribute to a reply, if it fits */
+static void
+put_attr(unsigned char *pkt, int *len, int type, const void *val, int vlen)
+{
+    if (*len + vlen + 2 > RC_PACKET_MAX)
+	return;
+    pkt[*len] = type;
+    pkt[*len + 1] = vlen + 2;
+    memcpy(pkt + *len + 2, val, vlen);
+    *len += vlen + 2;
+}
+
+static void
+put_int(unsigned char *pkt, int *len, int type, UINT4 val)
+{
+    val = htonl(val);
+    put_attr(pkt, len, type, &val, 4);
+}
+
+/*
+ * Find an attribute in a request, Microsoft's if vendor is set.
+ * Returns its length, or -1 if it isn't there.
+ */
+static int
+get_attr(const unsigned char *pkt, int len, int vendor, int type,
+	 const unsigned char **val)
+{
+    const unsigned char *p = pkt + AUTH_HDR_LEN, *end = pkt + len, *v;
+
+    for (; p + 2 <= end && p[1] >= 2 && p + p[1] <= end; p += p[1]) {
+	if (!vendor) {
+	    if (p[0] == type) {
+		*val = p + 2;
+		return p[1] - 2;
+	    }
+	    continue;
+	}
+	if (p[0] != PW_VENDOR_SPECIFIC || p[1] < 8
+	    || ((p[2] << 24) | (p[3] << 16) | (p[4] << 8) | p[5]) != vendor)
+	    continue;
+	for (v = p + 6; v + 2 <= p + p[1] && v[1] >= 2; v += v[1]) {
+	    if (v[0] == type) {
+		*val = v + 2;
+		return v[1] - 2;
+	    }
+	}
+    }
+    return -1;
+}
+
+/* Sign a reply to a request */
+static void
+sign(unsigned char *reply, int len, const unsigned char *vector)
+{
+    unsigned char buf[RC_PACKET_MAX + MAX_SECRET_LENGTH];
+    int slen = strlen(secret);
+
+    memcpy(buf, reply, len);
+    memcpy(buf + 4, vector, AUTH_VECTOR_LEN);
+    memcpy(buf + len, secret, slen);
+    rc_md5_calc(reply + 4, buf, len + slen);
+}
+
+/* Check the authenticator of an Accounting-Request */
+static int
+acct_ok(const unsigned char *pkt, int len)
+{
+    unsigned char buf[RC_PACKET_MAX + MAX_SECRET_LENGTH];
+    unsigned char digest[AUTH_VECTOR_LEN];
+    int slen = strlen(secret);
+
+    memcpy(buf, pkt, len);
+    memset(buf + 4, 0, AUTH_VECTOR_LEN);
+    memcpy(buf + len, secret, slen);
+    rc_md5_calc(digest, buf, len + slen);
+    return memcmp(digest, pkt + 4, AUTH_VECTOR_LEN) == 0;
+}
+
+/*
+ * Make the answer to a request, roughly as a real server would, or
+ * return NULL if it gets none.
+ */
+static struct answer *
+answer(const unsigned char *pkt, int len, struct sockaddr_in *from)
+{
+    static const char success[] = "S=0000000000000000000000000000000000000000";
+    struct answer *a;
+    const unsigned char *val;
+    unsigned char vsa[64], *r;
+    int rlen = AUTH_HDR_LEN, n, jitter;
+    struct timeval delay;
+
+    ++n_requests;
+    if (len < AUTH_HDR_LEN || ((pkt[2] << 8) | pkt[3]) > len) {
+	++n_bad;
+	return NULL;
+    }
+    len = (pkt[2] << 8) | pkt[3];
+    if (pkt[0] == PW_ACCOUNTING_REQUEST && !acct_ok(pkt, len)) {
+	++n_bad;
+	return NULL;
+    }
+    if (pkt[0] != PW_ACCESS_REQUEST && pkt[0] != PW_ACCOUNTING_REQUEST) {
+	++n_bad;
+	return NULL;
+    }
+    if (below(100) < loss_pct) {
+	++n_lost;
+	return NULL;
+    }
+
+    if ((a = malloc(sizeof(*a))) == NULL) {
+	error("out of memory");
+	exit(1);
+    }
+    r = a->pkt;
+    r[1] = pkt[1];
+    if (pkt[0] == PW_ACCOUNTING_REQUEST) {
+	r[0] = PW_ACCOUNTING_RESPONSE;
+	++n_acct;
+    } else if (below(100) < reject_pct) {
+	r[0] = PW_ACCESS_REJECT;
+	put_attr(r, &rlen, PW_REPLY_MESSAGE, "Rejected", 8);
+	++n_rejects;
+    } else {
+	r[0] = PW_ACCESS_ACCEPT;
+	put_int(r, &rlen, PW_SERVICE_TYPE, PW_FRAMED);
+	put_int(r, &rlen, PW_FRAMED_PROTOCOL, PW_PPP);
+	put_int(r, &rlen, PW_SESSION_TIMEOUT, 86400);
+	put_int(r, &rlen, PW_ACCT_INTERIM_INTERVAL, 300);
+	put_attr(r, &rlen, PW_CLASS, "standin", 7);
+	/* MS-CHAP2-Success, with the right id but a made-up response */
+	n = get_attr(pkt, len, VENDOR_MICROSOFT, PW_MS_CHAP2_RESPONSE, &val);
+	if (n > 0) {
+	    vsa[0] = 0;
+	    vsa[1] = 0;
+	    vsa[2] = (VENDOR_MICROSOFT >> 8) & 0xff;
+	    vsa[3] = VENDOR_MICROSOFT & 0xff;
+	    vsa[4] = PW_MS_CHAP2_SUCCESS;
+	    vsa[5] = sizeof(success) + 2;
+	    vsa[6] = val[0];
+	    memcpy(vsa + 7, success, sizeof(success) - 1);
+	    put_attr(r, &rlen, PW_VENDOR_SPECIFIC, vsa, sizeof(success) + 8);
+	}
+	++n_accepts;
+    }
+    r[2] = rlen >> 8;
+    r[3] = rlen & 0xff;
+    sign(r, rlen, pkt + 4);
+    a->len = rlen;
+    a->to = *from;
+
+    jitter = jitter_us ? (int) below(2 * jitter_us + 1) - jitter_us : 0;
+    n = delay_us + jitter > 0 ? delay_us + jitter : 0;
+    delay.tv_sec = n / 1000000;
+    delay.tv_usec = n % 1000000;
+    gettimeofday(&a->due, NULL);
+    timeradd(&a->due, &delay, &a->due);
+    return a;
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct sockaddr_in sin, from;
+    socklen_t fromlen;
+    unsigned char pkt[RC_PACKET_MAX];
+    struct timeval now, wait, *waitp;
+    struct answer *a;
+    char *address = "127.0.0.1";
+    int port = PW_AUTH_UDP_PORT, background = 0;
+    int c, fd, len;
+    fd_set readfds;
+    pid_t pid;
+
+    while ((c = getopt(argc, argv, "a:bd:j:l:p:r:s:")) != -1) {
+	switch (c) {
+	case 'a': address = optarg; break;
+	case 'b': background = 1; break;
+	case 'd': delay_us = atof(optarg) * 1000; break;
+	case 'j': jitter_us = atof(optarg) * 1000; break;
+	case 'l': loss_pct = atoi(optarg); break;
+	case 'p': port = atoi(optarg); break;
+	case 'r': reject_pct = atoi(optarg); break;
+	case 's': secret = optarg; break;
+	default: usage();
+	}
+    }
+    if (optind != argc || strlen(secret) > MAX_SECRET_LENGTH)
+	usage();
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(port);
+    if (inet_aton(address, &sin.sin_addr) == 0)
+	usage();
+    if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0
+	|| bind(fd, (struct sockaddr *) &sin, sizeof(sin)) < 0) {
+	error("radius_standin: %s:%d: %s", address, port, strerror(errno));
+	return 1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    /* with -b, once we're listening, say who we are and carry on alone */
+    if (background) {
+	if ((pid = fork()) < 0) {
+	    error("radius_standin: fork: %s", strerror(errno));
+	    return 1;
+	}
+	if (pid > 0) {
+	    printf("%d\n", (int) pid);
+	    return 0;
+	}
+	/* so that whoever reads our pid doesn't wait for us */
+	if ((c = open("/dev/null", O_RDWR)) >= 0) {
+	    dup2(c, 0);
+	    dup2(c, 1);
+	    close(c);
+	}
+	setsid();
+    }
+
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+
+    while (!stopped) {
+	gettimeofday(&now, NULL);
+	while (nheap > 0 && !timercmp(&now, &heap[0]->due, <)) {
+	    a = heap_pop();
+	    sendto(fd, a->pkt, a->len, 0, (struct sockaddr *) &a->to,
+		   sizeof(a->to));
+	    free(a);
+	}
+
+	waitp = NULL;
+	if (nheap > 0) {
+	    timersub(&heap[0]->due, &now, &wait);
+	    waitp = &wait;
+	}
+	FD_ZERO(&readfds);
+	FD_SET(fd, &readfds);
+	if (select(fd + 1, &readfds, NULL, NULL, waitp) <= 0)
+	    continue;
+
+	for (;;) {
+	    fromlen = sizeof(from);
+	    len = recvfrom(fd, pkt, sizeof(pkt), 0,
+			   (struct sockaddr *) &from, &fromlen);
+	    if (len < 0)
+		break;
+	    if ((a = answer(pkt, len, &from)) != NULL)
+		heap_push(a);
+	}
+    }
+
+    fprintf(stderr, "radius_standin: %lu requests: %lu accepted,"
+	    " %lu rejected, %lu accounting, %lu lost, %lu bad\n",
+	    n_requests, n_accepts, n_rejects, n_acct, n_lost, n_bad);
+    return 0;
+}
@@ -37,6 +37,7 @@ typedef int          INT4;
 #define AUTH_STRING_LEN		253	 /* maximum of 253 */
 
 #define	BUFFER_LEN		8192
+#define RC_PACKET_MAX		4096	/* largest packet, RFC 2865 */
 
 #define NAME_LENGTH		32
 #define	GETSTR_LENGTH		128	/* must be bigger than AUTH_PASS_LEN */
@@ -108,6 +109,15 @@ typedef struct pw_auth_hdr
 #define	PW_STATUS_SERVER		12
 #define	PW_STATUS_CLIENT		13
 
+/* dynamic authorization codes, RFC 5176 */
+
+#define	PW_DISCONNECT_REQUEST		40
+#define	PW_DISCONNECT_ACK		41
+#define	PW_DISCONNECT_NAK		42
+#define	PW_COA_REQUEST			43
+#define	PW_COA_ACK			44
+#define	PW_COA_NAK			45
+
 
 /* standard RADIUS attribute-value pairs */
 
@@ -189,8 +199,13 @@ typedef struct pw_auth_hdr
 /* From RFC 2869 */
 #define PW_ACCT_INPUT_GIGAWORDS         52	/* integer */
 #define PW_ACCT_OUTPUT_GIGAWORDS        53	/* integer */
+#define PW_EVENT_TIMESTAMP		55	/* date */
+#define PW_MESSAGE_AUTHENTICATOR	80	/* string */
 #define PW_ACCT_INTERIM_INTERVAL        85	/* integer */
 
+/* From RFC 5176 */
+#define PW_ERROR_CAUSE			101	/* integer */
+
 /*	Merit Experimental Extensions */
 
 #define PW_USER_ID                      222     /* string */
@@ -288,6 +303,13 @@ typedef struct pw_auth_hdr
 #define PW_USER_ERROR           17
 #define PW_HOST_REQUEST         18
 
+/*	ERROR CAUSES, RFC 5176	*/
+
+#define PW_ERROR_UNSUPPORTED_ATTRIBUTE	401
+#define PW_ERROR_MISSING_ATTRIBUTE	402
+#define PW_ERROR_INVALID_REQUEST	404
+#define PW_ERROR_SESSION_NOT_FOUND	503
+
 /*     NAS PORT TYPES    */
 
 #define PW_ASYNC		0
@@ -351,9 +373,29 @@ typedef struct value_pair
 	struct value_pair *next;
 } VALUE_PAIR;
 
+/* An attribute in a packet, as found by rc_attr_next */
+typedef struct rc_attr
+{
+	int		attribute;
+	int		vendorcode;	/* VENDOR_NONE unless Vendor-Specific */
+	const unsigned char *value;	/* points into the packet */
+	int		len;
+} RC_ATTR;
+
+/* Where rc_attr_next has got to in a packet */
+typedef struct rc_attr_cursor
+{
+	const unsigned char *ptr, *end;	/* the attributes still to read */
+	const unsigned char *vsa, *vsa_end; /* the rest of a Vendor-Specific */
+	int		vendorcode;	/* of that Vendor-Specific */
+} RC_ATTR_CURSOR;
+
 /* don't change this, as it has to be the same as in the Merit radiusd code */
 #define MGMT_POLL_SECRET	"Hardlyasecret"
 
+/* the shared secret for RADIUS over TLS, RFC 6614 */
+#define RADSEC_SECRET		"radsec"
+
 /*	Define return codes from "SendServer" utility */
 
 #define BADRESP_RC	-2
@@ -379,6 +421,20 @@ typedef struct request_info
 	u_char		request_vector[AUTH_VECTOR_LEN];
 } REQUEST_INFO;
 
+/* Called with the outcome of a request sent by rc_send_server_async */
+typedef void (rc_callback_fn)(int result, VALUE_PAIR *received, char *msg,
+			      REQUEST_INFO *info, void *arg);
+
+/* A connection to a server for RADIUS over TLS, and what it calls
+   with each reply read from it and when it breaks */
+typedef struct rc_radsec RC_RADSEC;
+typedef void (rc_radsec_input_fn)(void *arg, char *pkt, int len, int now);
+typedef void (rc_radsec_lost_fn)(void *arg);
+
+/* Called with a Disconnect-Request or CoA-Request for our session;
+   returns the Error-Cause to NAK it with, or 0 to ACK it */
+typedef int (rc_dynauth_fn)(void *arg, AUTH_HDR *req);
+
 #ifndef MIN
 #define MIN(a, b)     ((a) < (b) ? (a) : (b))
 #endif
@@ -413,15 +469,32 @@ void rc_avpair_free(VALUE_PAIR *);
 int rc_avpair_parse(char *, VALUE_PAIR **);
 int rc_avpair_tostr(VALUE_PAIR *, char *, int, char *, int);
 VALUE_PAIR *rc_avpair_readin(FILE *);
+void rc_arena_begin(void);
+void rc_arena_end(void);
+int rc_attr_put(unsigned char *, int, int, int, const void *, int);
+int rc_attr_put_int(unsigned char *, int, int, int, UINT4);
+void rc_attr_first(RC_ATTR_CURSOR *, AUTH_HDR *);
+int rc_attr_next(RC_ATTR_CURSOR *, RC_ATTR *);
+int rc_pack_list(VALUE_PAIR *, char *, AUTH_HDR *, int);
+int rc_avpair_flatten(VALUE_PAIR *, unsigned char *, int);
+VALUE_PAIR *rc_avpair_unflatten(const unsigned char *, int);
+
+/*	authcache.c		*/
+
+int rc_authcache_key(const char *, const void *, int, unsigned char *);
+int rc_authcache_get(const unsigned char *, VALUE_PAIR **);
+void rc_authcache_put(const unsigned char *, VALUE_PAIR *);
 
 /*	buildreq.c		*/
 
+int rc_get_nas_id(VALUE_PAIR **);
 void rc_buildreq(SEND_DATA *, int, char *, unsigned short, int, int);
 unsigned char rc_get_seqnbr(void);
 int rc_auth(UINT4, VALUE_PAIR *, VALUE_PAIR **, char *, REQUEST_INFO *);
 int rc_auth_using_server(SERVER *, UINT4, VALUE_PAIR *, VALUE_PAIR **,
 			 char *, REQUEST_INFO *);
 int rc_auth_proxy(VALUE_PAIR *, VALUE_PAIR **, char *);
+int rc_auth_async(SERVER *, UINT4, VALUE_PAIR *, rc_callback_fn *, void *);
 int rc_acct(UINT4, VALUE_PAIR *);
 int rc_acct_using_server(SERVER *, UINT4, VALUE_PAIR *);
 int rc_acct_proxy(VALUE_PAIR *);
@@ -450,24 +523,65 @@ DICT_VALUE * rc_dict_getval(UINT4, char *);
 VENDOR_DICT * rc_dict_findvendor(char *);
 VENDOR_DICT * rc_dict_getvendor(int);
 
+/*	dynauth.c		*/
+
+void rc_dynauth_start(const char *, UINT4, const char *, rc_dynauth_fn *,
+		      void *);
+void rc_dynauth_stop(void);
+
+/*	health.c		*/
+
+int rc_health_order(SERVER *, int *);
+void rc_health_sent(UINT4, int);
+void rc_health_cancel(UINT4, int);
+void rc_health_reply(UINT4, int, int);
+void rc_health_timeout(UINT4, int);
+
+/*	interim.c		*/
+
+int rc_interim_phase(const char *, int, int *);
+void rc_interim_release(int, int);
+int rc_interim_next(int, int, time_t);
+
 /*	ip_util.c		*/
 
+int rc_resolve(const char *, UINT4 *, int);
+void rc_resolve_refresh(void);
 UINT4 rc_get_ipaddr(const char *);
 int rc_good_ipaddr(const char *);
 const char *rc_ip_hostname(UINT4);
 UINT4 rc_own_ipaddress(void);
 UINT4 rc_own_bind_ipaddress(void);
 
+/*	radsec.c		*/
+
+int rc_radsec_server(const char *);
+RC_RADSEC *rc_radsec_new(const char *, UINT4, unsigned short,
+			 rc_radsec_input_fn *, rc_radsec_lost_fn *, void *);
+int rc_radsec_connect(RC_RADSEC *, int);
+int rc_radsec_send(RC_RADSEC *, const char *, int);
+int rc_radsec_wait(RC_RADSEC *, struct timeval *);
 
 /*	sendserver.c		*/
 
 int rc_send_server(SEND_DATA *, char *, REQUEST_INFO *);
+int rc_send_server_async(int, SERVER *, VALUE_PAIR *, rc_callback_fn *, void *);
+void rc_cancel_async(void *);
+int rc_pool_inflight(void);
+
+/*	spool.c			*/
+
+int rc_spool_init(SERVER *);
+int rc_acct_spool(SERVER *, UINT4, VALUE_PAIR *);
+int rc_spool_depth(void);
+void rc_spool_flush(void);
 
 /*	util.c			*/
 
 void rc_str2tm(char *, struct tm *);
 char *rc_mksid(void);
 void rc_mdelay(int);
+void *rc_map_table(const char *, size_t, UINT4, void (*)(void *), int *);
 
 /* md5.c			*/
 
@@ -25,6 +25,7 @@ static char const RCSID[] =
 #include <stdint.h>
 #include <stdarg.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 
 #include <pppd/pppd.h>
 
@@ -44,42 +45,133 @@ extern void (*radius_pre_auth_hook)(char const *user,
 				    SERVER **authserver,
 				    SERVER **acctserver);
 
+/*
+ * The realms file is compiled into a hash table of realms, each with
+ * its servers ready to hand to radius.so, so that looking up a realm
+ * doesn't touch the file.  The file is checked every few seconds from
+ * a timer, and if it has changed a new table is compiled and swapped
+ * in; if the new file has an error, the old table stays.  radius.so
+ * keeps the servers we give it, so a table some of whose servers have
+ * been handed out is never freed.
+ */
+
+#define REALMS_CHECK_INTERVAL	5
+
+struct realm {
+    char *name;
+    SERVER auth;
+    SERVER acct;
+};
+
+struct realm_table {
+    struct realm *realms;	/* hash table of size entries */
+    unsigned int size;
+    struct realm *deflt;	/* the DEFAULT realm, or NULL */
+    int handed_out;		/* radius.so has some of our servers */
+    struct stat st;		/* of the file we compiled */
+};
+
+static struct realm_table *realms;
+
+static unsigned int
+realm_hash(char const *name)
+{
+    unsigned int h = 2166136261U;
+
+    for (; *name; ++name)
+	h = (h ^ (unsigned char) *name) * 16777619U;
+    return h;
+}
+
+/*
+ * Find a realm in a table, or the empty slot where it would go.
+ */
+static struct realm *
+realm_slot(struct realm_table *t, char const *name)
+{
+    unsigned int i, mask = t->size - 1;
+    struct realm *r;
+
+    for (i = realm_hash(name) & mask; ; i = (i + 1) & mask) {
+	r = &t->realms[i];
+	if (r->name == NULL || strcmp(r->name, name) == 0)
+	    return r;
+    }
+}
+
 static void
-lookup_realm(char const *user,
-	     SERVER **authserver,
-	     SERVER **acctserver)
+free_realms(struct realm_table *t)
 {
-    char *realm;
-    FILE *fd;
-    SERVER *accts, *auths, *s;
-    char buffer[512], *p;
-    int line = 0;
-    
-    auths = (SERVER *) malloc(sizeof(SERVER));
-    auths->max = 0;
-    accts = (SERVER *) malloc(sizeof(SERVER));
-    accts->max = 0;
-    
-    realm = strrchr(user, '@');
-    
-    if (realm) {
-	info("Looking up servers for realm '%s'", realm);
-    } else {
-	info("Looking up servers for DEFAULT realm");
+    unsigned int i;
+    int j;
+
+    if (t == NULL)
+	return;
+    for (i = 0; i < t->size; ++i) {
+	if (t->realms[i].name == NULL)
+	    continue;
+	free(t->realms[i].name);
+	for (j = 0; j < t->realms[i].auth.max; ++j)
+	    free(t->realms[i].auth.name[j]);
+	for (j = 0; j < t->realms[i].acct.max; ++j)
+	    free(t->realms[i].acct.name[j]);
     }
-    if (realm) {
-	if (*(++realm) == '\0') {
-	    realm = NULL;
-	}
+    free(t->realms);
+    free(t);
+}
+
+/*
+ * Make room for another realm, growing the table if need be.
+ */
+static int
+grow_realms(struct realm_table *t, unsigned int count)
+{
+    struct realm *old = t->realms, *r;
+    unsigned int i, oldsize = t->size;
+
+    if (2 * (count + 1) <= t->size)
+	return 0;
+    t->size = oldsize ? 2 * oldsize : 64;
+    t->realms = calloc(t->size, sizeof(struct realm));
+    if (t->realms == NULL) {
+	t->realms = old;
+	t->size = oldsize;
+	return -1;
+    }
+    for (i = 0; i < oldsize; ++i) {
+	if (old[i].name == NULL)
+	    continue;
+	r = realm_slot(t, old[i].name);
+	*r = old[i];
     }
-    
+    free(old);
+    return 0;
+}
+
+/*
+ * Compile the realms file into a new table.
+ */
+static struct realm_table *
+compile_realms(void)
+{
+    struct realm_table *t;
+    struct realm *r;
+    FILE *fd;
+    SERVER *s;
+    char buffer[512], *p, *kind;
+    unsigned int count = 0;
+    int line = 0;
+
     if ((fd = fopen(radrealms_config, "r")) == NULL) {
-	ppp_option_error("cannot open %s", radrealms_config);
-	free(auths);
-	free(accts);
-	return;
+	error("cannot open %s", radrealms_config);
+	return NULL;
+    }
+    if ((t = calloc(1, sizeof(*t))) == NULL) {
+	novm("realms");
+	fclose(fd);
+	return NULL;
     }
-    info("Reading %s", radrealms_config);
+    fstat(fileno(fd), &t->st);
 
     while ((fgets(buffer, sizeof(buffer), fd) != NULL)) {
 	line++;
@@ -87,76 +179,163 @@ lookup_realm(char const *user,
 	if ((*buffer == '\n') || (*buffer == '#') || (*buffer == '\0'))
 	    continue;
 
-	buffer[strlen(buffer)-1] = '\0';
+	buffer[strcspn(buffer, "\n")] = '\0';
+
+	kind = strtok(buffer, "\t ");
 
-	p = strtok(buffer, "\t ");
+	if (kind == NULL || (strcmp(kind, "authserver") !=0
+	    && strcmp(kind, "acctserver"))) {
+	    error("%s: invalid line %d: %s", radrealms_config,
+		  line, buffer);
+	    goto bad;
+	}
 
-	if (p == NULL || (strcmp(p, "authserver") !=0
-	    && strcmp(p, "acctserver"))) {
-	    fclose(fd);
-	    ppp_option_error("%s: invalid line %d: %s", radrealms_config,
-			 line, buffer);
-	    free(auths);
-	    free(accts);
-	    return;
+	if ((p = strtok(NULL, "\t ")) == NULL) {
+	    error("%s: realm name missing on line %d: %s",
+		  radrealms_config, line, buffer);
+	    goto bad;
 	}
-	info("Parsing '%s' entry:", p);
-	s = auths;
-	if (p[1] == 'c') {
-	    s = accts;
+	if (grow_realms(t, count) < 0) {
+	    novm("realms");
+	    goto bad;
 	}
+	r = realm_slot(t, p);
+	if (r->name == NULL) {
+	    if ((r->name = strdup(p)) == NULL) {
+		novm("realms");
+		goto bad;
+	    }
+	    ++count;
+	    if (strcmp(p, "DEFAULT") == 0)
+		t->deflt = r;
+	}
+	s = kind[1] == 'c' ? &r->acct : &r->auth;
 	if (s->max >= SERVER_MAX)
 	    continue;
 
+	if ((p = strtok(NULL, ":")) == NULL) {
+	    error("%s: server address missing on line %d: %s",
+		  radrealms_config, line, buffer);
+	    goto bad;
+	}
+	if ((s->name[s->max] = strdup(p)) == NULL) {
+	    novm("realms");
+	    goto bad;
+	}
 	if ((p = strtok(NULL, "\t ")) == NULL) {
-	    fclose(fd);
-	    ppp_option_error("%s: realm name missing on line %d: %s",
-			 radrealms_config, line, buffer);
-	    free(auths);
-	    free(accts);
-	    return;
+	    error("%s: server port missing on line %d:  %s",
+		  radrealms_config, line, buffer);
+	    free(s->name[s->max]);
+	    goto bad;
 	}
-
-	if ((realm != NULL && strcmp(p, realm) == 0) ||
-	    (realm == NULL && strcmp(p, "DEFAULT") == 0) ) {
-	    info(" - Matched realm %s", p);
-	    if ((p = strtok(NULL, ":")) == NULL) {
-		fclose(fd);
-		ppp_option_error("%s: server address missing on line %d: %s",
-			     radrealms_config, line, buffer);
-	        free(auths);
-	        free(accts);
-		return;
-	    }
-	    s->name[s->max] = strdup(p);
-	    info(" - Address is '%s'",p);
-	    if ((p = strtok(NULL, "\t ")) == NULL) {
-		fclose(fd);
-		ppp_option_error("%s: server port missing on line %d:  %s",
-			     radrealms_config, line, buffer);
-		free(auths);
-		free(accts);
-		return;
-	    }
-	    s->port[s->max] = atoi(p);
-	    info(" - Port is '%d'", s->port[s->max]);
-	    s->max++;
-	} else 
-	    info(" - Skipping realm '%s'", p);
+	s->port[s->max] = atoi(p);
+	s->max++;
     }
     fclose(fd);
+    info("Read %u realms from %s", count, radrealms_config);
+
+    /* the DEFAULT realm may have moved as the table grew */
+    if (t->deflt != NULL)
+	t->deflt = realm_slot(t, "DEFAULT");
+    return t;
+
+ bad:
+    fclose(fd);
+    free_realms(t);
+    return NULL;
+}
+
+/*
+ * Compile the realms file again, if it has changed since we last did,
+ * and start using the new table.
+ */
+static void
+reload_realms(void)
+{
+    struct realm_table *t;
+    struct stat st;
+
+    if (realms != NULL
+	&& (stat(radrealms_config, &st) < 0
+	    || (st.st_mtime == realms->st.st_mtime
+		&& st.st_size == realms->st.st_size
+		&& st.st_ino == realms->st.st_ino)))
+	return;
+
+    if ((t = compile_realms()) == NULL)
+	return;
+    if (realms != NULL && !realms->handed_out)
+	free_realms(realms);
+    realms = t;
+}
+
+static void
+realms_check(void *arg)
+{
+    reload_realms();
+    ppp_timeout(realms_check, NULL, REALMS_CHECK_INTERVAL, 0);
+}
+
+/*
+ * Compile the realms file once the options have been read, so
+ * that it is ready before anyone authenticates.
+ */
+static void
+realms_phase_change(void *opaque, int phase)
+{
+    static int started;
 
-    if (accts->max)
-	*acctserver = accts;
-    else
-	free(accts);
+    if (started)
+	return;
+    started = 1;
+    realms_check(NULL);
+}
+
+static void
+lookup_realm(char const *user,
+	     SERVER **authserver,
+	     SERVER **acctserver)
+{
+    char const *realm;
+    struct realm *r;
 
-    if (auths->max)
-	*authserver = auths;
-    else
-	free(auths);
+    realm = strrchr(user, '@');
 
-    return;
+    if (realm) {
+	info("Looking up servers for realm '%s'", realm);
+    } else {
+	info("Looking up servers for DEFAULT realm");
+    }
+    if (realm) {
+	if (*(++realm) == '\0') {
+	    realm = NULL;
+	}
+    }
+
+    if (realms == NULL)
+	reload_realms();
+    if (realms == NULL)
+	return;
+
+    if (realm == NULL)
+	r = realms->deflt;
+    else if (realms->size == 0
+	     || (r = realm_slot(realms, realm))->name == NULL)
+	r = NULL;
+    if (r == NULL) {
+	info(" - No servers for realm");
+	return;
+    }
+    info(" - Matched realm %s", r->name);
+
+    if (r->acct.max) {
+	*acctserver = &r->acct;
+	realms->handed_out = 1;
+    }
+    if (r->auth.max) {
+	*authserver = &r->auth;
+	realms->handed_out = 1;
+    }
 }
 
 void
@@ -165,5 +344,6 @@ plugin_init(void)
     radius_pre_auth_hook = lookup_realm;
 
     ppp_add_options(Options);
+    ppp_add_notify(NF_PHASE_CHANGE, realms_phase_change, NULL);
     info("RADIUS Realms plugin initialized.");
 }
@@ -0,0 +1,645 @@
+/*
+ * radsec.c - RADIUS over TLS (RFC 6614): one connection to each server,
+ * carrying many requests at a time.
+ *
+ *
+ * Copyright (c) 2026 The ppp project. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The name(s) of the authors of this software must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission.
+ *
+ * THE AUTHORS OF THIS SOFTWARE DISCLAIM ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS, IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+ * AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <includes.h>
+#include <radiusclient.h>
+#include <sys/time.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+
+/*
+ * A server named in radsec_servers gets its requests over TLS rather
+ * than UDP, on a connection opened the first time it is needed and
+ * kept open after that.  Each request is written as soon as it is
+ * ready, without waiting for the replies to those before it, and
+ * sendserver.c matches the replies to the requests by identifier just
+ * as it does for UDP.  TCP does the retransmitting, so a request is
+ * only ever written once.  RFC 6614 fixes the shared secret as
+ * "radsec".
+ *
+ * pppd only tells us when a descriptor is readable, so connecting, the
+ * handshake, and a write that finds the socket full are waited for
+ * here, for at most radius_timeout seconds.  That only happens when a
+ * connection is opened or a server stops reading.
+ *
+ * When a connection breaks the requests waiting on it are given up at
+ * once, so they go on to the next server, and the next request for the
+ * server opens a new connection, resuming the TLS session if it can.
+ */
+
+#if defined(PPP_WITH_EAPTLS) || defined(PPP_WITH_PEAP)
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/x509v3.h>
+#include <pppd/tls.h>
+
+struct rc_radsec
+{
+	char		*name;		/* as in authserver or acctserver */
+	UINT4		ipaddr;
+	unsigned short	port;
+	int		timeout;	/* for connecting and writing */
+	int		fd;		/* -1 when not connected */
+	SSL		*ssl;
+	SSL_SESSION	*session;	/* from the last connection */
+	rc_radsec_input_fn *input;
+	rc_radsec_lost_fn *lost;
+	void		*arg;
+	int		rlen;		/* of the next reply, so far */
+	char		rbuf[RC_PACKET_MAX];
+};
+
+static SSL_CTX *rc_radsec_ctx;
+
+static void rc_radsec_read (RC_RADSEC *, int);
+
+/*
+ * Function: rc_radsec_context
+ *
+ * Purpose: set up what all our connections have in common, the first
+ *	    time one is opened.
+ *
+ * Returns: the context, or NULL on error.
+ *
+ */
+
+static SSL_CTX *rc_radsec_context (void)
+{
+	SSL_CTX		*ctx;
+	char		*ca_file = rc_conf_str("radsec_ca_file");
+	char		*ca_path = rc_conf_str("radsec_ca_path");
+	char		*cert = rc_conf_str("radsec_cert");
+	char		*key = rc_conf_str("radsec_key");
+
+	if (rc_radsec_ctx != NULL)
+		return rc_radsec_ctx;
+
+	tls_init();
+	ctx = SSL_CTX_new(tls_method());
+	if (ctx == NULL)
+	{
+		error("rc_radsec: can't make an SSL context");
+		tls_log_sslerr();
+		return NULL;
+	}
+	tls_set_opts(ctx);
+	/* that turned off tickets, which we want for resuming sessions */
+#ifdef SSL_OP_NO_TICKET
+	SSL_CTX_clear_options(ctx, SSL_OP_NO_TICKET);
+#endif
+	if (tls_set_version(ctx, "1.3") < 0)
+		goto fail;
+
+	if ((ca_file != NULL && *ca_file) || (ca_path != NULL && *ca_path))
+	{
+		if (tls_set_ca(ctx, ca_path, ca_file) < 0)
+			goto fail;
+	}
+	else if (!SSL_CTX_set_default_verify_paths(ctx))
+	{
+		error("rc_radsec: can't load the default CA certificates");
+		goto fail;
+	}
+	SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+
+	if (cert != NULL && *cert)
+	{
+		if (key == NULL || !*key)
+			key = cert;
+		if (!SSL_CTX_use_certificate_chain_file(ctx, cert))
+		{
+			error("rc_radsec: can't load certificate %s", cert);
+			goto fail;
+		}
+		if (!SSL_CTX_use_PrivateKey_file(ctx, key, SSL_FILETYPE_PEM)
+		    || !SSL_CTX_check_private_key(ctx))
+		{
+			error("rc_radsec: can't load private key %s", key);
+			goto fail;
+		}
+	}
+
+	rc_radsec_ctx = ctx;
+	return ctx;
+
+ fail:
+	tls_log_sslerr();
+	SSL_CTX_free(ctx);
+	return NULL;
+}
+
+/*
+ * Function: rc_radsec_poll
+ *
+ * Purpose: wait until a socket is readable, or writable if write
+ *	    is set.
+ *
+ * Returns: 1 if it is, 0 if the deadline passed first, -1 on error.
+ *
+ */
+
+static int rc_radsec_poll (int fd, int write, struct timeval *deadline)
+{
+	struct timeval	now, left;
+	fd_set		fds;
+	int		n;
+
+	for (;;)
+	{
+		ppp_get_time(&now);
+		if (!timercmp(&now, deadline, <))
+			return 0;
+		timersub(deadline, &now, &left);
+		FD_ZERO(&fds);
+		FD_SET(fd, &fds);
+		n = select(fd + 1, write ? NULL : &fds, write ? &fds : NULL,
+			   NULL, &left);
+		if (n > 0)
+			return 1;
+		if (n < 0 && errno != EINTR)
+			return -1;
+	}
+}
+
+/*
+ * Function: rc_radsec_retry
+ *
+ * Purpose: wait for whatever an SSL call that returned ret needs
+ *	    before it can be made again.
+ *
+ * Returns: 1 to try again, 0 if the deadline passed, -1 on error.
+ *
+ */
+
+static int rc_radsec_retry (RC_RADSEC *conn, int ret,
+			    struct timeval *deadline)
+{
+	switch (SSL_get_error(conn->ssl, ret))
+	{
+	case SSL_ERROR_WANT_READ:
+		return rc_radsec_poll(conn->fd, 0, deadline);
+	case SSL_ERROR_WANT_WRITE:
+		return rc_radsec_poll(conn->fd, 1, deadline);
+	}
+	return -1;
+}
+
+/*
+ * Function: rc_radsec_input
+ *
+ * Purpose: called from pppd's main loop when a connection is readable.
+ *
+ */
+
+static void rc_radsec_input (int fd, void *arg)
+{
+	rc_radsec_read (arg, 1);
+}
+
+/*
+ * Function: rc_radsec_pending
+ *
+ * Purpose: read what came in while we were writing, which pppd can't
+ *	    tell us about since it is no longer waiting in the socket.
+ *
+ */
+
+static void rc_radsec_pending (void *arg)
+{
+	rc_radsec_read (arg, 1);
+}
+
+/*
+ * Function: rc_radsec_open
+ *
+ * Purpose: connect to the server and do the TLS handshake.
+ *
+ * Returns: OK_RC, or ERROR_RC if we couldn't.
+ *
+ */
+
+static int rc_radsec_open (RC_RADSEC *conn)
+{
+	SSL_CTX		*ctx;
+	X509_VERIFY_PARAM *param;
+	UINT4		bind_ipaddr = rc_own_bind_ipaddress();
+	struct sockaddr_in sin;
+	struct timeval	deadline;
+	socklen_t	len;
+	int		fd, err, ret, one = 1;
+	long		verify;
+
+	if ((ctx = rc_radsec_context ()) == NULL)
+		return (ERROR_RC);
+
+	fd = socket (AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+	{
+		error("rc_radsec: socket: %m");
+		return (ERROR_RC);
+	}
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	/* requests are small and we don't wait for one before the next */
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	memset ((char *) &sin, '\0', sizeof (sin));
+	sin.sin_family = AF_INET;
+	if (bind_ipaddr != 0)
+	{
+		sin.sin_addr.s_addr = htonl(bind_ipaddr);
+		if (bind (fd, (struct sockaddr *) &sin, sizeof (sin)) < 0)
+		{
+			error("rc_radsec: bind: %I: %m", htonl(bind_ipaddr));
+			close (fd);
+			return (ERROR_RC);
+		}
+	}
+
+	ppp_get_time(&deadline);
+	deadline.tv_sec += conn->timeout;
+
+	sin.sin_addr.s_addr = htonl(conn->ipaddr);
+	sin.sin_port = htons(conn->port);
+	if (connect (fd, (struct sockaddr *) &sin, sizeof (sin)) < 0)
+	{
+		if (errno != EINPROGRESS)
+		{
+			error("rc_radsec: connect to %s:%u: %m",
+			      conn->name, conn->port);
+			close (fd);
+			return (ERROR_RC);
+		}
+		if (rc_radsec_poll (fd, 1, &deadline) <= 0)
+		{
+			error("rc_radsec: no connection to %s:%u",
+			      conn->name, conn->port);
+			close (fd);
+			return (ERROR_RC);
+		}
+		len = sizeof (err);
+		if (getsockopt (fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0
+		    || err != 0)
+		{
+			error("rc_radsec: connect to %s:%u: %s",
+			      conn->name, conn->port, strerror(err));
+			close (fd);
+			return (ERROR_RC);
+		}
+	}
+
+	conn->fd = fd;
+	conn->ssl = SSL_new(ctx);
+	if (conn->ssl == NULL || !SSL_set_fd(conn->ssl, fd))
+	{
+		error("rc_radsec: can't make an SSL connection");
+		goto fail;
+	}
+
+	/* the certificate has to be for the server we meant to reach */
+	param = SSL_get0_param(conn->ssl);
+	if (rc_good_ipaddr (conn->name) == 0)
+		X509_VERIFY_PARAM_set1_ip_asc(param, conn->name);
+	else
+	{
+		X509_VERIFY_PARAM_set1_host(param, conn->name, 0);
+		SSL_set_tlsext_host_name(conn->ssl, conn->name);
+	}
+	if (conn->session != NULL)
+		SSL_set_session(conn->ssl, conn->session);
+
+	while ((ret = SSL_connect(conn->ssl)) <= 0)
+	{
+		if (rc_radsec_retry (conn, ret, &deadline) <= 0)
+		{
+			verify = SSL_get_verify_result(conn->ssl);
+			if (verify != X509_V_OK)
+				error("rc_radsec: %s:%u: bad certificate: %s",
+				      conn->name, conn->port,
+				      X509_verify_cert_error_string(verify));
+			else
+				error("rc_radsec: TLS handshake with %s:%u failed",
+				      conn->name, conn->port);
+			goto fail;
+		}
+	}
+
+	if (ppp_add_fd_handler(fd, rc_radsec_input, conn) < 0)
+	{
+		error("rc_radsec: can't wait for replies from %s", conn->name);
+		goto fail;
+	}
+	conn->rlen = 0;
+	dbglog("rc_radsec: connected to %s:%u%s", conn->name, conn->port,
+	       SSL_session_reused(conn->ssl) ? ", session resumed" : "");
+	return (OK_RC);
+
+ fail:
+	tls_log_sslerr();
+	if (conn->ssl != NULL)
+		SSL_free(conn->ssl);
+	conn->ssl = NULL;
+	close (fd);
+	conn->fd = -1;
+	return (ERROR_RC);
+}
+
+/*
+ * Function: rc_radsec_drop
+ *
+ * Purpose: close a connection that has failed, keeping its session
+ *	    to resume, and give up the requests waiting on it.
+ *
+ */
+
+static void rc_radsec_drop (RC_RADSEC *conn)
+{
+	SSL_SESSION	*session;
+
+	if (conn->fd < 0)
+		return;
+	warn("rc_radsec: lost connection to %s:%u", conn->name, conn->port);
+
+	ppp_remove_fd_handler(conn->fd);
+	ppp_untimeout(rc_radsec_pending, conn);
+	/* without this, OpenSSL won't resume the session */
+	SSL_shutdown(conn->ssl);
+	if ((session = SSL_get1_session(conn->ssl)) != NULL)
+	{
+		if (conn->session != NULL)
+			SSL_SESSION_free(conn->session);
+		conn->session = session;
+	}
+	SSL_free(conn->ssl);
+	conn->ssl = NULL;
+	close (conn->fd);
+	conn->fd = -1;
+	conn->rlen = 0;
+
+	(*conn->lost)(conn->arg);
+}
+
+/*
+ * Function: rc_radsec_read
+ *
+ * Purpose: read what the server has sent and pass on each reply
+ *	    as it is completed.  Replies are framed by their own length
+ *	    field; one that can't be right means we've lost our place,
+ *	    and the connection is dropped.
+ *
+ */
+
+static void rc_radsec_read (RC_RADSEC *conn, int now)
+{
+	char		pkt[BUFFER_LEN];
+	unsigned char	*p = (unsigned char *) conn->rbuf;
+	int		n, len;
+
+	while (conn->ssl != NULL)
+	{
+		n = SSL_read(conn->ssl, conn->rbuf + conn->rlen,
+			     sizeof (conn->rbuf) - conn->rlen);
+		if (n <= 0)
+		{
+			switch (SSL_get_error(conn->ssl, n))
+			{
+			case SSL_ERROR_WANT_READ:
+			case SSL_ERROR_WANT_WRITE:
+				return;
+			case SSL_ERROR_ZERO_RETURN:
+				break;
+			default:
+				tls_log_sslerr();
+				break;
+			}
+			rc_radsec_drop (conn);
+			return;
+		}
+		conn->rlen += n;
+
+		while (conn->rlen >= 4)
+		{
+			len = (p[2] << 8) | p[3];
+			if (len < AUTH_HDR_LEN || len > RC_PACKET_MAX)
+			{
+				error("rc_radsec: bad reply from %s:%u",
+				      conn->name, conn->port);
+				rc_radsec_drop (conn);
+				return;
+			}
+			if (conn->rlen < len)
+				break;
+
+			/* the handler may write another request */
+			memcpy (pkt, conn->rbuf, len);
+			conn->rlen -= len;
+			memmove (conn->rbuf, conn->rbuf + len, conn->rlen);
+			(*conn->input)(conn->arg, pkt, len, now);
+			if (conn->ssl == NULL)
+				return;
+		}
+	}
+}
+
+/*
+ * Function: rc_radsec_new
+ *
+ * Purpose: make a connection, not yet opened, to a server.  Each
+ *	    reply read from it is passed to input, and lost is called
+ *	    if the connection breaks.
+ *
+ * Returns: the connection, or NULL on error.
+ *
+ */
+
+RC_RADSEC *rc_radsec_new (const char *name, UINT4 ipaddr,
+			  unsigned short port, rc_radsec_input_fn *input,
+			  rc_radsec_lost_fn *lost, void *arg)
+{
+	RC_RADSEC	*conn;
+
+	conn = calloc(1, sizeof(*conn));
+	if (conn == NULL || (conn->name = strdup(name)) == NULL)
+	{
+		free (conn);
+		error("rc_radsec: out of memory");
+		return NULL;
+	}
+	conn->ipaddr = ipaddr;
+	conn->port = port;
+	conn->fd = -1;
+	conn->input = input;
+	conn->lost = lost;
+	conn->arg = arg;
+	return conn;
+}
+
+/*
+ * Function: rc_radsec_connect
+ *
+ * Purpose: open a connection if it isn't already, waiting at most
+ *	    timeout seconds.
+ *
+ * Returns: OK_RC, or ERROR_RC if it can't be opened.
+ *
+ */
+
+int rc_radsec_connect (RC_RADSEC *conn, int timeout)
+{
+	if (conn->ssl != NULL)
+		return (OK_RC);
+	conn->timeout = timeout > 0 ? timeout : 1;
+	return rc_radsec_open (conn);
+}
+
+/*
+ * Function: rc_radsec_send
+ *
+ * Purpose: write a request on a connection.
+ *
+ * Returns: OK_RC, or ERROR_RC if the connection failed, in which
+ *	    case the requests waiting on it have been given up.
+ *
+ */
+
+int rc_radsec_send (RC_RADSEC *conn, const char *buf, int len)
+{
+	struct timeval	deadline;
+	int		n, waited = 0;
+
+	if (conn->ssl == NULL)
+		return (ERROR_RC);
+
+	ppp_get_time(&deadline);
+	deadline.tv_sec += conn->timeout;
+	while ((n = SSL_write(conn->ssl, buf, len)) <= 0)
+	{
+		if (rc_radsec_retry (conn, n, &deadline) <= 0)
+		{
+			tls_log_sslerr();
+			rc_radsec_drop (conn);
+			return (ERROR_RC);
+		}
+		waited = 1;
+	}
+	if (waited && SSL_pending(conn->ssl) > 0)
+		ppp_timeout(rc_radsec_pending, conn, 0, 0);
+	return (OK_RC);
+}
+
+/*
+ * Function: rc_radsec_wait
+ *
+ * Purpose: for callers that can't go back to pppd's main loop, wait
+ *	    at most timeout for the connection to be readable, and read
+ *	    it.  Replies are passed on as not wanted now.
+ *
+ * Returns: 0, or -1 if select failed or the connection is closed.
+ *
+ */
+
+int rc_radsec_wait (RC_RADSEC *conn, struct timeval *timeout)
+{
+	fd_set		readfds;
+
+	if (conn->ssl == NULL)
+		return -1;
+	if (SSL_pending(conn->ssl) == 0)
+	{
+		FD_ZERO (&readfds);
+		FD_SET (conn->fd, &readfds);
+		if (select (conn->fd + 1, &readfds, NULL, NULL, timeout) < 0)
+		{
+			if (errno == EINTR && !ppp_signaled(SIGTERM))
+				return 0;
+			return -1;
+		}
+		if (!FD_ISSET (conn->fd, &readfds))
+			return 0;
+	}
+	rc_radsec_read (conn, 0);
+	return 0;
+}
+
+#else /* no TLS */
+
+RC_RADSEC *rc_radsec_new (const char *name, UINT4 ipaddr,
+			  unsigned short port, rc_radsec_input_fn *input,
+			  rc_radsec_lost_fn *lost, void *arg)
+{
+	error("rc_radsec: can't reach %s:%u; pppd was built without TLS",
+	      name, port);
+	return NULL;
+}
+
+int rc_radsec_connect (RC_RADSEC *conn, int timeout)
+{
+	return (ERROR_RC);
+}
+
+int rc_radsec_send (RC_RADSEC *conn, const char *buf, int len)
+{
+	return (ERROR_RC);
+}
+
+int rc_radsec_wait (RC_RADSEC *conn, struct timeval *timeout)
+{
+	return -1;
+}
+
+#endif /* no TLS */
+
+/*
+ * Function: rc_radsec_server
+ *
+ * Purpose: tell whether a server is named in radsec_servers.
+ *
+ */
+
+int rc_radsec_server (const char *name)
+{
+	char		*list = rc_conf_str("radsec_servers");
+	const char	*p;
+	int		n;
+
+	if (list == NULL || name == NULL)
+		return 0;
+	for (p = list; *p != '\0'; p += n)
+	{
+		p += strspn (p, ", \t");
+		n = strcspn (p, ", \t");
+		if (n > 0 && strncmp (p, name, n) == 0 && name[n] == '\0')
+			return 1;
+	}
+	return 0;
+}
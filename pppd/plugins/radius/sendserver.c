@@ -18,256 +18,436 @@
 #include <radiusclient.h>
 #include <pathnames.h>
 #include <signal.h>
+#include <sys/time.h>
 
 static void rc_random_vector (unsigned char *);
 static int rc_check_reply (AUTH_HDR *, int, char *, unsigned char *, unsigned char);
 
 /*
- * Function: rc_pack_list
+ * Function: rc_server_secret
  *
- * Purpose: Packs an attribute value pair list into a buffer.
+ * Purpose: find the address of the server and the secret we share
+ *	    with it.
  *
- * Returns: Number of octets packed.
+ */
+
+static int rc_server_secret (SEND_DATA *data, UINT4 *auth_ipaddr,
+			     char *secret)
+{
+	char           *server_name = data->server;
+	VALUE_PAIR	*vp;
+
+	if (server_name == (char *) NULL || server_name[0] == '\0')
+		return (ERROR_RC);
+
+	if (rc_radsec_server (server_name))
+	{
+		strcpy(secret, RADSEC_SECRET);
+		if ((*auth_ipaddr = rc_get_ipaddr(server_name)) == 0)
+			return (ERROR_RC);
+	}
+	else if ((vp = rc_avpair_get(data->send_pairs, PW_SERVICE_TYPE)) && \
+	    (vp->lvalue == PW_ADMINISTRATIVE))
+	{
+		strcpy(secret, MGMT_POLL_SECRET);
+		if ((*auth_ipaddr = rc_get_ipaddr(server_name)) == 0)
+			return (ERROR_RC);
+	}
+	else
+	{
+		if (rc_find_server (server_name, auth_ipaddr, secret) != 0)
+		{
+			memset (secret, '\0', MAX_SECRET_LENGTH + 1);
+			return (ERROR_RC);
+		}
+	}
+	return (OK_RC);
+}
+
+/*
+ * A request waiting for a reply from a server.  rc_send_server keeps
+ * one on its stack while it waits; those sent with rc_send_server_async
+ * are kept on a list, and retransmissions are driven by pppd timeouts
+ * rather than by blocking in select().
+ */
+
+typedef struct rc_request
+{
+	struct rc_request *next;
+	SEND_DATA	data;
+	SERVER		*servers;	/* servers to try in turn */
+	int		order[SERVER_MAX]; /* ... in this order */
+	int		nservers;
+	int		server;		/* the one we're trying now */
+	int		timeout;
+	int		retries;
+	int		tries;		/* # times sent to this server */
+	struct rc_sock	*sock;		/* socket we sent it on */
+	int		id;		/* its slot there, or -1 */
+	int		counted;	/* rc_health_sent was called */
+	struct timeval	sent;		/* when we last sent it */
+	struct sockaddr_in saremote;
+	int		length;		/* of the packet in buffer */
+	char		secret[MAX_SECRET_LENGTH + 1];
+	unsigned char	vector[AUTH_VECTOR_LEN];
+	rc_callback_fn	*callback;	/* NULL for rc_send_server */
+	void		*arg;
+	int		replied;	/* reply is waiting in reply */
+	int		lost;		/* its RadSec connection broke */
+	char		msg[BUFFER_LEN];
+	char		buffer[BUFFER_LEN];
+	char		reply[BUFFER_LEN];
+} RC_REQUEST;
+
+/*
+ * Sockets we keep open for talking to servers, one per local address
+ * we bind to, shared by all requests, and one per RadSec server (see
+ * radsec.c).  The identifier of each request is allocated from the
+ * table of the socket it goes out on, so that the reply can be given
+ * to the request waiting for it.
+ */
+
+typedef struct rc_sock
+{
+	struct rc_sock	*next;
+	UINT4		bind_ipaddr;
+	int		fd;
+	RC_RADSEC	*radsec;	/* if not NULL, a RadSec connection */
+	UINT4		ipaddr;		/* ... to this server */
+	unsigned short	port;
+	int		inflight;	/* # slots in use */
+	RC_REQUEST	*slot[256];
+} RC_SOCK;
+
+static RC_SOCK *rc_socks;
+static RC_REQUEST *rc_requests;
+
+static void rc_sock_input (int, void *);
+static void rc_sock_read (RC_SOCK *, int);
+static void rc_async_reply (RC_REQUEST *);
+static void rc_async_deliver (void *);
+static void rc_async_lost (void *);
+
+/*
+ * Function: rc_sock_get
+ *
+ * Purpose: find the socket bound to our own address, opening it
+ *	    the first time.
+ *
+ * Returns: the socket, or NULL on error.
  *
  */
 
-static int rc_pack_list (VALUE_PAIR *vp, char *secret, AUTH_HDR *auth)
+static RC_SOCK *rc_sock_get (void)
 {
-    int             length, i, pc, secretlen, padded_length;
-    int             total_length = 0;
-    UINT4           lvalue;
-    unsigned char   passbuf[MAX(AUTH_PASS_LEN, CHAP_VALUE_LENGTH)];
-    unsigned char   md5buf[256];
-    unsigned char   *buf, *vector, *lenptr;
+	RC_SOCK		*sock;
+	UINT4		bind_ipaddr = rc_own_bind_ipaddress();
+	struct sockaddr_in sin;
+	int             fd;
 
-    buf = auth->data;
+	for (sock = rc_socks; sock != NULL; sock = sock->next)
+		if (sock->radsec == NULL && sock->bind_ipaddr == bind_ipaddr)
+			return sock;
 
-    while (vp != (VALUE_PAIR *) NULL)
+	fd = socket (AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
 	{
+		error("rc_send_server: socket: %s", strerror(errno));
+		return NULL;
+	}
 
-	    if (vp->vendorcode != VENDOR_NONE) {
-		*buf++ = PW_VENDOR_SPECIFIC;
+	memset ((char *) &sin, '\0', sizeof (sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(bind_ipaddr);
+	sin.sin_port = htons ((unsigned short) 0);
+	if (bind (fd, (struct sockaddr *) &sin, sizeof (sin)) < 0)
+	{
+		close (fd);
+		error("rc_send_server: bind: %I: %m", htonl(bind_ipaddr));
+		return NULL;
+	}
+	/* scripts don't need it, and we never want to block reading it */
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
 
-		/* Place-holder for where to put length */
-		lenptr = buf++;
+	sock = calloc(1, sizeof(*sock));
+	if (sock == NULL)
+	{
+		close (fd);
+		error("rc_send_server: out of memory");
+		return NULL;
+	}
+	sock->bind_ipaddr = bind_ipaddr;
+	sock->fd = fd;
+	if (ppp_add_fd_handler(fd, rc_sock_input, sock) < 0)
+	{
+		close (fd);
+		free (sock);
+		error("rc_send_server: can't wait for replies");
+		return NULL;
+	}
+	sock->next = rc_socks;
+	rc_socks = sock;
+	return sock;
+}
 
-		/* Insert vendor code */
-		*buf++ = 0;
-		*buf++ = (((unsigned int) vp->vendorcode) >> 16) & 255;
-		*buf++ = (((unsigned int) vp->vendorcode) >> 8) & 255;
-		*buf++ = ((unsigned int) vp->vendorcode) & 255;
+/*
+ * Function: rc_slot_alloc
+ *
+ * Purpose: give a request an identifier on a socket, starting the
+ *	    search at hint.
+ *
+ * Returns: the identifier, or -1 if all 256 are in use.
+ *
+ */
 
-		/* Insert vendor-type */
-		*buf++ = vp->attribute;
+static int rc_slot_alloc (RC_SOCK *sock, RC_REQUEST *req, int hint)
+{
+	int i, id;
 
-		/* Insert value */
-		switch(vp->type) {
-		case PW_TYPE_STRING:
-		    length = vp->lvalue;
-		    *lenptr = length + 8;
-		    *buf++ = length+2;
-		    memcpy(buf, vp->strvalue, (size_t) length);
-		    buf += length;
-		    total_length += length+8;
-		    break;
-		case PW_TYPE_INTEGER:
-		case PW_TYPE_IPADDR:
-		    length = sizeof(UINT4);
-		    *lenptr = length + 8;
-		    *buf++ = length+2;
-		    lvalue = htonl(vp->lvalue);
-		    memcpy(buf, (char *) &lvalue, sizeof(UINT4));
-		    buf += length;
-		    total_length += length+8;
-		    break;
-		default:
-		    break;
+	for (i = 0; i < 256; ++i)
+	{
+		id = (hint + i) & 0xff;
+		if (sock->slot[id] == NULL)
+		{
+			sock->slot[id] = req;
+			++sock->inflight;
+			req->sock = sock;
+			req->id = id;
+			return id;
 		}
-	    } else {
-		*buf++ = vp->attribute;
-		switch (vp->attribute) {
-		case PW_USER_PASSWORD:
-
-		    /* Encrypt the password */
-
-		    /* Chop off password at AUTH_PASS_LEN */
-		    length = vp->lvalue;
-		    if (length > AUTH_PASS_LEN) length = AUTH_PASS_LEN;
-
-		    /* Calculate the padded length */
-		    padded_length = (length+(AUTH_VECTOR_LEN-1)) & ~(AUTH_VECTOR_LEN-1);
-
-		    /* Record the attribute length */
-		    *buf++ = padded_length + 2;
-
-		    /* Pad the password with zeros */
-		    memset ((char *) passbuf, '\0', AUTH_PASS_LEN);
-		    memcpy ((char *) passbuf, vp->strvalue, (size_t) length);
-
-		    secretlen = strlen (secret);
-		    vector = auth->vector;
-		    for(i = 0; i < padded_length; i += AUTH_VECTOR_LEN) {
-			/* Calculate the MD5 digest*/
-			strcpy ((char *) md5buf, secret);
-			memcpy ((char *) md5buf + secretlen, vector,
-				AUTH_VECTOR_LEN);
-			rc_md5_calc (buf, md5buf, secretlen + AUTH_VECTOR_LEN);
-
-			/* Remeber the start of the digest */
-			vector = buf;
-
-			/* Xor the password into the MD5 digest */
-			for (pc = i; pc < (i + AUTH_VECTOR_LEN); pc++) {
-			    *buf++ ^= passbuf[pc];
-			}
-		    }
-
-		    total_length += padded_length + 2;
-
-		    break;
-#if 0
-		case PW_CHAP_PASSWORD:
-
-		    *buf++ = CHAP_VALUE_LENGTH + 2;
-
-		    /* Encrypt the Password */
-		    length = vp->lvalue;
-		    if (length > CHAP_VALUE_LENGTH) {
-			length = CHAP_VALUE_LENGTH;
-		    }
-		    memset ((char *) passbuf, '\0', CHAP_VALUE_LENGTH);
-		    memcpy ((char *) passbuf, vp->strvalue, (size_t) length);
-
-		    /* Calculate the MD5 Digest */
-		    secretlen = strlen (secret);
-		    strcpy ((char *) md5buf, secret);
-		    memcpy ((char *) md5buf + secretlen, (char *) auth->vector,
-			    AUTH_VECTOR_LEN);
-		    rc_md5_calc (buf, md5buf, secretlen + AUTH_VECTOR_LEN);
-
-		    /* Xor the password into the MD5 digest */
-		    for (i = 0; i < CHAP_VALUE_LENGTH; i++) {
-			*buf++ ^= passbuf[i];
-		    }
-		    total_length += CHAP_VALUE_LENGTH + 2;
-
-		    break;
-#endif
-		default:
-		    switch (vp->type) {
-		    case PW_TYPE_STRING:
-			length = vp->lvalue;
-			*buf++ = length + 2;
-			memcpy (buf, vp->strvalue, (size_t) length);
-			buf += length;
-			total_length += length + 2;
-			break;
+	}
+	return -1;
+}
 
-		    case PW_TYPE_INTEGER:
-		    case PW_TYPE_IPADDR:
-			*buf++ = sizeof (UINT4) + 2;
-			lvalue = htonl (vp->lvalue);
-			memcpy (buf, (char *) &lvalue, sizeof (UINT4));
-			buf += sizeof (UINT4);
-			total_length += sizeof (UINT4) + 2;
-			break;
+/*
+ * Function: rc_slot_free
+ *
+ * Purpose: stop waiting for a reply to a request.
+ *
+ */
 
-		    default:
-			break;
-		    }
-		    break;
-		}
-	    }
-	    vp = vp->next;
+static void rc_slot_free (RC_REQUEST *req)
+{
+	if (req->id >= 0)
+	{
+		req->sock->slot[req->id] = NULL;
+		--req->sock->inflight;
+		req->id = -1;
 	}
-    return total_length;
 }
 
 /*
- * Function: rc_send_server
+ * Function: rc_sock_input
  *
- * Purpose: send a request to a RADIUS server and wait for the reply
+ * Purpose: called from pppd's main loop when a socket is readable.
  *
  */
 
-int rc_send_server (SEND_DATA *data, char *msg, REQUEST_INFO *info)
+static void rc_sock_input (int fd, void *arg)
 {
-	int             sockfd;
-	struct sockaddr salocal;
-	struct sockaddr saremote;
-	struct sockaddr_in *sin;
-	struct timeval  authtime;
-	fd_set          readfds;
-	AUTH_HDR       *auth, *recv_auth;
-	UINT4           auth_ipaddr;
-	char           *server_name;	/* Name of server to query */
-	socklen_t       salen;
-	int             result;
-	int             total_length;
-	socklen_t       length;
-	int             retry_max;
-	int		secretlen;
-	char            secret[MAX_SECRET_LENGTH + 1];
-	unsigned char   vector[AUTH_VECTOR_LEN];
-	char            recv_buffer[BUFFER_LEN];
-	char            send_buffer[BUFFER_LEN];
-	int		retries;
-	VALUE_PAIR	*vp;
+	rc_sock_read (arg, 1);
+}
 
-	server_name = data->server;
-	if (server_name == (char *) NULL || server_name[0] == '\0')
-		return (ERROR_RC);
+/*
+ * Function: rc_sock_reply
+ *
+ * Purpose: give a reply to the request with its identifier, if it
+ *	    came from the server we sent that request to and carries the
+ *	    right authenticator.  Anything else is dropped and the request
+ *	    goes on waiting.  Replies to requests from rc_send_server_async
+ *	    are acted on at once if now is set, otherwise from a timeout.
+ *	    The buffer must hold BUFFER_LEN bytes.
+ *
+ */
 
-	if ((vp = rc_avpair_get(data->send_pairs, PW_SERVICE_TYPE)) && \
-	    (vp->lvalue == PW_ADMINISTRATIVE))
+static void rc_sock_reply (RC_SOCK *sock, char *recv_buffer, int length,
+			   struct sockaddr_in *sin, int now)
+{
+	AUTH_HDR	*recv_auth = (AUTH_HDR *) recv_buffer;
+	RC_REQUEST	*req;
+
+	if (length < AUTH_HDR_LEN || ntohs (recv_auth->length) > length)
+		return;
+	req = sock->slot[recv_auth->id];
+	if (req == NULL || req->replied)
+		return;
+	/* over UDP it must come from where we sent the request; a RadSec
+	   connection only goes to the one server anyway */
+	if (sin != NULL
+	    && (sin->sin_addr.s_addr != req->saremote.sin_addr.s_addr
+		|| sin->sin_port != req->saremote.sin_port))
+		return;
+	if (rc_check_reply (recv_auth, BUFFER_LEN, req->secret,
+			    req->vector, req->id) != OK_RC)
+		return;
+
+	memcpy (req->reply, recv_buffer, ntohs (recv_auth->length));
+	req->replied = 1;
+	if (req->callback != NULL)
 	{
-		strcpy(secret, MGMT_POLL_SECRET);
-		if ((auth_ipaddr = rc_get_ipaddr(server_name)) == 0)
-			return (ERROR_RC);
+		if (now)
+			rc_async_reply (req);
+		else
+			ppp_timeout(rc_async_deliver, req, 0, 0);
 	}
-	else
+}
+
+/*
+ * Function: rc_sock_read
+ *
+ * Purpose: read replies from a socket and pass each to rc_sock_reply.
+ *
+ */
+
+static void rc_sock_read (RC_SOCK *sock, int now)
+{
+	char		recv_buffer[BUFFER_LEN];
+	struct sockaddr_in sin;
+	socklen_t	salen;
+	int		length;
+
+	for (;;)
 	{
-		if (rc_find_server (server_name, &auth_ipaddr, secret) != 0)
+		salen = sizeof (sin);
+		length = recvfrom (sock->fd, recv_buffer, sizeof (recv_buffer),
+				   0, (struct sockaddr *) &sin, &salen);
+		if (length < 0)
 		{
-			memset (secret, '\0', sizeof (secret));
-			return (ERROR_RC);
+			if (errno != EAGAIN && errno != EWOULDBLOCK
+			    && errno != EINTR)
+				error("rc_send_server: recvfrom: %m");
+			return;
 		}
+		rc_sock_reply (sock, recv_buffer, length, &sin, now);
 	}
+}
+
+/*
+ * Function: rc_radsec_reply
+ *
+ * Purpose: called by radsec.c with each reply read from a connection.
+ *
+ */
+
+static void rc_radsec_reply (void *arg, char *pkt, int len, int now)
+{
+	rc_sock_reply (arg, pkt, len, NULL, now);
+}
+
+/*
+ * Function: rc_radsec_lost
+ *
+ * Purpose: called by radsec.c when a connection breaks, so that the
+ *	    requests waiting on it stop waiting; no reply to them can
+ *	    come now.
+ *
+ */
 
-	sockfd = socket (AF_INET, SOCK_DGRAM, 0);
-	if (sockfd < 0)
+static void rc_radsec_lost (void *arg)
+{
+	RC_SOCK		*sock = arg;
+	RC_REQUEST	*req;
+	int		id;
+
+	for (id = 0; id < 256; ++id)
 	{
-		memset (secret, '\0', sizeof (secret));
-		error("rc_send_server: socket: %s", strerror(errno));
-		return (ERROR_RC);
+		req = sock->slot[id];
+		if (req == NULL || req->replied || req->lost)
+			continue;
+		req->lost = 1;
+		if (req->callback != NULL)
+			ppp_timeout(rc_async_lost, req, 0, 0);
 	}
+}
+
+/*
+ * Function: rc_radsec_sock
+ *
+ * Purpose: find the connection to a RadSec server, opening it if
+ *	    it isn't open.
+ *
+ * Returns: the socket, or NULL on error.
+ *
+ */
+
+static RC_SOCK *rc_radsec_sock (SEND_DATA *data, UINT4 ipaddr)
+{
+	RC_SOCK		*sock;
+
+	for (sock = rc_socks; sock != NULL; sock = sock->next)
+		if (sock->radsec != NULL && sock->ipaddr == ipaddr
+		    && sock->port == data->svc_port)
+			break;
 
-	length = sizeof (salocal);
-	sin = (struct sockaddr_in *) & salocal;
-	memset ((char *) sin, '\0', (size_t) length);
-	sin->sin_family = AF_INET;
-	sin->sin_addr.s_addr = htonl(rc_own_bind_ipaddress());
-	sin->sin_port = htons ((unsigned short) 0);
-	if (bind (sockfd, (struct sockaddr *) sin, length) < 0 ||
-		   getsockname (sockfd, (struct sockaddr *) sin, &length) < 0)
+	if (sock == NULL)
 	{
-		close (sockfd);
-		memset (secret, '\0', sizeof (secret));
-		error("rc_send_server: bind: %s: %m", server_name);
-		return (ERROR_RC);
+		sock = calloc(1, sizeof(*sock));
+		if (sock == NULL)
+		{
+			error("rc_send_server: out of memory");
+			return NULL;
+		}
+		sock->fd = -1;
+		sock->ipaddr = ipaddr;
+		sock->port = data->svc_port;
+		sock->radsec = rc_radsec_new (data->server, ipaddr,
+					      data->svc_port, rc_radsec_reply,
+					      rc_radsec_lost, sock);
+		if (sock->radsec == NULL)
+		{
+			free (sock);
+			return NULL;
+		}
+		sock->next = rc_socks;
+		rc_socks = sock;
 	}
 
-	retry_max = data->retries;	/* Max. numbers to try for reply */
-	retries = 0;			/* Init retry cnt for blocking call */
+	if (rc_radsec_connect (sock->radsec, data->timeout) != OK_RC)
+		return NULL;
+	return sock;
+}
+
+/*
+ * Function: rc_pool_inflight
+ *
+ * Purpose: tell how many requests are waiting for replies on our
+ *	    sockets.
+ *
+ */
+
+int rc_pool_inflight (void)
+{
+	RC_SOCK	*sock;
+	int	n = 0;
+
+	for (sock = rc_socks; sock != NULL; sock = sock->next)
+		n += sock->inflight;
+	return n;
+}
+
+/*
+ * Function: rc_build_request
+ *
+ * Purpose: fill in the packet to send, choosing the request vector.
+ *
+ * Returns: the length of the packet.
+ *
+ */
+
+static int rc_build_request (SEND_DATA *data, char *secret,
+			     unsigned char *vector, AUTH_HDR *auth)
+{
+	int             total_length;
+	int		secretlen;
 
-	/* Build a request */
-	auth = (AUTH_HDR *) send_buffer;
 	auth->code = data->code;
 	auth->id = data->seq_nbr;
 
 	if (data->code == PW_ACCOUNTING_REQUEST)
 	{
-		total_length = rc_pack_list(data->send_pairs, secret, auth) + AUTH_HDR_LEN;
+		total_length = rc_pack_list(data->send_pairs, secret, auth,
+					    RC_PACKET_MAX - AUTH_HDR_LEN) + AUTH_HDR_LEN;
 
 		auth->length = htons ((unsigned short) total_length);
 
@@ -282,106 +462,561 @@ int rc_send_server (SEND_DATA *data, char *msg, REQUEST_INFO *info)
 		rc_random_vector (vector);
 		memcpy (auth->vector, vector, AUTH_VECTOR_LEN);
 
-		total_length = rc_pack_list(data->send_pairs, secret, auth) + AUTH_HDR_LEN;
+		total_length = rc_pack_list(data->send_pairs, secret, auth,
+					    RC_PACKET_MAX - AUTH_HDR_LEN) + AUTH_HDR_LEN;
 
 		auth->length = htons ((unsigned short) total_length);
 	}
+	return total_length;
+}
+
+/*
+ * Function: rc_read_reply
+ *
+ * Purpose: collect the attributes and any Reply-Message text from
+ *	    a reply that rc_sock_read has checked.
+ *
+ */
 
-	sin = (struct sockaddr_in *) & saremote;
-	memset ((char *) sin, '\0', sizeof (saremote));
-	sin->sin_family = AF_INET;
-	sin->sin_addr.s_addr = htonl (auth_ipaddr);
-	sin->sin_port = htons ((unsigned short) data->svc_port);
+static int rc_read_reply (SEND_DATA *data, AUTH_HDR *recv_auth, char *msg)
+{
+	RC_ATTR_CURSOR	cur;
+	RC_ATTR		attr;
+	int		len = 0;
 
-	for (;;)
+	/* There is nothing for us in an Accounting-Response but the code */
+	data->receive_pairs = NULL;
+	if (recv_auth->code != PW_ACCOUNTING_RESPONSE)
+		data->receive_pairs = rc_avpair_gen(recv_auth);
+
+	rc_attr_first(&cur, recv_auth);
+	while (rc_attr_next(&cur, &attr))
+	{
+		if (attr.attribute == PW_REPLY_MESSAGE
+		    && attr.vendorcode == VENDOR_NONE
+		    && len + attr.len + 2 <= BUFFER_LEN)
+		{
+			memcpy(msg + len, attr.value, attr.len);
+			len += attr.len;
+			msg[len++] = '\n';
+		}
+	}
+	msg[len] = '\0';
+
+	if ((recv_auth->code == PW_ACCESS_ACCEPT) ||
+		(recv_auth->code == PW_PASSWORD_ACK) ||
+		(recv_auth->code == PW_ACCOUNTING_RESPONSE))
+	{
+		return (OK_RC);
+	}
+	return (BADRESP_RC);
+}
+
+/*
+ * Function: rc_request_start
+ *
+ * Purpose: get a request ready to go to the server named in its
+ *	    data, on our socket.
+ *
+ */
+
+static int rc_request_start (RC_REQUEST *req)
+{
+	UINT4		auth_ipaddr;
+	SEND_DATA	*data = &req->data;
+	RC_SOCK		*sock;
+
+	if (rc_server_secret (data, &auth_ipaddr, req->secret) != OK_RC)
+		return (ERROR_RC);
+
+	if (rc_radsec_server (data->server))
+		sock = rc_radsec_sock (data, auth_ipaddr);
+	else
+		sock = rc_sock_get ();
+	if (sock == NULL)
+		return (ERROR_RC);
+	if (rc_slot_alloc (sock, req, data->seq_nbr) < 0)
+	{
+		error("rc_send_server: too many requests waiting for replies");
+		return (ERROR_RC);
+	}
+	data->seq_nbr = req->id;
+	req->replied = 0;
+	req->lost = 0;
+
+	req->length = rc_build_request (data, req->secret, req->vector,
+					(AUTH_HDR *) req->buffer);
+
+	memset ((char *) &req->saremote, '\0', sizeof (req->saremote));
+	req->saremote.sin_family = AF_INET;
+	req->saremote.sin_addr.s_addr = htonl (auth_ipaddr);
+	req->saremote.sin_port = htons ((unsigned short) data->svc_port);
+
+	req->tries = 0;
+	rc_health_sent (auth_ipaddr, data->svc_port);
+	req->counted = 1;
+	return (OK_RC);
+}
+
+/*
+ * Function: rc_request_send
+ *
+ * Purpose: (re)transmit a request.
+ *
+ */
+
+static void rc_request_send (RC_REQUEST *req)
+{
+	/* over TCP a retransmission only waits longer for the reply */
+	if (req->sock->radsec != NULL)
+	{
+		if (req->tries == 0)
+			rc_radsec_send (req->sock->radsec, req->buffer,
+					req->length);
+	}
+	else
+		sendto (req->sock->fd, req->buffer, (unsigned int) req->length,
+			0, (struct sockaddr *) &req->saremote,
+			sizeof (req->saremote));
+	ppp_get_time(&req->sent);
+	++req->tries;
+}
+
+/*
+ * Function: rc_request_health
+ *
+ * Purpose: tell the server health table how a request went.
+ *
+ */
+
+static void rc_request_health (RC_REQUEST *req, int result)
+{
+	UINT4		addr = ntohl (req->saremote.sin_addr.s_addr);
+	int		port = ntohs (req->saremote.sin_port);
+	struct timeval	now;
+	int		rtt = -1;
+
+	if (!req->counted)
+		return;
+	req->counted = 0;
+	switch (result)
+	{
+	case OK_RC:
+		/* a reply to a retransmission doesn't say which one it's for */
+		if (req->tries == 1)
+		{
+			ppp_get_time(&now);
+			rtt = (now.tv_sec - req->sent.tv_sec) * 1000
+				+ (now.tv_usec - req->sent.tv_usec) / 1000;
+		}
+		rc_health_reply (addr, port, rtt);
+		break;
+	case TIMEOUT_RC:
+		rc_health_timeout (addr, port);
+		break;
+	default:
+		rc_health_cancel (addr, port);
+		break;
+	}
+}
+
+/*
+ * Function: rc_send_server
+ *
+ * Purpose: send a request to a RADIUS server and wait for the reply
+ *
+ */
+
+int rc_send_server (SEND_DATA *data, char *msg, REQUEST_INFO *info)
+{
+	RC_REQUEST	*req;
+	struct timeval  authtime, now, deadline;
+	fd_set          readfds;
+	int             fd;
+	int             result;
+	RC_RADSEC	*radsec;
+
+	req = calloc(1, sizeof(*req));
+	if (req == NULL)
+	{
+		error("rc_send_server: out of memory");
+		return (ERROR_RC);
+	}
+	req->data = *data;
+	req->id = -1;
+	if (rc_request_start (req) != OK_RC)
+	{
+		memset (req->secret, '\0', sizeof (req->secret));
+		free (req);
+		return (ERROR_RC);
+	}
+	fd = req->sock->fd;
+	radsec = req->sock->radsec;
+
+	while (!req->replied && !req->lost)
 	{
-		sendto (sockfd, (char *) auth, (unsigned int) total_length, (int) 0,
-			(struct sockaddr *) sin, sizeof (struct sockaddr_in));
+		rc_request_send (req);
 
-		authtime.tv_usec = 0L;
-		authtime.tv_sec = (long) data->timeout;
-		FD_ZERO (&readfds);
-		FD_SET (sockfd, &readfds);
-		if (select (sockfd + 1, &readfds, NULL, NULL, &authtime) < 0)
+		ppp_get_time(&deadline);
+		deadline.tv_sec += data->timeout;
+		for (;;)
 		{
-			if (errno == EINTR && !ppp_signaled(SIGTERM))
+			ppp_get_time(&now);
+			if (!timercmp(&now, &deadline, <))
+				break;
+			timersub(&deadline, &now, &authtime);
+			if (radsec != NULL)
+			{
+				if (rc_radsec_wait (radsec, &authtime) < 0
+				    && !req->lost)
+				{
+					error("rc_send_server: select: %m");
+					result = ERROR_RC;
+					goto out;
+				}
+				if (req->replied || req->lost)
+					break;
 				continue;
-			error("rc_send_server: select: %m");
-			memset (secret, '\0', sizeof (secret));
-			close (sockfd);
-			return (ERROR_RC);
+			}
+			FD_ZERO (&readfds);
+			FD_SET (fd, &readfds);
+			if (select (fd + 1, &readfds, NULL, NULL, &authtime) < 0)
+			{
+				if (errno == EINTR && !ppp_signaled(SIGTERM))
+					continue;
+				error("rc_send_server: select: %m");
+				result = ERROR_RC;
+				goto out;
+			}
+			if (FD_ISSET (fd, &readfds))
+			{
+				rc_sock_read (req->sock, 0);
+				if (req->replied)
+					break;
+			}
 		}
-		if (FD_ISSET (sockfd, &readfds))
+		if (req->replied)
 			break;
 
 		/*
 		 * Timed out waiting for response.  Retry "retry_max" times
 		 * before giving up.  If retry_max = 0, don't retry at all.
 		 */
-		if (++retries >= retry_max)
+		if (req->lost || req->tries >= data->retries)
 		{
 			error("rc_send_server: no reply from RADIUS server %s:%u",
-			      rc_ip_hostname (auth_ipaddr), data->svc_port);
-			close (sockfd);
-			memset (secret, '\0', sizeof (secret));
-			return (TIMEOUT_RC);
+			      data->server, data->svc_port);
+			result = TIMEOUT_RC;
+			goto out;
 		}
 	}
-	salen = sizeof (saremote);
-	length = recvfrom (sockfd, (char *) recv_buffer,
-			   (int) sizeof (recv_buffer),
-			   (int) 0, &saremote, &salen);
 
-	if (length <= 0)
+	rc_request_health (req, OK_RC);
+	result = rc_read_reply (&req->data, (AUTH_HDR *) req->reply, msg);
+	data->receive_pairs = req->data.receive_pairs;
+
+	if (info)
 	{
-		error("rc_send_server: recvfrom: %s:%d: %m", server_name,\
-		      data->svc_port);
-		close (sockfd);
-		memset (secret, '\0', sizeof (secret));
-		return (ERROR_RC);
+		memcpy(info->secret, req->secret, sizeof(info->secret));
+		memcpy(info->request_vector, req->vector,
+		       sizeof(info->request_vector));
 	}
 
-	recv_auth = (AUTH_HDR *)recv_buffer;
+ out:
+	rc_request_health (req, result);
+	data->seq_nbr = req->data.seq_nbr;
+	rc_slot_free (req);
+	memset (req->secret, '\0', sizeof (req->secret));
+	free (req);
+	return (result);
+}
 
-	result = rc_check_reply (recv_auth, BUFFER_LEN, secret, vector, data->seq_nbr);
+static int rc_async_start (RC_REQUEST *);
+static void rc_async_timeout (void *);
 
-	data->receive_pairs = rc_avpair_gen(recv_auth);
+/*
+ * Function: rc_async_close
+ *
+ * Purpose: stop waiting for a reply from the current server.
+ *
+ */
 
-	close (sockfd);
-	if (info)
+static void rc_async_close (RC_REQUEST *req)
+{
+	ppp_untimeout(rc_async_timeout, req);
+	ppp_untimeout(rc_async_deliver, req);
+	ppp_untimeout(rc_async_lost, req);
+	rc_request_health (req, ERROR_RC);
+	rc_slot_free (req);
+	req->replied = 0;
+	req->lost = 0;
+}
+
+/*
+ * Function: rc_async_free
+ *
+ * Purpose: forget about a request.
+ *
+ */
+
+static void rc_async_free (RC_REQUEST *req)
+{
+	RC_REQUEST **rp;
+
+	for (rp = &rc_requests; *rp != NULL; rp = &(*rp)->next)
 	{
-		memcpy(info->secret, secret, sizeof(info->secret));
-		memcpy(info->request_vector, vector,
-		       sizeof(info->request_vector));
+		if (*rp == req)
+		{
+			*rp = req->next;
+			break;
+		}
 	}
-	memset (secret, '\0', sizeof (secret));
+	rc_async_close(req);
+	rc_avpair_free(req->data.send_pairs);
+	memset(req->secret, '\0', sizeof(req->secret));
+	free(req);
+}
+
+/*
+ * Function: rc_async_done
+ *
+ * Purpose: pass the result of a request to its callback.  The
+ *	    callback owns the received pairs.
+ *
+ */
 
-	if (result != OK_RC) return (result);
+static void rc_async_done (RC_REQUEST *req, int result)
+{
+	REQUEST_INFO	info;
+	VALUE_PAIR	*received = req->data.receive_pairs;
+	RC_REQUEST	**rp;
 
-	*msg = '\0';
-	vp = data->receive_pairs;
-	while (vp)
+	/* take it off the list first so the callback can't cancel it */
+	for (rp = &rc_requests; *rp != NULL; rp = &(*rp)->next)
 	{
-		if ((vp = rc_avpair_get(vp, PW_REPLY_MESSAGE)))
+		if (*rp == req)
 		{
-			strcat(msg, (char*) vp->strvalue);
-			strcat(msg, "\n");
-			vp = vp->next;
+			*rp = req->next;
+			break;
 		}
 	}
+	rc_async_close(req);
 
-	if ((recv_auth->code == PW_ACCESS_ACCEPT) ||
-		(recv_auth->code == PW_PASSWORD_ACK) ||
-		(recv_auth->code == PW_ACCOUNTING_RESPONSE))
+	memcpy(info.secret, req->secret, sizeof(info.secret));
+	memcpy(info.request_vector, req->vector, sizeof(info.request_vector));
+	req->data.receive_pairs = NULL;
+
+	(*req->callback)(result, received, req->msg, &info, req->arg);
+
+	memset(info.secret, '\0', sizeof(info.secret));
+	rc_async_free(req);
+}
+
+/*
+ * Function: rc_async_next
+ *
+ * Purpose: give up on the current server and try the next one,
+ *	    or report the failure if there are no more.
+ *
+ */
+
+static void rc_async_next (RC_REQUEST *req, int result)
+{
+	rc_async_close(req);
+	while (++req->server < req->nservers)
 	{
-		result = OK_RC;
+		if (rc_async_start(req) == OK_RC)
+			return;
 	}
-	else
+	rc_async_done(req, result);
+}
+
+/*
+ * Function: rc_async_send
+ *
+ * Purpose: (re)transmit the request and wait for the reply.
+ *
+ */
+
+static void rc_async_send (RC_REQUEST *req)
+{
+	rc_request_send (req);
+	ppp_timeout(rc_async_timeout, req, req->timeout, 0);
+}
+
+/*
+ * Function: rc_async_start
+ *
+ * Purpose: send the request to the current server.
+ *
+ */
+
+static int rc_async_start (RC_REQUEST *req)
+{
+	SEND_DATA	*data = &req->data;
+
+	rc_buildreq(data, data->code,
+		    req->servers->name[req->order[req->server]],
+		    req->servers->port[req->order[req->server]],
+		    req->timeout, req->retries);
+
+	if (rc_request_start (req) != OK_RC)
+		return (ERROR_RC);
+
+	rc_async_send (req);
+	return (OK_RC);
+}
+
+/*
+ * Function: rc_async_timeout
+ *
+ * Purpose: called when no reply has come in time.
+ *
+ */
+
+static void rc_async_timeout (void *arg)
+{
+	RC_REQUEST *req = arg;
+
+	if (req->tries < req->retries)
 	{
-		result = BADRESP_RC;
+		rc_async_send (req);
+		return;
 	}
+	error("rc_send_server: no reply from RADIUS server %s:%u",
+	      req->data.server, req->data.svc_port);
+	rc_request_health (req, TIMEOUT_RC);
+	rc_async_next (req, TIMEOUT_RC);
+}
 
-	return (result);
+/*
+ * Function: rc_async_lost
+ *
+ * Purpose: called when the RadSec connection a request went out on
+ *	    has broken.
+ *
+ */
+
+static void rc_async_lost (void *arg)
+{
+	RC_REQUEST *req = arg;
+
+	error("rc_send_server: no reply from RADIUS server %s:%u",
+	      req->data.server, req->data.svc_port);
+	rc_request_health (req, TIMEOUT_RC);
+	rc_async_next (req, TIMEOUT_RC);
+}
+
+/*
+ * Function: rc_async_reply
+ *
+ * Purpose: act on the reply to a request.
+ *
+ */
+
+static void rc_async_reply (RC_REQUEST *req)
+{
+	int		result;
+
+	ppp_untimeout(rc_async_deliver, req);
+	rc_request_health (req, OK_RC);
+	if (req->data.receive_pairs != NULL)
+	{
+		rc_avpair_free(req->data.receive_pairs);
+		req->data.receive_pairs = NULL;
+	}
+	result = rc_read_reply (&req->data, (AUTH_HDR *) req->reply,
+				req->msg);
+	rc_async_done (req, result);
+}
+
+/*
+ * Function: rc_async_deliver
+ *
+ * Purpose: act on a reply that came in while rc_send_server was
+ *	    waiting for another.
+ *
+ */
+
+static void rc_async_deliver (void *arg)
+{
+	rc_async_reply (arg);
+}
+
+/*
+ * Function: rc_send_server_async
+ *
+ * Purpose: send a request to each server in turn, as the blocking
+ *	    callers of rc_send_server do, but return at once and call
+ *	    callback with the outcome later from pppd's main loop.
+ *	    The send pairs now belong to the request.
+ *
+ * Returns: OK_RC if the request is under way, otherwise an error
+ *	    code, in which case the callback is never called.
+ *
+ */
+
+int rc_send_server_async (int code, SERVER *servers, VALUE_PAIR *send,
+			  rc_callback_fn *callback, void *arg)
+{
+	RC_REQUEST *req;
+
+	if (servers == NULL || servers->max <= 0)
+		return (ERROR_RC);
+
+	req = calloc(1, sizeof(*req));
+	if (req == NULL)
+	{
+		error("rc_send_server_async: out of memory");
+		return (ERROR_RC);
+	}
+	req->data.code = code;
+	req->data.send_pairs = send;
+	req->servers = servers;
+	req->timeout = rc_conf_int("radius_timeout");
+	req->retries = rc_conf_int("radius_retries");
+	req->id = -1;
+	req->callback = callback;
+	req->arg = arg;
+	req->nservers = rc_health_order (servers, req->order);
+
+	for (req->server = 0; req->server < req->nservers; ++req->server)
+	{
+		if (rc_async_start(req) == OK_RC)
+		{
+			req->next = rc_requests;
+			rc_requests = req;
+			return (OK_RC);
+		}
+	}
+
+	/* the caller still owns the pairs if we fail */
+	req->data.send_pairs = NULL;
+	rc_async_free(req);
+	return (ERROR_RC);
+}
+
+/*
+ * Function: rc_cancel_async
+ *
+ * Purpose: abandon any requests started with the given callback
+ *	    argument, without calling their callbacks.
+ *
+ */
+
+void rc_cancel_async (void *arg)
+{
+	RC_REQUEST *req, *next;
+
+	for (req = rc_requests; req != NULL; req = next)
+	{
+		next = req->next;
+		if (req->arg == arg)
+		{
+			rc_avpair_free(req->data.receive_pairs);
+			rc_async_free(req);
+		}
+	}
 }
 
 /*
@@ -0,0 +1,1130 @@
+/*
+ * spool.c - accounting records kept on disk until a server has them.
+ *
+ *
+ * Copyright (c) 2026 The ppp project. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The name(s) of the authors of this software must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission.
+ *
+ * THE AUTHORS OF THIS SOFTWARE DISCLAIM ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS, IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+ * AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <includes.h>
+#include <radiusclient.h>
+#include <sys/file.h>
+#include <sys/uio.h>
+#include <dirent.h>
+
+/*
+ * When acct_spool_dir is set, each accounting request is appended to a
+ * log in that directory, and synced, before it goes anywhere; it is
+ * sent from there in the background, and only forgotten once a server
+ * has answered it.  So if every server is down the records wait for
+ * one to come back, rather than being lost.
+ *
+ * The log is a series of segment files, each owned (flock'd) by the
+ * pppd that wrote it.  Next to each segment is an ack file listing the
+ * offsets of the records a server has answered; once they all have
+ * been, both files go.  A pppd that starts up takes over any segments
+ * nobody owns and sends what's left in them.
+ *
+ * Up to RC_SPOOL_BATCH requests are in flight at once, but never two
+ * for the same session, so a session's records reach the server in the
+ * order they happened.  If a request fails we wait a while, doubling
+ * up to RC_SPOOL_RETRY_MAX seconds, before trying again.  A record the
+ * servers keep answering with a bad reply is moved to the "rejected"
+ * file after RC_SPOOL_BADRESP_MAX tries, where it waits for someone to
+ * look at it rather than holding up the session's later records.
+ */
+
+#define RC_SPOOL_MAGIC		0x52535031	/* "RSP1" */
+#define RC_SPOOL_SEGMENT_MAX	(1 << 20)	/* bytes before a new segment */
+#define RC_SPOOL_BATCH		8
+#define RC_SPOOL_SCAN		256		/* records looked at per kick */
+#define RC_SPOOL_RETRY_MAX	60
+#define RC_SPOOL_BADRESP_MAX	5
+#define RC_SPOOL_SESSION_LEN	64
+#define RC_SPOOL_PAIRS_MAX	4096
+
+struct rc_spool_hdr {
+	UINT4		magic;
+	UINT4		len;		/* of the pairs that follow */
+	UINT4		sum;		/* of the pairs */
+	UINT4		event_time;	/* time() of what's recorded */
+	char		session[RC_SPOOL_SESSION_LEN];
+};
+
+typedef struct rc_segment {
+	struct rc_segment *next;
+	char		*path;
+	int		fd;		/* holds the lock */
+	int		ackfd;		/* or -1 until we need it */
+	int		pending;	/* records not yet answered */
+	int		writing;	/* we still append to it */
+	off_t		size;
+} RC_SEGMENT;
+
+typedef struct rc_spooled {
+	struct rc_spooled *next;
+	RC_SEGMENT	*seg;
+	UINT4		offset;
+	UINT4		event_time;
+	char		session[RC_SPOOL_SESSION_LEN];
+	int		inflight;
+	int		badresp;	/* bad replies so far */
+	int		len;
+	unsigned char	pairs[1];	/* really len */
+} RC_SPOOLED;
+
+static struct {
+	int		initialized;
+	char		*dir;
+	SERVER		*servers;
+	RC_SEGMENT	*segments;
+	RC_SEGMENT	*current;	/* the one we append to */
+	int		nsegments;	/* # we have made */
+	RC_SPOOLED	*head, **tail;
+	int		depth;		/* records waiting */
+	int		inflight;
+	int		retry_wait;	/* seconds, or 0 */
+	int		retry_pending;
+	int		warn_depth;
+} spool;
+
+static void rc_spool_kick (void);
+static void rc_spool_retry (void *);
+static void rc_spool_backoff (void);
+
+/*
+ * Function: rc_spool_sum
+ *
+ * Purpose: checksum a record, to catch one that was cut short.
+ *
+ */
+
+static UINT4 rc_spool_sum (const unsigned char *p, int len)
+{
+	UINT4 a = 1, b = 0;
+
+	while (len-- > 0)
+	{
+		a = (a + *p++) % 65521;
+		b = (b + a) % 65521;
+	}
+	return (b << 16) | a;
+}
+
+/*
+ * Function: rc_spool_depth
+ *
+ * Purpose: tell how many accounting records are waiting to be sent.
+ *
+ */
+
+int rc_spool_depth (void)
+{
+	return spool.depth;
+}
+
+/*
+ * Function: rc_spool_count
+ *
+ * Purpose: change the number of records waiting, and let scripts
+ *	    and the log know.
+ *
+ */
+
+static void rc_spool_count (int delta)
+{
+	char	buf[16];
+
+	spool.depth += delta;
+	slprintf (buf, sizeof (buf), "%d", spool.depth);
+	ppp_script_setenv ("RADIUS_ACCT_BACKLOG", buf, 0);
+
+	if (spool.warn_depth == 0)
+		spool.warn_depth = 100;
+	if (spool.depth >= spool.warn_depth)
+	{
+		warn("RADIUS accounting: %d records waiting to be sent",
+		     spool.depth);
+		spool.warn_depth *= 10;
+	}
+	else if (spool.depth == 0)
+		spool.warn_depth = 100;
+}
+
+/*
+ * Function: rc_spool_queue
+ *
+ * Purpose: add a record to those waiting to be sent.
+ *
+ */
+
+static void rc_spool_queue (RC_SEGMENT *seg, UINT4 offset,
+			    struct rc_spool_hdr *hdr, const unsigned char *pairs)
+{
+	RC_SPOOLED	*rec;
+
+	rec = malloc (sizeof (*rec) + hdr->len);
+	if (rec == NULL)
+	{
+		novm("rc_spool");
+		return;
+	}
+	rec->next = NULL;
+	rec->seg = seg;
+	rec->offset = offset;
+	rec->event_time = hdr->event_time;
+	memcpy (rec->session, hdr->session, sizeof (rec->session));
+	rec->session[sizeof (rec->session) - 1] = 0;
+	rec->inflight = 0;
+	rec->badresp = 0;
+	rec->len = hdr->len;
+	memcpy (rec->pairs, pairs, hdr->len);
+
+	*spool.tail = rec;
+	spool.tail = &rec->next;
+	++seg->pending;
+	rc_spool_count (1);
+}
+
+/*
+ * Function: rc_spool_drop_segment
+ *
+ * Purpose: remove a segment all of whose records have been answered.
+ *
+ */
+
+static void rc_spool_drop_segment (RC_SEGMENT *seg)
+{
+	RC_SEGMENT	**sp;
+	char		ackpath[PATH_MAX];
+
+	for (sp = &spool.segments; *sp != NULL; sp = &(*sp)->next)
+	{
+		if (*sp == seg)
+		{
+			*sp = seg->next;
+			break;
+		}
+	}
+	slprintf (ackpath, sizeof (ackpath), "%s.ack", seg->path);
+	unlink (seg->path);
+	unlink (ackpath);
+	if (seg->ackfd >= 0)
+		close (seg->ackfd);
+	close (seg->fd);
+	free (seg->path);
+	free (seg);
+}
+
+/*
+ * Function: rc_spool_add_segment
+ *
+ * Purpose: start looking after a segment whose lock we hold.
+ *
+ */
+
+static RC_SEGMENT *rc_spool_add_segment (char *path, int fd)
+{
+	RC_SEGMENT	*seg;
+
+	seg = calloc (1, sizeof (*seg));
+	if (seg == NULL || (seg->path = strdup (path)) == NULL)
+	{
+		novm("rc_spool");
+		return NULL;
+	}
+	seg->fd = fd;
+	seg->ackfd = -1;
+	seg->next = spool.segments;
+	spool.segments = seg;
+	return seg;
+}
+
+static int rc_spool_cmp_offset (const void *a, const void *b)
+{
+	UINT4 x = *(const UINT4 *) a, y = *(const UINT4 *) b;
+
+	return x < y? -1: x > y;
+}
+
+/*
+ * Function: rc_spool_adopt
+ *
+ * Purpose: take over a segment left by a pppd that has gone, and
+ *	    queue whatever in it hasn't been answered.  We stop at the
+ *	    first record that is cut short or damaged.
+ *
+ */
+
+static void rc_spool_adopt (char *path)
+{
+	char		ackpath[PATH_MAX];
+	unsigned char	pairs[RC_SPOOL_PAIRS_MAX];
+	struct rc_spool_hdr hdr;
+	RC_SEGMENT	*seg;
+	UINT4		*acks = NULL, offset;
+	int		fd, ackfd, nacks = 0;
+	struct stat	st;
+	FILE		*f;
+
+	if ((fd = open (path, O_RDWR | O_CLOEXEC)) < 0)
+		return;
+	if (flock (fd, LOCK_EX | LOCK_NB) < 0)
+	{
+		close (fd);		/* some other pppd has it */
+		return;
+	}
+	if ((seg = rc_spool_add_segment (path, fd)) == NULL)
+	{
+		close (fd);
+		return;
+	}
+
+	slprintf (ackpath, sizeof (ackpath), "%s.ack", path);
+	if ((ackfd = open (ackpath, O_RDONLY | O_CLOEXEC)) >= 0)
+	{
+		if (fstat (ackfd, &st) == 0 && st.st_size >= sizeof (UINT4)
+		    && (acks = malloc (st.st_size)) != NULL)
+		{
+			nacks = read (ackfd, acks, st.st_size) / sizeof (UINT4);
+			qsort (acks, nacks, sizeof (UINT4), rc_spool_cmp_offset);
+		}
+		close (ackfd);
+	}
+
+	if ((f = fdopen (dup (fd), "r")) != NULL)
+	{
+		offset = 0;
+		while (fread (&hdr, sizeof (hdr), 1, f) == 1
+		       && hdr.magic == RC_SPOOL_MAGIC
+		       && hdr.len <= sizeof (pairs)
+		       && fread (pairs, 1, hdr.len, f) == hdr.len
+		       && rc_spool_sum (pairs, hdr.len) == hdr.sum)
+		{
+			if (acks == NULL
+			    || bsearch (&offset, acks, nacks, sizeof (UINT4),
+					rc_spool_cmp_offset) == NULL)
+				rc_spool_queue (seg, offset, &hdr, pairs);
+			offset += sizeof (hdr) + hdr.len;
+		}
+		fclose (f);
+	}
+	free (acks);
+
+	if (seg->pending == 0)
+		rc_spool_drop_segment (seg);
+	else
+		info("RADIUS accounting: %d records to send from %s",
+		     seg->pending, path);
+}
+
+/*
+ * Function: rc_spool_init
+ *
+ * Purpose: get the spool ready, and start sending anything left in
+ *	    it by pppds that have gone, to the given servers.
+ *
+ * Returns: 0 if we are spooling, -1 if not
+ *
+ */
+
+int rc_spool_init (SERVER *acctserver)
+{
+	char		*dir = rc_conf_str("acct_spool_dir");
+	char		path[PATH_MAX];
+	struct dirent	**names;
+	int		i, n, len;
+
+	if (acctserver != NULL)
+		spool.servers = acctserver;
+	if (spool.initialized)
+		return spool.dir? 0: -1;
+	spool.initialized = 1;
+	spool.tail = &spool.head;
+	if (dir == NULL || *dir == 0)
+		return -1;
+
+	if (mkdir (dir, 0700) < 0 && errno != EEXIST)
+	{
+		error("RADIUS accounting: can't make spool %s: %m", dir);
+		return -1;
+	}
+	spool.dir = dir;
+
+	n = scandir (dir, &names, NULL, alphasort);
+	for (i = 0; i < n; ++i)
+	{
+		len = strlen (names[i]->d_name);
+		if (strncmp (names[i]->d_name, "acct-", 5) == 0
+		    && (len < 4 || strcmp (names[i]->d_name + len - 4, ".ack") != 0))
+		{
+			slprintf (path, sizeof (path), "%s/%s", dir,
+				  names[i]->d_name);
+			rc_spool_adopt (path);
+		}
+		free (names[i]);
+	}
+	if (n >= 0)
+		free (names);
+
+	rc_spool_kick ();
+	return 0;
+}
+
+/*
+ * Function: rc_spool_append
+ *
+ * Purpose: write a record to the end of our segment, and sync it.
+ *
+ * Returns: 0 on success, -1 on failure
+ *
+ */
+
+static int rc_spool_append (struct rc_spool_hdr *hdr, unsigned char *pairs)
+{
+	RC_SEGMENT	*seg = spool.current;
+	char		path[PATH_MAX];
+	struct iovec	iov[2];
+	int		fd;
+
+	if (seg != NULL && seg->size >= RC_SPOOL_SEGMENT_MAX)
+	{
+		seg->writing = 0;
+		if (seg->pending == 0)
+			rc_spool_drop_segment (seg);
+		seg = spool.current = NULL;
+	}
+	if (seg == NULL)
+	{
+		slprintf (path, sizeof (path), "%s/acct-%010d-%06d-%04d",
+			  spool.dir, (int) time (NULL), (int) getpid (),
+			  ++spool.nsegments);
+		fd = open (path, O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC,
+			   0600);
+		if (fd < 0)
+		{
+			error("RADIUS accounting: can't create %s: %m", path);
+			return -1;
+		}
+		if (flock (fd, LOCK_EX | LOCK_NB) < 0)
+		{
+			/* another pppd could take it over under us */
+			error("RADIUS accounting: can't lock %s: %m", path);
+			unlink (path);
+			close (fd);
+			return -1;
+		}
+		if ((seg = rc_spool_add_segment (path, fd)) == NULL)
+		{
+			unlink (path);
+			close (fd);
+			return -1;
+		}
+		seg->writing = 1;
+		spool.current = seg;
+	}
+
+	iov[0].iov_base = hdr;
+	iov[0].iov_len = sizeof (*hdr);
+	iov[1].iov_base = pairs;
+	iov[1].iov_len = hdr->len;
+	if (writev (seg->fd, iov, 2) != sizeof (*hdr) + hdr->len
+	    || fdatasync (seg->fd) < 0)
+	{
+		error("RADIUS accounting: can't write %s: %m", seg->path);
+		/* don't add anything after a partial record */
+		seg->size = RC_SPOOL_SEGMENT_MAX;
+		return -1;
+	}
+	seg->size += sizeof (*hdr) + hdr->len;
+	return 0;
+}
+
+/*
+ * Function: rc_spool_done
+ *
+ * Purpose: a server has answered a record; forget it.
+ *
+ */
+
+static void rc_spool_done (RC_SPOOLED *rec)
+{
+	RC_SPOOLED	**rp, *prev = NULL;
+	RC_SEGMENT	*seg = rec->seg;
+	char		ackpath[PATH_MAX];
+
+	for (rp = &spool.head; *rp != NULL; prev = *rp, rp = &(*rp)->next)
+	{
+		if (*rp == rec)
+		{
+			*rp = rec->next;
+			if (spool.tail == &rec->next)
+				spool.tail = prev? &prev->next: &spool.head;
+			break;
+		}
+	}
+
+	if (seg->ackfd < 0)
+	{
+		slprintf (ackpath, sizeof (ackpath), "%s.ack", seg->path);
+		seg->ackfd = open (ackpath, O_WRONLY | O_CREAT | O_APPEND
+				   | O_CLOEXEC, 0600);
+	}
+	/* if this is lost, the record is sent again; that's all */
+	if (seg->ackfd >= 0
+	    && write (seg->ackfd, &rec->offset, sizeof (rec->offset)) < 0)
+		warn("RADIUS accounting: can't write to %s.ack: %m", seg->path);
+
+	if (--seg->pending == 0 && !seg->writing)
+		rc_spool_drop_segment (seg);
+	free (rec);
+	rc_spool_count (-1);
+}
+
+/*
+ * Function: rc_spool_reject
+ *
+ * Purpose: keep a record no server will accept in the "rejected" file,
+ *	    in the same form as a segment, so that it can be looked at
+ *	    and, by renaming it to acct-something, sent again.
+ *
+ */
+
+static void rc_spool_reject (RC_SPOOLED *rec)
+{
+	struct rc_spool_hdr hdr;
+	char		path[PATH_MAX];
+	struct iovec	iov[2];
+	int		fd;
+
+	memset (&hdr, 0, sizeof (hdr));
+	hdr.magic = RC_SPOOL_MAGIC;
+	hdr.len = rec->len;
+	hdr.sum = rc_spool_sum (rec->pairs, rec->len);
+	hdr.event_time = rec->event_time;
+	memcpy (hdr.session, rec->session, sizeof (hdr.session));
+
+	slprintf (path, sizeof (path), "%s/rejected", spool.dir);
+	iov[0].iov_base = &hdr;
+	iov[0].iov_len = sizeof (hdr);
+	iov[1].iov_base = rec->pairs;
+	iov[1].iov_len = rec->len;
+	fd = open (path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+	if (fd < 0 || flock (fd, LOCK_EX) < 0
+	    || writev (fd, iov, 2) != sizeof (hdr) + rec->len
+	    || fdatasync (fd) < 0)
+		error("RADIUS accounting: can't keep rejected record in %s: %m",
+		      path);
+	else
+		error("RADIUS accounting: servers rejected a record for "
+		      "session %s %d times; moved to %s", rec->session,
+		      rec->badresp, path);
+	if (fd >= 0)
+		close (fd);
+}
+
+/*
+ * Function: rc_spool_pairs
+ *
+ * Purpose: get the pairs to send for a record, with Acct-Delay-Time
+ *	    saying how long ago it happened.
+ *
+ */
+
+static VALUE_PAIR *rc_spool_pairs (RC_SPOOLED *rec)
+{
+	VALUE_PAIR	*send = rc_avpair_unflatten (rec->pairs, rec->len);
+	UINT4		delay = 0;
+	time_t		now = time (NULL);
+
+	if (now > rec->event_time)
+		delay = now - rec->event_time;
+	rc_avpair_add (&send, PW_ACCT_DELAY_TIME, &delay, 0, VENDOR_NONE);
+	return send;
+}
+
+/*
+ * Function: rc_spool_reply
+ *
+ * Purpose: called with the outcome of sending a record.
+ *
+ */
+
+static void rc_spool_reply (int result, VALUE_PAIR *received, char *msg,
+			    REQUEST_INFO *info, void *arg)
+{
+	RC_SPOOLED	*rec = arg;
+
+	rc_avpair_free (received);
+	rec->inflight = 0;
+	--spool.inflight;
+
+	if (result == BADRESP_RC && ++rec->badresp >= RC_SPOOL_BADRESP_MAX)
+	{
+		rc_spool_reject (rec);
+		result = OK_RC;
+	}
+	if (result == OK_RC)
+	{
+		rc_spool_done (rec);
+		spool.retry_wait = 0;
+		rc_spool_kick ();
+		return;
+	}
+
+	rc_spool_backoff ();
+}
+
+/*
+ * Function: rc_spool_backoff
+ *
+ * Purpose: wait a while, longer each time, before sending again.
+ *
+ */
+
+static void rc_spool_backoff (void)
+{
+	if (!spool.retry_pending)
+	{
+		spool.retry_wait = spool.retry_wait?
+			MIN (2 * spool.retry_wait, RC_SPOOL_RETRY_MAX): 1;
+		spool.retry_pending = 1;
+		ppp_timeout(rc_spool_retry, NULL, spool.retry_wait, 0);
+	}
+}
+
+/*
+ * Function: rc_spool_retry
+ *
+ * Purpose: called from a timeout to try again.
+ *
+ */
+
+static void rc_spool_retry (void *arg)
+{
+	spool.retry_pending = 0;
+	rc_spool_kick ();
+}
+
+/*
+ * Function: rc_spool_kick
+ *
+ * Purpose: send as many waiting records as we may.  A record has to
+ *	    wait while an earlier one for the same session hasn't been
+ *	    answered.
+ *
+ */
+
+static void rc_spool_kick (void)
+{
+	RC_SPOOLED	*rec, *r;
+	VALUE_PAIR	*send;
+	int		scanned = 0;
+
+	if (spool.retry_pending || spool.servers == NULL)
+		return;
+	for (rec = spool.head; rec != NULL && spool.inflight < RC_SPOOL_BATCH
+		     && scanned < RC_SPOOL_SCAN; rec = rec->next, ++scanned)
+	{
+		if (rec->inflight)
+			continue;
+		for (r = spool.head; r != rec; r = r->next)
+			if (strcmp (r->session, rec->session) == 0)
+				break;
+		if (r != rec)
+			continue;
+
+		send = rc_spool_pairs (rec);
+		if (rc_send_server_async (PW_ACCOUNTING_REQUEST, spool.servers,
+					  send, rc_spool_reply, rec) != OK_RC)
+		{
+			/* nothing may come back to kick us again */
+			rc_avpair_free (send);
+			rc_spool_backoff ();
+			break;
+		}
+		rec->inflight = 1;
+		++spool.inflight;
+	}
+}
+
+/*
+ * Function: rc_acct_spool
+ *
+ * Purpose: like rc_acct_using_server, but if there is a spool the
+ *	    record goes there and is sent from there later.
+ *
+ * Returns: OK_RC if the record is spooled or was sent
+ *
+ */
+
+int rc_acct_spool (SERVER *acctserver, UINT4 client_port, VALUE_PAIR *send)
+{
+	unsigned char	pairs[RC_SPOOL_PAIRS_MAX];
+	struct rc_spool_hdr hdr;
+	VALUE_PAIR	*vp, **ours;
+	int		len;
+
+	if (rc_spool_init (acctserver) < 0)
+		return rc_acct_using_server (acctserver, client_port, send);
+
+	/*
+	 * Fill in NAS-IP-Address or NAS-Identifier, and NAS-Port, at the
+	 * end of the list, where we can take them off again
+	 */
+
+	for (ours = &send; *ours != NULL; ours = &(*ours)->next)
+		;
+	if (rc_get_nas_id(&send) == ERROR_RC)
+	    return (ERROR_RC);
+	if (rc_avpair_add(&send, PW_NAS_PORT, &client_port, 0, VENDOR_NONE) == NULL)
+		return (ERROR_RC);
+
+	len = rc_avpair_flatten (send, pairs, sizeof (pairs));
+	if (len < 0)
+	{
+		error("RADIUS accounting: record too big to spool");
+		return (ERROR_RC);
+	}
+	memset (&hdr, 0, sizeof (hdr));
+	hdr.magic = RC_SPOOL_MAGIC;
+	hdr.len = len;
+	hdr.sum = rc_spool_sum (pairs, len);
+	hdr.event_time = time (NULL);
+	if ((vp = rc_avpair_get (send, PW_ACCT_SESSION_ID)) != NULL)
+		strlcpy (hdr.session, (char *) vp->strvalue, sizeof (hdr.session));
+
+	if (rc_spool_append (&hdr, pairs) < 0)
+	{
+		/* better late than never: send it the old way, which adds
+		   the NAS pairs itself */
+		rc_avpair_free (*ours);
+		*ours = NULL;
+		return rc_acct_using_server (acctserver, client_port, send);
+	}
+	rc_spool_queue (spool.current, spool.current->size - sizeof (hdr) - len,
+			&hdr, pairs);
+	rc_spool_kick ();
+	return (OK_RC);
+}
+
+/*
+ * Function: rc_spool_flush
+ *
+ * Purpose: before pppd exits, try once more to send what's waiting,
+ *	    waiting for the replies.  We stop at the first record no
+ *	    server will take; the rest stay in the spool for the next
+ *	    pppd.
+ *
+ */
+
+void rc_spool_flush (void)
+{
+	RC_SPOOLED	*rec;
+	SEND_DATA	data;
+	char		msg[BUFFER_LEN];
+	int		order[SERVER_MAX], i, n, result;
+	int		timeout = rc_conf_int("radius_timeout");
+	int		retries = rc_conf_int("radius_retries");
+
+	if (spool.dir == NULL || spool.servers == NULL)
+		return;
+	ppp_untimeout(rc_spool_retry, NULL);
+	spool.retry_pending = 0;
+	for (rec = spool.head; rec != NULL; rec = rec->next)
+	{
+		if (rec->inflight)
+		{
+			rc_cancel_async (rec);
+			rec->inflight = 0;
+		}
+	}
+	spool.inflight = 0;
+
+	while ((rec = spool.head) != NULL)
+	{
+		data.send_pairs = rc_spool_pairs (rec);
+		data.receive_pairs = NULL;
+		result = ERROR_RC;
+		n = rc_health_order (spool.servers, order);
+		for (i = 0; i < n && result != OK_RC; ++i)
+		{
+			rc_avpair_free (data.receive_pairs);
+			data.receive_pairs = NULL;
+			rc_buildreq (&data, PW_ACCOUNTING_REQUEST,
+				     spool.servers->name[order[i]],
+				     spool.servers->port[order[i]],
+				     timeout, retries);
+			result = rc_send_server (&data, msg, NULL);
+		}
+		rc_avpair_free (data.receive_pairs);
+		rc_avpair_free (data.send_pairs);
+		if (result != OK_RC)
+		{
+			warn("RADIUS accounting: leaving %d records in %s",
+			     spool.depth, spool.dir);
+			break;
+		}
+		rc_spool_done (rec);
+	}
+}
+
+#ifdef UNIT_TEST
+/*
+ * Spool records, take them over from a pppd that has gone, and check
+ * what is sent and what is left on disk.  This stands in for pppd and
+ * for the servers, so the few things the library wants are here.
+ */
+#include <sys/wait.h>
+
+static char test_dir[] = "/tmp/utest_spool.XXXXXX";
+static char test_dict[] = "/tmp/utest_spool_dict.XXXXXX";
+static char spool_dir[PATH_MAX];
+
+static const char dict_text[] =
+    "ATTRIBUTE User-Name 1 string\n"
+    "ATTRIBUTE NAS-Port 5 integer\n"
+    "ATTRIBUTE NAS-Identifier 32 string\n"
+    "ATTRIBUTE Acct-Status-Type 40 integer\n"
+    "ATTRIBUTE Acct-Delay-Time 41 integer\n"
+    "ATTRIBUTE Acct-Session-Id 44 string\n";
+
+/* what the stand-in servers were asked */
+#define NSENT	16
+static RC_SPOOLED *sent[NSENT];
+static int nsent, send_result = OK_RC;
+static int fallback_port, fallback_nasid;
+static void (*timeout_fn)(void *);
+static SERVER servers;
+
+void error (const char *fmt, ...) { }
+void warn (const char *fmt, ...) { }
+void info (const char *fmt, ...) { }
+void dbglog (const char *fmt, ...) { }
+void fatal (const char *fmt, ...) { exit (1); }
+void novm (const char *msg) { exit (1); }
+UINT4 rc_get_ipaddr (const char *host) { return 0; }
+void rc_str2tm (char *valstr, struct tm *tm) { }
+void ppp_script_setenv (char *var, char *value, int iskey) { }
+void ppp_untimeout (void (*fn)(void *), void *arg) { timeout_fn = NULL; }
+int rc_health_order (SERVER *s, int *order) { return 0; }
+void rc_buildreq (SEND_DATA *data, int code, char *server,
+		  unsigned short port, int timeout, int retries) { }
+int rc_send_server (SEND_DATA *data, char *msg, REQUEST_INFO *info)
+{ return ERROR_RC; }
+void rc_cancel_async (void *arg) { }
+
+int slprintf (char *buf, int buflen, const char *fmt, ...)
+{
+	va_list	args;
+	int	n;
+
+	va_start (args, fmt);
+	n = vsnprintf (buf, buflen, fmt, args);
+	va_end (args);
+	return n;
+}
+
+size_t strlcpy (char *dest, const char *src, size_t len)
+{
+	size_t	ret = strlen (src);
+
+	if (len != 0)
+	{
+		strncpy (dest, src, len - 1);
+		dest[len - 1] = 0;
+	}
+	return ret;
+}
+
+char *rc_conf_str (char *name)
+{
+	if (strcmp (name, "acct_spool_dir") == 0)
+		return spool_dir;
+	return NULL;
+}
+
+int rc_conf_int (char *name)
+{
+	return 0;
+}
+
+void ppp_timeout (void (*fn)(void *), void *arg, int secs, int usecs)
+{
+	timeout_fn = fn;
+}
+
+int rc_get_nas_id (VALUE_PAIR **sendpairs)
+{
+	return rc_avpair_add (sendpairs, PW_NAS_IDENTIFIER, "nas", 0,
+			      VENDOR_NONE)? OK_RC: ERROR_RC;
+}
+
+int rc_send_server_async (int code, SERVER *s, VALUE_PAIR *send,
+			  rc_callback_fn *fn, void *arg)
+{
+	if (send_result != OK_RC)
+		return send_result;
+	rc_avpair_free (send);
+	if (nsent < NSENT)
+		sent[nsent++] = arg;
+	return OK_RC;
+}
+
+int rc_acct_using_server (SERVER *s, UINT4 client_port, VALUE_PAIR *send)
+{
+	VALUE_PAIR	*vp;
+
+	for (vp = send; vp != NULL; vp = vp->next)
+	{
+		fallback_port += vp->attribute == PW_NAS_PORT;
+		fallback_nasid += vp->attribute == PW_NAS_IDENTIFIER;
+	}
+	return OK_RC;
+}
+
+/* forget everything, as a new pppd would */
+static void reset (void)
+{
+	while (spool.segments != NULL)
+	{
+		close (spool.segments->fd);
+		if (spool.segments->ackfd >= 0)
+			close (spool.segments->ackfd);
+		spool.segments = spool.segments->next;
+	}
+	memset (&spool, 0, sizeof (spool));
+	nsent = 0;
+	send_result = OK_RC;
+	timeout_fn = NULL;
+}
+
+static int spool_record (char *session, UINT4 status)
+{
+	VALUE_PAIR	*send = NULL;
+	int		result;
+
+	rc_avpair_add (&send, PW_ACCT_SESSION_ID, session, 0, VENDOR_NONE);
+	rc_avpair_add (&send, PW_ACCT_STATUS_TYPE, &status, 0, VENDOR_NONE);
+	result = rc_acct_spool (&servers, 1, send);
+	rc_avpair_free (send);
+	return result;
+}
+
+static int status_of (RC_SPOOLED *rec)
+{
+	VALUE_PAIR	*send = rc_avpair_unflatten (rec->pairs, rec->len);
+	VALUE_PAIR	*vp = rc_avpair_get (send, PW_ACCT_STATUS_TYPE);
+	int		status = vp? vp->lvalue: -1;
+
+	rc_avpair_free (send);
+	return status;
+}
+
+/* in a child that then goes away, spool what fn does with every send failing */
+static int in_child (void (*fn)(void))
+{
+	pid_t	pid;
+	int	status;
+
+	if ((pid = fork ()) == 0)
+	{
+		reset ();
+		send_result = ERROR_RC;
+		fn ();
+		exit (timeout_fn == NULL);	/* nobody will try again */
+	}
+	return waitpid (pid, &status, 0) == pid && WIFEXITED (status)
+		&& WEXITSTATUS (status) == 0;
+}
+
+static int files_in (char *dir)
+{
+	struct dirent	**names;
+	int		i, n, count = 0;
+
+	n = scandir (dir, &names, NULL, alphasort);
+	for (i = 0; i < n; ++i)
+	{
+		count += names[i]->d_name[0] != '.';
+		free (names[i]);
+	}
+	if (n >= 0)
+		free (names);
+	return count;
+}
+
+static void three_records (void)
+{
+	spool_record ("A", 1);
+	spool_record ("B", 1);
+	spool_record ("A", 2);
+}
+
+/* what a pppd left is sent by the next, in order within a session */
+static int test_replay (void)
+{
+	int	i;
+
+	if (!in_child (three_records) || files_in (spool_dir) != 1)
+		return 0;
+	reset ();
+	if (rc_spool_init (&servers) < 0 || rc_spool_depth () != 3
+	    || nsent != 2 || strcmp (sent[0]->session, "A") != 0
+	    || status_of (sent[0]) != 1 || strcmp (sent[1]->session, "B") != 0)
+		return 0;
+	rc_spool_reply (OK_RC, NULL, NULL, NULL, sent[0]);
+	if (nsent != 3 || strcmp (sent[2]->session, "A") != 0
+	    || status_of (sent[2]) != 2 || files_in (spool_dir) != 2)
+		return 0;
+	for (i = 1; i < 3; ++i)
+		rc_spool_reply (OK_RC, NULL, NULL, NULL, sent[i]);
+	return rc_spool_depth () == 0 && files_in (spool_dir) == 0;
+}
+
+static void cut_short (void)
+{
+	spool_record ("C", 1);
+	spool_record ("C", 2);
+	if (ftruncate (spool.current->fd, spool.current->size - 3) < 0)
+		exit (1);
+}
+
+/* a record cut short by a crash, and what follows, is dropped */
+static int test_partial (void)
+{
+	RC_SPOOLED	*rec;
+
+	if (!in_child (cut_short))
+		return 0;
+	reset ();
+	if (rc_spool_init (&servers) < 0 || rc_spool_depth () != 1
+	    || nsent != 1 || status_of (sent[0]) != 1)
+		return 0;
+	rec = sent[0];
+	rc_spool_reply (OK_RC, NULL, NULL, NULL, rec);
+	return rc_spool_depth () == 0 && files_in (spool_dir) == 0;
+}
+
+/* a record that can't be spooled goes the old way, without our pairs */
+static int test_fallback (void)
+{
+	char	moved[PATH_MAX];
+	int	ok;
+
+	reset ();
+	if (spool_record ("D", 1) != OK_RC || rc_spool_depth () != 1)
+		return 0;
+	rc_spool_reply (OK_RC, NULL, NULL, NULL, sent[0]);
+	spool.current->size = RC_SPOOL_SEGMENT_MAX;
+	slprintf (moved, sizeof (moved), "%s.moved", spool_dir);
+	if (rename (spool_dir, moved) < 0)
+		return 0;
+	ok = spool_record ("D", 2) == OK_RC && rc_spool_depth () == 0
+		&& fallback_port == 0 && fallback_nasid == 0;
+	rename (moved, spool_dir);
+	return ok;
+}
+
+/* a record that keeps getting a bad reply is put aside */
+static int test_badresp (void)
+{
+	char		path[PATH_MAX];
+	struct stat	st;
+	int		i, len;
+
+	reset ();
+	spool_record ("E", 1);
+	spool_record ("E", 2);
+	if (nsent != 1)
+		return 0;
+	len = sent[0]->len;
+	for (i = 0; i < RC_SPOOL_BADRESP_MAX; ++i)
+	{
+		if (nsent != i + 1 || status_of (sent[i]) != 1)
+			return 0;
+		rc_spool_reply (BADRESP_RC, NULL, NULL, NULL, sent[i]);
+		if (i < RC_SPOOL_BADRESP_MAX - 1)
+		{
+			if (timeout_fn == NULL)
+				return 0;
+			timeout_fn (NULL);
+		}
+	}
+	/* the next record for the session goes on */
+	slprintf (path, sizeof (path), "%s/rejected", spool_dir);
+	return rc_spool_depth () == 1 && nsent == RC_SPOOL_BADRESP_MAX + 1
+		&& status_of (sent[nsent - 1]) == 2 && stat (path, &st) == 0
+		&& st.st_size == sizeof (struct rc_spool_hdr) + len;
+}
+
+int main (int argc, char *argv[])
+{
+	char	path[PATH_MAX];
+	int	fd, failure = 0;
+
+	if ((fd = mkstemp (test_dict)) < 0
+	    || write (fd, dict_text, sizeof (dict_text) - 1) < 0
+	    || mkdtemp (test_dir) == NULL)
+	{
+		perror ("utest_spool");
+		return 1;
+	}
+	close (fd);
+	fd = rc_read_dictionary (test_dict);
+	unlink (test_dict);
+	if (fd != 0)
+		return 1;
+	slprintf (spool_dir, sizeof (spool_dir), "%s/spool", test_dir);
+
+	if (!test_replay ())
+	{
+		printf ("Spooled records were not replayed in order\n");
+		failure++;
+	}
+	if (!test_partial ())
+	{
+		printf ("A record cut short was not dropped\n");
+		failure++;
+	}
+	if (!test_fallback ())
+	{
+		printf ("A record sent without spooling had our pairs twice\n");
+		failure++;
+	}
+	if (!test_badresp ())
+	{
+		printf ("A record with bad replies was not put aside\n");
+		failure++;
+	}
+
+	reset ();
+	slprintf (path, sizeof (path), "rm -rf %s", test_dir);
+	if (system (path) != 0)
+		failure++;
+	return failure;
+}
+#endif /* UNIT_TEST */
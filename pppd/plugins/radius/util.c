@@ -16,6 +16,8 @@
 
 #include <includes.h>
 #include <radiusclient.h>
+#include <sys/mman.h>
+#include <sys/file.h>
 
 /*
  * Function: rc_str2tm
@@ -82,3 +84,83 @@ rc_mksid (void)
   cnt++;
   return buf;
 }
+
+/*
+ * Function: rc_map_table
+ *
+ * Purpose: map a table shared by every pppd on the host, making the
+ *	    file if need be.  The table starts with a UINT4 magic number;
+ *	    one without it is cleared and handed to init, if given, while
+ *	    we hold a lock on the file, and the magic is written last.  A
+ *	    file of the wrong size is from some other version, and is
+ *	    cleared too.  With no path, or if the file can't be used, the
+ *	    table is private to this pppd.
+ *
+ * Returns: the table, or NULL if out of memory.  If fdp isn't NULL it
+ *	    gets the open file, for the caller to lock, or -1.
+ *
+ */
+
+void *rc_map_table (const char *path, size_t size, UINT4 magic,
+		    void (*init)(void *), int *fdp)
+{
+	int		fd = -1;
+	void		*p = MAP_FAILED;
+	struct stat	st;
+
+	if (path != NULL && *path != 0)
+	{
+		fd = open (path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+		if (fd < 0)
+			warn("rc_map_table: couldn't open %s: %m", path);
+	}
+	if (fd >= 0)
+	{
+		/* so that nobody sizes it or fills it in under us */
+		while (flock (fd, LOCK_EX) < 0 && errno == EINTR)
+			;
+		if (fstat (fd, &st) < 0
+		    || (st.st_size != (off_t) size
+			&& (ftruncate (fd, 0) < 0
+			    || ftruncate (fd, size) < 0)))
+			warn("rc_map_table: couldn't size %s: %m", path);
+		else
+			p = mmap (NULL, size, PROT_READ | PROT_WRITE,
+				  MAP_SHARED, fd, 0);
+		if (p == MAP_FAILED)
+		{
+			close (fd);
+			fd = -1;
+		}
+	}
+	if (p == MAP_FAILED)
+	{
+		p = calloc (1, size);
+		if (p == NULL)
+		{
+			novm("rc_map_table");
+			if (fdp != NULL)
+				*fdp = -1;
+			return NULL;
+		}
+	}
+
+	/* a new file is all zeroes, which is no table yet */
+	if (__atomic_load_n ((UINT4 *) p, __ATOMIC_ACQUIRE) != magic)
+	{
+		memset (p, 0, size);
+		if (init != NULL)
+			(*init) (p);
+		__atomic_store_n ((UINT4 *) p, magic, __ATOMIC_RELEASE);
+	}
+
+	if (fd >= 0)
+	{
+		flock (fd, LOCK_UN);
+		if (fdp == NULL)
+			close (fd);
+	}
+	if (fdp != NULL)
+		*fdp = fd;
+	return p;
+}
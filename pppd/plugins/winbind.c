@@ -40,6 +40,11 @@
 #include <fcntl.h>
 #include <sys/time.h>
 #include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/file.h>
+#include <sys/select.h>
+#include <signal.h>
 #include <string.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -65,7 +70,12 @@
 #define NOT_AUTHENTICATED 0
 #define AUTHENTICATED 1
 
+#define NTLM_HELPERS_MAX	16
+
 static char *ntlm_auth = NULL;
+static int ntlm_helpers = 2;	/* how many helpers to keep */
+static char *ntlm_socket;	/* to share them with other pppds */
+static int ntlm_timeout = 10;	/* seconds a helper may take to answer */
 
 static int set_ntlm_auth(char **argv)
 {
@@ -90,12 +100,24 @@ static int set_ntlm_auth(char **argv)
 static struct option Options[] = {
 	{ "ntlm_auth-helper", o_special, (void *) &set_ntlm_auth,
 	  "Path to ntlm_auth executable", OPT_PRIV },
+	{ "ntlm_auth-helpers", o_int, &ntlm_helpers,
+	  "Number of ntlm_auth helpers to keep running",
+	  OPT_PRIV | OPT_LIMITS, NULL, NTLM_HELPERS_MAX, 1 },
+	{ "ntlm_auth-socket", o_string, &ntlm_socket,
+	  "Socket for sharing ntlm_auth helpers between pppds", OPT_PRIV },
+	{ "ntlm_auth-timeout", o_int, &ntlm_timeout,
+	  "Seconds to wait for ntlm_auth to answer",
+	  OPT_PRIV | OPT_LIMITS, NULL, 600, 1 },
 	{ NULL }
 };
 
 static pap_check_hook_fn winbind_secret_check;
 static pap_auth_hook_fn winbind_pap_auth;
+static pap_auth_async_hook_fn winbind_pap_auth_async;
 static chap_verify_hook_fn winbind_chap_verify;
+static chap_verify_async_hook_fn winbind_chap_verify_async;
+static void winbind_link_down(void *opaque, int arg);
+static void ntlm_exit(void *opaque, int arg);
 static int winbind_allowed_address(uint32_t addr);
 
 char pppd_version[] = PPPD_VERSION;
@@ -114,9 +136,11 @@ plugin_init(void)
 {
     pap_check_hook = winbind_secret_check;
     pap_auth_hook = winbind_pap_auth;
+    pap_auth_async_hook = winbind_pap_auth_async;
 
     chap_check_hook = winbind_secret_check;
     chap_verify_hook = winbind_chap_verify;
+    chap_verify_async_hook = winbind_chap_verify_async;
 
     allowed_address_hook = winbind_allowed_address;
 
@@ -124,6 +148,8 @@ plugin_init(void)
     chap_mdtype_all &= (MDTYPE_MICROSOFT_V2 | MDTYPE_MICROSOFT);
     
     ppp_add_options(Options);
+    ppp_add_notify(NF_LINK_DOWN, winbind_link_down, NULL);
+    ppp_add_notify(NF_EXIT, ntlm_exit, NULL);
 
     info("WINBIND plugin initialized.");
 }
@@ -234,70 +260,461 @@ char * base64_encode(const char *data)
 	return result;
 }
 
-unsigned int run_ntlm_auth(const char *username, 
-			   const char *domain, 
-			   const char *full_username,
-			   const char *plaintext_password,
-			   const u_char *challenge,
-			   size_t challenge_length,
-			   const u_char *lm_response, 
-			   size_t lm_response_length,
-			   const u_char *nt_response, 
-			   size_t nt_response_length,
-			   u_char nt_key[16], 
-			   char **error_string) 
-{
-	
-	pid_t forkret;
-        int child_in[2];
-        int child_out[2];
-	int status;
+/*
+ * Rather than starting ntlm_auth for every verification, we keep up to
+ * ntlm_auth-helpers copies of it running, started the first time they
+ * are needed and restarted if they die, and hand each request to one
+ * that is free, over its stdin, reading the answer from its stdout.
+ * Requests wait in a queue while they are all busy.  The helper given
+ * with ntlm_auth-helper must speak --helper-protocol=ntlm-server-1,
+ * which takes any number of requests, each ended by a "." line, and
+ * answers each the same way.  A helper that takes longer than
+ * ntlm_auth-timeout seconds over a request is killed, to be restarted
+ * for the next one, and the request fails.
+ *
+ * Each pppd has one session, so with ntlm_auth-socket the helpers are
+ * shared: whichever pppd gets the lock beside the socket listens on it
+ * and runs the helpers for every pppd, which send it their requests
+ * over the socket.  If it exits, the next pppd to want a helper takes
+ * over.  Without it, the helpers are stopped once they have nothing
+ * to do, as pppd seldom has more to ask after the peer is in.
+ */
+
+#define NTLM_TEXT_MAX		4096	/* a request or its answer */
+#define NTLM_TRIES		2	/* helpers a request may outlive */
+#define NTLM_ANSWER_WAIT	1	/* seconds to give another pppd our answer */
+
+typedef void (ntlm_done_fn)(void *arg, char *reply);
+
+struct ntlm_request {
+	struct ntlm_request *next;	/* in the queue */
+	ntlm_done_fn	*done;		/* called with the answer, or NULL */
+	void		*arg;
+	int		waited;		/* found every helper busy */
+	int		remote;		/* answered by another pppd */
+	int		tries;
+	int		fd;		/* to or from another pppd, or -1 */
+	struct timeval	queued, started;
+	time_t		deadline;	/* for the answer, once started */
+	int		len;
+	char		text[NTLM_TEXT_MAX];
+	int		got;		/* of the answer, in reply */
+	char		reply[NTLM_TEXT_MAX];
+};
 
-	int authenticated = NOT_AUTHENTICATED; /* not auth */
-	int got_user_session_key = 0; /* not got key */
+struct ntlm_helper {
+	pid_t		pid;		/* 0 if not running */
+	int		in, out;	/* its stdin and stdout */
+	struct timeval	born;
+	time_t		not_before;	/* don't restart it before this */
+	struct ntlm_request *req;	/* what it is working on */
+};
 
-	char buffer[1024];
+static struct ntlm_helper ntlm_pool[NTLM_HELPERS_MAX];
+static struct ntlm_request *ntlm_queue, **ntlm_queue_tail = &ntlm_queue;
+static int ntlm_lock = -1;	/* held while we serve other pppds */
+static int ntlm_listen = -1;
+static int ntlm_ticking;	/* ntlm_tick is due */
+
+/* How long verifications take */
+static struct ntlm_stats {
+	unsigned	count;		/* answered */
+	unsigned	failed;		/* got no answer */
+	unsigned	queued;		/* waited for a helper */
+	unsigned	restarts;	/* helpers that died */
+	double		total, max;	/* in milliseconds */
+} ntlm_stats;
+
+/* The fds we watch, so that run_ntlm_auth can wait on them too */
+static struct ntlm_watch {
+	int		fd;
+	ppp_fd_handler_fn *func;
+	void		*arg;
+} *ntlm_watches;
+static int ntlm_nwatches, ntlm_maxwatches;
+
+/* Helpers we have stopped but not yet reaped */
+static pid_t *ntlm_stopped;
+static int ntlm_nstopped, ntlm_maxstopped;
+
+static void ntlm_dispatch(void);
+static void ntlm_retry(void *arg);
+static void ntlm_submit(struct ntlm_request *req);
+static void ntlm_peer_input(int fd, void *arg);
+static void ntlm_tick_start(void);
 
-	FILE *pipe_in;
-	FILE *pipe_out;
-	
+static int
+ntlm_watch(int fd, ppp_fd_handler_fn *func, void *arg)
+{
+	struct ntlm_watch *w;
+
+	if (ntlm_nwatches == ntlm_maxwatches) {
+		w = realloc(ntlm_watches, (ntlm_maxwatches + 8) * sizeof(*w));
+		if (w == NULL)
+			return -1;
+		ntlm_watches = w;
+		ntlm_maxwatches += 8;
+	}
+	if (ppp_add_fd_handler(fd, func, arg) < 0)
+		return -1;
+	w = &ntlm_watches[ntlm_nwatches++];
+	w->fd = fd;
+	w->func = func;
+	w->arg = arg;
+	return 0;
+}
+
+static void
+ntlm_unwatch(int fd)
+{
 	int i;
-	char *challenge_hex;
-	char *lm_hex_hash;
-	char *nt_hex_hash;
 
-	/* First see if we have a program to run... */
-	if (ntlm_auth == NULL)
-		return NOT_AUTHENTICATED;
+	for (i = 0; i < ntlm_nwatches; ++i) {
+		if (ntlm_watches[i].fd == fd) {
+			ntlm_watches[i] = ntlm_watches[--ntlm_nwatches];
+			ppp_remove_fd_handler(fd);
+			return;
+		}
+	}
+}
 
-        /* Make first child */
-        if (pipe(child_out) == -1) {
-                error("pipe creation failed for child OUT!");
-		return NOT_AUTHENTICATED;
-        }
+static double
+ntlm_ms(struct timeval *from, struct timeval *to)
+{
+	return (to->tv_sec - from->tv_sec) * 1000.0
+		+ (to->tv_usec - from->tv_usec) / 1000.0;
+}
 
-        if (pipe(child_in) == -1) {
-                error("pipe creation failed for child IN!");
-		return NOT_AUTHENTICATED;
-        }
+/* Has the whole of a request or answer arrived? */
+static int
+ntlm_complete(const char *text, int len)
+{
+	return (len == 2 && memcmp(text, ".\n", 2) == 0)
+		|| (len > 2 && memcmp(text + len - 3, "\n.\n", 3) == 0);
+}
+
+static int
+ntlm_write_all(int fd, const char *buf, int len)
+{
+	int n;
+
+	while (len > 0) {
+		n = write(fd, buf, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/*
+ * ntlm_finish - a request has its answer, or never will: note how
+ * long it took and pass the answer on.
+ */
+static void
+ntlm_finish(struct ntlm_request *req, int ok)
+{
+	struct timeval now;
+	double ms;
+
+	ppp_get_time(&now);
+	ms = ntlm_ms(&req->queued, &now);
+	if (ok) {
+		req->reply[req->got] = 0;
+		++ntlm_stats.count;
+		ntlm_stats.total += ms;
+		if (ms > ntlm_stats.max)
+			ntlm_stats.max = ms;
+		if (req->remote)
+			dbglog("WINBIND: ntlm_auth answered in %.1f ms, through %s",
+			       ms, ntlm_socket);
+		else
+			dbglog("WINBIND: ntlm_auth answered in %.1f ms, %.1f ms of it queued",
+			       ms, ntlm_ms(&req->queued, &req->started));
+	} else {
+		++ntlm_stats.failed;
+		error("WINBIND: no answer from ntlm_auth after %.1f ms", ms);
+	}
+	if (req->done)
+		(*req->done)(req->arg, ok? req->reply: NULL);
+	free(req);
+}
+
+/*
+ * ntlm_helper_died - a helper has gone away, or stopped making sense:
+ * get rid of it, and give what it was doing to another.
+ */
+static void
+ntlm_helper_died(struct ntlm_helper *h)
+{
+	struct ntlm_request *req = h->req;
+	struct timeval now;
+
+	warn("WINBIND: ntlm_auth helper (pid %d) died", h->pid);
+	++ntlm_stats.restarts;
+	ntlm_unwatch(h->out);
+	close(h->in);
+	close(h->out);
+	/* pppd's reap_kids may have got it first, and then the pid isn't ours */
+	if (waitpid(h->pid, NULL, WNOHANG) == 0) {
+		kill(h->pid, SIGKILL);
+		while (waitpid(h->pid, NULL, 0) < 0 && errno == EINTR)
+			;
+	}
+	h->pid = 0;
+	h->req = NULL;
+
+	/* one that can't even start waits a second before the next go */
+	ppp_get_time(&now);
+	h->not_before = now.tv_sec - h->born.tv_sec < 1? now.tv_sec + 1: 0;
+
+	if (req != NULL) {
+		if (++req->tries < NTLM_TRIES) {
+			req->next = ntlm_queue;
+			if (ntlm_queue == NULL)
+				ntlm_queue_tail = &req->next;
+			ntlm_queue = req;
+		} else
+			ntlm_finish(req, 0);
+	}
+	if (ntlm_queue != NULL)
+		ppp_timeout(ntlm_retry, NULL, h->not_before? 1: 0, 0);
+}
 
-        forkret = ppp_safe_fork(child_in[0], child_out[1], 2);
-        if (forkret == -1) {
-		if (error_string) {
-			*error_string = strdup("fork failed!");
+/*
+ * ntlm_helper_input - read (some of) a helper's answer.
+ */
+static void
+ntlm_helper_input(int fd, void *arg)
+{
+	struct ntlm_helper *h = arg;
+	struct ntlm_request *req = h->req;
+	char junk[256];
+	int n;
+
+	if (req == NULL) {
+		/* talking out of turn */
+		n = read(fd, junk, sizeof(junk));
+		if (n < 0 && (errno == EAGAIN || errno == EINTR))
+			return;
+	} else {
+		n = read(fd, req->reply + req->got,
+			 sizeof(req->reply) - 1 - req->got);
+		if (n < 0 && (errno == EAGAIN || errno == EINTR))
+			return;
+		if (n > 0) {
+			req->got += n;
+			if (ntlm_complete(req->reply, req->got)) {
+				h->req = NULL;
+				ntlm_finish(req, 1);
+				ntlm_dispatch();
+				return;
+			}
+			if (req->got < sizeof(req->reply) - 1)
+				return;
 		}
+	}
+	ntlm_helper_died(h);
+	ntlm_dispatch();
+}
+
+static void
+ntlm_retry(void *arg)
+{
+	ntlm_dispatch();
+}
+
+/*
+ * ntlm_helper_stop - let an idle helper go; it exits when it sees its
+ * stdin close, and ntlm_reap collects it.  pppd doesn't know about our
+ * helpers, so it won't.
+ */
+static void
+ntlm_helper_stop(struct ntlm_helper *h)
+{
+	pid_t *p;
+
+	dbglog("WINBIND: stopping idle ntlm_auth helper (pid %d)", h->pid);
+	ntlm_unwatch(h->out);
+	close(h->in);
+	close(h->out);
+	if (ntlm_nstopped >= ntlm_maxstopped) {
+		p = realloc(ntlm_stopped, (ntlm_maxstopped + 4) * sizeof(*p));
+		if (p == NULL) {
+			/* can't wait for it to go, so make it go now */
+			if (waitpid(h->pid, NULL, WNOHANG) == 0) {
+				kill(h->pid, SIGKILL);
+				while (waitpid(h->pid, NULL, 0) < 0
+				       && errno == EINTR)
+					;
+			}
+			h->pid = 0;
+			return;
+		}
+		ntlm_stopped = p;
+		ntlm_maxstopped += 4;
+	}
+	ntlm_stopped[ntlm_nstopped++] = h->pid;
+	h->pid = 0;
+	ntlm_tick_start();
+}
+
+/*
+ * ntlm_reap - collect the stopped helpers that have exited.  Returns 1
+ * while any have yet to.
+ */
+static int
+ntlm_reap(void)
+{
+	pid_t pid;
+	int i;
+
+	for (i = 0; i < ntlm_nstopped; ) {
+		pid = waitpid(ntlm_stopped[i], NULL, WNOHANG);
+		if (pid == 0 || (pid < 0 && errno == EINTR)) {
+			++i;
+			continue;
+		}
+		/* exited, or already reaped by pppd's reap_kids */
+		ntlm_stopped[i] = ntlm_stopped[--ntlm_nstopped];
+	}
+	return ntlm_nstopped > 0;
+}
+
+/*
+ * ntlm_expire - fail the requests that have run out of time, killing
+ * the helpers that were working on them.  Returns 1 while any request
+ * is still being worked on.
+ */
+static int
+ntlm_expire(void)
+{
+	struct ntlm_helper *h;
+	struct ntlm_request *req;
+	struct timeval now;
+	int i, busy = 0;
+
+	ppp_get_time(&now);
+	for (i = 0; i < ntlm_helpers; ++i) {
+		h = &ntlm_pool[i];
+		if ((req = h->req) == NULL)
+			continue;
+		if (now.tv_sec < req->deadline) {
+			busy = 1;
+			continue;
+		}
+		warn("WINBIND: ntlm_auth helper (pid %d) took more than %d s",
+		     h->pid, ntlm_timeout);
+		req->tries = NTLM_TRIES;	/* no second go */
+		ntlm_helper_died(h);
+	}
+
+	/* finishing one can change the list, so start again after each */
+ again:
+	for (i = 0; i < ntlm_nwatches; ++i) {
+		if (ntlm_watches[i].func != ntlm_peer_input)
+			continue;
+		req = ntlm_watches[i].arg;
+		if (now.tv_sec < req->deadline)
+			continue;
+		warn("WINBIND: no answer through %s after %d s", ntlm_socket,
+		     ntlm_timeout * NTLM_TRIES);
+		ntlm_unwatch(req->fd);
+		close(req->fd);
+		req->fd = -1;
+		ntlm_finish(req, 0);
+		goto again;
+	}
+	for (i = 0; i < ntlm_nwatches; ++i)
+		if (ntlm_watches[i].func == ntlm_peer_input)
+			busy = 1;
+	return busy || ntlm_queue != NULL;
+}
+
+/*
+ * ntlm_tick - look for requests that have run out of time, while any
+ * are being worked on, and for stopped helpers that have exited.
+ */
+static void
+ntlm_tick(void *arg)
+{
+	int busy;
+
+	ntlm_ticking = 0;
+	busy = ntlm_expire();
+	if (ntlm_reap())
+		busy = 1;
+	if (busy)
+		ntlm_tick_start();
+	ntlm_dispatch();
+}
+
+/*
+ * ntlm_tick_start - have ntlm_tick called in a second, if it isn't due.
+ */
+static void
+ntlm_tick_start(void)
+{
+	if (!ntlm_ticking) {
+		ntlm_ticking = 1;
+		ppp_timeout(ntlm_tick, NULL, 1, 0);
+	}
+}
+
+/*
+ * ntlm_started - a request has been handed to a helper or another
+ * pppd, which has until timeout seconds from now to answer.
+ */
+static void
+ntlm_started(struct ntlm_request *req, int timeout)
+{
+	struct timeval now;
+
+	ppp_get_time(&now);
+	req->deadline = now.tv_sec + timeout;
+	ntlm_tick_start();
+}
+
+/*
+ * ntlm_helper_start - start a helper, running as the user who ran pppd.
+ */
+static int
+ntlm_helper_start(struct ntlm_helper *h)
+{
+	int child_in[2], child_out[2];
+	struct timeval now;
+	pid_t pid;
+	char *cmd;
+
+	ppp_get_time(&now);
+	if (now.tv_sec < h->not_before) {
+		ppp_timeout(ntlm_retry, NULL, h->not_before - now.tv_sec, 0);
+		return -1;
+	}
 
-                return NOT_AUTHENTICATED;
-        }
+	if (pipe(child_in) == -1) {
+		error("WINBIND: pipe creation failed: %m");
+		return -1;
+	}
+	if (pipe(child_out) == -1) {
+		error("WINBIND: pipe creation failed: %m");
+		close(child_in[0]);
+		close(child_in[1]);
+		return -1;
+	}
+	/* none of the helpers needs the others' pipes */
+	fcntl(child_in[1], F_SETFD, FD_CLOEXEC);
+	fcntl(child_out[0], F_SETFD, FD_CLOEXEC);
 
-	if (forkret == 0) {
+	pid = ppp_safe_fork(child_in[0], child_out[1], 2);
+	if (pid == 0) {
 		/* child process */
 		uid_t uid;
 		gid_t gid;
 
-		close(child_out[0]);
-		close(child_in[1]);
-
 		/* run winbind as the user that invoked pppd */
 		gid = getgid();
 		if (setgid(gid) == -1 || getgid() != gid) {
@@ -307,102 +724,443 @@ unsigned int run_ntlm_auth(const char *username,
 		if (setuid(uid) == -1 || getuid() != uid) {
 			fatal("pppd/winbind: could not setuid to %d: %m", uid);
 		}
-		execl("/bin/sh", "sh", "-c", ntlm_auth, NULL);  
+		/* no shell hanging about for as long as the helper runs */
+		cmd = malloc(strlen(ntlm_auth) + 6);
+		if (cmd != NULL) {
+			strcpy(cmd, "exec ");
+			strcat(cmd, ntlm_auth);
+		}
+		execl("/bin/sh", "sh", "-c", cmd? cmd: ntlm_auth, NULL);
 		fatal("pppd/winbind: could not exec /bin/sh: %m");
 	}
-
-        /* parent */
-	close(child_out[1]);
 	close(child_in[0]);
+	close(child_out[1]);
+	if (pid == -1) {
+		close(child_in[1]);
+		close(child_out[0]);
+		return -1;
+	}
+
+	fcntl(child_out[0], F_SETFL, fcntl(child_out[0], F_GETFL) | O_NONBLOCK);
+	h->pid = pid;
+	h->in = child_in[1];
+	h->out = child_out[0];
+	h->born = now;
+	h->req = NULL;
+	if (ntlm_watch(h->out, ntlm_helper_input, h) < 0) {
+		error("WINBIND: out of memory");
+		ntlm_helper_died(h);
+		return -1;
+	}
+	dbglog("WINBIND: started ntlm_auth helper (pid %d)", pid);
+	return 0;
+}
+
+/*
+ * ntlm_dispatch - give queued requests to whichever helpers are free,
+ * starting them as needed.
+ */
+static void
+ntlm_dispatch(void)
+{
+	struct ntlm_helper *h;
+	struct ntlm_request *req;
+	int i;
+
+	for (i = 0; i < ntlm_helpers && ntlm_queue != NULL; ++i) {
+		h = &ntlm_pool[i];
+		if (h->req != NULL)
+			continue;
+		if (h->pid == 0 && ntlm_helper_start(h) < 0)
+			continue;
 
-	/* Need to write the User's info onto the pipe */
+		req = ntlm_queue;
+		ntlm_queue = req->next;
+		if (ntlm_queue == NULL)
+			ntlm_queue_tail = &ntlm_queue;
+		h->req = req;
+		req->got = 0;
+		ppp_get_time(&req->started);
+		ntlm_started(req, ntlm_timeout);
+		if (ntlm_write_all(h->in, req->text, req->len) < 0)
+			ntlm_helper_died(h);
+	}
+	for (req = ntlm_queue; req != NULL; req = req->next) {
+		if (!req->waited) {
+			req->waited = 1;
+			++ntlm_stats.queued;
+		}
+	}
+
+	/* with nobody else to serve, don't keep them for the whole session */
+	if (ntlm_socket == NULL && ntlm_queue == NULL) {
+		for (i = 0; i < ntlm_helpers; ++i) {
+			h = &ntlm_pool[i];
+			if (h->pid != 0 && h->req == NULL)
+				ntlm_helper_stop(h);
+		}
+	}
+	ntlm_reap();
+}
+
+/*
+ * ntlm_peer_input - read (some of) the answer to a request we sent to
+ * the pppd running the helpers.
+ */
+static void
+ntlm_peer_input(int fd, void *arg)
+{
+	struct ntlm_request *req = arg;
+	int n;
+
+	n = read(fd, req->reply + req->got, sizeof(req->reply) - 1 - req->got);
+	if (n < 0 && (errno == EAGAIN || errno == EINTR))
+		return;
+	if (n > 0) {
+		req->got += n;
+		if (!ntlm_complete(req->reply, req->got)) {
+			if (req->got < sizeof(req->reply) - 1)
+				return;
+			n = 0;
+		}
+	}
+	ntlm_unwatch(fd);
+	close(fd);
+	req->fd = -1;
+	if (n > 0) {
+		ntlm_finish(req, 1);
+	} else if (++req->tries < NTLM_TRIES) {
+		/* it went away; perhaps we are to run them now */
+		req->got = 0;
+		ntlm_submit(req);
+	} else
+		ntlm_finish(req, 0);
+}
+
+/*
+ * ntlm_answer_peer - send another pppd the answer to its request.  It
+ * fits in the socket buffer unless the other pppd is stuck, so we
+ * don't wait long for it to go.
+ */
+static void
+ntlm_answer_peer(void *arg, char *reply)
+{
+	int fd = (intptr_t) arg;
+	struct timeval tv = { NTLM_ANSWER_WAIT, 0 };
+
+	if (reply != NULL) {
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+		if (setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) < 0
+		    || ntlm_write_all(fd, reply, strlen(reply)) < 0)
+			warn("WINBIND: couldn't answer a pppd on %s", ntlm_socket);
+	}
+	close(fd);
+}
+
+/*
+ * ntlm_peer_request - read (some of) a request from another pppd.
+ */
+static void
+ntlm_peer_request(int fd, void *arg)
+{
+	struct ntlm_request *req = arg;
+	int n;
+
+	n = read(fd, req->text + req->len, sizeof(req->text) - req->len);
+	if (n < 0 && (errno == EAGAIN || errno == EINTR))
+		return;
+	if (n > 0) {
+		req->len += n;
+		if (!ntlm_complete(req->text, req->len)) {
+			if (req->len < sizeof(req->text))
+				return;
+			n = 0;
+		}
+	}
+	ntlm_unwatch(fd);
+	if (n <= 0) {
+		close(fd);
+		free(req);
+		return;
+	}
+	/* the answer goes back the same way */
+	req->done = ntlm_answer_peer;
+	req->arg = (void *) (intptr_t) fd;
+	req->fd = -1;
+	ppp_get_time(&req->queued);
+	req->started = req->queued;
+	*ntlm_queue_tail = req;
+	ntlm_queue_tail = &req->next;
+	ntlm_dispatch();
+}
+
+/*
+ * ntlm_accept - another pppd has a request for our helpers.
+ */
+static void
+ntlm_accept(int fd, void *arg)
+{
+	struct ntlm_request *req;
+	int s;
+
+	while ((s = accept(fd, NULL, NULL)) >= 0) {
+		fcntl(s, F_SETFD, FD_CLOEXEC);
+		fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK);
+		req = calloc(1, sizeof(*req));
+		if (req == NULL || ntlm_watch(s, ntlm_peer_request, req) < 0) {
+			free(req);
+			close(s);
+		}
+	}
+}
 
-	pipe_in = fdopen(child_in[1], "w");
+/*
+ * ntlm_serve - work out whether we run the helpers, or another pppd
+ * does.  Returns 1 if it's us.
+ */
+static int
+ntlm_serve(void)
+{
+	struct sockaddr_un addr;
+	char lock[sizeof(addr.sun_path) + 5];
+	int fd;
 
-	pipe_out = fdopen(child_out[0], "r");
+	if (ntlm_socket == NULL || ntlm_listen >= 0)
+		return 1;
 
-	/* look for session key coming back */
+	/* whoever holds the lock has the socket */
+	slprintf(lock, sizeof(lock), "%s.lock", ntlm_socket);
+	if (ntlm_lock < 0) {
+		ntlm_lock = open(lock, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+		if (ntlm_lock < 0) {
+			error("WINBIND: can't open %s: %m", lock);
+			return 1;
+		}
+	}
+	if (flock(ntlm_lock, LOCK_EX | LOCK_NB) < 0)
+		return 0;
 
-	if (username) {
-		char *b64_username = base64_encode(username);
-		fprintf(pipe_in, "Username:: %s\n", b64_username);
-		free(b64_username);
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strlcpy(addr.sun_path, ntlm_socket, sizeof(addr.sun_path));
+	unlink(ntlm_socket);
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0
+	    || listen(fd, 64) < 0) {
+		error("WINBIND: can't listen on %s: %m", ntlm_socket);
+		if (fd >= 0)
+			close(fd);
+		return 1;
+	}
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	if (ntlm_watch(fd, ntlm_accept, NULL) < 0) {
+		close(fd);
+		return 1;
 	}
+	ntlm_listen = fd;
+	dbglog("WINBIND: running ntlm_auth helpers for other pppds on %s",
+	       ntlm_socket);
+	return 1;
+}
 
-	if (domain) {
-		char *b64_domain = base64_encode(domain);
-		fprintf(pipe_in, "NT-Domain:: %s\n", b64_domain);
-		free(b64_domain);
+/*
+ * ntlm_send_peer - send a request to the pppd running the helpers.
+ */
+static int
+ntlm_send_peer(struct ntlm_request *req)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strlcpy(addr.sun_path, ntlm_socket, sizeof(addr.sun_path));
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0
+	    || ntlm_write_all(fd, req->text, req->len) < 0) {
+		close(fd);
+		return -1;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	if (ntlm_watch(fd, ntlm_peer_input, req) < 0) {
+		close(fd);
+		return -1;
 	}
+	req->fd = fd;
+	req->remote = 1;
+	/* it gives each of its helpers ntlm_timeout */
+	ntlm_started(req, ntlm_timeout * NTLM_TRIES);
+	return 0;
+}
+
+/*
+ * ntlm_submit - get a request answered, by our helpers or by the pppd
+ * running them.  The answer can come before this returns.
+ */
+static void
+ntlm_submit(struct ntlm_request *req)
+{
+	if (!ntlm_serve() && ntlm_send_peer(req) == 0)
+		return;
+	req->next = NULL;
+	*ntlm_queue_tail = req;
+	ntlm_queue_tail = &req->next;
+	ntlm_dispatch();
+}
 
-	if (full_username) {
-		char *b64_full_username = base64_encode(full_username);
-		fprintf(pipe_in, "Full-Username:: %s\n", b64_full_username);
-		free(b64_full_username);
+/*
+ * ntlm_wait - wait for something to happen to the helpers or the
+ * other pppds, for run_ntlm_auth.
+ */
+static void
+ntlm_wait(void)
+{
+	struct timeval tv = { 1, 0 };
+	fd_set fds;
+	int i, maxfd = -1;
+
+	FD_ZERO(&fds);
+	for (i = 0; i < ntlm_nwatches; ++i) {
+		FD_SET(ntlm_watches[i].fd, &fds);
+		if (ntlm_watches[i].fd > maxfd)
+			maxfd = ntlm_watches[i].fd;
 	}
+	if (select(maxfd + 1, &fds, NULL, NULL, &tv) <= 0)
+		maxfd = -1;		/* nothing to read */
+	/* a handler can change the list, so look for each fd again */
+	for (i = maxfd; i >= 0; --i) {
+		int j;
 
-	if (plaintext_password) {
-		char *b64_plaintext_password = base64_encode(plaintext_password);
-		fprintf(pipe_in, "Password:: %s\n", b64_plaintext_password);
-		free(b64_plaintext_password);
+		if (!FD_ISSET(i, &fds))
+			continue;
+		for (j = 0; j < ntlm_nwatches; ++j) {
+			if (ntlm_watches[j].fd == i) {
+				(*ntlm_watches[j].func)(i, ntlm_watches[j].arg);
+				break;
+			}
+		}
 	}
+	/*
+	 * pppd's timers don't run while we wait here, so fail what has
+	 * run out of time, and restart the helpers that are due.
+	 */
+	ntlm_expire();
+	ntlm_dispatch();
+}
 
+static void
+ntlm_add(struct ntlm_request *req, const char *name, const char *value)
+{
+	char *b64;
+
+	if (value == NULL)
+		return;
+	b64 = base64_encode(value);
+	req->len += slprintf(req->text + req->len, sizeof(req->text) - req->len,
+			     "%s:: %s\n", name, b64);
+	free(b64);
+}
+
+static void
+ntlm_add_hex(struct ntlm_request *req, const char *name,
+	     const u_char *value, size_t len)
+{
+	size_t i;
+
+	if (len == 0 || req->len + strlen(name) + 2 * len + 3 >= sizeof(req->text))
+		return;
+	req->len += slprintf(req->text + req->len, sizeof(req->text) - req->len,
+			     "%s: ", name);
+	for (i = 0; i < len; i++)
+		req->len += slprintf(req->text + req->len, 3, "%02X", value[i]);
+	req->text[req->len++] = '\n';
+}
+
+/*
+ * ntlm_new - make up a request for ntlm_auth.
+ */
+static struct ntlm_request *
+ntlm_new(const char *username,
+	 const char *domain,
+	 const char *full_username,
+	 const char *plaintext_password,
+	 const u_char *challenge,
+	 size_t challenge_length,
+	 const u_char *lm_response,
+	 size_t lm_response_length,
+	 const u_char *nt_response,
+	 size_t nt_response_length)
+{
+	struct ntlm_request *req = calloc(1, sizeof(*req));
+
+	if (req == NULL) {
+		novm("ntlm_auth request");
+		return NULL;
+	}
+	req->fd = -1;
+	ntlm_add(req, "Username", username);
+	ntlm_add(req, "NT-Domain", domain);
+	ntlm_add(req, "Full-Username", full_username);
+	ntlm_add(req, "Password", plaintext_password);
 	if (challenge_length) {
-		fprintf(pipe_in, "Request-User-Session-Key: yes\n");
-
-		challenge_hex = malloc(challenge_length*2+1);
-		
-		for (i = 0; i < challenge_length; i++)
-			sprintf(challenge_hex + i * 2, "%02X", challenge[i]);
-		
-		fprintf(pipe_in, "LANMAN-Challenge: %s\n", challenge_hex);
-		free(challenge_hex);
-	}
-	
-	if (lm_response_length) {
-		lm_hex_hash = malloc(lm_response_length*2+1);
-		
-		for (i = 0; i < lm_response_length; i++)
-			sprintf(lm_hex_hash + i * 2, "%02X", lm_response[i]);
-		
-		fprintf(pipe_in, "LANMAN-response: %s\n", lm_hex_hash);
-		free(lm_hex_hash);
-	}
-	
-	if (nt_response_length) {
-		nt_hex_hash = malloc(nt_response_length*2+1);
-		
-		for (i = 0; i < nt_response_length; i++)
-			sprintf(nt_hex_hash + i * 2, "%02X", nt_response[i]);
-		
-		fprintf(pipe_in, "NT-response: %s\n", nt_hex_hash);
-		free(nt_hex_hash);
-	}
-	
-	fprintf(pipe_in, ".\n");
-	fflush(pipe_in);
-	
-	while (fgets(buffer, sizeof(buffer)-1, pipe_out) != NULL) {
+		req->len += slprintf(req->text + req->len,
+				     sizeof(req->text) - req->len,
+				     "Request-User-Session-Key: yes\n");
+		ntlm_add_hex(req, "LANMAN-Challenge", challenge,
+			     challenge_length);
+	}
+	ntlm_add_hex(req, "LANMAN-response", lm_response, lm_response_length);
+	ntlm_add_hex(req, "NT-response", nt_response, nt_response_length);
+	req->len += slprintf(req->text + req->len, sizeof(req->text) - req->len,
+			     ".\n");
+	ppp_get_time(&req->queued);
+	req->started = req->queued;
+	return req;
+}
+
+/*
+ * ntlm_result - make sense of what ntlm_auth said.
+ */
+static unsigned int
+ntlm_result(char *reply, u_char nt_key[16], char **error_string)
+{
+	int authenticated = NOT_AUTHENTICATED; /* not auth */
+	int got_user_session_key = 0; /* not got key */
+	char *buffer, *next;
+
+	if (reply == NULL) {
+		if (error_string)
+			*error_string = strdup("no answer from ntlm_auth");
+		return NOT_AUTHENTICATED;
+	}
+
+	for (buffer = reply; *buffer != 0; buffer = next) {
 		char *message, *parameter;
-		if (buffer[strlen(buffer)-1] != '\n') {
+		if ((next = strchr(buffer, '\n')) == NULL) {
 			break;
 		}
-		buffer[strlen(buffer)-1] = '\0';
+		*next++ = '\0';
 		message = buffer;
 
+		if (strcmp(message, ".") == 0) {
+			/* end of sequence */
+			break;
+		}
+
 		if (!(parameter = strstr(buffer, ": "))) {
 			break;
 		}
-		
+
 		parameter[0] = '\0';
 		parameter++;
 		parameter[0] = '\0';
 		parameter++;
-		
-		if (strcmp(message, ".") == 0) {
-			/* end of sequence */
-			break;
-		} else if (strcasecmp(message, "Authenticated") == 0) {
+
+		if (strcasecmp(message, "Authenticated") == 0) {
 			if (strcasecmp(parameter, "Yes") == 0) {
 				authenticated = AUTHENTICATED;
 			} else {
@@ -411,7 +1169,7 @@ unsigned int run_ntlm_auth(const char *username,
 			}
 		} else if (strcasecmp(message, "User-session-key") == 0) {
 			/* length is the number of characters to parse */
-			if (nt_key) { 
+			if (nt_key) {
 				if (strhex_to_str(nt_key, 32, parameter) == 16) {
 					got_user_session_key = 1;
 				} else {
@@ -427,26 +1185,10 @@ unsigned int run_ntlm_auth(const char *username,
 			if (error_string)
 				*error_string = strdup(parameter);
 		} else {
-			notice("unrecognised input from ntlm_auth helper - %s: %s", message, parameter); 
+			notice("unrecognised input from ntlm_auth helper - %s: %s", message, parameter);
 		}
 	}
 
-        /* parent */
-        if (fclose(pipe_out) == -1) {
-                fclose(pipe_in);
-                notice("error closing pipe?!? for child OUT[0]");
-                return NOT_AUTHENTICATED;
-        }
-
-       /* parent */
-        if (fclose(pipe_in) == -1) {
-                notice("error closing pipe?!? for child IN[1]");
-                return NOT_AUTHENTICATED;
-        }
-
-	while ((wait(&status) == -1) && errno == EINTR && !ppp_signaled(SIGTERM))
-                ;
-
 	if ((authenticated == AUTHENTICATED) && nt_key && !got_user_session_key) {
 		notice("Did not get user session key, despite being authenticated!");
 		return NOT_AUTHENTICATED;
@@ -454,6 +1196,82 @@ unsigned int run_ntlm_auth(const char *username,
 	return authenticated;
 }
 
+/* Where run_ntlm_auth waits for its answer */
+struct ntlm_sync {
+	int done;
+	unsigned int authenticated;
+	u_char *nt_key;
+	char **error_string;
+};
+
+static void
+ntlm_sync_done(void *arg, char *reply)
+{
+	struct ntlm_sync *s = arg;
+
+	s->authenticated = ntlm_result(reply, s->nt_key, s->error_string);
+	s->done = 1;
+}
+
+unsigned int run_ntlm_auth(const char *username,
+			   const char *domain,
+			   const char *full_username,
+			   const char *plaintext_password,
+			   const u_char *challenge,
+			   size_t challenge_length,
+			   const u_char *lm_response,
+			   size_t lm_response_length,
+			   const u_char *nt_response,
+			   size_t nt_response_length,
+			   u_char nt_key[16],
+			   char **error_string)
+{
+	struct ntlm_request *req;
+	struct ntlm_sync s;
+
+	/* First see if we have a program to run... */
+	if (ntlm_auth == NULL)
+		return NOT_AUTHENTICATED;
+
+	req = ntlm_new(username, domain, full_username, plaintext_password,
+		       challenge, challenge_length, lm_response,
+		       lm_response_length, nt_response, nt_response_length);
+	if (req == NULL)
+		return NOT_AUTHENTICATED;
+
+	memset(&s, 0, sizeof(s));
+	s.nt_key = nt_key;
+	s.error_string = error_string;
+	req->done = ntlm_sync_done;
+	req->arg = &s;
+	ntlm_submit(req);
+	while (!s.done && !ppp_signaled(SIGTERM))
+		ntlm_wait();
+	if (!s.done) {
+		/* whoever has it can forget about us */
+		req->done = NULL;
+		return NOT_AUTHENTICATED;
+	}
+	return s.authenticated;
+}
+
+/*
+ * ntlm_exit - pppd is going: say how the helpers did.  They go when
+ * they see their stdin close.
+ */
+static void
+ntlm_exit(void *opaque, int arg)
+{
+	if (ntlm_stats.count + ntlm_stats.failed == 0)
+		return;
+	info("WINBIND: %u verifications, average %.1f ms, slowest %.1f ms, "
+	     "%u waited for a helper, %u failed, %u helpers died",
+	     ntlm_stats.count + ntlm_stats.failed,
+	     ntlm_stats.count? ntlm_stats.total / ntlm_stats.count: 0.0,
+	     ntlm_stats.max, ntlm_stats.queued, ntlm_stats.failed,
+	     ntlm_stats.restarts);
+}
+
 /**********************************************************************
 * %FUNCTION: winbind_secret_check
 * %ARGUMENTS:
@@ -470,6 +1288,45 @@ winbind_secret_check(void)
 	return ntlm_auth != NULL;
 }
 
+/* The verification pppd is waiting for, while a helper works on it */
+static struct winbind_pending {
+	struct ntlm_request *req;	/* NULL once answered */
+	int starting;			/* answered before we returned */
+	int result;
+	pap_auth_done_fn *pap_done;
+	chap_verify_done_fn *chap_done;
+	void *arg;
+	int code;			/* CHAP digest */
+	char user[MAXNAMELEN];
+	char *domain;
+	char domainname[256];
+	unsigned char challenge[256];	/* length in first byte */
+	unsigned char response[256];	/* likewise */
+	unsigned char Challenge[8];	/* what ntlm_auth sees for MS-CHAPv2 */
+	char *message;
+	int message_space;
+	char msg[BUF_LEN];
+} pending;
+
+/**********************************************************************
+* %FUNCTION: winbind_cancel
+* %ARGUMENTS:
+*  None
+* %RETURNS:
+*  Nothing
+* %DESCRIPTION:
+* Forgets about any verification pppd no longer wants the answer to.
+***********************************************************************/
+static void
+winbind_cancel(void)
+{
+	if (pending.req != NULL)
+		pending.req->done = NULL;
+	pending.req = NULL;
+	pending.pap_done = NULL;
+	pending.chap_done = NULL;
+}
+
 /**********************************************************************
 * %FUNCTION: winbind_pap_auth
 * %ARGUMENTS:
@@ -492,72 +1349,143 @@ winbind_pap_auth(char *user,
 {
 	if (run_ntlm_auth(NULL, NULL, user, password, NULL, 0, NULL, 0, NULL, 0, NULL, msgp) == AUTHENTICATED) {
 		return 1;
-	} 
+	}
 	return -1;
 }
 
 /**********************************************************************
-* %FUNCTION: winbind_chap_auth
+* %FUNCTION: winbind_pap_reply
 * %ARGUMENTS:
-*  user -- user-name of peer
-*  remmd -- hash received from peer
-*  remmd_len -- length of remmd
-*  cstate -- pppd's chap_state structure
+*  arg -- ignored
+*  reply -- what ntlm_auth said, or NULL
 * %RETURNS:
-*  AUTHENTICATED (1) if we can authenticate, NOT_AUTHENTICATED (0) if we cannot.
+*  Nothing
 * %DESCRIPTION:
-* Performs MS-CHAP and MS-CHAPv2 authentication using WINBIND.
+* Finishes PAP authentication started by winbind_pap_auth_async.
 ***********************************************************************/
+static void
+winbind_pap_reply(void *arg, char *reply)
+{
+	pap_auth_done_fn *done = pending.pap_done;
+	char *error_string = NULL;
+
+	pending.req = NULL;
+	pending.result = ntlm_result(reply, NULL, &error_string) == AUTHENTICATED? 1: -1;
+	pending.msg[0] = 0;
+	if (error_string) {
+		strlcpy(pending.msg, error_string, sizeof(pending.msg));
+		free(error_string);
+	}
+	if (pending.starting)
+		return;
+	pending.pap_done = NULL;
+	(*done)(pending.arg, pending.result, pending.msg, NULL, NULL);
+}
 
-static int 
-winbind_chap_verify(char *user, char *ourname, int id,
-		    struct chap_digest_type *digest,
-		    unsigned char *challenge,
-		    unsigned char *response,
-		    char *message, int message_space)
+/**********************************************************************
+* %FUNCTION: winbind_pap_auth_async
+* %ARGUMENTS:
+*  user, passwd, msgp, paddrs, popts -- as for winbind_pap_auth
+*  done -- called with the result once ntlm_auth answers
+*  arg -- passed to done
+* %RETURNS:
+*  PAP_AUTH_PENDING if the request is with a helper, otherwise as for
+*  winbind_pap_auth.
+* %DESCRIPTION:
+* Performs PAP authentication using WINBIND without blocking pppd.
+***********************************************************************/
+static int
+winbind_pap_auth_async(char *user,
+		       char *password,
+		       char **msgp,
+		       struct wordlist **paddrs,
+		       struct wordlist **popts,
+		       pap_auth_done_fn *done, void *arg)
+{
+	struct ntlm_request *req;
+
+	winbind_cancel();
+	pending.msg[0] = 0;
+	*msgp = pending.msg;
+	if (ntlm_auth == NULL)
+		return -1;
+
+	req = ntlm_new(NULL, NULL, user, password, NULL, 0, NULL, 0, NULL, 0);
+	if (req == NULL)
+		return -1;
+	req->done = winbind_pap_reply;
+	pending.req = req;
+	pending.pap_done = done;
+	pending.arg = arg;
+	pending.starting = 1;
+	ntlm_submit(req);
+	pending.starting = 0;
+	if (pending.req == NULL) {
+		pending.pap_done = NULL;
+		return pending.result;
+	}
+	return PAP_AUTH_PENDING;
+}
+
+/**********************************************************************
+* %FUNCTION: winbind_chap_request
+* %ARGUMENTS:
+*  user -- name of the peer
+*  digest -- points to the structure representing the digest type
+*  challenge -- the challenge string we sent (length in first byte)
+*  response -- the response (hash) the peer sent back (length in 1st byte)
+* %RETURNS:
+*  The request for ntlm_auth, or NULL if the response is no good.
+* %DESCRIPTION:
+* Builds the request for MS-CHAP and MS-CHAPv2 authentication, keeping
+* what winbind_chap_result needs in pending.
+***********************************************************************/
+static struct ntlm_request *
+winbind_chap_request(char *user, struct chap_digest_type *digest,
+		     unsigned char *challenge, unsigned char *response)
 {
 	int challenge_len, response_len;
-	char domainname[256];
-	char *domain;
 	const char *username;
 	char *p;
-	unsigned char saresponse[MS_AUTH_RESPONSE_LENGTH+1];
 
 	/* The first byte of each of these strings contains their length */
 	challenge_len = *challenge++;
 	response_len = *response++;
-	
+
+	pending.code = digest->code;
+	strlcpy(pending.user, user, sizeof(pending.user));
+	memcpy(pending.challenge, challenge - 1, challenge_len + 1);
+	memcpy(pending.response, response - 1, response_len + 1);
+
 	/* remove domain from "domain\username" */
 	if ((username = strrchr(user, '\\')) != NULL)
 		++username;
 	else
 		username = user;
-	
-	strlcpy(domainname, user, sizeof(domainname));
-	
+
+	strlcpy(pending.domainname, user, sizeof(pending.domainname));
+
 	/* remove domain from "domain\username" */
-	if ((p = strrchr(domainname, '\\')) != NULL) {
+	if ((p = strrchr(pending.domainname, '\\')) != NULL) {
 		*p = '\0';
-		domain = domainname;
+		pending.domain = pending.domainname;
 	} else {
-		domain = NULL;
+		pending.domain = NULL;
 	}
-	
+
 	/*  generate MD based on negotiated type */
 	switch (digest->code) {
-		
+
 	case CHAP_MICROSOFT:
 	{
-		char *error_string = NULL;
 		u_char *nt_response = NULL;
 		u_char *lm_response = NULL;
 		int nt_response_size = 0;
 		int lm_response_size = 0;
-		u_char session_key[MD4_DIGEST_LENGTH];
-		
+
 		if (response_len != MS_CHAP_RESPONSE_LEN)
 			break;			/* not even the right length */
-		
+
 		/* Determine which part of response to verify against */
 		if (response[MS_CHAP_USENT]) {
 			nt_response = &response[MS_CHAP_NTRESP];
@@ -569,27 +1497,69 @@ winbind_chap_verify(char *user, char *ourname, int id,
 #else
 			/* Should really propagate this into the error packet. */
 			notice("Peer request for LANMAN auth not supported");
-			return NOT_AUTHENTICATED;
+			return NULL;
 #endif /* PPP_WITH_MSLANMAN */
 		}
-		
+
+		/* ship off to winbind, and check */
+		return ntlm_new(username, pending.domain, NULL, NULL,
+				challenge, challenge_len,
+				lm_response, lm_response_size,
+				nt_response, nt_response_size);
+	}
+
+	case CHAP_MICROSOFT_V2:
+		if (response_len != MS_CHAP2_RESPONSE_LEN)
+			break;			/* not even the right length */
+
+		ChallengeHash(&response[MS_CHAP2_PEER_CHALLENGE], challenge,
+			      user, pending.Challenge);
+
 		/* ship off to winbind, and check */
-		
-		if (run_ntlm_auth(username, 
-				  domain,
-				  NULL,
-				  NULL,
-				  challenge, challenge_len,
-				  lm_response, lm_response_size,
-				  nt_response, nt_response_size,
-				  session_key,
-				  &error_string) == AUTHENTICATED) {
+		return ntlm_new(username, pending.domain, NULL, NULL,
+				pending.Challenge, 8,
+				NULL, 0,
+				&response[MS_CHAP2_NTRESP],
+				MS_CHAP2_NTRESP_LEN);
+
+	default:
+		error("WINBIND: Challenge type %u unsupported", digest->code);
+	}
+	return NULL;
+}
+
+/**********************************************************************
+* %FUNCTION: winbind_chap_result
+* %ARGUMENTS:
+*  reply -- what ntlm_auth said, or NULL
+*  message -- space for the message to send the peer
+*  message_space -- its size
+* %RETURNS:
+*  AUTHENTICATED (1) if we can authenticate, NOT_AUTHENTICATED (0) if we cannot.
+* %DESCRIPTION:
+* Finishes MS-CHAP and MS-CHAPv2 authentication of the request built by
+* winbind_chap_request.
+***********************************************************************/
+static int
+winbind_chap_result(char *reply, char *message, int message_space)
+{
+	int challenge_len = pending.challenge[0];
+	unsigned char *challenge = pending.challenge + 1;
+	unsigned char *response = pending.response + 1;
+	unsigned char saresponse[MS_AUTH_RESPONSE_LENGTH+1];
+	u_char session_key[MD4_DIGEST_LENGTH];
+	char *error_string = NULL;
+
+	switch (pending.code) {
+
+	case CHAP_MICROSOFT:
+		if (ntlm_result(reply, session_key, &error_string) == AUTHENTICATED) {
 #ifdef PPP_WITH_MPPE
 			mppe_set_chapv1(challenge, session_key);
 #endif
 			slprintf(message, message_space, "Access granted");
 			return AUTHENTICATED;
-			
+
 		} else {
 			if (error_string) {
 				notice(error_string);
@@ -600,37 +1570,14 @@ winbind_chap_verify(char *user, char *ourname, int id,
 			return NOT_AUTHENTICATED;
 		}
 		break;
-	}
-	
+
 	case CHAP_MICROSOFT_V2:
-	{
-		u_char Challenge[8];
-		u_char session_key[MD4_DIGEST_LENGTH];
-		char *error_string = NULL;
-		
-		if (response_len != MS_CHAP2_RESPONSE_LEN)
-			break;			/* not even the right length */
-		
-		ChallengeHash(&response[MS_CHAP2_PEER_CHALLENGE], challenge,
-			      user, Challenge);
-		
-		/* ship off to winbind, and check */
-		
-		if (run_ntlm_auth(username, 
-				  domain, 
-				  NULL,
-				  NULL,
-				  Challenge, 8,
-				  NULL, 0,
-				  &response[MS_CHAP2_NTRESP],
-				  MS_CHAP2_NTRESP_LEN,
-				  session_key,
-				  &error_string) == AUTHENTICATED) {
-			
+		if (ntlm_result(reply, session_key, &error_string) == AUTHENTICATED) {
+
 			GenerateAuthenticatorResponse(session_key,
 				&response[MS_CHAP2_NTRESP],
 				&response[MS_CHAP2_PEER_CHALLENGE],
-				challenge, user, saresponse);
+				challenge, pending.user, saresponse);
 #ifdef PPP_WITH_MPPE
 			mppe_set_chapv2(session_key, &response[MS_CHAP2_NTRESP],
 				       MS_CHAP2_AUTHENTICATOR);
@@ -642,7 +1589,7 @@ winbind_chap_verify(char *user, char *ourname, int id,
 					 saresponse, "Access granted");
 			}
 			return AUTHENTICATED;
-			
+
 		} else {
 			if (error_string) {
 				notice(error_string);
@@ -657,13 +1604,153 @@ winbind_chap_verify(char *user, char *ourname, int id,
 		}
 		break;
 	}
-	
-	default:
-		error("WINBIND: Challenge type %u unsupported", digest->code);
-	}
 	return NOT_AUTHENTICATED;
 }
 
+/* Keeps the answer for winbind_chap_verify, which waits for it */
+static void
+winbind_chap_sync_done(void *arg, char *reply)
+{
+	*(char **) arg = reply? strdup(reply): NULL;
+	pending.req = NULL;
+}
+
+/**********************************************************************
+* %FUNCTION: winbind_chap_verify
+* %ARGUMENTS:
+*  user -- user-name of peer
+*  ourname -- ignored
+*  id -- ignored
+*  digest -- points to the structure representing the digest type
+*  challenge -- the challenge string we sent (length in first byte)
+*  response -- the response (hash) the peer sent back (length in 1st byte)
+*  message -- space for the message to send the peer
+*  message_space -- its size
+* %RETURNS:
+*  AUTHENTICATED (1) if we can authenticate, NOT_AUTHENTICATED (0) if we cannot.
+* %DESCRIPTION:
+* Performs MS-CHAP and MS-CHAPv2 authentication using WINBIND.
+***********************************************************************/
+
+static int
+winbind_chap_verify(char *user, char *ourname, int id,
+		    struct chap_digest_type *digest,
+		    unsigned char *challenge,
+		    unsigned char *response,
+		    char *message, int message_space)
+{
+	struct ntlm_request *req;
+	char *reply = NULL;
+	int result;
+
+	winbind_cancel();
+	if (ntlm_auth == NULL)
+		return NOT_AUTHENTICATED;
+	req = winbind_chap_request(user, digest, challenge, response);
+	if (req == NULL)
+		return NOT_AUTHENTICATED;
+
+	req->done = winbind_chap_sync_done;
+	req->arg = &reply;
+	pending.req = req;
+	ntlm_submit(req);
+	while (pending.req != NULL && !ppp_signaled(SIGTERM))
+		ntlm_wait();
+	if (pending.req != NULL) {
+		winbind_cancel();
+		return NOT_AUTHENTICATED;
+	}
+	result = winbind_chap_result(reply, message, message_space);
+	free(reply);
+	return result;
+}
+
+/**********************************************************************
+* %FUNCTION: winbind_chap_reply
+* %ARGUMENTS:
+*  arg -- ignored
+*  reply -- what ntlm_auth said, or NULL
+* %RETURNS:
+*  Nothing
+* %DESCRIPTION:
+* Finishes CHAP authentication started by winbind_chap_verify_async.
+***********************************************************************/
+static void
+winbind_chap_reply(void *arg, char *reply)
+{
+	chap_verify_done_fn *done = pending.chap_done;
+
+	pending.req = NULL;
+	pending.result = winbind_chap_result(reply, pending.message,
+					     pending.message_space);
+	if (pending.starting)
+		return;
+	pending.chap_done = NULL;
+	(*done)(pending.arg, pending.result);
+}
+
+/**********************************************************************
+* %FUNCTION: winbind_chap_verify_async
+* %ARGUMENTS:
+*  user ... message_space -- as for winbind_chap_verify
+*  done -- called with the result once ntlm_auth answers
+*  arg -- passed to done
+* %RETURNS:
+*  CHAP_VERIFY_PENDING if the request is with a helper, otherwise as
+*  for winbind_chap_verify.
+* %DESCRIPTION:
+* Performs MS-CHAP and MS-CHAPv2 authentication using WINBIND without
+* blocking pppd.
+***********************************************************************/
+static int
+winbind_chap_verify_async(char *user, char *ourname, int id,
+			  struct chap_digest_type *digest,
+			  unsigned char *challenge, unsigned char *response,
+			  char *message, int message_space,
+			  chap_verify_done_fn *done, void *arg)
+{
+	struct ntlm_request *req;
+
+	winbind_cancel();
+	if (ntlm_auth == NULL)
+		return NOT_AUTHENTICATED;
+	req = winbind_chap_request(user, digest, challenge, response);
+	if (req == NULL)
+		return NOT_AUTHENTICATED;
+
+	req->done = winbind_chap_reply;
+	pending.req = req;
+	pending.chap_done = done;
+	pending.arg = arg;
+	pending.message = message;
+	pending.message_space = message_space;
+	pending.starting = 1;
+	ntlm_submit(req);
+	pending.starting = 0;
+	if (pending.req == NULL) {
+		pending.chap_done = NULL;
+		return pending.result;
+	}
+	return CHAP_VERIFY_PENDING;
+}
+
+/**********************************************************************
+* %FUNCTION: winbind_link_down
+* %ARGUMENTS:
+*  opaque -- ignored
+*  arg -- ignored
+* %RETURNS:
+*  Nothing
+* %DESCRIPTION:
+* Called when the link goes down.  Abandons any verification still with
+* a helper, since pppd no longer wants the answer.
+***********************************************************************/
+static void
+winbind_link_down(void *opaque, int arg)
+{
+	winbind_cancel();
+}
+
 static int 
 winbind_allowed_address(uint32_t addr)
 {
@@ -53,11 +53,13 @@
 #define EVP_CIPHER_CTX_reset EVP_CIPHER_CTX_cleanup
 #endif
 
-static int des_init(PPP_CIPHER_CTX *ctx, const unsigned char *key, const unsigned char *iv)
+static int ossl_des_init(PPP_CIPHER_CTX *ctx, const unsigned char *key, const unsigned char *iv)
 {
     if (ctx) {
-        EVP_CIPHER_CTX *cc = EVP_CIPHER_CTX_new();
+        /* Re-keying a context reuses its EVP context */
+        EVP_CIPHER_CTX *cc = ctx->priv? ctx->priv: EVP_CIPHER_CTX_new();
         if (cc) {
+            const EVP_CIPHER *type = ctx->priv? NULL: EVP_des_ecb();
 
             if (key) {
                 memcpy(ctx->key, key, 8);
@@ -66,7 +68,7 @@ static int des_init(PPP_CIPHER_CTX *ctx, const unsigned char *key, const unsigne
                 memcpy(ctx->iv, iv, 8);
             }
 
-            if (EVP_CipherInit(cc, EVP_des_ecb(), ctx->key, ctx->iv, ctx->is_encr)) {
+            if (EVP_CipherInit_ex(cc, type, NULL, ctx->key, ctx->iv, ctx->is_encr)) {
 
                 if (EVP_CIPHER_CTX_set_padding(cc, 0)) {
                     ctx->priv = cc;
@@ -75,12 +77,13 @@ static int des_init(PPP_CIPHER_CTX *ctx, const unsigned char *key, const unsigne
             }
 
             EVP_CIPHER_CTX_free(cc);
+            ctx->priv = NULL;
         }
     }
     return 0;
 }
 
-static int des_update(PPP_CIPHER_CTX *ctx, unsigned char *out, int *outl, const unsigned char *in, int inl)
+static int ossl_des_update(PPP_CIPHER_CTX *ctx, unsigned char *out, int *outl, const unsigned char *in, int inl)
 {
     if (ctx) {
         return EVP_CipherUpdate((EVP_CIPHER_CTX*) ctx->priv, out, outl, in, inl);
@@ -88,7 +91,7 @@ static int des_update(PPP_CIPHER_CTX *ctx, unsigned char *out, int *outl, const
     return 0;
 }
 
-static int des_final(PPP_CIPHER_CTX *ctx, unsigned char *out, int *outl)
+static int ossl_des_final(PPP_CIPHER_CTX *ctx, unsigned char *out, int *outl)
 {
     if (ctx) {
         return EVP_CipherFinal((EVP_CIPHER_CTX*) ctx->priv, out, outl);
@@ -96,7 +99,7 @@ static int des_final(PPP_CIPHER_CTX *ctx, unsigned char *out, int *outl)
     return 0;
 }
 
-static void des_clean(PPP_CIPHER_CTX *ctx)
+static void ossl_des_clean(PPP_CIPHER_CTX *ctx)
 {
     if (ctx->priv) {
         EVP_CIPHER_CTX_free((EVP_CIPHER_CTX*) ctx->priv);
@@ -104,7 +107,15 @@ static void des_clean(PPP_CIPHER_CTX *ctx)
     }
 }
 
-#else
+static PPP_CIPHER ossl_des = {
+    .init_fn = ossl_des_init,
+    .update_fn = ossl_des_update,
+    .final_fn = ossl_des_final,
+    .clean_fn = ossl_des_clean,
+};
+
+#endif /* OPENSSL_HAVE_DES */
+
 
 /*
  * DES related functions are imported from openssl 3.0 project with the 
@@ -665,7 +676,7 @@ static void DES_set_key(const DES_cblock *key, DES_key_schedule *schedule)
 
 static int des_init(PPP_CIPHER_CTX *ctx, const unsigned char *key, const unsigned char *iv)
 {
-    DES_key_schedule *ks = calloc(1, sizeof(DES_key_schedule));
+    DES_key_schedule *ks = ctx->priv? ctx->priv: calloc(1, sizeof(DES_key_schedule));
     if (ks) {
 
         if (key) {
@@ -714,17 +725,27 @@ static void des_clean(PPP_CIPHER_CTX *ctx)
     }
 }
 
-#endif
-
-static PPP_CIPHER ppp_des = {
+static PPP_CIPHER builtin_des = {
     .init_fn = des_init,
     .update_fn = des_update,
     .final_fn = des_final,
     .clean_fn = des_clean,
 };
 
+struct ppp_crypto_prim ppp_des_prim = {
+    .name = "des",
+#ifdef OPENSSL_HAVE_DES
+    .used = PPP_CRYPTO_OPENSSL,
+#endif
+    .cipher = {
+        [PPP_CRYPTO_BUILTIN] = &builtin_des,
+#ifdef OPENSSL_HAVE_DES
+        [PPP_CRYPTO_OPENSSL] = &ossl_des,
+#endif
+    },
+};
+
 const PPP_CIPHER *PPP_des_ecb(void)
 {
-    return &ppp_des;
+    return ppp_des_prim.cipher[ppp_des_prim.used];
 }
-
@@ -0,0 +1,254 @@
+/*
+ * ppp-mb.c - MD4 and SHA1 of several messages at once.
+ *
+ * Copyright (c) 2026 The ppp project. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The name(s) of the authors of this software must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission.
+ *
+ * THE AUTHORS OF THIS SOFTWARE DISCLAIM ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS, IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+ * AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * A multi-buffer hash runs the same rounds over MB_LANES independent
+ * messages, one per lane, with each step written as a loop across the
+ * lanes.  The compiler turns those loops into vector instructions, so
+ * that hashing eight short messages costs little more than hashing one.
+ * Messages needing fewer blocks than the longest in their group keep
+ * their state unchanged through the extra blocks.
+ *
+ * This is meant for the short messages of MS-CHAP verification, where
+ * each digest would otherwise pay for a context of its own.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "crypto.h"
+
+#define MB_LANES	8
+
+#define ROTL(x, n)	(((x) << (n)) | ((x) >> (32 - (n))))
+
+/* Do stmt for each lane l */
+#define LANES(stmt)	do { int l; for (l = 0; l < MB_LANES; ++l) { stmt; } } while (0)
+
+/*
+ * mb_block - fill in block blk of a message as the hash sees it, with
+ * the padding and, in its last block, the length in bits.
+ */
+static void
+mb_block(const unsigned char *data, size_t len, size_t blk, size_t nblocks,
+	 int bigendian, unsigned char buf[64])
+{
+    size_t off = blk * 64;
+    uint64_t bits = (uint64_t) len * 8;
+    int i;
+
+    memset(buf, 0, 64);
+    if (off < len)
+	memcpy(buf, data + off, (len - off < 64? len - off: 64));
+    if (off <= len && len < off + 64)
+	buf[len - off] = 0x80;
+    if (blk == nblocks - 1) {
+	for (i = 0; i < 8; ++i) {
+	    if (bigendian)
+		buf[63 - i] = bits >> (8 * i);
+	    else
+		buf[56 + i] = bits >> (8 * i);
+	}
+    }
+}
+
+/* Blocks in a padded message of len bytes */
+#define MB_NBLOCKS(len)	(((len) + 8) / 64 + 1)
+
+/*
+ * MD4
+ */
+#define MD4_F(x, y, z)	(((x) & (y)) | (~(x) & (z)))
+#define MD4_G(x, y, z)	(((x) & (y)) | ((x) & (z)) | ((y) & (z)))
+#define MD4_H(x, y, z)	((x) ^ (y) ^ (z))
+
+#define MD4_STEP(f, a, b, c, d, k, s, add) \
+    LANES(a[l] += f(b[l], c[l], d[l]) + x[k][l] + (add); a[l] = ROTL(a[l], s))
+
+static void
+md4_lanes(int m, const unsigned char *const *data, const size_t *len,
+	  unsigned char (*out)[MD4_DIGEST_LENGTH])
+{
+    uint32_t a[MB_LANES], b[MB_LANES], c[MB_LANES], d[MB_LANES];
+    uint32_t aa[MB_LANES], bb[MB_LANES], cc[MB_LANES], dd[MB_LANES];
+    uint32_t x[16][MB_LANES], live[MB_LANES];
+    size_t nblocks[MB_LANES], most = 0, blk;
+    unsigned char buf[64];
+    int i, j;
+
+    for (j = 0; j < MB_LANES; ++j) {
+	nblocks[j] = j < m? MB_NBLOCKS(len[j]): 0;
+	if (nblocks[j] > most)
+	    most = nblocks[j];
+    }
+    LANES(a[l] = 0x67452301; b[l] = 0xefcdab89;
+	  c[l] = 0x98badcfe; d[l] = 0x10325476);
+    /* lanes past m never get a block, but are still computed on */
+    memset(x, 0, sizeof(x));
+
+    for (blk = 0; blk < most; ++blk) {
+	for (j = 0; j < MB_LANES; ++j) {
+	    live[j] = blk < nblocks[j]? 0xffffffff: 0;
+	    if (!live[j])
+		continue;
+	    mb_block(data[j], len[j], blk, nblocks[j], 0, buf);
+	    for (i = 0; i < 16; ++i)
+		x[i][j] = buf[4*i] | buf[4*i+1] << 8
+		    | buf[4*i+2] << 16 | (uint32_t) buf[4*i+3] << 24;
+	}
+	LANES(aa[l] = a[l]; bb[l] = b[l]; cc[l] = c[l]; dd[l] = d[l]);
+
+	for (i = 0; i < 16; i += 4) {
+	    MD4_STEP(MD4_F, a, b, c, d, i,     3, 0);
+	    MD4_STEP(MD4_F, d, a, b, c, i + 1, 7, 0);
+	    MD4_STEP(MD4_F, c, d, a, b, i + 2, 11, 0);
+	    MD4_STEP(MD4_F, b, c, d, a, i + 3, 19, 0);
+	}
+	for (i = 0; i < 4; ++i) {
+	    MD4_STEP(MD4_G, a, b, c, d, i,      3, 0x5a827999);
+	    MD4_STEP(MD4_G, d, a, b, c, i + 4,  5, 0x5a827999);
+	    MD4_STEP(MD4_G, c, d, a, b, i + 8,  9, 0x5a827999);
+	    MD4_STEP(MD4_G, b, c, d, a, i + 12, 13, 0x5a827999);
+	}
+	for (i = 0; i < 4; ++i) {
+	    static const int k[4] = { 0, 2, 1, 3 };
+	    MD4_STEP(MD4_H, a, b, c, d, k[i],      3, 0x6ed9eba1);
+	    MD4_STEP(MD4_H, d, a, b, c, k[i] + 8,  9, 0x6ed9eba1);
+	    MD4_STEP(MD4_H, c, d, a, b, k[i] + 4,  11, 0x6ed9eba1);
+	    MD4_STEP(MD4_H, b, c, d, a, k[i] + 12, 15, 0x6ed9eba1);
+	}
+
+	/* lanes whose message has ended keep their state */
+	LANES(a[l] = aa[l] + (a[l] & live[l]); b[l] = bb[l] + (b[l] & live[l]);
+	      c[l] = cc[l] + (c[l] & live[l]); d[l] = dd[l] + (d[l] & live[l]));
+    }
+
+    for (j = 0; j < m; ++j) {
+	uint32_t w[4] = { a[j], b[j], c[j], d[j] };
+	for (i = 0; i < 16; ++i)
+	    out[j][i] = w[i / 4] >> (8 * (i % 4));
+    }
+}
+
+/*
+ * SHA1
+ */
+#define SHA1_F1(x, y, z)	(((x) & (y)) | (~(x) & (z)))
+#define SHA1_F2(x, y, z)	((x) ^ (y) ^ (z))
+#define SHA1_F3(x, y, z)	(((x) & (y)) | ((x) & (z)) | ((y) & (z)))
+
+static void
+sha1_lanes(int m, const unsigned char *const *data, const size_t *len,
+	   unsigned char (*out)[SHA_DIGEST_LENGTH])
+{
+    uint32_t h[5][MB_LANES], s[5][MB_LANES], w[16][MB_LANES], live[MB_LANES];
+    size_t nblocks[MB_LANES], most = 0, blk;
+    unsigned char buf[64];
+    int i, j;
+
+    for (j = 0; j < MB_LANES; ++j) {
+	nblocks[j] = j < m? MB_NBLOCKS(len[j]): 0;
+	if (nblocks[j] > most)
+	    most = nblocks[j];
+    }
+    LANES(h[0][l] = 0x67452301; h[1][l] = 0xefcdab89; h[2][l] = 0x98badcfe;
+	  h[3][l] = 0x10325476; h[4][l] = 0xc3d2e1f0);
+    /* lanes past m never get a block, but are still computed on */
+    memset(w, 0, sizeof(w));
+
+    for (blk = 0; blk < most; ++blk) {
+	for (j = 0; j < MB_LANES; ++j) {
+	    live[j] = blk < nblocks[j]? 0xffffffff: 0;
+	    if (!live[j])
+		continue;
+	    mb_block(data[j], len[j], blk, nblocks[j], 1, buf);
+	    for (i = 0; i < 16; ++i)
+		w[i][j] = (uint32_t) buf[4*i] << 24 | buf[4*i+1] << 16
+		    | buf[4*i+2] << 8 | buf[4*i+3];
+	}
+	for (i = 0; i < 5; ++i)
+	    LANES(s[i][l] = h[i][l]);
+
+	for (i = 0; i < 80; ++i) {
+	    uint32_t *wi = w[i & 15];
+
+	    if (i >= 16)
+		LANES(wi[l] = ROTL(w[(i + 13) & 15][l] ^ w[(i + 8) & 15][l]
+				   ^ w[(i + 2) & 15][l] ^ wi[l], 1));
+	    if (i < 20)
+		LANES(s[4][l] += SHA1_F1(s[1][l], s[2][l], s[3][l]) + 0x5a827999);
+	    else if (i < 40)
+		LANES(s[4][l] += SHA1_F2(s[1][l], s[2][l], s[3][l]) + 0x6ed9eba1);
+	    else if (i < 60)
+		LANES(s[4][l] += SHA1_F3(s[1][l], s[2][l], s[3][l]) + 0x8f1bbcdc);
+	    else
+		LANES(s[4][l] += SHA1_F2(s[1][l], s[2][l], s[3][l]) + 0xca62c1d6);
+	    LANES(uint32_t t = s[4][l] + ROTL(s[0][l], 5) + wi[l];
+		  s[4][l] = s[3][l]; s[3][l] = s[2][l];
+		  s[2][l] = ROTL(s[1][l], 30);
+		  s[1][l] = s[0][l]; s[0][l] = t);
+	}
+
+	/* lanes whose message has ended keep their state */
+	for (i = 0; i < 5; ++i)
+	    LANES(h[i][l] += s[i][l] & live[l]);
+    }
+
+    for (j = 0; j < m; ++j)
+	for (i = 0; i < SHA_DIGEST_LENGTH; ++i)
+	    out[j][i] = h[i / 4][j] >> (24 - 8 * (i % 4));
+}
+
+void
+PPP_md4_mb(int n, const unsigned char *const *data, const size_t *len,
+	   unsigned char (*out)[MD4_DIGEST_LENGTH])
+{
+    int i;
+
+    for (i = 0; i < n; i += MB_LANES)
+	md4_lanes((n - i < MB_LANES? n - i: MB_LANES), data + i, len + i,
+		  out + i);
+}
+
+void
+PPP_sha1_mb(int n, const unsigned char *const *data, const size_t *len,
+	    unsigned char (*out)[SHA_DIGEST_LENGTH])
+{
+    int i;
+
+    for (i = 0; i < n; i += MB_LANES)
+	sha1_lanes((n - i < MB_LANES? n - i: MB_LANES), data + i, len + i,
+		   out + i);
+}
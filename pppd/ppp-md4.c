@@ -34,6 +34,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "crypto-priv.h"
 
@@ -47,7 +48,7 @@
 #endif
 
 
-static int md4_init(PPP_MD_CTX *ctx)
+static int ossl_md4_init(PPP_MD_CTX *ctx)
 {
     if (ctx) {
         EVP_MD_CTX *mctx = EVP_MD_CTX_new();
@@ -62,7 +63,7 @@ static int md4_init(PPP_MD_CTX *ctx)
     return 0;
 }
 
-static int md4_update(PPP_MD_CTX *ctx, const void *data, size_t len)
+static int ossl_md4_update(PPP_MD_CTX *ctx, const void *data, size_t len)
 {
     if (EVP_DigestUpdate((EVP_MD_CTX*) ctx->priv, data, len)) {
         return 1;
@@ -70,7 +71,7 @@ static int md4_update(PPP_MD_CTX *ctx, const void *data, size_t len)
     return 0;
 }
 
-static int md4_final(PPP_MD_CTX *ctx, unsigned char *out, unsigned int *len)
+static int ossl_md4_final(PPP_MD_CTX *ctx, unsigned char *out, unsigned int *len)
 {
     if (EVP_DigestFinal((EVP_MD_CTX*) ctx->priv, out, len)) {
         return 1;
@@ -78,7 +79,7 @@ static int md4_final(PPP_MD_CTX *ctx, unsigned char *out, unsigned int *len)
     return 0;
 }
 
-static void md4_clean(PPP_MD_CTX *ctx)
+static void ossl_md4_clean(PPP_MD_CTX *ctx)
 {
     if (ctx->priv) {
         EVP_MD_CTX_free(ctx->priv);
@@ -86,8 +87,15 @@ static void md4_clean(PPP_MD_CTX *ctx)
     }
 }
 
+static PPP_MD ossl_md4 = {
+    .init_fn = ossl_md4_init,
+    .update_fn = ossl_md4_update,
+    .final_fn = ossl_md4_final,
+    .clean_fn = ossl_md4_clean,
+};
+
+#endif /* OPENSSL_HAVE_MD4 */
 
-#else // !OPENSSL_HAVE_MD4
 
 #define TRUE  1
 #define FALSE 0
@@ -173,22 +181,6 @@ typedef struct {
 #define gg(A,B,C,D,i,s)      A = rot((A + g(B,C,D) + X[i] + C2),s)
 #define hh(A,B,C,D,i,s)      A = rot((A + h(B,C,D) + X[i] + C3),s)
 
-/* MD4print(MDp)
-** Print message digest buffer MDp as 32 hexadecimal digits.
-** Order is from low-order byte of buffer[0] to high-order byte of
-** buffer[3].
-** Each byte is printed with high-order hexadecimal digit first.
-** This is a user-callable routine.
-*/
-static void
-MD4Print(MD4_CTX *MDp)
-{
-  int i,j;
-  for (i=0;i<4;i++)
-    for (j=0;j<32;j=j+8)
-      printf("%02x",(MDp->buffer[i]>>j) & 0xFF);
-}
-
 /* MD4Init(MDp)
 ** Initialize message digest buffer MDp.
 ** This is a user-callable routine.
@@ -336,9 +328,9 @@ MD4Update(MD4_CTX *MDp, unsigned char *X, unsigned int count)
     byte = count >> 3;
     bit =  count & 7;
     /* Copy X into XX since we need to modify it */
-    if (count)
-      for (i=0;i<=byte;i++) XX[i] = X[i];
-    for (i=byte+1;i<64;i++) XX[i] = 0;
+    for (i=0;i<byte;i++) XX[i] = X[i];
+    for (i=byte;i<64;i++) XX[i] = 0;
+    if (bit) XX[byte] = X[byte];
     /* Add padding '1' bit and low-order zeros in last byte */
     mask = 1 << (7 - bit);
     XX[byte] = (XX[byte] | mask) & ~( mask - 1);
@@ -383,13 +375,30 @@ MD4Final(unsigned char *buf, MD4_CTX *MD)
 ** End of md4.c
 ****************************(cut)***********************************/
 
+#if defined(__NetBSD__)
+/* NetBSD uses the libc md4 routines which take bytes instead of bits */
+#define MD4_BITS(n)	(n)
+#else
+#define MD4_BITS(n)	((n) * 8)
+#endif
+
+/*
+ * MD4Update takes whole blocks until the last one, which ends the
+ * digest, so we hold back the tail until md4_final.
+ */
+struct md4_state {
+    MD4_CTX md;
+    unsigned char tail[64];
+    size_t ntail;
+};
+
 static int md4_init(PPP_MD_CTX *ctx)
 {
     if (ctx) {
-        MD4_CTX *mctx = calloc(1, sizeof(MD4_CTX));
-        if (mctx) {
-            MD4Init(mctx);
-            ctx->priv = mctx;
+        struct md4_state *st = calloc(1, sizeof(struct md4_state));
+        if (st) {
+            MD4Init(&st->md);
+            ctx->priv = st;
             return 1;
         }
     }
@@ -398,47 +407,68 @@ static int md4_init(PPP_MD_CTX *ctx)
 
 static int md4_update(PPP_MD_CTX *ctx, const void *data, size_t len)
 {
-#if defined(__NetBSD__)
-    /* NetBSD uses the libc md4 routines which take bytes instead of bits */
-    int			mdlen = len;
-#else
-    int			mdlen = len * 8;
-#endif
-
-    /* Internal MD4Update can take at most 64 bytes at a time */
-    while (mdlen > 512) {
-        MD4Update((MD4_CTX*) ctx->priv, (unsigned char*) data, 512);
-        data += 64;
-        mdlen -= 512;
+    struct md4_state *st = ctx->priv;
+    const unsigned char *p = data;
+    size_t n;
+
+    if (st->ntail) {
+        n = 64 - st->ntail < len? 64 - st->ntail: len;
+        memcpy(st->tail + st->ntail, p, n);
+        st->ntail += n;
+        p += n;
+        len -= n;
+        if (st->ntail < 64)
+            return 1;
+        MD4Update(&st->md, st->tail, MD4_BITS(64));
+        st->ntail = 0;
     }
-    MD4Update((MD4_CTX*) ctx->priv, (unsigned char*) data, mdlen);
+    for (; len >= 64; p += 64, len -= 64)
+        MD4Update(&st->md, (unsigned char *) p, MD4_BITS(64));
+    memcpy(st->tail, p, len);
+    st->ntail = len;
     return 1;
 }
 
 static int md4_final(PPP_MD_CTX *ctx, unsigned char *out, unsigned int *len)
 {
-    MD4Final(out, (MD4_CTX*) ctx->priv);
+    struct md4_state *st = ctx->priv;
+
+    MD4Update(&st->md, st->tail, MD4_BITS(st->ntail));
+    MD4Final(out, &st->md);
+    *len = MD4_DIGEST_LENGTH;
     return 1;
 }
 
 static void md4_clean(PPP_MD_CTX *ctx)
 {
     if (ctx->priv) {
+        memset(ctx->priv, 0, sizeof(struct md4_state));
         free(ctx->priv);
         ctx->priv = NULL;
     }
 }
 
-#endif
-
-static PPP_MD ppp_md4 = {
+static PPP_MD builtin_md4 = {
     .init_fn = md4_init,
     .update_fn = md4_update,
     .final_fn = md4_final,
     .clean_fn = md4_clean,
 };
 
+struct ppp_crypto_prim ppp_md4_prim = {
+    .name = "md4",
+#ifdef OPENSSL_HAVE_MD4
+    .used = PPP_CRYPTO_OPENSSL,
+#endif
+    .md = {
+        [PPP_CRYPTO_BUILTIN] = &builtin_md4,
+#ifdef OPENSSL_HAVE_MD4
+        [PPP_CRYPTO_OPENSSL] = &ossl_md4,
+#endif
+    },
+};
+
 const PPP_MD *PPP_md4(void)
 {
-    return &ppp_md4;
+    return ppp_md4_prim.md[ppp_md4_prim.used];
 }
@@ -46,7 +46,7 @@
 #define EVP_MD_CTX_new EVP_MD_CTX_create
 #endif
 
-static int md5_init(PPP_MD_CTX *ctx)
+static int ossl_md5_init(PPP_MD_CTX *ctx)
 {
     if (ctx) {
         EVP_MD_CTX *mctx = EVP_MD_CTX_new();
@@ -61,7 +61,7 @@ static int md5_init(PPP_MD_CTX *ctx)
     return 0;
 }
 
-static int md5_update(PPP_MD_CTX *ctx, const void *data, size_t len)
+static int ossl_md5_update(PPP_MD_CTX *ctx, const void *data, size_t len)
 {
     if (EVP_DigestUpdate((EVP_MD_CTX*) ctx->priv, data, len)) {
         return 1;
@@ -69,7 +69,7 @@ static int md5_update(PPP_MD_CTX *ctx, const void *data, size_t len)
     return 0;
 }
 
-static int md5_final(PPP_MD_CTX *ctx, unsigned char *out, unsigned int *len)
+static int ossl_md5_final(PPP_MD_CTX *ctx, unsigned char *out, unsigned int *len)
 {
     if (EVP_DigestFinal((EVP_MD_CTX*) ctx->priv, out, len)) {
         return 1;
@@ -77,7 +77,7 @@ static int md5_final(PPP_MD_CTX *ctx, unsigned char *out, unsigned int *len)
     return 0;
 }
 
-static void md5_clean(PPP_MD_CTX *ctx)
+static void ossl_md5_clean(PPP_MD_CTX *ctx)
 {
     if (ctx->priv) {
         EVP_MD_CTX_free((EVP_MD_CTX*) ctx->priv);
@@ -85,7 +85,15 @@ static void md5_clean(PPP_MD_CTX *ctx)
     }
 }
 
-#else // !OPENSSL_HAVE_MD5
+static PPP_MD ossl_md5 = {
+    .init_fn = ossl_md5_init,
+    .update_fn = ossl_md5_update,
+    .final_fn = ossl_md5_final,
+    .clean_fn = ossl_md5_clean,
+};
+
+#endif /* OPENSSL_HAVE_MD5 */
+
 
 /*
  ***********************************************************************
@@ -424,6 +432,7 @@ static int md5_update(PPP_MD_CTX *ctx, const void *data, size_t len)
 static int md5_final(PPP_MD_CTX *ctx, unsigned char *out, unsigned int *len)
 {
     MD5_Final(out, (MD5_CTX*) ctx->priv);
+    *len = MD5_DIGEST_LENGTH;
     return 1;
 }
 
@@ -435,17 +444,27 @@ static void md5_clean(PPP_MD_CTX *ctx)
     }
 }
 
-#endif
-
-static PPP_MD ppp_md5 = {
+static PPP_MD builtin_md5 = {
     .init_fn = md5_init,
     .update_fn = md5_update,
     .final_fn = md5_final,
     .clean_fn  = md5_clean,
 };
 
+struct ppp_crypto_prim ppp_md5_prim = {
+    .name = "md5",
+#ifdef OPENSSL_HAVE_MD5
+    .used = PPP_CRYPTO_OPENSSL,
+#endif
+    .md = {
+        [PPP_CRYPTO_BUILTIN] = &builtin_md5,
+#ifdef OPENSSL_HAVE_MD5
+        [PPP_CRYPTO_OPENSSL] = &ossl_md5,
+#endif
+    },
+};
+
 const PPP_MD *PPP_md5(void)
 {
-    return &ppp_md5;
+    return ppp_md5_prim.md[ppp_md5_prim.used];
 }
-
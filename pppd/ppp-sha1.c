@@ -48,7 +48,7 @@
 #define EVP_MD_CTX_new EVP_MD_CTX_create
 #endif
 
-static int sha1_init(PPP_MD_CTX *ctx)
+static int ossl_sha1_init(PPP_MD_CTX *ctx)
 {
     if (ctx) {
         EVP_MD_CTX *mctx = EVP_MD_CTX_new();
@@ -63,7 +63,7 @@ static int sha1_init(PPP_MD_CTX *ctx)
     return 0;
 }
 
-static int sha1_update(PPP_MD_CTX *ctx, const void *data, size_t len)
+static int ossl_sha1_update(PPP_MD_CTX *ctx, const void *data, size_t len)
 {
     if (EVP_DigestUpdate((EVP_MD_CTX*) ctx->priv, data, len)) {
         return 1;
@@ -71,7 +71,7 @@ static int sha1_update(PPP_MD_CTX *ctx, const void *data, size_t len)
     return 0;
 }
 
-static int sha1_final(PPP_MD_CTX *ctx, unsigned char *out, unsigned int *len)
+static int ossl_sha1_final(PPP_MD_CTX *ctx, unsigned char *out, unsigned int *len)
 {
     if (EVP_DigestFinal((EVP_MD_CTX*) ctx->priv, out, len)) {
         return 1;
@@ -79,7 +79,7 @@ static int sha1_final(PPP_MD_CTX *ctx, unsigned char *out, unsigned int *len)
     return 0;
 }
 
-static void sha1_clean(PPP_MD_CTX *ctx)
+static void ossl_sha1_clean(PPP_MD_CTX *ctx)
 {
     if (ctx->priv) {
         EVP_MD_CTX_free((EVP_MD_CTX*) ctx->priv);
@@ -87,8 +87,15 @@ static void sha1_clean(PPP_MD_CTX *ctx)
     }
 }
 
+static PPP_MD ossl_sha1 = {
+    .init_fn = ossl_sha1_init,
+    .update_fn = ossl_sha1_update,
+    .final_fn = ossl_sha1_final,
+    .clean_fn = ossl_sha1_clean,
+};
+
+#endif /* OPENSSL_HAVE_SHA */
 
-#else // !OPENSSL_HAVE_SHA
 
 /*
  * ftp://ftp.funet.fi/pub/crypt/hash/sha/sha1.c
@@ -285,6 +292,7 @@ static int sha1_update(PPP_MD_CTX* ctx, const void *data, size_t len)
 static int sha1_final(PPP_MD_CTX *ctx, unsigned char *out, unsigned int *len)
 {
     SHA1_Final(out, (SHA1_CTX*) ctx->priv);
+    *len = SHA_DIGEST_LENGTH;
     return 1;
 }
 
@@ -296,17 +304,27 @@ static void sha1_clean(PPP_MD_CTX *ctx)
     }
 }
 
-#endif
-
-static PPP_MD ppp_sha1 = {
+static PPP_MD builtin_sha1 = {
     .init_fn = sha1_init,
     .update_fn = sha1_update,
     .final_fn = sha1_final,
     .clean_fn = sha1_clean,
 };
 
+struct ppp_crypto_prim ppp_sha1_prim = {
+    .name = "sha1",
+#ifdef OPENSSL_HAVE_SHA
+    .used = PPP_CRYPTO_OPENSSL,
+#endif
+    .md = {
+        [PPP_CRYPTO_BUILTIN] = &builtin_sha1,
+#ifdef OPENSSL_HAVE_SHA
+        [PPP_CRYPTO_OPENSSL] = &ossl_sha1,
+#endif
+    },
+};
+
 const PPP_MD *PPP_sha1(void)
 {
-    return &ppp_sha1;
+    return ppp_sha1_prim.md[ppp_sha1_prim.used];
 }
-
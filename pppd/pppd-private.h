@@ -183,6 +183,7 @@ extern char	our_name[MAXNAMELEN];/* Our name for authentication purposes */
 extern char	remote_name[MAXNAMELEN]; /* Peer's name for authentication */
 extern char	path_upapfile[];/* Pathname of pap-secrets file */
 extern char	path_chapfile[];/* Pathname of chap-secrets file */
+extern char	path_nthashfile[]; /* Pathname of chap-nthashes file */
 extern bool	explicit_remote;/* remote_name specified with remotename opt */
 extern bool	demand;		/* Do dial-on-demand */
 extern char	*ipparam;	/* Extra parameter for ip up/down scripts */
@@ -346,6 +347,7 @@ void continue_networks(int); /* start network [ip, etc] control protos */
 void np_up(int, int);	  /* a network protocol has come up */
 void np_down(int, int);	  /* a network protocol has gone down */
 void np_finished(int, int); /* a network protocol no longer needs link */
+void session_limits_changed(void); /* re-arm the session limit timers */
 void auth_peer_fail(int, int);
 				/* peer failed to authenticate itself */
 void auth_peer_success(int, int, int, char *, int);
@@ -359,13 +361,35 @@ void auth_check_options(void);
 void auth_reset(int);	/* check what secrets we have */
 int  check_passwd(int, char *, int, char *, int, char **);
 				/* Check peer-supplied username/password */
+int  pap_hook_result(int, int, struct wordlist *, struct wordlist *);
+				/* Act on a plugin's PAP answer */
 int  get_secret(int, char *, char *, char *, int *, int);
 				/* get "secret" for chap */
+int  get_nt_hash(int, char *, char *, unsigned char *);
+				/* get precomputed hashes for MS-CHAP */
 int  get_srp_secret(int unit, char *client, char *server, char *secret,
     int am_server);
 int  auth_ip_addr(int, u_int32_t);
 				/* check if IP address is authorized */
 int  auth_number(void);	/* check if remote number is authorized */
+void check_access(FILE *, char *);
+				/* complain if a secrets file is insecure */
+
+/* Procedures exported from authfile.c */
+struct wordlist;
+int  scan_authfile(FILE *, char *, char *, char *, struct wordlist **,
+		   struct wordlist **, char *, int);
+				/* Find a secret in a secrets file */
+int  scan_authfile_eaptls(FILE *, char *, char *, char *, char *, char *,
+			  char *, struct wordlist **, struct wordlist **,
+			  char *);
+				/* Find the files for EAP-TLS */
+
+/* Bits in scan_authfile return value */
+#define NONWILD_SERVER	1
+#define NONWILD_CLIENT	2
+
+#define ISWILD(word)	(word[0] == '*' && word[1] == 0)
 
 /* Procedures exported from demand.c */
 void demand_conf(void);	/* config interface(s) for demand-dial */
@@ -396,6 +420,7 @@ void output(int, unsigned char *, int); /* Output a PPP packet */
 void wait_input(struct timeval *);
 				/* Wait for input, with timeout */
 void add_fd(int);		/* Add fd to set to wait for */
+int  try_add_fd(int);		/* Add fd if we can; -1 if not */
 void remove_fd(int);	/* Remove fd from set to wait for */
 int  read_packet(unsigned char *); /* Read PPP packet */
 int  get_loop_output(void); /* Read pkts from loopback */
@@ -470,7 +495,6 @@ int  getword(FILE *f, char *word, int *newlinep, char *filename);
 				/* Read a word from a file */
 int  options_from_user(void); /* Parse options from user's .ppprc */
 int  options_for_tty(void); /* Parse options from /etc/ppp/options.tty */
-struct wordlist;
 int  options_from_list(struct wordlist *, int privileged);
 				/* Parse options from a wordlist */
 void check_options(void);	/* check values after all options parsed */
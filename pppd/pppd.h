@@ -310,7 +310,8 @@ ppp_exit_code_t ppp_status();
 void ppp_set_status(ppp_exit_code_t code);
 
 /*
- * Configure the session's maximum number of octets
+ * Configure the session's maximum number of octets; if the link is
+ * already up, the new limit applies from now on
  */
 void ppp_set_session_limit(unsigned int octets);
 
@@ -340,6 +341,18 @@ void ppp_timeout(ppp_timer_cb func, void *arg, int s, int us);
  */
 void ppp_untimeout(void (*func)(void *), void *arg);
 
+/*
+ * Have func(fd, arg) called from the main loop when fd is readable.
+ * Returns -1 if it can't be, in which case fd will never be polled.
+ */
+typedef void (ppp_fd_handler_fn)(int fd, void *arg);
+int ppp_add_fd_handler(int fd, ppp_fd_handler_fn *func, void *arg);
+
+/*
+ * Stop watching an fd added with ppp_add_fd_handler
+ */
+void ppp_remove_fd_handler(int fd);
+
 /*
  * Clean up in a child before execing
  */
@@ -396,7 +409,8 @@ bool ppp_signaled(int sig);
 int ppp_get_max_connect_time(void);
 
 /*
- * Set the maximum connect time in seconds
+ * Set the maximum connect time in seconds, counted from when the
+ * link came up; if it is already up, the new limit applies from now on
  */
 void ppp_set_max_connect_time(unsigned int max);
 
@@ -406,7 +420,8 @@ void ppp_set_max_connect_time(unsigned int max);
 int ppp_get_max_idle_time(void);
 
 /*
- * Set the link idle time before shutting the link down
+ * Set the link idle time before shutting the link down; if the link
+ * is already up, the new limit applies from now on
  */
 void ppp_set_max_idle_time(unsigned int idle);
 
@@ -89,6 +89,9 @@
 #include <utmp.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
 #include "pppd-private.h"
 #include "session.h"
 
@@ -167,39 +170,19 @@ static struct pam_conv pam_conv_data = {
     &conversation,
     NULL
 };
-#endif /* #ifdef PPP_WITH_PAM */
 
-int
-session_start(const int flags, const char *user, const char *passwd, const char *ttyName, char **msg)
+/*
+ * session_pam - do the PAM checks asked for by flags, leaving pamh for
+ * session_end.  Returns non-zero if they passed.
+ */
+static int
+session_pam(const int flags, const char *user, const char *passwd, const char *ttyName, char **msg)
 {
-#ifdef PPP_WITH_PAM
     bool ok = 1;
     const char *usr;
     int pam_error;
     bool try_session = 0;
-#else /* #ifdef PPP_WITH_PAM */
-    struct passwd *pw;
-    char *cbuf;
-#ifdef HAVE_SHADOW_H
-    struct spwd *spwd;
-    struct spwd *getspnam();
-    long now = 0;
-#endif /* #ifdef HAVE_SHADOW_H */
-#endif /* #ifdef PPP_WITH_PAM */
-
-    SET_MSG(msg, SUCCESS_MSG);
-
-    /* If no verification is requested, then simply return an OK */
-    if (!(SESS_ALL & flags)) {
-        return SESSION_OK;
-    }
-
-    if (user == NULL) {
-       SET_MSG(msg, ABORT_MSG);
-       return SESSION_FAILED;
-    }
 
-#ifdef PPP_WITH_PAM
     /* Find the '\\' in the username */
     /* This needs to be fixed to support different username schemes */
     if ((usr = strchr(user, '\\')) == NULL)
@@ -292,8 +275,81 @@ session_start(const int flags, const char *user, const char *passwd, const char
     /* This is needed because apparently the PAM stuff closes the log */
     reopen_log();
 
+    return ok;
+}
+#endif /* #ifdef PPP_WITH_PAM */
+
+/*
+ * session_login - write the login records for a user whose session has
+ * started.  'pw' is NULL unless the user was authenticated using local
+ * UNIX system services.
+ */
+static void
+session_login(const int flags, const char *user, const char *ttyName, struct passwd *pw)
+{
+    if (SESS_ACCT & flags) {
+	if (strncmp(ttyName, "/dev/", 5) == 0)
+	    ttyName += 5;
+	logwtmp(ttyName, user, ifname); /* Add wtmp login entry */
+	logged_in = 1;
+
+#if defined(_PATH_LASTLOG) && !defined(PPP_WITH_PAM)
+	/*
+	 * Enter the user in lastlog only if he has been authenticated using
+	 * local system services.  If he has not, then we don't know what his
+	 * UID might be, and lastlog is indexed by UID.
+	 */
+	if (pw != NULL) {
+            struct lastlog ll;
+            int fd;
+	    time_t tnow;
+
+            if ((fd = open(_PATH_LASTLOG, O_RDWR, 0)) >= 0) {
+                (void)lseek(fd, (off_t)(pw->pw_uid * sizeof(ll)), SEEK_SET);
+                memset((void *)&ll, 0, sizeof(ll));
+		(void)time(&tnow);
+                ll.ll_time = tnow;
+                strlcpy(ll.ll_line, ttyName, sizeof(ll.ll_line));
+                strlcpy(ll.ll_host, ifname, sizeof(ll.ll_host));
+                (void)write(fd, (char *)&ll, sizeof(ll));
+                (void)close(fd);
+            }
+	}
+#endif /* _PATH_LASTLOG and not PPP_WITH_PAM */
+	info("user %s logged in on tty %s intf %s", user, ttyName, ifname);
+    }
+}
+
+int
+session_start(const int flags, const char *user, const char *passwd, const char *ttyName, char **msg)
+{
+#ifndef PPP_WITH_PAM
+    struct passwd *pw;
+    char *cbuf;
+#ifdef HAVE_SHADOW_H
+    struct spwd *spwd;
+    struct spwd *getspnam();
+    long now = 0;
+#endif /* #ifdef HAVE_SHADOW_H */
+#endif /* #ifndef PPP_WITH_PAM */
+
+    SET_MSG(msg, SUCCESS_MSG);
+
+    /* If no verification is requested, then simply return an OK */
+    if (!(SESS_ALL & flags)) {
+        return SESSION_OK;
+    }
+
+    if (user == NULL) {
+       SET_MSG(msg, ABORT_MSG);
+       return SESSION_FAILED;
+    }
+
+#ifdef PPP_WITH_PAM
     /* If our PAM checks have already failed, then we must return a failure */
-    if (!ok) return SESSION_FAILED;
+    if (!session_pam(flags, user, passwd, ttyName, msg))
+	return SESSION_FAILED;
+    session_login(flags, user, ttyName, NULL);
 
 #else /* #ifdef PPP_WITH_PAM */
 
@@ -359,47 +415,189 @@ session_start(const int flags, const char *user, const char *passwd, const char
             return SESSION_FAILED;
     }
 
+    session_login(flags, user, ttyName, pw);
+
 #endif /* #ifdef PPP_WITH_PAM */
 
-    /*
-     * Write a wtmp entry for this user.
-     */
+    return SESSION_OK;
+}
 
-    if (SESS_ACCT & flags) {
-	if (strncmp(ttyName, "/dev/", 5) == 0)
-	    ttyName += 5;
-	logwtmp(ttyName, user, ifname); /* Add wtmp login entry */
-	logged_in = 1;
+#ifdef PPP_WITH_PAM
+/*
+ * A PAM module such as pam_ldap or pam_sss can take seconds to answer,
+ * so session_start_async does the PAM work in a child process and lets
+ * the main loop carry on servicing the link.  The child keeps the PAM
+ * handle, and with it any session it opened, until it sees pppd close
+ * its end of the socket, in session_end or by exiting.
+ */
+struct session_reply {
+    int ok;
+    char msg[256];
+};
 
-#if defined(_PATH_LASTLOG) && !defined(PPP_WITH_PAM)
-	/*
-	 * Enter the user in lastlog only if he has been authenticated using
-	 * local system services.  If he has not, then we don't know what his
-	 * UID might be, and lastlog is indexed by UID.
-	 */
-	if (pw != NULL) {
-            struct lastlog ll;
-            int fd;
-	    time_t tnow;
+static struct session_worker {
+    int fd;			/* socket to the worker, or -1 */
+    session_done_fn *done;	/* to call with its answer */
+    void *arg;
+    int flags;
+    char user[256];
+    char tty[MAXPATHLEN];
+    int got;			/* bytes of reply so far */
+    struct session_reply reply;
+} worker = { -1 };
 
-            if ((fd = open(_PATH_LASTLOG, O_RDWR, 0)) >= 0) {
-                (void)lseek(fd, (off_t)(pw->pw_uid * sizeof(ll)), SEEK_SET);
-                memset((void *)&ll, 0, sizeof(ll));
-		(void)time(&tnow);
-                ll.ll_time = tnow;
-                strlcpy(ll.ll_line, ttyName, sizeof(ll.ll_line));
-                strlcpy(ll.ll_host, ifname, sizeof(ll.ll_host));
-                (void)write(fd, (char *)&ll, sizeof(ll));
-                (void)close(fd);
-            }
-	}
-#endif /* _PATH_LASTLOG and not PPP_WITH_PAM */
-	info("user %s logged in on tty %s intf %s", user, ttyName, ifname);
+/*
+ * session_worker_stop - let go of the worker, which then ends the PAM
+ * session and exits.  Any answer still to come is forgotten.
+ */
+static void
+session_worker_stop(void)
+{
+    if (worker.fd >= 0) {
+	ppp_remove_fd_handler(worker.fd);
+	close(worker.fd);
+	worker.fd = -1;
     }
+    worker.done = NULL;
+}
 
-    return SESSION_OK;
+/*
+ * session_worker_input - the worker has answered, or died.
+ */
+static void
+session_worker_input(int fd, void *arg)
+{
+    session_done_fn *done = worker.done;
+    char *msg;
+    int n, ok;
+
+    n = read(fd, (char *) &worker.reply + worker.got,
+	     sizeof(worker.reply) - worker.got);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN))
+	return;
+    if (n > 0) {
+	worker.got += n;
+	if (worker.got < sizeof(worker.reply))
+	    return;
+    }
+    ppp_remove_fd_handler(fd);
+
+    if (n > 0) {
+	ok = worker.reply.ok;
+	worker.reply.msg[sizeof(worker.reply.msg) - 1] = 0;
+	msg = worker.reply.msg;
+    } else {
+	error("PAM worker for %s exited without answering", worker.user);
+	ok = 0;
+	msg = "PAM worker failed";
+    }
+    if (ok)
+	session_login(worker.flags, worker.user, worker.tty, NULL);
+    else
+	session_worker_stop();
+    worker.done = NULL;
+    if (done != NULL)
+	(*done)(worker.arg, ok, msg);
 }
 
+/*
+ * session_worker - the child: do the PAM work, answer, then hold on to
+ * the PAM handle until pppd is finished with the session.
+ */
+static void
+session_worker(const int flags, const char *user, const char *passwd, const char *ttyName)
+{
+    struct session_reply reply;
+    char *msg = SUCCESS_MSG;
+    char c;
+    int n;
+
+    signal(SIGHUP, SIG_IGN);		/* pppd's to deal with */
+    signal(SIGINT, SIG_IGN);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGCHLD, SIG_DFL);
+    signal(SIGUSR1, SIG_DFL);
+    signal(SIGUSR2, SIG_DFL);
+    signal(SIGALRM, SIG_DFL);
+    signal(SIGPIPE, SIG_IGN);
+
+    /* whatever pppd had open is not ours to close */
+    pamh = NULL;
+    logged_in = 0;
+
+    memset(&reply, 0, sizeof(reply));
+    reply.ok = session_pam(flags, user, passwd, ttyName, &msg);
+    if (msg != NULL)
+	strlcpy(reply.msg, msg, sizeof(reply.msg));
+    if (write(1, &reply, sizeof(reply)) == sizeof(reply)) {
+	while ((n = read(0, &c, 1)) != 0)
+	    if (n < 0 && errno != EINTR)
+		break;
+    }
+    session_end(NULL);
+    exit(0);
+}
+#endif /* #ifdef PPP_WITH_PAM */
+
+int
+session_start_async(const int flags, const char *user, const char *passwd,
+		    const char *ttyName, char **msg, session_done_fn *done,
+		    void *arg)
+{
+#ifdef PPP_WITH_PAM
+    int fds[2], pid;
+
+    if (!(SESS_ALL & flags) || user == NULL)
+	return session_start(flags, user, passwd, ttyName, msg);
+
+    /* One session at a time */
+    session_worker_stop();
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+	error("Can't create socket for PAM worker: %m");
+	return session_start(flags, user, passwd, ttyName, msg);
+    }
+    pid = ppp_safe_fork(fds[1], fds[1], (log_to_fd >= 0? log_to_fd: 2));
+    if (pid == -1) {
+	error("Can't fork PAM worker: %m");
+	close(fds[0]);
+	close(fds[1]);
+	return session_start(flags, user, passwd, ttyName, msg);
+    }
+    if (pid == 0) {
+	/* child */
+	close(fds[0]);
+	reopen_log();
+	if (!nodetach)
+	    log_to_fd = -1;
+	else if (log_to_fd >= 0)
+	    log_to_fd = 2;
+	session_worker(flags, user, passwd, ttyName);
+    }
+    close(fds[1]);
+    record_child(pid, "pppd (PAM)", NULL, NULL, 0);
+
+    worker.fd = fds[0];
+    worker.done = done;
+    worker.arg = arg;
+    worker.flags = flags;
+    strlcpy(worker.user, user, sizeof(worker.user));
+    strlcpy(worker.tty, (ttyName? ttyName: ""), sizeof(worker.tty));
+    worker.got = 0;
+    if (ppp_add_fd_handler(worker.fd, session_worker_input, NULL) < 0) {
+	/* we would never hear its answer */
+	session_worker_stop();
+	if (msg != NULL)
+	    *msg = "Can't wait for PAM worker";
+	return 0;
+    }
+    return SESSION_PENDING;
+#else
+    return session_start(flags, user, passwd, ttyName, msg);
+#endif /* #ifdef PPP_WITH_PAM */
+}
+
+
 /*
  * session_end - Logout the user.
  */
@@ -409,6 +607,7 @@ session_end(const char* ttyName)
 #ifdef PPP_WITH_PAM
     int pam_error = PAM_SUCCESS;
 
+    session_worker_stop();
     if (pamh != NULL) {
         if (PAM_session) pam_error = pam_close_session (pamh, PAM_SILENT);
         PAM_session = 0;
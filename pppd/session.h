@@ -81,6 +81,33 @@ session_start(const int flags, const char* user, const char* passwd, const char*
 #define session_full(user, pass, tty, msg) \
 	session_start(SESS_ALL, user, pass, tty, msg)
 
+/* Returned by session_start_async when the answer will come later */
+#define SESSION_PENDING 2
+
+/* Called with the result of session_start_async */
+typedef void (session_done_fn)(void *arg, int ok, char *msg);
+
+/*
+ * int session_start_async(...)
+ *
+ * Like session_start, but the checks may be done by another process
+ * while pppd carries on: PAM modules can take seconds to answer.
+ *
+ * Parameters, as for session_start and:
+ *	session_done_fn *done :
+ *		Called with the result and message once the checks are done,
+ *		unless session_end is called first.
+ *
+ *	void *arg :
+ *		Passed to done.
+ *
+ * Return Value:
+ * 	SESSION_PENDING if done will be called, otherwise as for session_start.
+ */
+int
+session_start_async(const int flags, const char* user, const char* passwd,
+		    const char* tty, char** msg, session_done_fn *done, void *arg);
+
 /*
  * void session_end(...)
  *
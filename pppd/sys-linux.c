@@ -1448,11 +1448,22 @@ void wait_input(struct timeval *timo)
  */
 void add_fd(int fd)
 {
-    if (fd >= FD_SETSIZE)
+    if (try_add_fd(fd) < 0)
 	fatal("internal error: file descriptor too large (%d)", fd);
+}
+
+/*
+ * try_add_fd - add an fd to the set that wait_input waits for,
+ * returning -1 if we can't.
+ */
+int try_add_fd(int fd)
+{
+    if (fd < 0 || fd >= FD_SETSIZE)
+	return -1;
     FD_SET(fd, &in_fds);
     if (fd > max_in_fd)
 	max_in_fd = fd;
+    return 0;
 }
 
 /*
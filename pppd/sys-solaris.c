@@ -1089,18 +1089,28 @@ wait_input(struct timeval *timo)
  * add_fd - add an fd to the set that wait_input waits for.
  */
 void add_fd(int fd)
+{
+    if (try_add_fd(fd) < 0)
+	error("Too many inputs!");
+}
+
+/*
+ * try_add_fd - add an fd to the set that wait_input waits for,
+ * returning -1 if we can't.
+ */
+int try_add_fd(int fd)
 {
     int n;
 
     for (n = 0; n < n_pollfds; ++n)
 	if (pollfds[n].fd == fd)
-	    return;
-    if (n_pollfds < MAX_POLLFDS) {
-	pollfds[n_pollfds].fd = fd;
-	pollfds[n_pollfds].events = POLLIN | POLLPRI | POLLHUP;
-	++n_pollfds;
-    } else
-	error("Too many inputs!");
+	    return 0;
+    if (n_pollfds >= MAX_POLLFDS)
+	return -1;
+    pollfds[n_pollfds].fd = fd;
+    pollfds[n_pollfds].events = POLLIN | POLLPRI | POLLHUP;
+    ++n_pollfds;
+    return 0;
 }
 
 /*
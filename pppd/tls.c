@@ -30,7 +30,9 @@
 #include "config.h"
 #endif
 
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include <openssl/x509v3.h>
@@ -85,6 +87,17 @@ static inline int SSL_CTX_set_max_proto_version(SSL_CTX *ctx, long tls_ver_max)
 }
 #endif /* SSL_CTX_set_max_proto_version */
 
+/** Mimic the reference counting the store and context cache uses */
+static inline int X509_STORE_up_ref(X509_STORE *store)
+{
+    return CRYPTO_add(&store->references, 1, CRYPTO_LOCK_X509_STORE) > 1;
+}
+
+static inline int SSL_CTX_up_ref(SSL_CTX *ctx)
+{
+    return CRYPTO_add(&ctx->references, 1, CRYPTO_LOCK_SSL_CTX) > 1;
+}
+
 #endif /* OPENSSL_VERSION_NUMBER < 0x10100000L */
 
 
@@ -350,19 +363,20 @@ int tls_set_opts(SSL_CTX *ctx) {
     return 0;
 }
 
-int tls_set_crl(SSL_CTX *ctx, const char *crl_dir, const char *crl_file) 
+static int tls_store_add_crl(X509_STORE *certstore, const char *crl_dir,
+        const char *crl_file)
 {
-    X509_STORE  *certstore = NULL;
     X509_LOOKUP *lookup = NULL;
+    X509_CRL *crl = NULL;
     FILE *fp = NULL;
     int status = -1;
 
-    if (crl_dir) {
-        if (!(certstore = SSL_CTX_get_cert_store(ctx))) {
-            error("Failed to get certificate store");
-            goto done;
-        }
+    if (!certstore) {
+        error("Failed to get certificate store");
+        goto done;
+    }
 
+    if (crl_dir) {
         if (!(lookup =
              X509_STORE_add_lookup(certstore, X509_LOOKUP_hash_dir()))) {
             error("Store lookup for CRL failed");
@@ -374,8 +388,6 @@ int tls_set_crl(SSL_CTX *ctx, const char *crl_dir, const char *crl_file)
     }
 
     if (crl_file) {
-        X509_CRL *crl = NULL;
-
         fp = fopen(crl_file, "r");
         if (!fp) {
             error("Cannot open CRL file '%s'", crl_file);
@@ -388,10 +400,6 @@ int tls_set_crl(SSL_CTX *ctx, const char *crl_dir, const char *crl_file)
             goto done;
         }
 
-        if (!(certstore = SSL_CTX_get_cert_store(ctx))) {
-            error("Failed to get certificate store");
-            goto done;
-        }
         if (!X509_STORE_add_crl(certstore, crl)) {
             error("Cannot add CRL to certificate store");
             goto done;
@@ -403,6 +411,10 @@ int tls_set_crl(SSL_CTX *ctx, const char *crl_dir, const char *crl_file)
 
 done: 
 
+    if (crl != NULL) {
+        X509_CRL_free(crl);
+    }
+
     if (fp != NULL) {
         fclose(fp);
     }
@@ -410,6 +422,14 @@ done:
     return status;
 }
 
+int tls_set_crl(SSL_CTX *ctx, const char *crl_dir, const char *crl_file) 
+{
+    if (!crl_dir && !crl_file)
+        return 0;
+
+    return tls_store_add_crl(SSL_CTX_get_cert_store(ctx), crl_dir, crl_file);
+}
+
 int tls_set_ca(SSL_CTX *ctx, const char *ca_dir, const char *ca_file) 
 {
     if (ca_file && strlen(ca_file) == 0) {
@@ -437,6 +457,291 @@ int tls_set_ca(SSL_CTX *ctx, const char *ca_dir, const char *ca_file)
     return 0;
 }
 
+/*
+ * Parsing a large CA bundle or CRL, or our certificate and private key,
+ * is slow, so we keep the certificate stores and SSL contexts we build
+ * for the life of the process and hand out references to them.  A store
+ * is shared by every context that trusts the same CAs and CRLs, and a
+ * context by every session with the same configuration.  Either is
+ * rebuilt when one of the files it came from changes.  This is plain
+ * process memory, so a pppd that forks after building them passes them
+ * on to its children ready to use.
+ */
+#define TLS_CACHE_FILES 7       /* CA file and path, cert, key, PKCS12, CRLs */
+#define TLS_CACHE_MAX   8       /* most stores, and contexts, we keep */
+
+struct tls_cache
+{
+    struct tls_cache *next;
+    char        *name;
+    int         server;
+    char        *files[TLS_CACHE_FILES];
+    struct timespec mtime[TLS_CACHE_FILES];
+    char        *max_version;
+    char        passwd[MAXSECRETLEN];
+    void        *obj;
+    void        (*release)(void *);
+};
+
+static struct tls_cache *tls_stores = NULL;
+static struct tls_cache *tls_ctxs = NULL;
+
+static void tls_conf_files(const struct tls_ctx_conf *conf, const char **files)
+{
+    files[0] = conf->ca_file;
+    files[1] = conf->ca_dir;
+    files[2] = conf->cert_file;
+    files[3] = conf->pkey_file;
+    files[4] = conf->pkcs12_file;
+    files[5] = conf->crl_dir;
+    files[6] = conf->crl_file;
+}
+
+static void tls_conf_mtime(const struct tls_ctx_conf *conf,
+        struct timespec *mtime)
+{
+    const char *files[TLS_CACHE_FILES];
+    struct stat sbuf;
+    int i;
+
+    tls_conf_files(conf, files);
+    for (i = 0; i < TLS_CACHE_FILES; i++)
+    {
+        /* engine URIs and missing files compare equal to themselves */
+        if (files[i] == NULL || files[i][0] == 0 || stat(files[i], &sbuf) < 0)
+        {
+            mtime[i].tv_sec = -1;
+            mtime[i].tv_nsec = 0;
+        }
+        else
+            mtime[i] = sbuf.st_mtim;
+    }
+}
+
+static int same_string(const char *a, const char *b)
+{
+    return strcmp(a? a: "", b? b: "") == 0;
+}
+
+static char *dup_string(const char *s)
+{
+    return strdup(s? s: "");
+}
+
+static void tls_cache_free(struct tls_cache *tc)
+{
+    int i;
+
+    for (i = 0; i < TLS_CACHE_FILES; i++)
+        free(tc->files[i]);
+    free(tc->name);
+    free(tc->max_version);
+    memset(tc->passwd, 0, sizeof(tc->passwd));
+    if (tc->obj)
+        tc->release(tc->obj);
+    free(tc);
+}
+
+/*
+ * Find the entry in the list for this configuration and move it to the
+ * front, or drop it if one of its files has changed since we read it.
+ */
+static void *tls_cache_get(struct tls_cache **list,
+        const struct tls_ctx_conf *conf, const struct timespec *mtime)
+{
+    const char *files[TLS_CACHE_FILES];
+    struct tls_cache *tc, **tcp;
+    int i;
+
+    tls_conf_files(conf, files);
+    for (tcp = list; (tc = *tcp) != NULL; tcp = &tc->next)
+    {
+        if (tc->server != conf->server
+            || !same_string(tc->name, conf->name)
+            || !same_string(tc->max_version, conf->max_version)
+            || !same_string(tc->passwd, conf->passwd))
+            continue;
+        for (i = 0; i < TLS_CACHE_FILES; i++)
+            if (!same_string(tc->files[i], files[i]))
+                break;
+        if (i < TLS_CACHE_FILES)
+            continue;
+
+        *tcp = tc->next;
+        for (i = 0; i < TLS_CACHE_FILES; i++)
+            if (tc->mtime[i].tv_sec != mtime[i].tv_sec
+                || tc->mtime[i].tv_nsec != mtime[i].tv_nsec)
+                break;
+        if (i < TLS_CACHE_FILES)
+        {
+            dbglog("%s: %s has changed, reloading", conf->name, files[i]);
+            tls_cache_free(tc);
+            return NULL;
+        }
+
+        tc->next = *list;
+        *list = tc;
+        return tc->obj;
+    }
+    return NULL;
+}
+
+/*
+ * Add obj, which the cache now holds a reference to, to the front of the
+ * list, and forget the least recently used entries.
+ */
+static void tls_cache_add(struct tls_cache **list,
+        const struct tls_ctx_conf *conf, const struct timespec *mtime,
+        void *obj, void (*release)(void *))
+{
+    const char *files[TLS_CACHE_FILES];
+    struct tls_cache *tc, **tcp;
+    int i, n;
+
+    tc = calloc(1, sizeof(*tc));
+    if (!tc)
+    {
+        release(obj);
+        return;
+    }
+    tc->obj = obj;
+    tc->release = release;
+
+    tls_conf_files(conf, files);
+    for (i = 0; i < TLS_CACHE_FILES; i++)
+    {
+        tc->files[i] = dup_string(files[i]);
+        tc->mtime[i] = mtime[i];
+        if (!tc->files[i])
+            break;
+    }
+    tc->name = dup_string(conf->name);
+    tc->max_version = dup_string(conf->max_version);
+    if (i < TLS_CACHE_FILES || !tc->name || !tc->max_version)
+    {
+        tls_cache_free(tc);
+        return;
+    }
+    strlcpy(tc->passwd, conf->passwd? conf->passwd: "", sizeof(tc->passwd));
+    tc->server = conf->server;
+
+    tc->next = *list;
+    *list = tc;
+
+    for (n = 0, tcp = list; (tc = *tcp) != NULL; n++)
+    {
+        if (n < TLS_CACHE_MAX)
+        {
+            tcp = &tc->next;
+            continue;
+        }
+        *tcp = tc->next;
+        tls_cache_free(tc);
+    }
+}
+
+static void tls_release_store(void *obj)
+{
+    X509_STORE_free(obj);
+}
+
+static void tls_release_ctx(void *obj)
+{
+    SSL_CTX_free(obj);
+}
+
+X509_STORE *tls_get_store(const char *ca_dir, const char *ca_file,
+        const char *crl_dir, const char *crl_file)
+{
+    struct tls_ctx_conf conf;
+    struct timespec mtime[TLS_CACHE_FILES];
+    X509_STORE *store;
+
+    if (ca_file && strlen(ca_file) == 0)
+        ca_file = NULL;
+    if (ca_dir && strlen(ca_dir) == 0)
+        ca_dir = NULL;
+
+    memset(&conf, 0, sizeof(conf));
+    conf.name = "TLS";
+    conf.ca_file = ca_file;
+    conf.ca_dir = ca_dir;
+    conf.crl_dir = crl_dir;
+    conf.crl_file = crl_file;
+    tls_conf_mtime(&conf, mtime);
+
+    store = tls_cache_get(&tls_stores, &conf, mtime);
+    if (store)
+    {
+        X509_STORE_up_ref(store);
+        return store;
+    }
+
+    store = X509_STORE_new();
+    if (!store)
+    {
+        error("Cannot create certificate store");
+        return NULL;
+    }
+
+    if (!X509_STORE_load_locations(store, ca_file, ca_dir))
+    {
+        error("Cannot load verify locations");
+        if (ca_file)
+            dbglog("CA certificate file = [%s]", ca_file);
+        if (ca_dir)
+            dbglog("CA certificate path = [%s]", ca_dir);
+        X509_STORE_free(store);
+        return NULL;
+    }
+
+    if ((crl_dir || crl_file)
+        && tls_store_add_crl(store, crl_dir, crl_file) != 0)
+    {
+        X509_STORE_free(store);
+        return NULL;
+    }
+
+    if (X509_STORE_up_ref(store))
+        tls_cache_add(&tls_stores, &conf, mtime, store, tls_release_store);
+    return store;
+}
+
+int tls_set_store(SSL_CTX *ctx, const char *ca_dir, const char *ca_file,
+        const char *crl_dir, const char *crl_file)
+{
+    X509_STORE *store;
+
+    store = tls_get_store(ca_dir, ca_file, crl_dir, crl_file);
+    if (!store)
+        return -1;
+
+    /* the context takes over our reference */
+    SSL_CTX_set_cert_store(ctx, store);
+    return 0;
+}
+
+SSL_CTX *tls_get_ctx(const struct tls_ctx_conf *conf,
+        SSL_CTX *(*build)(const struct tls_ctx_conf *conf))
+{
+    struct timespec mtime[TLS_CACHE_FILES];
+    SSL_CTX *ctx;
+
+    tls_conf_mtime(conf, mtime);
+    ctx = tls_cache_get(&tls_ctxs, conf, mtime);
+    if (ctx)
+    {
+        SSL_CTX_up_ref(ctx);
+        dbglog("%s: using cached SSL context", conf->name);
+        return ctx;
+    }
+
+    ctx = build(conf);
+    if (ctx && SSL_CTX_up_ref(ctx))
+        tls_cache_add(&tls_ctxs, conf, mtime, ctx, tls_release_ctx);
+    return ctx;
+}
+
 void tls_log_sslerr( void )
 {
     unsigned long ssl_err = ERR_get_error();
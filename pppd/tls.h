@@ -82,6 +82,45 @@ int tls_set_crl(SSL_CTX *ctx, const char *crl_dir, const char *crl_file);
  */
 int tls_set_ca(SSL_CTX *ctx, const char *ca_dir, const char *ca_file);
 
+/**
+ * What an SSL context is built from, which tls_get_ctx uses as the key
+ * to its cache; unused members are NULL
+ */
+struct tls_ctx_conf
+{
+    const char *name;           /* "EAP-TLS", "PEAP", used in messages */
+    int server;
+    const char *ca_file;
+    const char *ca_dir;
+    const char *cert_file;
+    const char *pkey_file;
+    const char *pkcs12_file;
+    const char *crl_dir;
+    const char *crl_file;
+    const char *max_version;
+    const char *passwd;         /* for the private key or PKCS12 file */
+};
+
+/**
+ * Get a reference to a certificate store with these CA certificates and
+ * CRLs, shared with every other user of the same files until one changes
+ */
+X509_STORE *tls_get_store(const char *ca_dir, const char *ca_file,
+        const char *crl_dir, const char *crl_file);
+
+/**
+ * Configure the SSL context's CA and CRL details with a shared store
+ */
+int tls_set_store(SSL_CTX *ctx, const char *ca_dir, const char *ca_file,
+        const char *crl_dir, const char *crl_file);
+
+/**
+ * Get a reference to an SSL context for this configuration, from the
+ * cache if its files haven't changed since it was built, else from build
+ */
+SSL_CTX *tls_get_ctx(const struct tls_ctx_conf *conf,
+        SSL_CTX *(*build)(const struct tls_ctx_conf *conf));
+
 /**
  * Log all errors from ssl library
  */
@@ -117,6 +117,17 @@ static void upap_rauthack(upap_state *, u_char *, int, int);
 static void upap_rauthnak(upap_state *, u_char *, int, int);
 static void upap_sauthreq(upap_state *);
 static void upap_sresp(upap_state *, int, int, char *, int);
+static void upap_finish_auth(upap_state *, int, int, char *, char *, int);
+
+/*
+ * The Authenticate-Request a plugin is checking for us; one for each unit.
+ * Kept here rather than in upap_state so the public struct doesn't change.
+ */
+static struct upap_check {
+    int id;			/* id of the latest request */
+    int userlen;
+    char user[256];
+} checking[NUM_PPP];
 
 
 /*
@@ -291,7 +302,8 @@ upap_protrej(int unit)
 	error("PAP authentication failed due to protocol-reject");
 	auth_withpeer_fail(unit, PPP_PAP);
     }
-    if (u->us_serverstate == UPAPSS_LISTEN) {
+    if (u->us_serverstate == UPAPSS_LISTEN
+	|| u->us_serverstate == UPAPSS_CHECKING) {
 	error("PAP authentication of peer failed (protocol-reject)");
 	auth_peer_fail(unit, PPP_PAP);
     }
@@ -362,14 +374,20 @@ upap_rauthreq(upap_state *u, u_char *inp, int id, int len)
 {
     u_char ruserlen, rpasswdlen;
     char *ruser, *rpasswd;
-    char rhostname[256];
     int retcode;
     char *msg;
-    int msglen;
 
     if (u->us_serverstate < UPAPSS_LISTEN)
 	return;
 
+    /*
+     * We'll answer the latest request once the plugin has finished.
+     */
+    if (u->us_serverstate == UPAPSS_CHECKING) {
+	checking[u->us_unit].id = id;
+	return;
+    }
+
     /*
      * If we receive a duplicate authenticate-request, we are
      * supposed to return the same status as for the first request.
@@ -412,6 +430,53 @@ upap_rauthreq(upap_state *u, u_char *inp, int id, int len)
 			   rpasswdlen, &msg);
     BZERO(rpasswd, rpasswdlen);
 
+    if (retcode == UPAP_AUTHPENDING) {
+	struct upap_check *c = &checking[u->us_unit];
+
+	c->id = id;
+	c->userlen = ruserlen;
+	memcpy(c->user, ruser, ruserlen);
+	u->us_serverstate = UPAPSS_CHECKING;
+	return;
+    }
+
+    upap_finish_auth(u, retcode, id, msg, ruser, ruserlen);
+}
+
+
+/*
+ * upap_auth_done - a plugin has finished checking an Authenticate.
+ */
+void
+upap_auth_done(void *arg, int ok, char *msg, struct wordlist *addrs,
+	       struct wordlist *opts)
+{
+    upap_state *u = arg;
+    struct upap_check *c;
+    int retcode;
+
+    if (u->us_serverstate != UPAPSS_CHECKING) {
+	/* the link went down while we were waiting */
+	pap_hook_result(u->us_unit, 0, addrs, opts);
+	return;
+    }
+    retcode = pap_hook_result(u->us_unit, ok, addrs, opts);
+    c = &checking[u->us_unit];
+    upap_finish_auth(u, retcode, c->id, msg? msg: "", c->user, c->userlen);
+}
+
+
+/*
+ * upap_finish_auth - send the response to an Authenticate and
+ * tell the rest of pppd how it went.
+ */
+static void
+upap_finish_auth(upap_state *u, int retcode, int id, char *msg,
+		 char *ruser, int ruserlen)
+{
+    char rhostname[256];
+    int msglen;
+
     /*
      * Check remote number authorization.  A plugin may have filled in
      * the remote number or added an allowed number, and rather than
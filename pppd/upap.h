@@ -62,6 +62,8 @@ extern "C" {
 #define UPAP_AUTHACK	2	/* Authenticate-Ack */
 #define UPAP_AUTHNAK	3	/* Authenticate-Nak */
 
+#define UPAP_AUTHPENDING 0	/* check_passwd: the answer will come later */
+
 
 /*
  * Each interface is described by upap structure.
@@ -101,6 +103,7 @@ typedef struct upap_state {
 #define UPAPSS_LISTEN	3	/* Listening for an Authenticate */
 #define UPAPSS_OPEN	4	/* We've sent an Ack */
 #define UPAPSS_BADAUTH	5	/* We've sent a Nak */
+#define UPAPSS_CHECKING	6	/* A plugin is checking an Authenticate */
 
 
 /*
@@ -120,6 +123,13 @@ typedef int  (pap_check_hook_fn)(void);
 typedef int  (pap_auth_hook_fn)(char *user, char *passwd, char **msgp,
                 struct wordlist **paddrs,
                 struct wordlist **popts);
+typedef void (pap_auth_done_fn)(void *arg, int ok, char *msg,
+                struct wordlist *addrs,
+                struct wordlist *opts);
+typedef int  (pap_auth_async_hook_fn)(char *user, char *passwd, char **msgp,
+                struct wordlist **paddrs,
+                struct wordlist **popts,
+                pap_auth_done_fn *done, void *arg);
 typedef void (pap_logout_hook_fn)(void);
 typedef int  (pap_passwd_hook_fn)(char *user, char *passwd);
 
@@ -137,6 +147,17 @@ extern pap_check_hook_fn  *pap_check_hook;
  */
 extern pap_auth_hook_fn   *pap_auth_hook;
 
+/*
+ * Like pap_auth_hook, but the plugin may instead return PAP_AUTH_PENDING
+ *   and later call done(arg, ok, msg, addrs, opts) with the answer, so that
+ *   pppd keeps running while the check is done.  This hook is tried first.
+ */
+#define PAP_AUTH_PENDING	2
+extern pap_auth_async_hook_fn *pap_auth_async_hook;
+
+/* The done function passed to pap_auth_async_hook */
+extern pap_auth_done_fn upap_auth_done;
+
 /*
  * Hook for plugin to know about PAP user logout.
  */